@@ -3,13 +3,20 @@
 #include "coreruncommon.h"
 #include <string>
 #include <set>
+#include <vector>
 #include <limits.h>
+#include <cerrno>
 #include <cstring>
 #include <dirent.h>
 #include <dlfcn.h>
+#include <fstream>
+#include <iterator>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "coreclrhost.h"
+#include "hostfxr.h"
+#include "runtimelocator.h"
 
 // Name of the environment variable controlling server GC.
 // If set to 1, server GC is enabled on startup. If 0, server GC is
@@ -20,6 +27,13 @@ static const char* serverGcVar = "COMPlus_gcServer";
 // Set to 1 for Globalization Invariant mode to be true. Default is false.
 static const char* globalizationInvariantVar = "CORECLR_GLOBAL_INVARIANT";
 
+// Name of the environment variable selecting the hosting API. Set to "coreclr" to
+// skip hostfxr and start the runtime with coreclr_initialize.
+static const char* hostVar = "LOADMANAGED_HOST";
+
+// Declares a delegate type for each entry point, named after the method, as hostfxr can't infer it
+static const char* entryPointsTypeName = "PluginInterop.EntryPoints";
+
 #ifndef SUCCEEDED
 #define SUCCEEDED(Status) ((Status) >= 0)
 #endif // !SUCCEEDED
@@ -33,6 +47,10 @@ class ClrInterop
     void* hostHandle;
     unsigned int domainId;
 
+    // Set when the runtime was started through hostfxr
+    load_assembly_and_get_function_pointer_fn loadAssemblyAndGetFunctionPointer;
+    std::string managedAssemblyPath;
+
     bool GetDirectory(const char* absolutePath, std::string& directory)
     {
         directory.assign(absolutePath);
@@ -185,6 +203,50 @@ class ClrInterop
             return false;
         }
 
+        LoadPlugins = (LoadPluginsFunc*)CreateDelegate(
+                "PluginInterop",
+                "PluginInterop.PluginLoader",
+                "LoadPlugins");
+
+        if (LoadPlugins == nullptr)
+        {
+            std::cout << "Could not find function LoadPlugins in PluginInterop.dll" << std::endl;
+            return false;
+        }
+
+        UnloadPlugin = (UnloadPluginFunc*)CreateDelegate(
+                "PluginInterop",
+                "PluginInterop.PluginLoader",
+                "UnloadPlugin");
+
+        if (UnloadPlugin == nullptr)
+        {
+            std::cout << "Could not find function UnloadPlugin in PluginInterop.dll" << std::endl;
+            return false;
+        }
+
+        ReloadPlugin = (ReloadPluginFunc*)CreateDelegate(
+                "PluginInterop",
+                "PluginInterop.PluginLoader",
+                "ReloadPlugin");
+
+        if (ReloadPlugin == nullptr)
+        {
+            std::cout << "Could not find function ReloadPlugin in PluginInterop.dll" << std::endl;
+            return false;
+        }
+
+        IsPluginModified = (IsPluginModifiedFunc*)CreateDelegate(
+                "PluginInterop",
+                "PluginInterop.PluginLoader",
+                "IsPluginModified");
+
+        if (IsPluginModified == nullptr)
+        {
+            std::cout << "Could not find function IsPluginModified in PluginInterop.dll" << std::endl;
+            return false;
+        }
+
         Invoke = (InvokeFunc*)CreateDelegate(
                 "PluginInterop",
                 "PluginInterop.PluginLoader",
@@ -199,15 +261,7 @@ class ClrInterop
         return true;
     }
 
-public:
-    bool Initialized;
-
-    GetExportCountFunc* GetExportCount;
-    GetExportNameFunc* GetExportName;
-    LoadPluginFunc* LoadPlugin;
-    InvokeFunc* Invoke;
-
-    int Initialize(
+    int InitializeCoreClr(
             const char* name,
             const char* currentExeAbsolutePath,
             const char* clrFilesAbsolutePath,
@@ -367,6 +421,256 @@ public:
         return -1;
     }
 
+    // Writes a copy of the runtimeconfig that requires exactly the framework version given, keeping its
+    // configProperties. Without it hostfxr would pick a framework of its own instead of the runtime located
+    // for the target.
+    bool CreatePinnedRuntimeConfig(
+            const std::string& runtimeConfigPath,
+            const char* frameworkVersion,
+            std::string& pinnedPath)
+    {
+        std::ifstream source(runtimeConfigPath);
+        std::string text((std::istreambuf_iterator<char>(source)), std::istreambuf_iterator<char>());
+        std::string properties = "{}";
+
+        size_t key = text.find("\"configProperties\"");
+        size_t start = key != std::string::npos ? text.find('{', key) : std::string::npos;
+
+        if (start != std::string::npos)
+        {
+            int depth = 0;
+            bool inString = false;
+
+            for (size_t i = start; i < text.size(); i++)
+            {
+                char c = text[i];
+
+                if (inString)
+                {
+                    if (c == '\\')
+                    {
+                        i++;
+                    }
+                    else if (c == '"')
+                    {
+                        inString = false;
+                    }
+                }
+                else if (c == '"')
+                {
+                    inString = true;
+                }
+                else if (c == '{')
+                {
+                    depth++;
+                }
+                else if (c == '}' && --depth == 0)
+                {
+                    properties = text.substr(start, i - start + 1);
+                    break;
+                }
+            }
+        }
+
+        const char* tempDirectory = std::getenv("TMPDIR");
+        std::string pathTemplate = std::string(tempDirectory != nullptr ? tempDirectory : "/tmp") + "/PluginInterop.XXXXXX.runtimeconfig.json";
+        std::vector<char> path(pathTemplate.begin(), pathTemplate.end());
+        path.push_back('\0');
+
+        int fd = mkstemps(path.data(), strlen(".runtimeconfig.json"));
+        if (fd == -1)
+        {
+            fprintf(stderr, "Could not create %s: %s\n", pathTemplate.c_str(), strerror(errno));
+            return false;
+        }
+
+        std::string config = std::string("{\n")
+            + "  \"runtimeOptions\": {\n"
+            + "    \"rollForward\": \"Disable\",\n"
+            + "    \"framework\": { \"name\": \"Microsoft.NETCore.App\", \"version\": \"" + frameworkVersion + "\" },\n"
+            + "    \"configProperties\": " + properties + "\n"
+            + "  }\n"
+            + "}\n";
+
+        bool written = write(fd, config.data(), config.size()) == (ssize_t)config.size();
+        close(fd);
+
+        pinnedPath = path.data();
+
+        if (!written)
+        {
+            unlink(pinnedPath.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    // Starts the runtime with the settings of PluginInterop.runtimeconfig.json. Returns 0 on success.
+    // The framework is pinned to frameworkVersion, the version of the runtime in clrFilesAbsolutePath.
+    // runtimeStarted is set once the runtime may have been loaded, coreclr_initialize can't be used after that.
+    int InitializeHostFxr(
+            const char* clrFilesAbsolutePath,
+            const char* frameworkVersion,
+            const char* managedAssemblyAbsolutePath,
+            bool& runtimeStarted)
+    {
+        runtimeStarted = false;
+
+        const char* host = std::getenv(hostVar);
+        if (host != nullptr && strcasecmp(host, "coreclr") == 0)
+        {
+            return -1;
+        }
+
+        if (frameworkVersion == nullptr || frameworkVersion[0] == '\0')
+        {
+            return -1;
+        }
+
+        // PluginInterop.dll -> PluginInterop.runtimeconfig.json
+        std::string runtimeConfigPath(managedAssemblyAbsolutePath);
+        size_t extension = runtimeConfigPath.rfind('.');
+        if (extension != std::string::npos)
+        {
+            runtimeConfigPath.erase(extension);
+        }
+        runtimeConfigPath.append(".runtimeconfig.json");
+
+        struct stat sb;
+        if (stat(runtimeConfigPath.c_str(), &sb) == -1)
+        {
+            return -1;
+        }
+
+        std::string hostFxrPath;
+        std::string dotnetRoot;
+        if (!LocateHostFxr(clrFilesAbsolutePath, hostFxrPath, dotnetRoot))
+        {
+            return -1;
+        }
+
+        void* hostFxrLib = dlopen(hostFxrPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (hostFxrLib == nullptr)
+        {
+            fprintf(stderr, "dlopen failed to open %s with error %s\n", hostFxrPath.c_str(), dlerror());
+            return -1;
+        }
+
+        auto initializeForRuntimeConfig = (hostfxr_initialize_for_runtime_config_fn)dlsym(hostFxrLib, "hostfxr_initialize_for_runtime_config");
+        auto getRuntimeDelegate = (hostfxr_get_runtime_delegate_fn)dlsym(hostFxrLib, "hostfxr_get_runtime_delegate");
+        auto setRuntimePropertyValue = (hostfxr_set_runtime_property_value_fn)dlsym(hostFxrLib, "hostfxr_set_runtime_property_value");
+        auto closeHostFxr = (hostfxr_close_fn)dlsym(hostFxrLib, "hostfxr_close");
+
+        if (initializeForRuntimeConfig == nullptr || getRuntimeDelegate == nullptr || setRuntimePropertyValue == nullptr || closeHostFxr == nullptr)
+        {
+            // hostfxr older than 3.0
+            dlclose(hostFxrLib);
+            return -1;
+        }
+
+        std::string pinnedConfigPath;
+        if (!CreatePinnedRuntimeConfig(runtimeConfigPath, frameworkVersion, pinnedConfigPath))
+        {
+            dlclose(hostFxrLib);
+            return -1;
+        }
+
+        hostfxr_initialize_parameters parameters = { sizeof(hostfxr_initialize_parameters), nullptr, dotnetRoot.c_str() };
+        hostfxr_handle context = nullptr;
+
+        // The runtimeconfig is only read here
+        int st = initializeForRuntimeConfig(pinnedConfigPath.c_str(), &parameters, &context);
+        unlink(pinnedConfigPath.c_str());
+
+        if (!SUCCEEDED(st) || context == nullptr)
+        {
+            fprintf(stderr, "hostfxr_initialize_for_runtime_config failed - status: 0x%08x\n", st);
+
+            if (context != nullptr)
+            {
+                closeHostFxr(context);
+            }
+
+            return -1;
+        }
+
+        // Same environment overrides as with coreclr_initialize, they take precedence over the runtimeconfig
+        if (std::getenv(serverGcVar) != nullptr)
+        {
+            setRuntimePropertyValue(context, "System.GC.Server", GetEnvValueBoolean(serverGcVar));
+        }
+
+        if (std::getenv(globalizationInvariantVar) != nullptr)
+        {
+            setRuntimePropertyValue(context, "System.Globalization.Invariant", GetEnvValueBoolean(globalizationInvariantVar));
+        }
+
+        // The first delegate loads the runtime
+        runtimeStarted = true;
+
+        void* function = nullptr;
+        st = getRuntimeDelegate(context, hdt_load_assembly_and_get_function_pointer, &function);
+        closeHostFxr(context);
+
+        if (!SUCCEEDED(st) || function == nullptr)
+        {
+            fprintf(stderr, "hostfxr_get_runtime_delegate failed - status: 0x%08x\n", st);
+            return -1;
+        }
+
+        loadAssemblyAndGetFunctionPointer = (load_assembly_and_get_function_pointer_fn)function;
+        managedAssemblyPath = managedAssemblyAbsolutePath;
+
+        return 0;
+    }
+
+public:
+    bool Initialized;
+
+    GetExportCountFunc* GetExportCount;
+    GetExportNameFunc* GetExportName;
+    LoadPluginFunc* LoadPlugin;
+    LoadPluginsFunc* LoadPlugins;
+    UnloadPluginFunc* UnloadPlugin;
+    ReloadPluginFunc* ReloadPlugin;
+    IsPluginModifiedFunc* IsPluginModified;
+    InvokeFunc* Invoke;
+
+    // Hosts the runtime through hostfxr when PluginInterop.runtimeconfig.json is deployed and the version
+    // of the runtime is known, and falls back to coreclr_initialize otherwise (frameworkVersion nullptr)
+    int Initialize(
+            const char* name,
+            const char* currentExeAbsolutePath,
+            const char* clrFilesAbsolutePath,
+            const char* frameworkVersion,
+            const char* managedAssemblyAbsolutePath)
+    {
+        bool runtimeStarted;
+
+        if (InitializeHostFxr(clrFilesAbsolutePath, frameworkVersion, managedAssemblyAbsolutePath, runtimeStarted) == 0)
+        {
+            Initialized = true;
+
+            if (!InitializeDelegates())
+            {
+                std::cout << "An error occured while calling PluginInterop.dll. "
+                << "Make sure the right version of the file is located in " << currentExeAbsolutePath << std::endl;
+                return -1;
+            }
+
+            return 0;
+        }
+
+        // A runtime can only be loaded once per process
+        if (runtimeStarted)
+        {
+            return -1;
+        }
+
+        return InitializeCoreClr(name, currentExeAbsolutePath, clrFilesAbsolutePath, managedAssemblyAbsolutePath);
+    }
+
     void* CreateDelegate(
             const char* assemblyName,
             const char* typeName,
@@ -375,6 +679,22 @@ public:
 
         void* pfnDelegate = NULL;
 
+        if (loadAssemblyAndGetFunctionPointer != nullptr)
+        {
+            std::string qualifiedTypeName = std::string(typeName) + ", " + assemblyName;
+            std::string delegateTypeName = std::string(entryPointsTypeName) + "+" + methodName + "Delegate, " + assemblyName;
+
+            loadAssemblyAndGetFunctionPointer(
+                    managedAssemblyPath.c_str(),
+                    qualifiedTypeName.c_str(),
+                    methodName,
+                    delegateTypeName.c_str(),
+                    nullptr,
+                    &pfnDelegate);
+
+            return pfnDelegate;
+        }
+
         int st = createDelegate(
                 hostHandle,
                 domainId,
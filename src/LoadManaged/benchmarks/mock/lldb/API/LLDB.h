@@ -0,0 +1,530 @@
+//
+// Stand-in for the lldb SB API, backed by the synthetic target of
+// mocktarget.h. Only the subset used by LLDBServices is provided, with the
+// same signatures as the real headers so services.cpp compiles unchanged.
+// SB objects are cheap handles onto the shared model, like the real ones.
+//
+
+#ifndef __MOCK_LLDB_H__
+#define __MOCK_LLDB_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define LLDB_INVALID_ADDRESS UINT64_MAX
+#define LLDB_INVALID_PROCESS_ID 0
+
+namespace lldb_mock
+{
+    struct MockTarget;
+}
+
+namespace lldb
+{
+    typedef uint64_t addr_t;
+    typedef uint64_t tid_t;
+    typedef uint64_t pid_t;
+    typedef uint64_t user_id_t;
+    typedef int32_t break_id_t;
+
+    enum ReturnStatus
+    {
+        eReturnStatusInvalid,
+        eReturnStatusSuccessFinishNoResult,
+        eReturnStatusSuccessFinishResult,
+        eReturnStatusSuccessContinuingNoResult,
+        eReturnStatusSuccessContinuingResult,
+        eReturnStatusStarted,
+        eReturnStatusFailed,
+        eReturnStatusQuit
+    };
+
+    enum StateType
+    {
+        eStateInvalid,
+        eStateUnloaded,
+        eStateConnected,
+        eStateAttaching,
+        eStateLaunching,
+        eStateStopped,
+        eStateRunning,
+        eStateStepping,
+        eStateCrashed,
+        eStateDetached,
+        eStateExited,
+        eStateSuspended
+    };
+
+    enum LanguageType { eLanguageTypeC_plus_plus = 4 };
+    enum DynamicValueType { eNoDynamicValues };
+    enum ByteOrder { eByteOrderLittle = 4 };
+
+    typedef std::shared_ptr<lldb_mock::MockTarget> MockTargetSP;
+
+    class SBTarget;
+    class SBProcess;
+    class SBThread;
+    class SBFrame;
+    class SBModule;
+    class SBSymbol;
+    class SBLineEntry;
+    class SBDebugger;
+
+    class SBError
+    {
+    private:
+        bool m_fail;
+        std::string m_message;
+
+    public:
+        SBError();
+        bool Success() const;
+        bool Fail() const;
+        const char* GetCString() const;
+        void SetErrorString(const char* message);
+    };
+
+    class SBFileSpec
+    {
+    private:
+        std::string m_directory;
+        std::string m_filename;
+
+    public:
+        SBFileSpec();
+        SBFileSpec(const char* path, bool resolve = true);
+        bool IsValid() const;
+        const char* GetFilename() const;
+        const char* GetDirectory() const;
+        void SetFilename(const char* filename);
+        uint32_t GetPath(char* path, size_t size) const;
+        bool Exists() const;
+    };
+
+    class SBBroadcaster
+    {
+    public:
+        SBBroadcaster();
+        bool IsValid() const;
+        const char* GetName() const;
+    };
+
+    class SBEvent
+    {
+    public:
+        SBEvent();
+        bool IsValid() const;
+        uint32_t GetType() const;
+        SBBroadcaster GetBroadcaster() const;
+        bool BroadcasterMatchesRef(const SBBroadcaster& broadcaster);
+    };
+
+    class SBListener
+    {
+    public:
+        SBListener();
+        SBListener(const char* name);
+        bool IsValid() const;
+        uint32_t StartListeningForEvents(const SBBroadcaster& broadcaster, uint32_t mask);
+        bool StopListeningForEvents(const SBBroadcaster& broadcaster, uint32_t mask);
+        bool WaitForEvent(uint32_t seconds, SBEvent& event);
+        uint32_t StartListeningForEventClass(SBDebugger& debugger, const char* broadcasterClass, uint32_t mask);
+    };
+
+    class SBLineEntry
+    {
+    public:
+        SBLineEntry();
+        bool IsValid() const;
+        uint32_t GetLine() const;
+        SBFileSpec GetFileSpec() const;
+    };
+
+    class SBAddress
+    {
+    private:
+        MockTargetSP m_target;
+        addr_t m_address;
+        int m_module;
+        int m_section;
+
+    public:
+        SBAddress();
+        SBAddress(MockTargetSP target, addr_t address, int module, int section);
+        bool IsValid() const;
+        addr_t GetOffset();
+        addr_t GetLoadAddress(const SBTarget& target) const;
+        SBModule GetModule();
+        SBSymbol GetSymbol();
+        SBLineEntry GetLineEntry();
+    };
+
+    class SBSymbol
+    {
+    private:
+        MockTargetSP m_target;
+        int m_module;
+        int m_symbol;
+
+    public:
+        SBSymbol();
+        SBSymbol(MockTargetSP target, int module, int symbol);
+        bool IsValid() const;
+        const char* GetName() const;
+        SBAddress GetStartAddress();
+        SBAddress GetEndAddress();
+    };
+
+    class SBSection
+    {
+    private:
+        MockTargetSP m_target;
+        int m_module;
+        int m_section;
+
+    public:
+        SBSection();
+        SBSection(MockTargetSP target, int module, int section);
+        bool IsValid() const;
+        addr_t GetLoadAddress(SBTarget& target);
+        addr_t GetByteSize();
+        uint64_t GetFileOffset();
+        const char* GetName();
+    };
+
+    class SBModule
+    {
+    private:
+        MockTargetSP m_target;
+        int m_module;
+
+    public:
+        SBModule();
+        SBModule(MockTargetSP target, int module);
+        bool IsValid() const;
+        SBFileSpec GetFileSpec() const;
+        size_t GetNumSections();
+        SBSection GetSectionAtIndex(size_t index);
+        bool operator==(const SBModule& other) const;
+        bool operator!=(const SBModule& other) const;
+        const char* GetUUIDString() const;
+        SBAddress GetObjectFileHeaderAddress() const;
+    };
+
+    class SBData
+    {
+    private:
+        std::vector<uint8_t> m_bytes;
+
+    public:
+        SBData();
+        explicit SBData(std::vector<uint8_t> bytes);
+        uint8_t GetUnsignedInt8(SBError& error, uint64_t offset);
+    };
+
+    class SBInstruction
+    {
+    private:
+        MockTargetSP m_target;
+        addr_t m_address;
+
+    public:
+        SBInstruction();
+        SBInstruction(MockTargetSP target, addr_t address);
+        bool IsValid();
+        size_t GetByteSize();
+        SBData GetData(SBTarget target);
+        const char* GetMnemonic(SBTarget target);
+        const char* GetOperands(SBTarget target);
+    };
+
+    class SBInstructionList
+    {
+    private:
+        std::vector<SBInstruction> m_instructions;
+        bool m_valid;
+
+    public:
+        SBInstructionList();
+        explicit SBInstructionList(std::vector<SBInstruction> instructions);
+        bool IsValid() const;
+        size_t GetSize();
+        SBInstruction GetInstructionAtIndex(uint32_t index);
+    };
+
+    class SBValue
+    {
+    private:
+        bool m_valid;
+        uint64_t m_value;
+
+    public:
+        SBValue();
+        explicit SBValue(uint64_t value);
+        bool IsValid();
+        uint64_t GetValueAsUnsigned(SBError& error, uint64_t fail = 0);
+        uint64_t GetValueAsUnsigned(uint64_t fail = 0);
+    };
+
+    class SBFrame
+    {
+    private:
+        MockTargetSP m_target;
+        uint32_t m_thread;
+        uint32_t m_frame;
+
+    public:
+        SBFrame();
+        SBFrame(MockTargetSP target, uint32_t thread, uint32_t frame);
+        bool IsValid() const;
+        addr_t GetPC() const;
+        addr_t GetSP() const;
+        addr_t GetFP() const;
+        uint32_t GetFrameID() const;
+        const char* GetFunctionName();
+        SBValue FindVariable(const char* name);
+        SBValue FindRegister(const char* name);
+        SBValue EvaluateExpression(const char* expression, DynamicValueType dynamic);
+        SBThread GetThread() const;
+    };
+
+    class SBThread
+    {
+    private:
+        MockTargetSP m_target;
+        uint32_t m_thread;
+
+    public:
+        SBThread();
+        SBThread(MockTargetSP target, uint32_t thread);
+        bool IsValid() const;
+        tid_t GetThreadID() const;
+        uint32_t GetIndexID() const;
+        uint32_t GetNumFrames();
+        SBFrame GetFrameAtIndex(uint32_t index);
+        SBFrame GetSelectedFrame();
+        SBProcess GetProcess();
+    };
+
+    class SBMemoryRegionInfo
+    {
+    private:
+        addr_t m_base;
+        addr_t m_end;
+        uint32_t m_protection;
+        bool m_mapped;
+
+    public:
+        SBMemoryRegionInfo();
+        SBMemoryRegionInfo(addr_t base, addr_t end, uint32_t protection, bool mapped);
+        addr_t GetRegionBase();
+        addr_t GetRegionEnd();
+        bool IsReadable();
+        bool IsWritable();
+        bool IsExecutable();
+        bool IsMapped();
+        const char* GetName();
+    };
+
+    class SBMemoryRegionInfoList
+    {
+    private:
+        std::vector<SBMemoryRegionInfo> m_regions;
+
+    public:
+        SBMemoryRegionInfoList();
+        explicit SBMemoryRegionInfoList(std::vector<SBMemoryRegionInfo> regions);
+        uint32_t GetSize() const;
+        bool GetMemoryRegionAtIndex(uint32_t index, SBMemoryRegionInfo& region);
+    };
+
+    class SBProcess
+    {
+    private:
+        MockTargetSP m_target;
+
+    public:
+        enum
+        {
+            eBroadcastBitStateChanged = 1,
+            eBroadcastBitInterrupt = 2,
+            eBroadcastBitSTDOUT = 4,
+            eBroadcastBitSTDERR = 8
+        };
+
+        SBProcess();
+        explicit SBProcess(MockTargetSP target);
+        bool IsValid() const;
+        size_t ReadMemory(addr_t address, void* buffer, size_t size, SBError& error);
+        size_t WriteMemory(addr_t address, const void* buffer, size_t size, SBError& error);
+        SBThread GetThreadByID(tid_t tid);
+        SBThread GetThreadByIndexID(uint32_t indexId);
+        uint32_t GetNumThreads();
+        SBThread GetThreadAtIndex(size_t index);
+        SBThread GetSelectedThread() const;
+        bool SetSelectedThreadByIndexID(uint32_t indexId);
+        uint32_t GetStopID(bool include_expression_stops = false);
+        uint32_t GetUniqueID();
+        StateType GetState();
+        pid_t GetProcessID();
+        SBTarget GetTarget() const;
+        SBBroadcaster GetBroadcaster() const;
+        static StateType GetStateFromEvent(const SBEvent& event);
+        static bool GetRestartedFromEvent(const SBEvent& event);
+        static bool EventIsProcessEvent(const SBEvent& event);
+        static SBProcess GetProcessFromEvent(const SBEvent& event);
+        static const char* GetBroadcasterClassName();
+        SBMemoryRegionInfoList GetMemoryRegions();
+        SBError GetMemoryRegionInfo(addr_t address, SBMemoryRegionInfo& region);
+        const char* GetPluginName();
+        SBFileSpec GetCoreFile();
+        uint32_t GetAddressByteSize() const;
+    };
+
+    class SBBreakpointLocation
+    {
+    public:
+        SBBreakpointLocation();
+        bool IsValid() const;
+        addr_t GetLoadAddress();
+        bool IsEnabled();
+    };
+
+    typedef bool (*SBBreakpointHitCallback)(void* baton, SBProcess& process, SBThread& thread, SBBreakpointLocation& location);
+
+    class SBBreakpoint
+    {
+    private:
+        break_id_t m_id;
+
+    public:
+        SBBreakpoint();
+        explicit SBBreakpoint(break_id_t id);
+        bool IsValid() const;
+        break_id_t GetID() const;
+        void SetCallback(SBBreakpointHitCallback callback, void* baton);
+        bool AddName(const char* name);
+        bool IsEnabled();
+        size_t GetNumLocations() const;
+        SBBreakpointLocation GetLocationAtIndex(uint32_t index);
+    };
+
+    class SBTarget
+    {
+    private:
+        MockTargetSP m_target;
+
+    public:
+        enum
+        {
+            eBroadcastBitBreakpointChanged = 1,
+            eBroadcastBitModulesLoaded = 2,
+            eBroadcastBitModulesUnloaded = 4,
+            eBroadcastBitWatchpointChanged = 8,
+            eBroadcastBitSymbolsLoaded = 16
+        };
+
+        SBTarget();
+        explicit SBTarget(MockTargetSP target);
+        bool IsValid() const;
+        SBProcess GetProcess();
+        uint32_t GetNumModules() const;
+        SBModule GetModuleAtIndex(uint32_t index);
+        SBModule FindModule(const SBFileSpec& file);
+        SBAddress ResolveLoadAddress(addr_t address);
+        SBInstructionList ReadInstructions(SBAddress address, uint32_t count, const char* flavor);
+        uint32_t GetAddressByteSize();
+        SBBreakpoint BreakpointCreateForException(LanguageType language, bool catchBp, bool throwBp);
+        bool BreakpointDelete(break_id_t id);
+        uint32_t GetNumBreakpoints() const;
+        SBBreakpoint GetBreakpointAtIndex(uint32_t index) const;
+        SBDebugger GetDebugger() const;
+        SBBroadcaster GetBroadcaster() const;
+        bool operator==(const SBTarget& other) const;
+        const char* GetTriple();
+        static bool EventIsTargetEvent(const SBEvent& event);
+        static SBTarget GetTargetFromEvent(const SBEvent& event);
+        static const char* GetBroadcasterClassName();
+        SBFileSpec GetExecutable();
+    };
+
+    class SBCommandReturnObject
+    {
+    private:
+        ReturnStatus m_status;
+        std::string m_output;
+        std::string m_error;
+        FILE* m_outputFile;
+        FILE* m_errorFile;
+
+    public:
+        SBCommandReturnObject();
+        void SetStatus(ReturnStatus status);
+        ReturnStatus GetStatus();
+        size_t Printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+        void SetImmediateOutputFile(FILE* file);
+        void SetImmediateErrorFile(FILE* file);
+        void AppendMessage(const char* message);
+        void AppendWarning(const char* message);
+        void SetError(const char* message);
+        const char* GetOutput();
+        const char* GetError();
+        bool Succeeded();
+        void Clear();
+    };
+
+    class SBCommandPluginInterface
+    {
+    public:
+        virtual ~SBCommandPluginInterface() = default;
+        virtual bool DoExecute(SBDebugger debugger, char** command, SBCommandReturnObject& result);
+    };
+
+    class SBCommand
+    {
+    public:
+        SBCommand();
+        bool IsValid();
+        SBCommand AddCommand(const char* name, SBCommandPluginInterface* implementation, const char* help = nullptr, const char* syntax = nullptr);
+        SBCommand AddMultiwordCommand(const char* name, const char* help = nullptr);
+        void SetHelp(const char* help);
+    };
+
+    class SBCommandInterpreter
+    {
+    public:
+        SBCommandInterpreter();
+        bool IsValid() const;
+        SBCommand AddCommand(const char* name, SBCommandPluginInterface* implementation, const char* help);
+        SBCommand AddMultiwordCommand(const char* name, const char* help);
+        ReturnStatus HandleCommand(const char* command, SBCommandReturnObject& result, bool add_to_history = false);
+        bool CommandExists(const char* name);
+    };
+
+    class SBDebugger
+    {
+    private:
+        MockTargetSP m_target;
+
+    public:
+        SBDebugger();
+        explicit SBDebugger(MockTargetSP target);
+        bool IsValid() const;
+        SBTarget GetSelectedTarget();
+        SBCommandInterpreter GetCommandInterpreter();
+        SBListener GetListener();
+        user_id_t GetID();
+        void DispatchInputInterrupt();
+        bool InterruptRequested();
+        bool GetAsync();
+        void SetAsync(bool async);
+        uint32_t GetNumTargets();
+        SBTarget GetTargetAtIndex(uint32_t index);
+    };
+}
+
+#endif // __MOCK_LLDB_H__
@@ -0,0 +1 @@
+#include "lldb/API/LLDB.h"
@@ -0,0 +1,762 @@
+#include "lldb/API/LLDB.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstring>
+#include "mocktarget.h"
+
+using namespace lldb_mock;
+
+namespace lldb
+{
+    //------------------------------------------------------------------------
+    // SBError
+    //------------------------------------------------------------------------
+
+    SBError::SBError() : m_fail(false) {}
+    bool SBError::Success() const { return !m_fail; }
+    bool SBError::Fail() const { return m_fail; }
+    const char* SBError::GetCString() const { return m_fail ? m_message.c_str() : nullptr; }
+
+    void
+    SBError::SetErrorString(const char* message)
+    {
+        m_fail = true;
+        m_message = message != nullptr ? message : "error";
+    }
+
+    //------------------------------------------------------------------------
+    // SBFileSpec
+    //------------------------------------------------------------------------
+
+    SBFileSpec::SBFileSpec() {}
+
+    SBFileSpec::SBFileSpec(const char* path, bool resolve)
+    {
+        const char* slash = strrchr(path, '/');
+
+        if (slash == nullptr)
+        {
+            m_filename = path;
+        }
+        else
+        {
+            m_directory.assign(path, slash - path);
+            m_filename = slash + 1;
+        }
+    }
+
+    bool SBFileSpec::IsValid() const { return !m_filename.empty() || !m_directory.empty(); }
+    const char* SBFileSpec::GetFilename() const { return m_filename.empty() ? nullptr : m_filename.c_str(); }
+    const char* SBFileSpec::GetDirectory() const { return m_directory.empty() ? nullptr : m_directory.c_str(); }
+    void SBFileSpec::SetFilename(const char* filename) { m_filename = filename != nullptr ? filename : ""; }
+    bool SBFileSpec::Exists() const { return false; }
+
+    uint32_t
+    SBFileSpec::GetPath(char* path, size_t size) const
+    {
+        std::string full = m_directory.empty() ? m_filename : m_directory + "/" + m_filename;
+
+        if (path != nullptr && size > 0)
+        {
+            size_t count = std::min(full.size(), size - 1);
+            memcpy(path, full.c_str(), count);
+            path[count] = '\0';
+        }
+
+        return (uint32_t)full.size();
+    }
+
+    //------------------------------------------------------------------------
+    // Events (the mock target never changes state by itself)
+    //------------------------------------------------------------------------
+
+    SBBroadcaster::SBBroadcaster() {}
+    bool SBBroadcaster::IsValid() const { return false; }
+    const char* SBBroadcaster::GetName() const { return nullptr; }
+
+    SBEvent::SBEvent() {}
+    bool SBEvent::IsValid() const { return false; }
+    uint32_t SBEvent::GetType() const { return 0; }
+    SBBroadcaster SBEvent::GetBroadcaster() const { return SBBroadcaster(); }
+    bool SBEvent::BroadcasterMatchesRef(const SBBroadcaster&) { return false; }
+
+    SBListener::SBListener() {}
+    SBListener::SBListener(const char*) {}
+    bool SBListener::IsValid() const { return false; }
+    uint32_t SBListener::StartListeningForEvents(const SBBroadcaster&, uint32_t) { return 0; }
+    bool SBListener::StopListeningForEvents(const SBBroadcaster&, uint32_t) { return false; }
+    bool SBListener::WaitForEvent(uint32_t, SBEvent&) { return false; }
+    uint32_t SBListener::StartListeningForEventClass(SBDebugger&, const char*, uint32_t) { return 0; }
+
+    //------------------------------------------------------------------------
+    // Symbols
+    //------------------------------------------------------------------------
+
+    SBLineEntry::SBLineEntry() {}
+    bool SBLineEntry::IsValid() const { return false; }
+    uint32_t SBLineEntry::GetLine() const { return 0; }
+    SBFileSpec SBLineEntry::GetFileSpec() const { return SBFileSpec(); }
+
+    SBAddress::SBAddress() : m_address(LLDB_INVALID_ADDRESS), m_module(-1), m_section(-1) {}
+
+    SBAddress::SBAddress(MockTargetSP target, addr_t address, int module, int section) :
+            m_target(target),
+            m_address(address),
+            m_module(module),
+            m_section(section)
+    {
+    }
+
+    bool SBAddress::IsValid() const { return m_target != nullptr && m_address != LLDB_INVALID_ADDRESS; }
+
+    addr_t
+    SBAddress::GetOffset()
+    {
+        if (m_section == -1)
+        {
+            return m_address;
+        }
+
+        const MockModule& module = m_target->Modules[m_module];
+        return m_address - (module.Base + module.Sections[m_section].Offset);
+    }
+
+    addr_t SBAddress::GetLoadAddress(const SBTarget&) const { return m_address; }
+    SBModule SBAddress::GetModule() { return m_module == -1 ? SBModule() : SBModule(m_target, m_module); }
+
+    SBSymbol
+    SBAddress::GetSymbol()
+    {
+        if (m_module == -1)
+        {
+            return SBSymbol();
+        }
+
+        int symbol = m_target->FindSymbol(m_module, m_address);
+        return symbol == -1 ? SBSymbol() : SBSymbol(m_target, m_module, symbol);
+    }
+
+    SBLineEntry SBAddress::GetLineEntry() { return SBLineEntry(); }
+
+    SBSymbol::SBSymbol() : m_module(-1), m_symbol(-1) {}
+    SBSymbol::SBSymbol(MockTargetSP target, int module, int symbol) : m_target(target), m_module(module), m_symbol(symbol) {}
+    bool SBSymbol::IsValid() const { return m_symbol != -1; }
+    const char* SBSymbol::GetName() const { return IsValid() ? m_target->Modules[m_module].Symbols[m_symbol].Name.c_str() : nullptr; }
+
+    SBAddress
+    SBSymbol::GetStartAddress()
+    {
+        if (!IsValid())
+        {
+            return SBAddress();
+        }
+
+        addr_t start = m_target->Modules[m_module].Symbols[m_symbol].Start;
+        return SBAddress(m_target, start, m_module, m_target->FindSection(m_module, start));
+    }
+
+    SBAddress
+    SBSymbol::GetEndAddress()
+    {
+        if (!IsValid())
+        {
+            return SBAddress();
+        }
+
+        const MockSymbol& symbol = m_target->Modules[m_module].Symbols[m_symbol];
+        return SBAddress(m_target, symbol.Start + symbol.Size, m_module, m_target->FindSection(m_module, symbol.Start));
+    }
+
+    //------------------------------------------------------------------------
+    // Modules
+    //------------------------------------------------------------------------
+
+    SBSection::SBSection() : m_module(-1), m_section(-1) {}
+    SBSection::SBSection(MockTargetSP target, int module, int section) : m_target(target), m_module(module), m_section(section) {}
+    bool SBSection::IsValid() const { return m_section != -1; }
+
+    addr_t
+    SBSection::GetLoadAddress(SBTarget&)
+    {
+        if (!IsValid())
+        {
+            return LLDB_INVALID_ADDRESS;
+        }
+
+        const MockModule& module = m_target->Modules[m_module];
+        return module.Base + module.Sections[m_section].Offset;
+    }
+
+    addr_t SBSection::GetByteSize() { return IsValid() ? m_target->Modules[m_module].Sections[m_section].Size : 0; }
+    uint64_t SBSection::GetFileOffset() { return IsValid() ? m_target->Modules[m_module].Sections[m_section].FileOffset : 0; }
+    const char* SBSection::GetName() { return IsValid() ? m_target->Modules[m_module].Sections[m_section].Name.c_str() : nullptr; }
+
+    SBModule::SBModule() : m_module(-1) {}
+    SBModule::SBModule(MockTargetSP target, int module) : m_target(target), m_module(module) {}
+    bool SBModule::IsValid() const { return m_module != -1; }
+
+    SBFileSpec
+    SBModule::GetFileSpec() const
+    {
+        if (!IsValid())
+        {
+            return SBFileSpec();
+        }
+
+        const MockModule& module = m_target->Modules[m_module];
+        return SBFileSpec((module.Directory + "/" + module.Filename).c_str());
+    }
+
+    size_t SBModule::GetNumSections() { return IsValid() ? m_target->Modules[m_module].Sections.size() : 0; }
+
+    SBSection
+    SBModule::GetSectionAtIndex(size_t index)
+    {
+        return IsValid() && index < m_target->Modules[m_module].Sections.size() ? SBSection(m_target, m_module, (int)index) : SBSection();
+    }
+
+    bool SBModule::operator==(const SBModule& other) const { return m_target == other.m_target && m_module == other.m_module; }
+    bool SBModule::operator!=(const SBModule& other) const { return !(*this == other); }
+    const char* SBModule::GetUUIDString() const { return IsValid() ? m_target->Modules[m_module].Uuid.c_str() : nullptr; }
+
+    SBAddress
+    SBModule::GetObjectFileHeaderAddress() const
+    {
+        return IsValid() ? SBAddress(m_target, m_target->Modules[m_module].Base, m_module, -1) : SBAddress();
+    }
+
+    //------------------------------------------------------------------------
+    // Instructions
+    //------------------------------------------------------------------------
+
+    // Not x86: lengths and mnemonics are derived from the generated bytes
+    static const char* const s_mnemonics[] = { "mov", "lea", "call", "cmp", "jne", "add", "push", "ret" };
+    static const char* const s_operands[] = { "rax, qword ptr [rbp - 0x8]", "rdi, rsi", "0x7f0000123456", "dword ptr [rsp + 0x20], 0x0" };
+
+    SBData::SBData() {}
+    SBData::SBData(std::vector<uint8_t> bytes) : m_bytes(std::move(bytes)) {}
+
+    uint8_t
+    SBData::GetUnsignedInt8(SBError& error, uint64_t offset)
+    {
+        if (offset >= m_bytes.size())
+        {
+            error.SetErrorString("offset out of range");
+            return 0;
+        }
+
+        return m_bytes[offset];
+    }
+
+    SBInstruction::SBInstruction() : m_address(LLDB_INVALID_ADDRESS) {}
+    SBInstruction::SBInstruction(MockTargetSP target, addr_t address) : m_target(target), m_address(address) {}
+    bool SBInstruction::IsValid() { return m_target != nullptr; }
+
+    size_t
+    SBInstruction::GetByteSize()
+    {
+        uint8_t opcode = 0;
+        return IsValid() && m_target->Read(m_address, &opcode, 1) == 1 ? 1 + opcode % 8 : 0;
+    }
+
+    SBData
+    SBInstruction::GetData(SBTarget)
+    {
+        std::vector<uint8_t> bytes(GetByteSize());
+        bytes.resize(m_target->Read(m_address, bytes.data(), bytes.size()));
+        return SBData(std::move(bytes));
+    }
+
+    const char*
+    SBInstruction::GetMnemonic(SBTarget)
+    {
+        uint8_t opcode = 0;
+        m_target->Read(m_address, &opcode, 1);
+        return s_mnemonics[opcode % 8];
+    }
+
+    const char*
+    SBInstruction::GetOperands(SBTarget)
+    {
+        uint8_t operand = 0;
+        m_target->Read(m_address + 1, &operand, 1);
+        return s_operands[operand % 4];
+    }
+
+    SBInstructionList::SBInstructionList() : m_valid(false) {}
+    SBInstructionList::SBInstructionList(std::vector<SBInstruction> instructions) : m_instructions(std::move(instructions)), m_valid(true) {}
+    bool SBInstructionList::IsValid() const { return m_valid; }
+    size_t SBInstructionList::GetSize() { return m_instructions.size(); }
+    SBInstruction SBInstructionList::GetInstructionAtIndex(uint32_t index) { return index < m_instructions.size() ? m_instructions[index] : SBInstruction(); }
+
+    //------------------------------------------------------------------------
+    // Threads and frames
+    //------------------------------------------------------------------------
+
+    SBValue::SBValue() : m_valid(false), m_value(0) {}
+    SBValue::SBValue(uint64_t value) : m_valid(true), m_value(value) {}
+    bool SBValue::IsValid() { return m_valid; }
+
+    uint64_t
+    SBValue::GetValueAsUnsigned(SBError& error, uint64_t fail)
+    {
+        if (!m_valid)
+        {
+            error.SetErrorString("invalid value");
+            return fail;
+        }
+
+        return m_value;
+    }
+
+    uint64_t SBValue::GetValueAsUnsigned(uint64_t fail) { return m_valid ? m_value : fail; }
+
+    SBFrame::SBFrame() : m_thread(UINT32_MAX), m_frame(UINT32_MAX) {}
+    SBFrame::SBFrame(MockTargetSP target, uint32_t thread, uint32_t frame) : m_target(target), m_thread(thread), m_frame(frame) {}
+    bool SBFrame::IsValid() const { return m_frame != UINT32_MAX; }
+    addr_t SBFrame::GetPC() const { return IsValid() ? m_target->Threads[m_thread].Frames[m_frame].PC : LLDB_INVALID_ADDRESS; }
+    addr_t SBFrame::GetSP() const { return IsValid() ? m_target->Threads[m_thread].Frames[m_frame].SP : LLDB_INVALID_ADDRESS; }
+    addr_t SBFrame::GetFP() const { return IsValid() ? m_target->Threads[m_thread].Frames[m_frame].FP : LLDB_INVALID_ADDRESS; }
+    uint32_t SBFrame::GetFrameID() const { return m_frame; }
+
+    const char*
+    SBFrame::GetFunctionName()
+    {
+        if (!IsValid())
+        {
+            return nullptr;
+        }
+
+        addr_t pc = GetPC();
+        int module = m_target->FindModule(pc);
+        int symbol = module == -1 ? -1 : m_target->FindSymbol(module, pc);
+
+        return symbol == -1 ? nullptr : m_target->Modules[module].Symbols[symbol].Name.c_str();
+    }
+
+    SBValue SBFrame::FindVariable(const char*) { return SBValue(); }
+
+    SBValue
+    SBFrame::FindRegister(const char* name)
+    {
+        if (!IsValid())
+        {
+            return SBValue();
+        }
+
+        // lldb looks the register up by name in the register context
+        if (strcmp(name, "rip") == 0 || strcmp(name, "pc") == 0)
+        {
+            return SBValue(GetPC());
+        }
+        if (strcmp(name, "rsp") == 0 || strcmp(name, "sp") == 0)
+        {
+            return SBValue(GetSP());
+        }
+        if (strcmp(name, "rbp") == 0 || strcmp(name, "fp") == 0)
+        {
+            return SBValue(GetFP());
+        }
+
+        uint64_t value = GetSP();
+        for (const char* c = name; *c != '\0'; c++)
+        {
+            value = value * 31 + *c;
+        }
+
+        return SBValue(value);
+    }
+
+    SBValue SBFrame::EvaluateExpression(const char*, DynamicValueType) { return SBValue(); }
+    SBThread SBFrame::GetThread() const { return IsValid() ? SBThread(m_target, m_thread) : SBThread(); }
+
+    SBThread::SBThread() : m_thread(UINT32_MAX) {}
+    SBThread::SBThread(MockTargetSP target, uint32_t thread) : m_target(target), m_thread(thread) {}
+    bool SBThread::IsValid() const { return m_thread != UINT32_MAX; }
+    tid_t SBThread::GetThreadID() const { return IsValid() ? m_target->Threads[m_thread].ThreadId : 0; }
+    uint32_t SBThread::GetIndexID() const { return IsValid() ? m_target->Threads[m_thread].IndexId : 0; }
+    uint32_t SBThread::GetNumFrames() { return IsValid() ? (uint32_t)m_target->Threads[m_thread].Frames.size() : 0; }
+
+    SBFrame
+    SBThread::GetFrameAtIndex(uint32_t index)
+    {
+        return IsValid() && index < m_target->Threads[m_thread].Frames.size() ? SBFrame(m_target, m_thread, index) : SBFrame();
+    }
+
+    SBFrame SBThread::GetSelectedFrame() { return GetFrameAtIndex(0); }
+    SBProcess SBThread::GetProcess() { return IsValid() ? SBProcess(m_target) : SBProcess(); }
+
+    //------------------------------------------------------------------------
+    // Process
+    //------------------------------------------------------------------------
+
+    SBMemoryRegionInfo::SBMemoryRegionInfo() : m_base(0), m_end(0), m_protection(0), m_mapped(false) {}
+    SBMemoryRegionInfo::SBMemoryRegionInfo(addr_t base, addr_t end, uint32_t protection, bool mapped) : m_base(base), m_end(end), m_protection(protection), m_mapped(mapped) {}
+    addr_t SBMemoryRegionInfo::GetRegionBase() { return m_base; }
+    addr_t SBMemoryRegionInfo::GetRegionEnd() { return m_end; }
+    bool SBMemoryRegionInfo::IsReadable() { return (m_protection & MockRead) != 0; }
+    bool SBMemoryRegionInfo::IsWritable() { return (m_protection & MockWrite) != 0; }
+    bool SBMemoryRegionInfo::IsExecutable() { return (m_protection & MockExecute) != 0; }
+    bool SBMemoryRegionInfo::IsMapped() { return m_mapped; }
+    const char* SBMemoryRegionInfo::GetName() { return nullptr; }
+
+    SBMemoryRegionInfoList::SBMemoryRegionInfoList() {}
+    SBMemoryRegionInfoList::SBMemoryRegionInfoList(std::vector<SBMemoryRegionInfo> regions) : m_regions(std::move(regions)) {}
+    uint32_t SBMemoryRegionInfoList::GetSize() const { return (uint32_t)m_regions.size(); }
+
+    bool
+    SBMemoryRegionInfoList::GetMemoryRegionAtIndex(uint32_t index, SBMemoryRegionInfo& region)
+    {
+        if (index >= m_regions.size())
+        {
+            return false;
+        }
+
+        region = m_regions[index];
+        return true;
+    }
+
+    SBProcess::SBProcess() {}
+    SBProcess::SBProcess(MockTargetSP target) : m_target(target) {}
+    bool SBProcess::IsValid() const { return m_target != nullptr; }
+
+    size_t
+    SBProcess::ReadMemory(addr_t address, void* buffer, size_t size, SBError& error)
+    {
+        if (m_target->ReadLatencyNs != 0)
+        {
+            auto end = std::chrono::steady_clock::now() + std::chrono::nanoseconds(m_target->ReadLatencyNs);
+            while (std::chrono::steady_clock::now() < end)
+            {
+            }
+        }
+
+        size_t read = m_target->Read(address, buffer, size);
+
+        if (read == 0 && size != 0)
+        {
+            error.SetErrorString("memory read failed");
+        }
+
+        return read;
+    }
+
+    size_t
+    SBProcess::WriteMemory(addr_t address, const void* buffer, size_t size, SBError& error)
+    {
+        size_t written = m_target->Write(address, buffer, size);
+
+        if (written == 0 && size != 0)
+        {
+            error.SetErrorString("memory write failed");
+        }
+
+        return written;
+    }
+
+    SBThread
+    SBProcess::GetThreadByID(tid_t tid)
+    {
+        // Linear, like lldb's ThreadList::FindThreadByID
+        for (size_t i = 0; i < m_target->Threads.size(); i++)
+        {
+            if (m_target->Threads[i].ThreadId == tid)
+            {
+                return SBThread(m_target, (uint32_t)i);
+            }
+        }
+
+        return SBThread();
+    }
+
+    SBThread
+    SBProcess::GetThreadByIndexID(uint32_t indexId)
+    {
+        for (size_t i = 0; i < m_target->Threads.size(); i++)
+        {
+            if (m_target->Threads[i].IndexId == indexId)
+            {
+                return SBThread(m_target, (uint32_t)i);
+            }
+        }
+
+        return SBThread();
+    }
+
+    uint32_t SBProcess::GetNumThreads() { return (uint32_t)m_target->Threads.size(); }
+    SBThread SBProcess::GetThreadAtIndex(size_t index) { return index < m_target->Threads.size() ? SBThread(m_target, (uint32_t)index) : SBThread(); }
+
+    SBThread
+    SBProcess::GetSelectedThread() const
+    {
+        return m_target->SelectedThread < m_target->Threads.size() ? SBThread(m_target, m_target->SelectedThread) : SBThread();
+    }
+
+    bool
+    SBProcess::SetSelectedThreadByIndexID(uint32_t indexId)
+    {
+        SBThread thread = GetThreadByIndexID(indexId);
+
+        if (!thread.IsValid())
+        {
+            return false;
+        }
+
+        m_target->SelectedThread = indexId - 1;
+        return true;
+    }
+
+    uint32_t SBProcess::GetStopID(bool) { return m_target->StopId; }
+    uint32_t SBProcess::GetUniqueID() { return m_target->UniqueId; }
+    StateType SBProcess::GetState() { return eStateStopped; }
+    pid_t SBProcess::GetProcessID() { return m_target->ProcessId; }
+    SBTarget SBProcess::GetTarget() const { return SBTarget(m_target); }
+    SBBroadcaster SBProcess::GetBroadcaster() const { return SBBroadcaster(); }
+    StateType SBProcess::GetStateFromEvent(const SBEvent&) { return eStateInvalid; }
+    bool SBProcess::GetRestartedFromEvent(const SBEvent&) { return false; }
+    bool SBProcess::EventIsProcessEvent(const SBEvent&) { return false; }
+    SBProcess SBProcess::GetProcessFromEvent(const SBEvent&) { return SBProcess(); }
+    const char* SBProcess::GetBroadcasterClassName() { return "lldb.process"; }
+
+    SBMemoryRegionInfoList
+    SBProcess::GetMemoryRegions()
+    {
+        std::vector<SBMemoryRegionInfo> regions;
+        addr_t previous = 0;
+
+        // lldb reports the holes too
+        for (const MockMemoryBlock& block : m_target->Memory)
+        {
+            if (block.Start > previous)
+            {
+                regions.push_back(SBMemoryRegionInfo(previous, block.Start, 0, false));
+            }
+
+            regions.push_back(SBMemoryRegionInfo(block.Start, block.Start + block.Size, block.Protection, true));
+            previous = block.Start + block.Size;
+        }
+
+        return SBMemoryRegionInfoList(std::move(regions));
+    }
+
+    SBError
+    SBProcess::GetMemoryRegionInfo(addr_t address, SBMemoryRegionInfo& region)
+    {
+        SBError error;
+        const MockMemoryBlock* block = m_target->FindBlock(address);
+
+        if (block == nullptr)
+        {
+            error.SetErrorString("unmapped address");
+        }
+        else
+        {
+            region = SBMemoryRegionInfo(block->Start, block->Start + block->Size, block->Protection, true);
+        }
+
+        return error;
+    }
+
+    const char* SBProcess::GetPluginName() { return "mock"; }
+    SBFileSpec SBProcess::GetCoreFile() { return SBFileSpec(); }
+    uint32_t SBProcess::GetAddressByteSize() const { return 8; }
+
+    //------------------------------------------------------------------------
+    // Target
+    //------------------------------------------------------------------------
+
+    SBBreakpointLocation::SBBreakpointLocation() {}
+    bool SBBreakpointLocation::IsValid() const { return false; }
+    addr_t SBBreakpointLocation::GetLoadAddress() { return LLDB_INVALID_ADDRESS; }
+    bool SBBreakpointLocation::IsEnabled() { return false; }
+
+    SBBreakpoint::SBBreakpoint() : m_id(0) {}
+    SBBreakpoint::SBBreakpoint(break_id_t id) : m_id(id) {}
+    bool SBBreakpoint::IsValid() const { return m_id != 0; }
+    break_id_t SBBreakpoint::GetID() const { return m_id; }
+    void SBBreakpoint::SetCallback(SBBreakpointHitCallback, void*) {}
+    bool SBBreakpoint::AddName(const char*) { return IsValid(); }
+    bool SBBreakpoint::IsEnabled() { return IsValid(); }
+    // The mock target has no breakpoint sites, the exception breakpoint is never resolved
+    size_t SBBreakpoint::GetNumLocations() const { return 0; }
+    SBBreakpointLocation SBBreakpoint::GetLocationAtIndex(uint32_t) { return SBBreakpointLocation(); }
+
+    SBTarget::SBTarget() {}
+    SBTarget::SBTarget(MockTargetSP target) : m_target(target) {}
+    bool SBTarget::IsValid() const { return m_target != nullptr; }
+    SBProcess SBTarget::GetProcess() { return SBProcess(m_target); }
+    uint32_t SBTarget::GetNumModules() const { return IsValid() ? (uint32_t)m_target->Modules.size() : 0; }
+    SBModule SBTarget::GetModuleAtIndex(uint32_t index) { return index < GetNumModules() ? SBModule(m_target, (int)index) : SBModule(); }
+
+    SBModule
+    SBTarget::FindModule(const SBFileSpec& file)
+    {
+        const char* filename = file.GetFilename();
+
+        for (size_t i = 0; filename != nullptr && i < m_target->Modules.size(); i++)
+        {
+            if (m_target->Modules[i].Filename == filename)
+            {
+                return SBModule(m_target, (int)i);
+            }
+        }
+
+        return SBModule();
+    }
+
+    SBAddress
+    SBTarget::ResolveLoadAddress(addr_t address)
+    {
+        // Addresses outside of any section are still valid, as in lldb
+        int module = m_target->FindModule(address);
+        int section = module == -1 ? -1 : m_target->FindSection(module, address);
+
+        return SBAddress(m_target, address, section == -1 ? -1 : module, section);
+    }
+
+    SBInstructionList
+    SBTarget::ReadInstructions(SBAddress address, uint32_t count, const char*)
+    {
+        std::vector<SBInstruction> instructions;
+        addr_t current = address.GetLoadAddress(*this);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            SBInstruction instruction(m_target, current);
+
+            size_t size = instruction.GetByteSize();
+            if (size == 0)
+            {
+                break;
+            }
+
+            instructions.push_back(instruction);
+            current += size;
+        }
+
+        return SBInstructionList(std::move(instructions));
+    }
+
+    uint32_t SBTarget::GetAddressByteSize() { return 8; }
+
+    SBBreakpoint
+    SBTarget::BreakpointCreateForException(LanguageType, bool, bool)
+    {
+        static break_id_t nextId = 1;
+        return SBBreakpoint(nextId++);
+    }
+
+    bool SBTarget::BreakpointDelete(break_id_t) { return true; }
+    uint32_t SBTarget::GetNumBreakpoints() const { return 0; }
+    SBBreakpoint SBTarget::GetBreakpointAtIndex(uint32_t) const { return SBBreakpoint(); }
+    SBDebugger SBTarget::GetDebugger() const { return SBDebugger(m_target); }
+    SBBroadcaster SBTarget::GetBroadcaster() const { return SBBroadcaster(); }
+    bool SBTarget::operator==(const SBTarget& other) const { return m_target == other.m_target; }
+    const char* SBTarget::GetTriple() { return "x86_64-unknown-linux-gnu"; }
+    bool SBTarget::EventIsTargetEvent(const SBEvent&) { return false; }
+    SBTarget SBTarget::GetTargetFromEvent(const SBEvent&) { return SBTarget(); }
+    const char* SBTarget::GetBroadcasterClassName() { return "lldb.target"; }
+    SBFileSpec SBTarget::GetExecutable() { return SBFileSpec("/usr/share/dotnet/dotnet"); }
+
+    //------------------------------------------------------------------------
+    // Commands
+    //------------------------------------------------------------------------
+
+    SBCommandReturnObject::SBCommandReturnObject() :
+            m_status(eReturnStatusSuccessFinishNoResult),
+            m_outputFile(nullptr),
+            m_errorFile(nullptr)
+    {
+    }
+
+    void SBCommandReturnObject::SetStatus(ReturnStatus status) { m_status = status; }
+    ReturnStatus SBCommandReturnObject::GetStatus() { return m_status; }
+
+    size_t
+    SBCommandReturnObject::Printf(const char* format, ...)
+    {
+        char buffer[1024];
+
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+
+        if (m_outputFile != nullptr)
+        {
+            fputs(buffer, m_outputFile);
+        }
+        else
+        {
+            m_output.append(buffer);
+        }
+
+        return length < 0 ? 0 : (size_t)length;
+    }
+
+    void SBCommandReturnObject::SetImmediateOutputFile(FILE* file) { m_outputFile = file; }
+    void SBCommandReturnObject::SetImmediateErrorFile(FILE* file) { m_errorFile = file; }
+    void SBCommandReturnObject::AppendMessage(const char* message) { Printf("%s\n", message); }
+    void SBCommandReturnObject::AppendWarning(const char* message) { Printf("warning: %s\n", message); }
+
+    void
+    SBCommandReturnObject::SetError(const char* message)
+    {
+        m_status = eReturnStatusFailed;
+        m_error.append(message);
+    }
+
+    const char* SBCommandReturnObject::GetOutput() { return m_output.c_str(); }
+    const char* SBCommandReturnObject::GetError() { return m_error.c_str(); }
+    bool SBCommandReturnObject::Succeeded() { return m_status != eReturnStatusFailed; }
+
+    void
+    SBCommandReturnObject::Clear()
+    {
+        m_output.clear();
+        m_error.clear();
+        m_status = eReturnStatusSuccessFinishNoResult;
+    }
+
+    bool SBCommandPluginInterface::DoExecute(SBDebugger, char**, SBCommandReturnObject&) { return false; }
+
+    SBCommand::SBCommand() {}
+    bool SBCommand::IsValid() { return false; }
+    SBCommand SBCommand::AddCommand(const char*, SBCommandPluginInterface*, const char*, const char*) { return SBCommand(); }
+    SBCommand SBCommand::AddMultiwordCommand(const char*, const char*) { return SBCommand(); }
+    void SBCommand::SetHelp(const char*) {}
+
+    SBCommandInterpreter::SBCommandInterpreter() {}
+    bool SBCommandInterpreter::IsValid() const { return true; }
+    SBCommand SBCommandInterpreter::AddCommand(const char*, SBCommandPluginInterface*, const char*) { return SBCommand(); }
+    SBCommand SBCommandInterpreter::AddMultiwordCommand(const char*, const char*) { return SBCommand(); }
+
+    ReturnStatus
+    SBCommandInterpreter::HandleCommand(const char* command, SBCommandReturnObject& result, bool)
+    {
+        result.SetError("commands are not supported by the mock target");
+        return eReturnStatusFailed;
+    }
+
+    bool SBCommandInterpreter::CommandExists(const char*) { return false; }
+
+    //------------------------------------------------------------------------
+    // Debugger
+    //------------------------------------------------------------------------
+
+    SBDebugger::SBDebugger() {}
+    SBDebugger::SBDebugger(MockTargetSP target) : m_target(target) {}
+    bool SBDebugger::IsValid() const { return true; }
+    SBTarget SBDebugger::GetSelectedTarget() { return SBTarget(m_target); }
+    SBCommandInterpreter SBDebugger::GetCommandInterpreter() { return SBCommandInterpreter(); }
+    SBListener SBDebugger::GetListener() { return SBListener(); }
+    user_id_t SBDebugger::GetID() { return 1; }
+    void SBDebugger::DispatchInputInterrupt() {}
+    bool SBDebugger::InterruptRequested() { return false; }
+    bool SBDebugger::GetAsync() { return false; }
+    void SBDebugger::SetAsync(bool) {}
+    uint32_t SBDebugger::GetNumTargets() { return m_target != nullptr ? 1 : 0; }
+    SBTarget SBDebugger::GetTargetAtIndex(uint32_t index) { return index == 0 ? SBTarget(m_target) : SBTarget(); }
+}
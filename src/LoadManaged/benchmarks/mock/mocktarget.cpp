@@ -0,0 +1,235 @@
+#include "mocktarget.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+namespace lldb_mock
+{
+    static uint8_t
+    GeneratedByte(
+            uint64_t address)
+    {
+        return (uint8_t)((address * 0x9E3779B97F4A7C15ULL) >> 56);
+    }
+
+    int
+    MockTarget::FindModule(
+            uint64_t address) const
+    {
+        auto it = std::upper_bound(Modules.begin(), Modules.end(), address,
+            [](uint64_t value, const MockModule& module) { return value < module.Base; });
+
+        if (it == Modules.begin())
+        {
+            return -1;
+        }
+
+        --it;
+        return address - it->Base < it->Size ? (int)(it - Modules.begin()) : -1;
+    }
+
+    int
+    MockTarget::FindSection(
+            int module,
+            uint64_t address) const
+    {
+        const MockModule& mod = Modules[module];
+
+        for (size_t i = 0; i < mod.Sections.size(); i++)
+        {
+            const MockSection& section = mod.Sections[i];
+
+            if (address - (mod.Base + section.Offset) < section.Size)
+            {
+                return (int)i;
+            }
+        }
+
+        return -1;
+    }
+
+    int
+    MockTarget::FindSymbol(
+            int module,
+            uint64_t address) const
+    {
+        const std::vector<MockSymbol>& symbols = Modules[module].Symbols;
+
+        auto it = std::upper_bound(symbols.begin(), symbols.end(), address,
+            [](uint64_t value, const MockSymbol& symbol) { return value < symbol.Start; });
+
+        if (it == symbols.begin())
+        {
+            return -1;
+        }
+
+        --it;
+        return address - it->Start < it->Size ? (int)(it - symbols.begin()) : -1;
+    }
+
+    const MockMemoryBlock*
+    MockTarget::FindBlock(
+            uint64_t address) const
+    {
+        auto it = std::upper_bound(Memory.begin(), Memory.end(), address,
+            [](uint64_t value, const MockMemoryBlock& block) { return value < block.Start; });
+
+        if (it == Memory.begin())
+        {
+            return nullptr;
+        }
+
+        --it;
+        return address - it->Start < it->Size ? &*it : nullptr;
+    }
+
+    size_t
+    MockTarget::Read(
+            uint64_t address,
+            void* buffer,
+            size_t size) const
+    {
+        size_t read = 0;
+
+        while (read < size)
+        {
+            const MockMemoryBlock* block = FindBlock(address + read);
+            if (block == nullptr)
+            {
+                break;
+            }
+
+            uint64_t offset = address + read - block->Start;
+            size_t count = (size_t)std::min<uint64_t>(size - read, block->Size - offset);
+            uint8_t* destination = (uint8_t*)buffer + read;
+
+            if (!block->Bytes.empty())
+            {
+                memcpy(destination, block->Bytes.data() + offset, count);
+            }
+            else
+            {
+                for (size_t i = 0; i < count; i++)
+                {
+                    destination[i] = GeneratedByte(address + read + i);
+                }
+            }
+
+            read += count;
+        }
+
+        return read;
+    }
+
+    size_t
+    MockTarget::Write(
+            uint64_t address,
+            const void* buffer,
+            size_t size)
+    {
+        MockMemoryBlock* block = const_cast<MockMemoryBlock*>(FindBlock(address));
+
+        if (block == nullptr || block->Bytes.empty() || (block->Protection & MockWrite) == 0)
+        {
+            return 0;
+        }
+
+        size_t count = (size_t)std::min<uint64_t>(size, block->Size - (address - block->Start));
+        memcpy(block->Bytes.data() + (address - block->Start), buffer, count);
+
+        return count;
+    }
+
+    static MockModule
+    CreateModule(
+            int index,
+            int symbolCount)
+    {
+        char name[128];
+
+        MockModule module;
+        module.Directory = "/usr/share/dotnet/shared/Microsoft.NETCore.App/2.2.1";
+        snprintf(name, sizeof(name), "libmodule%04d.so", index);
+        module.Filename = name;
+        snprintf(name, sizeof(name), "%08X-0000-0000-0000-%012X", index, index);
+        module.Uuid = name;
+        module.Base = MockModuleStart + index * MockModuleSize;
+        module.Size = MockModuleSize;
+
+        module.Sections.push_back(MockSection{ ".text", MockTextOffset, MockTextSize, MockTextOffset, MockRead | MockExecute });
+        module.Sections.push_back(MockSection{ ".rodata", 0x201000, 0x80000, 0x201000, MockRead });
+        module.Sections.push_back(MockSection{ ".data", 0x300000, 0x40000, 0x281000, MockRead | MockWrite });
+        module.Sections.push_back(MockSection{ ".bss", 0x340000, 0x40000, 0, MockRead | MockWrite });
+
+        uint64_t symbolSize = MockTextSize / symbolCount;
+        module.Symbols.reserve(symbolCount);
+
+        for (int i = 0; i < symbolCount; i++)
+        {
+            snprintf(name, sizeof(name), "Namespace%d::Type%d::Method%d(int, void*)", index, i / 16, i);
+            module.Symbols.push_back(MockSymbol{ name, module.Base + MockTextOffset + i * symbolSize, symbolSize });
+        }
+
+        return module;
+    }
+
+    std::shared_ptr<MockTarget>
+    CreateMockTarget(
+            const MockTargetOptions& options)
+    {
+        std::shared_ptr<MockTarget> target = std::make_shared<MockTarget>();
+        std::mt19937_64 random(options.Seed);
+
+        for (int i = 0; i < options.Modules; i++)
+        {
+            target->Modules.push_back(CreateModule(i, options.SymbolsPerModule));
+
+            const MockModule& module = target->Modules.back();
+            for (const MockSection& section : module.Sections)
+            {
+                target->Memory.push_back(MockMemoryBlock{ module.Base + section.Offset, section.Size, section.Protection, {} });
+            }
+        }
+
+        MockMemoryBlock heap{ MockHeapStart, options.HeapSize, MockRead | MockWrite, std::vector<uint8_t>(options.HeapSize) };
+
+        // Mostly pointers into the heap, like a GC heap
+        uint64_t* words = (uint64_t*)heap.Bytes.data();
+        for (uint64_t i = 0; i < options.HeapSize / sizeof(uint64_t); i++)
+        {
+            words[i] = (i % 4) != 0 ? MockHeapStart + (random() % options.HeapSize & ~7ULL) : random();
+        }
+
+        target->Memory.push_back(std::move(heap));
+
+        for (int t = 0; t < options.Threads; t++)
+        {
+            MockThread thread;
+            thread.ThreadId = 10000 + t;
+            thread.IndexId = t + 1;
+
+            uint64_t stackBase = MockStackStart + (uint64_t)t * MockStackSize * 2;
+            target->Memory.push_back(MockMemoryBlock{ stackBase, MockStackSize, MockRead | MockWrite, {} });
+
+            uint64_t sp = stackBase + 0x100;
+            for (int f = 0; f < options.FramesPerThread && options.Modules > 0; f++)
+            {
+                const MockModule& module = target->Modules[random() % target->Modules.size()];
+                const MockSymbol& symbol = module.Symbols[random() % module.Symbols.size()];
+
+                uint64_t pc = symbol.Start + random() % symbol.Size;
+                thread.Frames.push_back(MockFrame{ pc, sp, sp + 0x10 });
+
+                sp += (MockStackSize - 0x200) / options.FramesPerThread;
+            }
+
+            target->Threads.push_back(std::move(thread));
+        }
+
+        std::sort(target->Memory.begin(), target->Memory.end(),
+            [](const MockMemoryBlock& left, const MockMemoryBlock& right) { return left.Start < right.Start; });
+
+        return target;
+    }
+}
@@ -0,0 +1,125 @@
+#ifndef __MOCKTARGET_H__
+#define __MOCKTARGET_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+//
+// Synthetic stopped process for the mock SB layer: modules with sections and
+// symbols, threads with their frames, and a memory image. Bytes not backed by
+// a buffer are generated from their address, so large targets stay cheap.
+//
+namespace lldb_mock
+{
+    enum MockProtection : uint32_t
+    {
+        MockRead = 0x1,
+        MockWrite = 0x2,
+        MockExecute = 0x4,
+    };
+
+    struct MockSection
+    {
+        std::string Name;
+        uint64_t Offset;        // From the module base
+        uint64_t Size;
+        uint64_t FileOffset;
+        uint32_t Protection;
+    };
+
+    struct MockSymbol
+    {
+        std::string Name;
+        uint64_t Start;         // Load address
+        uint64_t Size;
+    };
+
+    struct MockModule
+    {
+        std::string Directory;
+        std::string Filename;
+        std::string Uuid;
+        uint64_t Base;
+        uint64_t Size;
+        std::vector<MockSection> Sections;
+        std::vector<MockSymbol> Symbols;    // Sorted by address
+    };
+
+    struct MockFrame
+    {
+        uint64_t PC;
+        uint64_t SP;
+        uint64_t FP;
+    };
+
+    struct MockThread
+    {
+        uint64_t ThreadId;
+        uint32_t IndexId;
+        std::vector<MockFrame> Frames;
+    };
+
+    struct MockMemoryBlock
+    {
+        uint64_t Start;
+        uint64_t Size;
+        uint32_t Protection;
+        std::vector<uint8_t> Bytes;         // Empty: generated from the address
+    };
+
+    struct MockTarget
+    {
+        std::vector<MockModule> Modules;        // Sorted by base address
+        std::vector<MockThread> Threads;
+        std::vector<MockMemoryBlock> Memory;    // Sorted by address, disjoint
+        uint32_t SelectedThread = 0;
+        uint32_t StopId = 1;
+        uint32_t UniqueId = 1;
+        // No live process behind the mock: keeps the memory readers on the SB path
+        uint64_t ProcessId = 0;
+        // Simulated cost of each SBProcess::ReadMemory call (a gdb-remote round trip)
+        uint64_t ReadLatencyNs = 0;
+
+        // Index of the module containing the address, -1 if none
+        int FindModule(uint64_t address) const;
+
+        // Index of the section of the module containing the address, -1 if none
+        int FindSection(int module, uint64_t address) const;
+
+        // Index of the symbol of the module containing the address, -1 if none
+        int FindSymbol(int module, uint64_t address) const;
+
+        const MockMemoryBlock* FindBlock(uint64_t address) const;
+
+        // Stops at the first unmapped byte, like SBProcess::ReadMemory
+        size_t Read(uint64_t address, void* buffer, size_t size) const;
+
+        size_t Write(uint64_t address, const void* buffer, size_t size);
+    };
+
+    struct MockTargetOptions
+    {
+        int Modules = 1000;
+        int SymbolsPerModule = 500;
+        int Threads = 10000;
+        int FramesPerThread = 100;
+        uint64_t HeapSize = 64 * 1024 * 1024;
+        uint32_t Seed = 42;
+    };
+
+    // Typical layout of a .NET process: mapped images, a GC heap backed by real bytes, and one stack per thread
+    std::shared_ptr<MockTarget> CreateMockTarget(const MockTargetOptions& options);
+
+    const uint64_t MockModuleStart = 0x7f0000000000;
+    const uint64_t MockModuleSize = 0x400000;
+    const uint64_t MockTextOffset = 0x1000;
+    const uint64_t MockTextSize = 0x200000;
+    const uint64_t MockHeapStart = 0x7e0000000000;
+    const uint64_t MockStackStart = 0x7d0000000000;
+    const uint64_t MockStackSize = 0x10000;
+}
+
+#endif // __MOCKTARGET_H__
@@ -0,0 +1,94 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Runtime.CompilerServices;
+using System.Threading;
+
+namespace DumpTarget
+{
+    /// <summary>
+    /// Deterministic workload dumped by replay.py: the same object graph and thread stacks on every run,
+    /// so the benchmark results only depend on the code being measured.
+    /// </summary>
+    public class Node
+    {
+        public int Id;
+        public string Name;
+        public Node Left;
+        public Node Right;
+        public byte[] Payload;
+    }
+
+    public static class Program
+    {
+        private const int NodeCount = 1_000_000;
+        private const int ThreadCount = 64;
+        private const int StackDepth = 50;
+
+        private static readonly ManualResetEventSlim Exit = new ManualResetEventSlim();
+        private static readonly List<object> Roots = new List<object>();
+
+        public static void Main()
+        {
+            var random = new Random(42);
+            var nodes = new Node[NodeCount];
+
+            for (int i = 0; i < NodeCount; i++)
+            {
+                nodes[i] = new Node
+                {
+                    Id = i,
+                    Name = "Node" + i,
+                    Payload = new byte[random.Next(0, 256)]
+                };
+
+                if (i > 0)
+                {
+                    var parent = nodes[(i - 1) / 2];
+
+                    if (i % 2 == 1)
+                    {
+                        parent.Left = nodes[i];
+                    }
+                    else
+                    {
+                        parent.Right = nodes[i];
+                    }
+                }
+            }
+
+            Roots.Add(nodes[0]);
+
+            using (var ready = new CountdownEvent(ThreadCount))
+            {
+                for (int i = 0; i < ThreadCount; i++)
+                {
+                    new Thread(() => Recurse(StackDepth, ready)) { IsBackground = true, Name = "Worker" + i }.Start();
+                }
+
+                ready.Wait();
+            }
+
+            Console.WriteLine("READY {0}", Process.GetCurrentProcess().Id);
+            Console.Out.Flush();
+
+            Exit.Wait();
+        }
+
+        [MethodImpl(MethodImplOptions.NoInlining)]
+        private static void Recurse(int depth, CountdownEvent ready)
+        {
+            if (depth == 0)
+            {
+                ready.Signal();
+                Exit.Wait();
+                return;
+            }
+
+            Recurse(depth - 1, ready);
+
+            // Not a tail call: keeps every frame on the stack
+            GC.KeepAlive(ready);
+        }
+    }
+}
@@ -0,0 +1,264 @@
+#!/usr/bin/env python3
+"""
+End-to-end replay benchmark of the managed commands.
+
+Loads a .NET core dump in lldb (through its Python module, in this process),
+loads libloadmanaged.so and a managed plugin, then runs a fixed script of
+commands and records for each one the wall time, the RSS of the process
+hosting lldb and the CLR, and the ILLDBServices calls it made
+(LoadManagedStats --json). The results are written as a single JSON document
+so they can be compared across releases.
+
+    replay.py --plugin-library build/lib/libloadmanaged.so \\
+              --plugin MyPlugin.dll --core core.1234 [--script commands.txt]
+
+Without --core, a dump of DumpTarget (a small deterministic workload) is
+generated with createdump, so the runs are reproducible on any machine with
+the same runtime.
+"""
+
+import argparse
+import json
+import os
+import platform
+import shutil
+import subprocess
+import sys
+import time
+
+SCHEMA_VERSION = 1
+SCRIPT_DIRECTORY = os.path.dirname(os.path.abspath(__file__))
+
+
+def import_lldb():
+    try:
+        import lldb
+        return lldb
+    except ImportError:
+        pass
+
+    # lldb -P prints the directory of its Python module
+    try:
+        path = subprocess.check_output(["lldb", "-P"], universal_newlines=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        sys.exit("error: the lldb Python module is not available (is lldb installed?)")
+
+    sys.path.insert(0, path)
+    import lldb
+    return lldb
+
+
+def read_memory_status():
+    """Returns the current and peak RSS of this process, in KB"""
+    values = {}
+
+    with open("/proc/self/status") as status:
+        for line in status:
+            key, _, value = line.partition(":")
+            if key in ("VmRSS", "VmHWM"):
+                values[key] = int(value.split()[0])
+
+    return values.get("VmRSS", 0), values.get("VmHWM", 0)
+
+
+def read_script(path):
+    commands = []
+
+    with open(path) as script:
+        for line in script:
+            line = line.strip()
+            if line and not line.startswith("#"):
+                commands.append(line)
+
+    return commands
+
+
+def generate_core(clr_path, dotnet, directory):
+    """Builds and runs DumpTarget, and dumps it with the createdump of the runtime"""
+    createdump = os.path.join(clr_path, "createdump")
+    if not os.path.exists(createdump):
+        sys.exit("error: createdump not found in %s" % clr_path)
+
+    os.makedirs(directory, exist_ok=True)
+    output = os.path.join(directory, "DumpTarget")
+
+    subprocess.check_call(
+        [dotnet, "build", "-c", "Release", "-o", output, os.path.join(SCRIPT_DIRECTORY, "DumpTarget")],
+        stdout=subprocess.DEVNULL)
+
+    target = subprocess.Popen([dotnet, os.path.join(output, "DumpTarget.dll")], stdout=subprocess.PIPE, universal_newlines=True)
+
+    try:
+        # The workload prints its pid once its heap and threads are set up
+        line = target.stdout.readline().split()
+        if len(line) != 2 or line[0] != "READY":
+            sys.exit("error: DumpTarget failed to start")
+
+        core = os.path.join(directory, "DumpTarget.core")
+        subprocess.check_call([createdump, "--withheap", "-f", core, line[1]], stdout=subprocess.DEVNULL)
+    finally:
+        target.kill()
+        target.wait()
+
+    return core
+
+
+class Replay:
+    def __init__(self, lldb, args):
+        self.lldb = lldb
+        self.args = args
+        self.debugger = lldb.SBDebugger.Create()
+        self.debugger.SetAsync(False)
+        self.interpreter = self.debugger.GetCommandInterpreter()
+
+    def run(self, command):
+        result = self.lldb.SBCommandReturnObject()
+        self.interpreter.HandleCommand(command, result)
+        return result
+
+    def run_checked(self, command):
+        result = self.run(command)
+        if not result.Succeeded():
+            sys.exit("error: '%s' failed: %s" % (command, result.GetError()))
+        return result
+
+    def service_calls(self):
+        output = self.run("LoadManagedStats --json").GetOutput()
+
+        try:
+            return json.loads(output)["methods"]
+        except (ValueError, KeyError):
+            return None
+
+    def measure(self, command):
+        self.run("LoadManagedStats reset")
+
+        start = time.perf_counter()
+        result = self.run(command)
+        elapsed = time.perf_counter() - start
+
+        rss, peak = read_memory_status()
+
+        return {
+            "command": command,
+            "succeeded": result.Succeeded(),
+            "wall_ms": round(elapsed * 1000, 3),
+            "rss_kb": rss,
+            "peak_rss_kb": peak,
+            "service_calls": self.service_calls(),
+        }
+
+    def load(self, core):
+        target = self.debugger.CreateTarget(self.args.host)
+        if not target.IsValid():
+            sys.exit("error: failed to create a target for %s" % self.args.host)
+
+        start = time.perf_counter()
+        process = target.LoadCore(core)
+        if not process.IsValid():
+            sys.exit("error: failed to load %s" % core)
+        load_core = time.perf_counter() - start
+
+        self.run_checked("plugin load %s" % self.args.plugin_library)
+        self.run_checked("SetClrPath %s" % self.args.clr_path)
+        self.run_checked("LoadManagedStats on")
+
+        if self.args.trace:
+            self.run_checked("LoadManagedTrace on")
+
+        # Includes the CLR startup
+        load_plugin = self.measure("LoadManaged %s" % self.args.plugin)
+        if not load_plugin["succeeded"]:
+            sys.exit("error: failed to load %s" % self.args.plugin)
+
+        return {"load_core_ms": round(load_core * 1000, 3), "load_plugin": load_plugin}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Replays a script of managed commands on a core dump and reports their cost as JSON")
+    parser.add_argument("--plugin-library", required=True, help="path to libloadmanaged.so")
+    parser.add_argument("--plugin", required=True, help="managed plugin to load with LoadManaged")
+    parser.add_argument("--core", help="core dump to replay (generated from DumpTarget if omitted)")
+    parser.add_argument("--script", default=os.path.join(SCRIPT_DIRECTORY, "commands.txt"), help="commands to run, one per line")
+    parser.add_argument("--clr-path", default=None, help="directory of the runtime used to host the plugin")
+    parser.add_argument("--host", default=None, help="executable of the dumped process (default: dotnet)")
+    parser.add_argument("--repeat", type=int, default=3, help="number of measured runs of the script")
+    parser.add_argument("--warmup", type=int, default=1, help="number of runs of the script before measuring")
+    parser.add_argument("--output", default="-", help="where to write the JSON results (default: stdout)")
+    parser.add_argument("--log", default=os.devnull, help="where to send the output of the commands")
+    parser.add_argument("--trace", help="also save a Chrome trace of the measured runs to this file")
+    parser.add_argument("--work-directory", default=os.path.join(os.getcwd(), "replay"), help="where to generate the core dump")
+    args = parser.parse_args()
+
+    dotnet = shutil.which("dotnet")
+    args.host = args.host or dotnet
+
+    if args.clr_path is None:
+        if dotnet is None:
+            sys.exit("error: dotnet not found, use --clr-path")
+        runtimes = subprocess.check_output([dotnet, "--list-runtimes"], universal_newlines=True)
+        # "Microsoft.NETCore.App 2.2.1 [/usr/share/dotnet/shared/Microsoft.NETCore.App]"
+        app = [line.split() for line in runtimes.splitlines() if line.startswith("Microsoft.NETCore.App ")][-1]
+        args.clr_path = os.path.join(app[2].strip("[]"), app[1])
+
+    core = args.core or generate_core(args.clr_path, dotnet, args.work_directory)
+    commands = read_script(args.script)
+
+    lldb = import_lldb()
+    lldb.SBDebugger.Initialize()
+
+    # The managed commands write straight to fd 1, keep it for the results
+    results_stream = os.fdopen(os.dup(1), "w") if args.output == "-" else open(args.output, "w")
+
+    log = os.open(args.log, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o644)
+    sys.stdout.flush()
+    os.dup2(log, 1)
+
+    replay = Replay(lldb, args)
+    report = {
+        "schema": SCHEMA_VERSION,
+        "timestamp": time.strftime("%Y-%m-%dT%H:%M:%SZ", time.gmtime()),
+        "machine": {"hostname": platform.node(), "cpus": os.cpu_count(), "python": platform.python_version()},
+        "lldb": lldb.SBDebugger.GetVersionString().splitlines()[0],
+        "core": os.path.abspath(core),
+        "plugin": os.path.abspath(args.plugin),
+        "clr_path": args.clr_path,
+        "script": os.path.abspath(args.script),
+    }
+
+    report.update(replay.load(core))
+
+    for _ in range(args.warmup):
+        for command in commands:
+            replay.run(command)
+
+    if args.trace:
+        replay.run_checked("LoadManagedTrace clear")
+
+    runs = []
+    for iteration in range(args.repeat):
+        runs.append([dict(replay.measure(command), iteration=iteration) for command in commands])
+
+    report["runs"] = runs
+
+    # Median wall time per command, the figure to track across releases
+    summary = {}
+    for index, command in enumerate(commands):
+        times = sorted(run[index]["wall_ms"] for run in runs)
+        if times:
+            summary[command] = {"median_wall_ms": times[len(times) // 2], "min_wall_ms": times[0], "max_wall_ms": times[-1]}
+    report["summary"] = summary
+
+    if args.trace:
+        replay.run_checked("LoadManagedTrace save %s" % os.path.abspath(args.trace))
+
+    json.dump(report, results_stream, indent=2)
+    results_stream.write("\n")
+    results_stream.flush()
+
+    lldb.SBDebugger.Destroy(replay.debugger)
+    lldb.SBDebugger.Terminate()
+
+
+if __name__ == "__main__":
+    main()
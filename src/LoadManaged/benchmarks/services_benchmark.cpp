@@ -0,0 +1,403 @@
+//
+// Microbenchmarks of LLDBServices against the mock SB layer, at the scale of
+// a large .NET dump: 1k modules, 10k threads of 100 frames.
+//
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "mocktarget.h"
+#include "sosplugin.h"
+
+using namespace lldb_mock;
+
+namespace
+{
+    const size_t ChainNodeSize = 64;
+    const ULONG ChainNextOffset = 8;
+    const ULONG ChainLength = 64 * 1024;
+
+    struct ServicesFixture
+    {
+        std::shared_ptr<MockTarget> Target;
+        lldb::SBDebugger Debugger;
+        lldb::SBCommandReturnObject Result;
+        LLDBServices* Services;
+
+        ServicesFixture() :
+                Target(CreateMockTarget(MockTargetOptions())),
+                Debugger(Target)
+        {
+            Services = new LLDBServices(Debugger, Result);
+        }
+
+        // Random addresses in the code of the modules, like the IPs of the stack walks
+        std::vector<uint64_t> GetCodeAddresses(size_t count)
+        {
+            std::mt19937_64 random(count);
+            std::vector<uint64_t> addresses(count);
+
+            for (uint64_t& address : addresses)
+            {
+                const MockModule& module = Target->Modules[random() % Target->Modules.size()];
+                address = module.Base + MockTextOffset + random() % MockTextSize;
+            }
+
+            return addresses;
+        }
+
+        // Random pointer-aligned addresses in the heap, like the objects of a heap walk
+        std::vector<uint64_t> GetHeapAddresses(size_t count)
+        {
+            std::mt19937_64 random(count);
+            std::vector<uint64_t> addresses(count);
+
+            for (uint64_t& address : addresses)
+            {
+                address = MockHeapStart + (random() % (MockTargetOptions().HeapSize - 64) & ~7ULL);
+            }
+
+            return addresses;
+        }
+
+        // Linked list of count 64-byte nodes shuffled in the heap, the next pointer is at offset 8
+        uint64_t CreateChain(size_t count)
+        {
+            std::mt19937_64 random(count);
+            std::vector<uint64_t> nodes(count);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                nodes[i] = MockHeapStart + MockTargetOptions().HeapSize / 2 + i * ChainNodeSize;
+            }
+
+            std::shuffle(nodes.begin(), nodes.end(), random);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                ULONG64 next = i + 1 < count ? nodes[i + 1] : 0;
+                Services->WriteVirtual(nodes[i] + ChainNextOffset, &next, sizeof(next), NULL);
+            }
+
+            return nodes[0];
+        }
+    };
+
+    ServicesFixture&
+    GetFixture()
+    {
+        static ServicesFixture fixture;
+        return fixture;
+    }
+
+    const size_t AddressCount = 4096;
+}
+
+static void
+BM_ReadVirtual(benchmark::State& state)
+{
+    ServicesFixture& fixture = GetFixture();
+    const ULONG size = (ULONG)state.range(0);
+
+    std::mt19937_64 random(size);
+    std::vector<uint64_t> offsets(AddressCount);
+    for (uint64_t& offset : offsets)
+    {
+        offset = MockHeapStart + (random() % (MockTargetOptions().HeapSize - size) & ~7ULL);
+    }
+
+    std::vector<uint8_t> buffer(size);
+    size_t i = 0;
+
+    for (auto _ : state)
+    {
+        ULONG read;
+        fixture.Services->ReadVirtual(offsets[i++ % AddressCount], buffer.data(), size, &read);
+        benchmark::DoNotOptimize(read);
+    }
+
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_ReadVirtual)->Arg(8)->Arg(4096)->Arg(64 * 1024);
+
+static void
+BM_ReadVirtualSequential(benchmark::State& state)
+{
+    ServicesFixture& fixture = GetFixture();
+    const ULONG size = (ULONG)state.range(0);
+    uint64_t offset = MockHeapStart;
+    std::vector<uint8_t> buffer(size);
+
+    fixture.Target->ReadLatencyNs = state.range(1);
+
+    // Starts from a cold page cache, as after a stop
+    fixture.Target->StopId++;
+
+    for (auto _ : state)
+    {
+        ULONG read;
+        fixture.Services->ReadVirtual(offset, buffer.data(), size, &read);
+        benchmark::DoNotOptimize(read);
+
+        // Objects of varying sizes, in ascending order like a heap walk
+        offset += size + (offset & 0x18);
+        if (offset + size > MockHeapStart + MockTargetOptions().HeapSize)
+        {
+            offset = MockHeapStart;
+        }
+    }
+
+    fixture.Target->ReadLatencyNs = 0;
+
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_ReadVirtualSequential)->Args({ 24, 0 })->Args({ 256, 0 })->Args({ 24, 20000 })->Args({ 256, 20000 })->UseRealTime();
+
+// MethodTable-like layout: flags, base size, parent and module pointers
+const DEBUG_STRUCT_FIELD ObjectFields[] = { { 0, 4 }, { 4, 4 }, { 16, 8 }, { 32, 8 } };
+
+static void
+BM_ReadStructFields(benchmark::State& state)
+{
+    ServicesFixture& fixture = GetFixture();
+    std::vector<uint64_t> addresses = fixture.GetHeapAddresses(AddressCount);
+    uint8_t record[24];
+    size_t i = 0;
+
+    for (auto _ : state)
+    {
+        uint64_t address = addresses[i++ % AddressCount];
+        uint8_t* field = record;
+
+        for (const DEBUG_STRUCT_FIELD& objectField : ObjectFields)
+        {
+            fixture.Services->ReadVirtual(address + objectField.Offset, field, objectField.Size, NULL);
+            field += objectField.Size;
+        }
+
+        benchmark::DoNotOptimize(record);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReadStructFields);
+
+static void
+BM_ReadStructs(benchmark::State& state)
+{
+    ServicesFixture& fixture = GetFixture();
+    const ULONG count = (ULONG)state.range(0);
+    std::vector<uint64_t> addresses = fixture.GetHeapAddresses(count);
+
+    ULONG layoutId, recordSize;
+    fixture.Services->RegisterStructLayout(ObjectFields, sizeof(ObjectFields) / sizeof(ObjectFields[0]), &layoutId, &recordSize);
+
+    std::vector<uint8_t> records(count * recordSize);
+
+    for (auto _ : state)
+    {
+        HRESULT hr = fixture.Services->ReadStructs(layoutId, addresses.data(), count, records.data(), records.size(), NULL);
+        benchmark::DoNotOptimize(hr);
+    }
+
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_ReadStructs)->Arg(64)->Arg(64 * 1024)->UseRealTime();
+
+static void
+BM_WalkChainReadVirtual(benchmark::State& state)
+{
+    ServicesFixture& fixture = GetFixture();
+    uint64_t start = fixture.CreateChain(ChainLength);
+
+    for (auto _ : state)
+    {
+        uint64_t node = start;
+        ULONG count = 0;
+
+        while (node != 0)
+        {
+            fixture.Services->ReadVirtual(node + ChainNextOffset, &node, sizeof(node), NULL);
+            count++;
+        }
+
+        benchmark::DoNotOptimize(count);
+    }
+
+    state.SetItemsProcessed(state.iterations() * ChainLength);
+}
+BENCHMARK(BM_WalkChainReadVirtual);
+
+static void
+BM_WalkChain(benchmark::State& state)
+{
+    ServicesFixture& fixture = GetFixture();
+    uint64_t start = fixture.CreateChain(ChainLength);
+    std::vector<ULONG64> nodes(ChainLength);
+
+    for (auto _ : state)
+    {
+        ULONG count;
+        fixture.Services->WalkChain(start, ChainNextOffset, NULL, 0, ChainLength, nodes.data(), NULL, &count, NULL, NULL);
+        benchmark::DoNotOptimize(count);
+    }
+
+    state.SetItemsProcessed(state.iterations() * ChainLength);
+}
+BENCHMARK(BM_WalkChain);
+
+static void
+BM_GetModuleByOffset(benchmark::State& state)
+{
+    ServicesFixture& fixture = GetFixture();
+    std::vector<uint64_t> addresses = fixture.GetCodeAddresses(AddressCount);
+    size_t i = 0;
+
+    for (auto _ : state)
+    {
+        ULONG index;
+        ULONG64 base;
+        fixture.Services->GetModuleByOffset(addresses[i++ % AddressCount], 0, &index, &base);
+        benchmark::DoNotOptimize(base);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetModuleByOffset);
+
+static void
+BM_GetModuleByModuleName(benchmark::State& state)
+{
+    ServicesFixture& fixture = GetFixture();
+    std::vector<std::string> names;
+    std::mt19937_64 random(AddressCount);
+
+    for (size_t i = 0; i < AddressCount; i++)
+    {
+        names.push_back(fixture.Target->Modules[random() % fixture.Target->Modules.size()].Filename);
+    }
+
+    size_t i = 0;
+
+    for (auto _ : state)
+    {
+        ULONG index;
+        ULONG64 base;
+        fixture.Services->GetModuleByModuleName(names[i++ % AddressCount].c_str(), 0, &index, &base);
+        benchmark::DoNotOptimize(base);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetModuleByModuleName);
+
+static void
+BM_GetNameByOffset(benchmark::State& state)
+{
+    ServicesFixture& fixture = GetFixture();
+    std::vector<uint64_t> addresses = fixture.GetCodeAddresses(AddressCount);
+    char name[1024];
+    size_t i = 0;
+
+    for (auto _ : state)
+    {
+        ULONG nameSize;
+        ULONG64 displacement;
+        fixture.Services->GetNameByOffset(addresses[i++ % AddressCount], name, sizeof(name), &nameSize, &displacement);
+        benchmark::DoNotOptimize(displacement);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetNameByOffset);
+
+static void
+BM_GetContextStackTrace(benchmark::State& state)
+{
+    ServicesFixture& fixture = GetFixture();
+    const ULONG frameCount = (ULONG)MockTargetOptions().FramesPerThread;
+
+    std::vector<DEBUG_STACK_FRAME> frames(frameCount + 1);
+    std::vector<DT_CONTEXT> contexts(frameCount + 1);
+    uint32_t thread = 0;
+
+    for (auto _ : state)
+    {
+        fixture.Target->SelectedThread = thread++ % fixture.Target->Threads.size();
+
+        ULONG filled;
+        fixture.Services->GetContextStackTrace(NULL, 0, frames.data(), frameCount, contexts.data(), contexts.size() * sizeof(DT_CONTEXT), sizeof(DT_CONTEXT), &filled);
+        benchmark::DoNotOptimize(filled);
+    }
+
+    state.SetItemsProcessed(state.iterations() * frameCount);
+}
+BENCHMARK(BM_GetContextStackTrace);
+
+static void
+BM_GetAllThreadStacks(benchmark::State& state)
+{
+    ServicesFixture& fixture = GetFixture();
+    ULONG flags = (ULONG)state.range(0);
+    int64_t frames = 0;
+
+    for (auto _ : state)
+    {
+        PDEBUG_THREAD_STACKS stacks;
+        fixture.Services->GetAllThreadStacks(0, flags, &stacks);
+        frames += stacks->FrameCount;
+        fixture.Services->ReleaseThreadStacks(stacks);
+    }
+
+    state.SetItemsProcessed(frames);
+}
+BENCHMARK(BM_GetAllThreadStacks)->Arg(0)->Arg(DEBUG_THREAD_STACKS_SYMBOLS)->Arg(DEBUG_THREAD_STACKS_CONTEXTS | DEBUG_THREAD_STACKS_SYMBOLS);
+
+static void
+BM_GetThreadIdBySystemId(benchmark::State& state)
+{
+    ServicesFixture& fixture = GetFixture();
+    std::mt19937 random(1);
+    size_t i = 0;
+
+    std::vector<ULONG> systemIds(AddressCount);
+    for (ULONG& systemId : systemIds)
+    {
+        systemId = (ULONG)fixture.Target->Threads[random() % fixture.Target->Threads.size()].ThreadId;
+    }
+
+    for (auto _ : state)
+    {
+        ULONG threadId;
+        fixture.Services->GetThreadIdBySystemId(systemIds[i++ % AddressCount], &threadId);
+        benchmark::DoNotOptimize(threadId);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetThreadIdBySystemId);
+
+static void
+BM_Disassemble(benchmark::State& state)
+{
+    ServicesFixture& fixture = GetFixture();
+    std::vector<uint64_t> addresses = fixture.GetCodeAddresses(AddressCount);
+    char buffer[256];
+    size_t i = 0;
+
+    for (auto _ : state)
+    {
+        ULONG size;
+        ULONG64 end;
+        fixture.Services->Disassemble(addresses[i++ % AddressCount], 0, buffer, sizeof(buffer), &size, &end);
+        benchmark::DoNotOptimize(end);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Disassemble);
+
+BENCHMARK_MAIN();
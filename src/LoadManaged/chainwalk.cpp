@@ -0,0 +1,138 @@
+#include "chainwalk.h"
+
+#include <vector>
+
+// Nodes walked between two checks of the interrupt flag
+const size_t ChainInterruptInterval = 4096;
+
+namespace
+{
+    // Open addressing set of the visited nodes. std::unordered_set allocates
+    // a node per insertion, which cost more than reading the chain itself.
+    class NodeSet
+    {
+    private:
+        // 0 marks an empty slot, the walk never visits address 0
+        std::vector<uint64_t> m_slots;
+        size_t m_count;
+
+        // Fibonacci hashing keeps the top bits of the product
+        unsigned m_shift;
+
+        void
+        Grow()
+        {
+            std::vector<uint64_t> slots(m_slots.size() * 2);
+            std::swap(slots, m_slots);
+            m_count = 0;
+            m_shift--;
+
+            for (uint64_t node : slots)
+            {
+                if (node != 0)
+                {
+                    Insert(node);
+                }
+            }
+        }
+
+    public:
+        NodeSet() :
+                m_slots(1024),
+                m_count(0),
+                m_shift(64 - 10)
+        {
+        }
+
+        // Returns false if the node was already in the set
+        bool
+        Insert(
+                uint64_t node)
+        {
+            // Keeps the load factor under 1/2
+            if (m_count * 2 >= m_slots.size())
+            {
+                Grow();
+            }
+
+            size_t mask = m_slots.size() - 1;
+
+            for (size_t slot = (node * 0x9E3779B97F4A7C15ULL) >> m_shift; ; slot = (slot + 1) & mask)
+            {
+                if (m_slots[slot] == node)
+                {
+                    return false;
+                }
+
+                if (m_slots[slot] == 0)
+                {
+                    m_slots[slot] = node;
+                    m_count++;
+                    return true;
+                }
+            }
+        }
+    };
+}
+
+ChainEnd
+WalkChain(
+        PageCache& cache,
+        uint64_t start,
+        const ChainLayout& layout,
+        size_t maxNodes,
+        uint64_t* nodes,
+        uint64_t* payloads,
+        size_t* nodeCount,
+        uint64_t* next,
+        const std::atomic<int>* interrupt)
+{
+    NodeSet visited;
+    uint64_t node = start;
+    size_t count = 0;
+    ChainEnd end = ChainEnd::Null;
+
+    while (node != 0)
+    {
+        if (count == maxNodes)
+        {
+            end = ChainEnd::Limit;
+            break;
+        }
+
+        if (count % ChainInterruptInterval == 0 && interrupt->load(std::memory_order_relaxed) != 0)
+        {
+            end = ChainEnd::Interrupted;
+            break;
+        }
+
+        if (!visited.Insert(node))
+        {
+            end = ChainEnd::Cycle;
+            break;
+        }
+
+        uint64_t nodeNext;
+        bool readable = cache.ReadPointer(node + layout.NextOffset, nodeNext);
+
+        uint64_t* nodePayloads = payloads + count * layout.PayloadCount;
+
+        for (size_t i = 0; i < layout.PayloadCount && readable; i++)
+        {
+            readable = cache.ReadPointer(node + layout.PayloadOffsets[i], nodePayloads[i]);
+        }
+
+        if (!readable)
+        {
+            end = ChainEnd::Unreadable;
+            break;
+        }
+
+        nodes[count++] = node;
+        node = nodeNext;
+    }
+
+    *nodeCount = count;
+    *next = node;
+    return end;
+}
@@ -0,0 +1,48 @@
+#ifndef __CHAINWALK_H__
+#define __CHAINWALK_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "pagecache.h"
+
+enum class ChainEnd
+{
+    // The next pointer of the last node is null
+    Null,
+    // maxNodes nodes were walked, the chain may continue at next
+    Limit,
+    // next points back to a node already walked
+    Cycle,
+    // The next pointer or a payload of the node at next can't be read
+    Unreadable,
+    Interrupted
+};
+
+struct ChainLayout
+{
+    // Offset of the pointer to the next node
+    uint32_t NextOffset;
+
+    // Offsets of the pointer-sized words returned for each node
+    const uint32_t* PayloadOffsets;
+    size_t PayloadCount;
+};
+
+//
+// Follows the next pointers from start, storing the address of each node in
+// nodes and its payload words in payloads (PayloadCount per node), up to
+// maxNodes nodes. next receives the pointer that wasn't followed.
+//
+ChainEnd WalkChain(
+        PageCache& cache,
+        uint64_t start,
+        const ChainLayout& layout,
+        size_t maxNodes,
+        uint64_t* nodes,
+        uint64_t* payloads,
+        size_t* nodeCount,
+        uint64_t* next,
+        const std::atomic<int>* interrupt);
+
+#endif // __CHAINWALK_H__
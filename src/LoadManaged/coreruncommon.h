@@ -3,6 +3,7 @@
 // See the LICENSE file in the project root for more information.
 
 #include "lldbservices.h"
+#include <cstdint>
 #include <string>
 
 #ifndef CORERUNCOMMON_H
@@ -45,9 +46,20 @@ void AddFilesFromDirectoryToTpaList(const char* directory, std::string& tpaList)
 //
 
 typedef char* (LoadPluginFunc)(const char *path);
+typedef char* (LoadPluginsFunc)(const char *paths);
+typedef int (UnloadPluginFunc)(const char *pluginName);
+typedef char* (ReloadPluginFunc)(const char *pluginName);
+typedef int (IsPluginModifiedFunc)(const char *pluginName);
 typedef int (GetExportCountFunc)(const char *pluginName);
 typedef char* (GetExportNameFunc)(const char *pluginName, int index);
-typedef void (InvokeFunc)(const char* pluginName, const char* commandName, ILLDBServices* services, const char *args);
+// Argument of a managed command, read as a ReadOnlySpan<byte> of UTF-8 by the managed side
+struct CommandArgument
+{
+    const char* Data;
+    uint64_t Length;
+};
+
+typedef void (InvokeFunc)(const char* pluginName, const char* commandName, ILLDBServices* services, const CommandArgument* argv, int argc, const int *interruptFlag);
 
 
 static const char * const coreClrDll = "libcoreclr.so";
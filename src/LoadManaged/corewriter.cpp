@@ -0,0 +1,529 @@
+#include "corewriter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <elf.h>
+#include <memory>
+#include <mutex>
+#include <sys/procfs.h>
+#include <utility>
+#include <vector>
+#include "memoryreader.h"
+#include "regionmap.h"
+#include "sosplugin.h"
+
+namespace
+{
+    const size_t PageSize = MemorySnapshot::PageSize;
+
+#if defined(__x86_64__)
+    const uint16_t CoreMachine = EM_X86_64;
+
+    // Order of user_regs_struct
+    const char* const CoreRegisterNames[] =
+    {
+        "r15", "r14", "r13", "r12", "rbp", "rbx", "r11", "r10", "r9", "r8",
+        "rax", "rcx", "rdx", "rsi", "rdi", "orig_rax", "rip", "cs", "rflags", "rsp",
+        "ss", "fs_base", "gs_base", "ds", "es", "fs", "gs"
+    };
+#elif defined(__aarch64__)
+    const uint16_t CoreMachine = EM_AARCH64;
+
+    // Order of user_pt_regs
+    const char* const CoreRegisterNames[] =
+    {
+        "x0", "x1", "x2", "x3", "x4", "x5", "x6", "x7", "x8", "x9",
+        "x10", "x11", "x12", "x13", "x14", "x15", "x16", "x17", "x18", "x19",
+        "x20", "x21", "x22", "x23", "x24", "x25", "x26", "x27", "x28", "fp",
+        "lr", "sp", "pc", "cpsr"
+    };
+#else
+#error Unsupported architecture
+#endif
+
+    static_assert(sizeof(CoreRegisterNames) / sizeof(CoreRegisterNames[0]) == sizeof(elf_gregset_t) / sizeof(elf_greg_t),
+        "the register names must match the layout of elf_gregset_t");
+
+    struct FileMapping
+    {
+        uint64_t Start;
+        uint64_t End;
+        uint64_t PageOffset;
+        std::string Path;
+    };
+
+    // Run of contiguous pages, the last one may be partially readable
+    struct LoadSegment
+    {
+        uint64_t Address;
+        uint64_t Size;
+        uint32_t Flags;
+        size_t FirstPage;
+        size_t PageCount;
+    };
+
+    uint64_t
+    AlignUp(
+            uint64_t value,
+            uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    void
+    Append(
+            std::vector<uint8_t>& buffer,
+            const void* data,
+            size_t size)
+    {
+        const uint8_t* bytes = (const uint8_t*)data;
+        buffer.insert(buffer.end(), bytes, bytes + size);
+        buffer.resize(AlignUp(buffer.size(), 4));
+    }
+
+    void
+    AppendNote(
+            std::vector<uint8_t>& notes,
+            uint32_t type,
+            const void* data,
+            size_t size)
+    {
+        static const char Name[] = "CORE";
+
+        Elf64_Nhdr header;
+        header.n_namesz = sizeof(Name);
+        header.n_descsz = (Elf64_Word)size;
+        header.n_type = type;
+
+        Append(notes, &header, sizeof(header));
+        Append(notes, Name, sizeof(Name));
+        Append(notes, data, size);
+    }
+
+    std::string
+    GetPath(
+            const lldb::SBFileSpec& fileSpec)
+    {
+        char path[PATH_MAX];
+
+        if (!fileSpec.IsValid() || fileSpec.GetPath(path, sizeof(path)) == 0)
+        {
+            return std::string();
+        }
+
+        return path;
+    }
+
+    void
+    AppendThreadNotes(
+            lldb::SBProcess process,
+            std::vector<uint8_t>& notes)
+    {
+        uint32_t numThreads = process.GetNumThreads();
+
+        for (uint32_t i = 0; i < numThreads; i++)
+        {
+            lldb::SBThread thread = process.GetThreadAtIndex(i);
+            lldb::SBFrame frame = thread.GetFrameAtIndex(0);
+
+            struct elf_prstatus status;
+            memset(&status, 0, sizeof(status));
+            status.pr_pid = (pid_t)thread.GetThreadID();
+            status.pr_ppid = (pid_t)process.GetProcessID();
+
+            for (size_t r = 0; r < sizeof(CoreRegisterNames) / sizeof(CoreRegisterNames[0]); r++)
+            {
+                // Registers lldb doesn't know about (orig_rax on some versions) are left to 0
+                lldb::SBValue value = frame.FindRegister(CoreRegisterNames[r]);
+                if (value.IsValid())
+                {
+                    lldb::SBError error;
+                    status.pr_reg[r] = value.GetValueAsUnsigned(error);
+                }
+            }
+
+            AppendNote(notes, NT_PRSTATUS, &status, sizeof(status));
+        }
+    }
+
+    void
+    AppendProcessNote(
+            lldb::SBProcess process,
+            lldb::SBTarget target,
+            std::vector<uint8_t>& notes)
+    {
+        struct elf_prpsinfo info;
+        memset(&info, 0, sizeof(info));
+        info.pr_sname = 'T';
+        info.pr_pid = (pid_t)process.GetProcessID();
+
+        lldb::SBFileSpec executable = target.GetExecutable();
+        if (executable.IsValid() && executable.GetFilename() != nullptr)
+        {
+            strncpy(info.pr_fname, executable.GetFilename(), sizeof(info.pr_fname) - 1);
+        }
+
+        strncpy(info.pr_psargs, GetPath(executable).c_str(), sizeof(info.pr_psargs) - 1);
+
+        AppendNote(notes, NT_PRPSINFO, &info, sizeof(info));
+    }
+
+    // Lists the loaded sections of the modules, and the address of their headers
+    void
+    GetModuleMappings(
+            lldb::SBTarget target,
+            std::vector<FileMapping>& mappings,
+            std::vector<uint64_t>& headers)
+    {
+        uint32_t numModules = target.GetNumModules();
+
+        for (uint32_t mi = 0; mi < numModules; mi++)
+        {
+            lldb::SBModule module = target.GetModuleAtIndex(mi);
+            std::string path = GetPath(module.GetFileSpec());
+
+            if (path.empty())
+            {
+                continue;
+            }
+
+            lldb::addr_t header = module.GetObjectFileHeaderAddress().GetLoadAddress(target);
+            if (header != LLDB_INVALID_ADDRESS)
+            {
+                headers.push_back(header);
+            }
+
+            size_t numSections = module.GetNumSections();
+            for (size_t si = 0; si < numSections; si++)
+            {
+                lldb::SBSection section = module.GetSectionAtIndex(si);
+                if (!section.IsValid())
+                {
+                    continue;
+                }
+
+                lldb::addr_t start = section.GetLoadAddress(target);
+                uint64_t size = section.GetByteSize();
+                uint64_t fileOffset = section.GetFileOffset();
+
+                if (start == LLDB_INVALID_ADDRESS || size == 0 || fileOffset < start % PageSize)
+                {
+                    continue;
+                }
+
+                // Whole pages, as the kernel maps them. The sections sharing a page end up in the same mapping.
+                FileMapping mapping = { start / PageSize * PageSize, AlignUp(start + size, PageSize), (fileOffset - start % PageSize) / PageSize, path };
+
+                if (!mappings.empty())
+                {
+                    FileMapping& last = mappings.back();
+
+                    if (last.Path == mapping.Path && mapping.Start >= last.Start && mapping.Start <= last.End &&
+                        last.PageOffset + (mapping.Start - last.Start) / PageSize == mapping.PageOffset)
+                    {
+                        last.End = std::max(last.End, mapping.End);
+                        continue;
+                    }
+                }
+
+                mappings.push_back(mapping);
+            }
+        }
+    }
+
+    void
+    AppendFileNote(
+            const std::vector<FileMapping>& mappings,
+            std::vector<uint8_t>& notes)
+    {
+        // count, page size, then (start, end, offset in pages) for each mapping, then the names
+        std::vector<uint64_t> table;
+        table.push_back(mappings.size());
+        table.push_back(PageSize);
+
+        for (auto& mapping : mappings)
+        {
+            table.push_back(mapping.Start);
+            table.push_back(mapping.End);
+            table.push_back(mapping.PageOffset);
+        }
+
+        std::vector<uint8_t> data((const uint8_t*)table.data(), (const uint8_t*)(table.data() + table.size()));
+
+        for (auto& mapping : mappings)
+        {
+            data.insert(data.end(), mapping.Path.c_str(), mapping.Path.c_str() + mapping.Path.size() + 1);
+        }
+
+        AppendNote(notes, NT_FILE, data.data(), data.size());
+    }
+
+    // Adds the pages the commands didn't read themselves
+    void
+    CapturePage(
+            const std::shared_ptr<TargetMemoryReader>& reader,
+            MemorySnapshot& capture,
+            uint64_t address)
+    {
+        uint64_t page = address / PageSize;
+        uint8_t data[MemorySnapshot::PageSize];
+        size_t valid;
+
+        if (!capture.LookupPage(page, data, &valid))
+        {
+            valid = reader->Read(page * PageSize, data, PageSize);
+            capture.StorePage(page, data, valid);
+        }
+    }
+
+    uint32_t
+    GetSegmentFlags(
+            const MemoryRegionMap& regions,
+            uint64_t address)
+    {
+        const MemoryRegion* region = regions.FindRegion(address);
+
+        // Without the memory map, the pages are at least readable
+        if (region == nullptr || region->Start > address)
+        {
+            return PF_R | PF_W;
+        }
+
+        return ((region->Protection & MemoryProtectionRead) ? PF_R : 0)
+            | ((region->Protection & MemoryProtectionWrite) ? PF_W : 0)
+            | ((region->Protection & MemoryProtectionExecute) ? PF_X : 0);
+    }
+
+    void
+    BuildSegments(
+            const std::vector<std::pair<uint64_t, size_t>>& pages,
+            const MemoryRegionMap& regions,
+            std::vector<LoadSegment>& segments)
+    {
+        for (size_t i = 0; i < pages.size(); i++)
+        {
+            uint64_t address = pages[i].first * PageSize;
+            size_t valid = pages[i].second;
+
+            // Pages stored only to record that they can't be read
+            if (valid == 0)
+            {
+                continue;
+            }
+
+            uint32_t flags = GetSegmentFlags(regions, address);
+
+            if (!segments.empty())
+            {
+                LoadSegment& last = segments.back();
+
+                if (last.Address + last.Size == address && last.Size % PageSize == 0 && last.Flags == flags)
+                {
+                    last.Size += valid;
+                    last.PageCount++;
+                    continue;
+                }
+            }
+
+            segments.push_back({ address, valid, flags, i, 1 });
+        }
+    }
+
+    class CoreFileWriter
+    {
+    private:
+        FILE* m_file;
+        uint64_t m_offset;
+        bool m_failed;
+
+    public:
+        explicit CoreFileWriter(FILE* file) :
+                m_file(file),
+                m_offset(0),
+                m_failed(false)
+        {
+        }
+
+        void
+        Write(
+                const void* data,
+                size_t size)
+        {
+            if (!m_failed && size != 0 && fwrite(data, size, 1, m_file) != 1)
+            {
+                m_failed = true;
+            }
+
+            m_offset += size;
+        }
+
+        void
+        PadTo(
+                uint64_t offset)
+        {
+            static const uint8_t Zeros[MemorySnapshot::PageSize] = {};
+
+            while (m_offset < offset)
+            {
+                Write(Zeros, (size_t)std::min<uint64_t>(sizeof(Zeros), offset - m_offset));
+            }
+        }
+
+        uint64_t GetOffset() const { return m_offset; }
+
+        bool Failed() const { return m_failed; }
+    };
+}
+
+bool
+WriteCaptureCore(
+        lldb::SBProcess process,
+        MemorySnapshot& capture,
+        const char* path,
+        std::string& error)
+{
+    std::vector<uint8_t> notes;
+    std::vector<FileMapping> mappings;
+    std::vector<uint64_t> headers;
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_sbApiLock);
+
+        // The threads and modules are read from the current stop, which must be the one the pages come from
+        if (!capture.IsFor(process.GetUniqueID(), process.GetStopID()))
+        {
+            error = "the process has run since the capture";
+            return false;
+        }
+
+        lldb::SBTarget target = process.GetTarget();
+
+        AppendProcessNote(process, target, notes);
+        AppendThreadNotes(process, notes);
+        GetModuleMappings(target, mappings, headers);
+        AppendFileNote(mappings, notes);
+    }
+
+    std::shared_ptr<TargetMemoryReader> reader = TargetMemoryReader::Get(process);
+
+    for (uint64_t header : headers)
+    {
+        CapturePage(reader, capture, header);
+    }
+
+    std::vector<std::pair<uint64_t, size_t>> pages;
+    capture.ListPages(pages);
+
+    std::vector<LoadSegment> segments;
+    BuildSegments(pages, *MemoryRegionMap::Get(process), segments);
+
+    uint64_t programHeaderCount = segments.size() + 1;
+    bool extendedCount = programHeaderCount >= PN_XNUM;
+
+    uint64_t notesOffset = sizeof(Elf64_Ehdr) + programHeaderCount * sizeof(Elf64_Phdr) + (extendedCount ? sizeof(Elf64_Shdr) : 0);
+    uint64_t dataOffset = AlignUp(notesOffset + notes.size(), PageSize);
+
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr)
+    {
+        error = strerror(errno);
+        return false;
+    }
+
+    CoreFileWriter writer(file);
+
+    Elf64_Ehdr header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_NONE;
+    header.e_type = ET_CORE;
+    header.e_machine = CoreMachine;
+    header.e_version = EV_CURRENT;
+    header.e_phoff = sizeof(Elf64_Ehdr);
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_phentsize = sizeof(Elf64_Phdr);
+    header.e_phnum = extendedCount ? PN_XNUM : (Elf64_Half)programHeaderCount;
+
+    // Same convention as the kernel: the real count goes in the first section header
+    if (extendedCount)
+    {
+        header.e_shoff = sizeof(Elf64_Ehdr) + programHeaderCount * sizeof(Elf64_Phdr);
+        header.e_shentsize = sizeof(Elf64_Shdr);
+        header.e_shnum = 1;
+    }
+
+    writer.Write(&header, sizeof(header));
+
+    Elf64_Phdr notesHeader;
+    memset(&notesHeader, 0, sizeof(notesHeader));
+    notesHeader.p_type = PT_NOTE;
+    notesHeader.p_offset = notesOffset;
+    notesHeader.p_filesz = notes.size();
+    notesHeader.p_align = 4;
+
+    writer.Write(&notesHeader, sizeof(notesHeader));
+
+    uint64_t offset = dataOffset;
+
+    for (auto& segment : segments)
+    {
+        Elf64_Phdr segmentHeader;
+        memset(&segmentHeader, 0, sizeof(segmentHeader));
+        segmentHeader.p_type = PT_LOAD;
+        segmentHeader.p_flags = segment.Flags;
+        segmentHeader.p_offset = offset;
+        segmentHeader.p_vaddr = segment.Address;
+        segmentHeader.p_filesz = segment.Size;
+        segmentHeader.p_memsz = segment.Size;
+        segmentHeader.p_align = PageSize;
+
+        writer.Write(&segmentHeader, sizeof(segmentHeader));
+        offset += AlignUp(segment.Size, PageSize);
+    }
+
+    if (extendedCount)
+    {
+        Elf64_Shdr sectionHeader;
+        memset(&sectionHeader, 0, sizeof(sectionHeader));
+        sectionHeader.sh_type = SHT_NULL;
+        sectionHeader.sh_info = (Elf64_Word)programHeaderCount;
+
+        writer.Write(&sectionHeader, sizeof(sectionHeader));
+    }
+
+    writer.Write(notes.data(), notes.size());
+
+    for (auto& segment : segments)
+    {
+        writer.PadTo(AlignUp(writer.GetOffset(), PageSize));
+
+        for (size_t i = segment.FirstPage; i < segment.FirstPage + segment.PageCount; i++)
+        {
+            uint8_t data[MemorySnapshot::PageSize];
+            size_t valid = 0;
+
+            // A page erased by a write through the services since it was listed is dumped as zeros
+            if (!capture.LookupPage(pages[i].first, data, &valid) || valid != pages[i].second)
+            {
+                memset(data, 0, sizeof(data));
+                valid = pages[i].second;
+            }
+
+            writer.Write(data, valid);
+        }
+    }
+
+    if (fclose(file) != 0 || writer.Failed())
+    {
+        error = "write failed";
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,22 @@
+#ifndef __COREWRITER_H__
+#define __COREWRITER_H__
+
+#include <string>
+#include "lldb/API/SBProcess.h"
+#include "memorysnapshot.h"
+
+//
+// Writes the pages recorded by LoadManagedCapture as a minimal ELF core, so
+// the commands that produced them can be run again elsewhere without the
+// full dump. The core has one PT_LOAD per run of contiguous pages with the
+// same protection, and the notes lldb needs to open it: NT_PRPSINFO,
+// NT_PRSTATUS with the registers of every thread, and NT_FILE with the
+// mappings of the modules. The header page of each module is added to the
+// capture, so the modules can be identified from the core.
+//
+// The threads and modules are read from the process, so it must still be at
+// the stop the capture was taken at.
+//
+bool WriteCaptureCore(lldb::SBProcess process, MemorySnapshot& capture, const char* path, std::string& error);
+
+#endif // __COREWRITER_H__
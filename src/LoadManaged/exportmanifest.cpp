@@ -0,0 +1,251 @@
+#include "exportmanifest.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <sys/stat.h>
+
+static const char* const ManifestHeader = "# loadmanaged-commands 1";
+
+static std::string
+GetManifestPath(
+        const char* assemblyPath)
+{
+    return std::string(assemblyPath) + ".commands";
+}
+
+// Size and modification time of the assembly, recorded in the manifest
+static bool
+GetAssemblyStamp(
+        const char* assemblyPath,
+        std::string& stamp)
+{
+    struct stat st;
+    if (stat(assemblyPath, &st) != 0)
+    {
+        return false;
+    }
+
+    std::ostringstream builder;
+    builder << ManifestHeader << " " << st.st_size << " " << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec;
+    stamp = builder.str();
+    return true;
+}
+
+static bool
+ReadCachedManifest(
+        const char* assemblyPath,
+        const std::string& stamp,
+        std::vector<std::string>& exports)
+{
+    std::ifstream manifest(GetManifestPath(assemblyPath));
+    std::string line;
+
+    if (!std::getline(manifest, line) || line != stamp)
+    {
+        return false;
+    }
+
+    while (std::getline(manifest, line))
+    {
+        if (!line.empty())
+        {
+            exports.push_back(line);
+        }
+    }
+
+    return true;
+}
+
+template<typename T> static bool
+ReadValue(
+        const std::vector<uint8_t>& image,
+        uint64_t offset,
+        T& value)
+{
+    if (offset + sizeof(T) > image.size())
+    {
+        return false;
+    }
+
+    memcpy(&value, image.data() + offset, sizeof(T));
+    return true;
+}
+
+// Translates a relative virtual address to a file offset using the section table
+static bool
+RvaToOffset(
+        const std::vector<uint8_t>& image,
+        uint64_t sections,
+        uint16_t sectionCount,
+        uint32_t rva,
+        uint64_t& offset)
+{
+    for (uint16_t i = 0; i < sectionCount; i++)
+    {
+        uint64_t section = sections + i * 40;
+        uint32_t virtualSize, virtualAddress, rawSize, rawPointer;
+
+        if (!ReadValue(image, section + 8, virtualSize) ||
+            !ReadValue(image, section + 12, virtualAddress) ||
+            !ReadValue(image, section + 16, rawSize) ||
+            !ReadValue(image, section + 20, rawPointer))
+        {
+            return false;
+        }
+
+        uint32_t size = virtualSize > rawSize ? virtualSize : rawSize;
+
+        if (rva >= virtualAddress && rva - virtualAddress < size)
+        {
+            offset = (uint64_t)rawPointer + (rva - virtualAddress);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Reads the names of the PE export directory
+static bool
+ReadPeExports(
+        const char* assemblyPath,
+        std::vector<std::string>& exports)
+{
+    std::ifstream file(assemblyPath, std::ios::binary);
+    std::vector<uint8_t> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    uint16_t dosMagic;
+    uint32_t peOffset, peSignature;
+    if (!ReadValue(image, 0, dosMagic) || dosMagic != 0x5A4D ||
+        !ReadValue(image, 0x3C, peOffset) ||
+        !ReadValue(image, peOffset, peSignature) || peSignature != 0x00004550)
+    {
+        return false;
+    }
+
+    uint64_t fileHeader = peOffset + 4;
+    uint16_t sectionCount, optionalHeaderSize, magic;
+    if (!ReadValue(image, fileHeader + 2, sectionCount) ||
+        !ReadValue(image, fileHeader + 16, optionalHeaderSize))
+    {
+        return false;
+    }
+
+    uint64_t optionalHeader = fileHeader + 20;
+    uint64_t sections = optionalHeader + optionalHeaderSize;
+    if (!ReadValue(image, optionalHeader, magic))
+    {
+        return false;
+    }
+
+    // The data directories start at 96 for PE32, 112 for PE32+, and the export directory is the first one
+    uint32_t exportRva, exportSize;
+    uint64_t dataDirectories = optionalHeader + (magic == 0x20b ? 112 : 96);
+    if (!ReadValue(image, dataDirectories, exportRva) ||
+        !ReadValue(image, dataDirectories + 4, exportSize))
+    {
+        return false;
+    }
+
+    if (exportRva == 0 || exportSize == 0)
+    {
+        // Valid assembly without any export
+        return true;
+    }
+
+    uint64_t exportDirectory;
+    uint32_t nameCount, namesRva;
+    uint64_t names;
+    if (!RvaToOffset(image, sections, sectionCount, exportRva, exportDirectory) ||
+        !ReadValue(image, exportDirectory + 24, nameCount) ||
+        !ReadValue(image, exportDirectory + 32, namesRva) ||
+        !RvaToOffset(image, sections, sectionCount, namesRva, names))
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < nameCount; i++)
+    {
+        uint32_t nameRva;
+        uint64_t name;
+        if (!ReadValue(image, names + i * 4, nameRva) ||
+            !RvaToOffset(image, sections, sectionCount, nameRva, name) ||
+            name >= image.size())
+        {
+            return false;
+        }
+
+        const char* start = reinterpret_cast<const char*>(image.data() + name);
+        exports.emplace_back(start, strnlen(start, image.size() - name));
+    }
+
+    return true;
+}
+
+bool
+ReadExportManifest(
+        const char* assemblyPath,
+        std::vector<std::string>& exports)
+{
+    std::string stamp;
+    if (!GetAssemblyStamp(assemblyPath, stamp))
+    {
+        return false;
+    }
+
+    if (ReadCachedManifest(assemblyPath, stamp, exports))
+    {
+        return true;
+    }
+
+    exports.clear();
+    return ReadPeExports(assemblyPath, exports);
+}
+
+bool
+WriteExportManifest(
+        const char* assemblyPath,
+        const std::vector<std::string>& exports)
+{
+    std::string stamp;
+    if (!GetAssemblyStamp(assemblyPath, stamp))
+    {
+        return false;
+    }
+
+    // Written to a temporary file first, so a concurrent session never reads a partial manifest
+    std::string manifestPath = GetManifestPath(assemblyPath);
+    std::string temporaryPath = manifestPath + ".tmp";
+
+    {
+        std::ofstream manifest(temporaryPath, std::ios::trunc);
+        if (!manifest)
+        {
+            return false;
+        }
+
+        manifest << stamp << "\n";
+
+        for (auto& name : exports)
+        {
+            manifest << name << "\n";
+        }
+
+        if (!manifest.flush())
+        {
+            return false;
+        }
+    }
+
+    if (rename(temporaryPath.c_str(), manifestPath.c_str()) != 0)
+    {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
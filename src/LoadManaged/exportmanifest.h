@@ -0,0 +1,20 @@
+#ifndef __EXPORTMANIFEST_H__
+#define __EXPORTMANIFEST_H__
+
+#include <string>
+#include <vector>
+
+//
+// Names of the commands exported by a plugin, read without starting the CLR
+// (LoadManaged --lazy). The list validated by the managed loader is cached in
+// <assembly>.commands next to the plugin, and invalidated when the assembly
+// size or modification time changes. Without a valid manifest, the names are
+// read from the PE export table, which may include exports that turn out not
+// to be valid commands once the plugin is loaded.
+//
+bool ReadExportManifest(const char* assemblyPath, std::vector<std::string>& exports);
+
+// Best effort: the plugin directory may be read-only
+bool WriteExportManifest(const char* assemblyPath, const std::vector<std::string>& exports);
+
+#endif // __EXPORTMANIFEST_H__
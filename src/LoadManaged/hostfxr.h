@@ -0,0 +1,60 @@
+// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+// See the LICENSE file in the project root for more information.
+
+//
+// APIs for hosting .NET Core through hostfxr (hostfxr.h and coreclr_delegates.h of the .NET host)
+//
+
+#ifndef __HOSTFXR_H__
+#define __HOSTFXR_H__
+
+#include <cstddef>
+#include <cstdint>
+
+enum hostfxr_delegate_type
+{
+    hdt_com_activation,
+    hdt_load_in_memory_assembly,
+    hdt_winrt_activation,
+    hdt_com_register,
+    hdt_com_unregister,
+    hdt_load_assembly_and_get_function_pointer,
+    hdt_get_function_pointer,
+};
+
+typedef void* hostfxr_handle;
+
+struct hostfxr_initialize_parameters
+{
+    size_t size;
+    const char* host_path;
+    const char* dotnet_root;
+};
+
+typedef int32_t (*hostfxr_initialize_for_runtime_config_fn)(
+        const char* runtime_config_path,
+        const hostfxr_initialize_parameters* parameters,
+        hostfxr_handle* host_context_handle);
+
+typedef int32_t (*hostfxr_get_runtime_delegate_fn)(
+        const hostfxr_handle host_context_handle,
+        hostfxr_delegate_type type,
+        void** delegate);
+
+typedef int32_t (*hostfxr_set_runtime_property_value_fn)(
+        const hostfxr_handle host_context_handle,
+        const char* name,
+        const char* value);
+
+typedef int32_t (*hostfxr_close_fn)(const hostfxr_handle host_context_handle);
+
+typedef int (*load_assembly_and_get_function_pointer_fn)(
+        const char* assembly_path,
+        const char* type_name,
+        const char* method_name,
+        const char* delegate_type_name,
+        void* reserved,
+        void** delegate);
+
+#endif // __HOSTFXR_H__
@@ -0,0 +1,63 @@
+#include "interrupt.h"
+
+#include <mutex>
+#include <signal.h>
+#include <string.h>
+
+std::atomic<int> g_interruptRequested(0);
+
+static std::mutex g_interruptLock;
+static int g_interruptDepth = 0;
+static struct sigaction g_previousSigint;
+
+static void
+InterruptSignalHandler(int signo, siginfo_t *info, void *context)
+{
+    g_interruptRequested.store(1, std::memory_order_relaxed);
+
+    // Chain to whoever was there before us (lldb's driver forwards Ctrl-C
+    // to the debugger so the interpreter sees the interrupt too)
+    if (g_previousSigint.sa_flags & SA_SIGINFO)
+    {
+        if (g_previousSigint.sa_sigaction != nullptr)
+        {
+            g_previousSigint.sa_sigaction(signo, info, context);
+        }
+    }
+    else if (g_previousSigint.sa_handler != SIG_DFL && g_previousSigint.sa_handler != SIG_IGN)
+    {
+        g_previousSigint.sa_handler(signo);
+    }
+}
+
+InterruptScope::InterruptScope()
+{
+    std::lock_guard<std::mutex> lock(g_interruptLock);
+
+    if (g_interruptDepth++ != 0)
+    {
+        return;
+    }
+
+    g_interruptRequested.store(0, std::memory_order_relaxed);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = InterruptSignalHandler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    sigaction(SIGINT, &action, &g_previousSigint);
+}
+
+InterruptScope::~InterruptScope()
+{
+    std::lock_guard<std::mutex> lock(g_interruptLock);
+
+    if (--g_interruptDepth != 0)
+    {
+        return;
+    }
+
+    sigaction(SIGINT, &g_previousSigint, nullptr);
+}
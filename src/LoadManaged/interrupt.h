@@ -0,0 +1,28 @@
+#ifndef __INTERRUPT_H__
+#define __INTERRUPT_H__
+
+#include <atomic>
+
+// Set to 1 when the user presses Ctrl-C while a managed command is running.
+// It is a plain lock-free int so that both the signal handler and the managed
+// side (through the pointer handed to PluginLoader.Invoke) can poll it cheaply.
+extern std::atomic<int> g_interruptRequested;
+
+//
+// Hooks SIGINT for the lifetime of a managed command. The previous handler
+// (usually lldb's driver, which forwards to SBDebugger::DispatchInputInterrupt)
+// is still called so lldb keeps its own interrupt behavior.
+// Scopes can be nested; the handler is installed by the outermost one and the
+// flag is cleared when a new outermost scope starts.
+//
+class InterruptScope
+{
+public:
+    InterruptScope();
+    ~InterruptScope();
+
+    InterruptScope(const InterruptScope&) = delete;
+    InterruptScope& operator=(const InterruptScope&) = delete;
+};
+
+#endif // __INTERRUPT_H__
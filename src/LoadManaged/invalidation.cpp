@@ -0,0 +1,226 @@
+#include "invalidation.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "lldb/API/SBEvent.h"
+#include "lldb/API/SBListener.h"
+#include "lldb/API/SBTarget.h"
+
+namespace
+{
+    std::atomic<uint64_t> s_generations[CacheKindCount];
+
+    std::mutex s_syncLock;
+    uint32_t s_syncUniqueId;
+    uint32_t s_syncStopId;
+
+    std::mutex s_handlersLock;
+    std::vector<std::function<void()>> s_resumeHandlers;
+
+    std::atomic<int> s_expressionDepth;
+
+    // Last stop reported to the listener
+    uint32_t s_stoppedUniqueId;
+    uint32_t s_stoppedStopId;
+
+    // The events are handled after the fact: a resume that is already back at the stop
+    // it started from didn't leave it (the expression stops don't count as stops)
+    bool
+    IsUserResume(
+            const lldb::SBEvent& event)
+    {
+        if (s_expressionDepth.load(std::memory_order_acquire) != 0)
+        {
+            return false;
+        }
+
+        lldb::SBProcess process = lldb::SBProcess::GetProcessFromEvent(event);
+
+        return !process.IsValid()
+            || process.GetState() != lldb::eStateStopped
+            || process.GetUniqueID() != s_stoppedUniqueId
+            || process.GetStopID() != s_stoppedStopId;
+    }
+
+    void
+    OnProcessEvent(
+            const lldb::SBEvent& event)
+    {
+        // Any transition makes the memory, registers and stacks stale, including the stop itself
+        InvalidateCaches(CacheKindAll);
+
+        // lldb stopped and resumed on its own (breakpoint condition, signal passed to the process)
+        if (lldb::SBProcess::GetRestartedFromEvent(event))
+        {
+            return;
+        }
+
+        lldb::StateType state = lldb::SBProcess::GetStateFromEvent(event);
+
+        if (state == lldb::eStateStopped)
+        {
+            lldb::SBProcess process = lldb::SBProcess::GetProcessFromEvent(event);
+
+            if (process.IsValid())
+            {
+                s_stoppedUniqueId = process.GetUniqueID();
+                s_stoppedStopId = process.GetStopID();
+            }
+        }
+
+        if ((state != lldb::eStateRunning && state != lldb::eStateStepping) || !IsUserResume(event))
+        {
+            return;
+        }
+
+        std::vector<std::function<void()>> handlers;
+
+        {
+            std::lock_guard<std::mutex> lock(s_handlersLock);
+            handlers = s_resumeHandlers;
+        }
+
+        for (auto& handler : handlers)
+        {
+            handler();
+        }
+    }
+
+    void
+    OnTargetEvent(
+            const lldb::SBEvent& event)
+    {
+        uint32_t type = event.GetType();
+
+        if (type & (lldb::SBTarget::eBroadcastBitModulesLoaded | lldb::SBTarget::eBroadcastBitModulesUnloaded))
+        {
+            InvalidateCaches(CACHE_KIND_MASK(CacheKindModules) | CACHE_KIND_MASK(CacheKindSymbols) | CACHE_KIND_MASK(CacheKindUnwind));
+        }
+        else if (type & lldb::SBTarget::eBroadcastBitSymbolsLoaded)
+        {
+            InvalidateCaches(CACHE_KIND_MASK(CacheKindSymbols) | CACHE_KIND_MASK(CacheKindUnwind));
+        }
+
+        if (type & lldb::SBTarget::eBroadcastBitBreakpointChanged)
+        {
+            InvalidateCaches(CACHE_KIND_MASK(CacheKindBreakpoints));
+        }
+    }
+
+    void
+    ListenerThread(
+            lldb::SBListener listener)
+    {
+        while (true)
+        {
+            lldb::SBEvent event;
+
+            // UINT32_MAX waits forever
+            if (!listener.WaitForEvent(UINT32_MAX, event) || !event.IsValid())
+            {
+                continue;
+            }
+
+            if (lldb::SBProcess::EventIsProcessEvent(event))
+            {
+                OnProcessEvent(event);
+            }
+            else if (lldb::SBTarget::EventIsTargetEvent(event))
+            {
+                OnTargetEvent(event);
+            }
+        }
+    }
+}
+
+uint64_t
+GetCacheGeneration(
+        uint32_t kinds)
+{
+    // The counters only grow, so the sum changes as soon as one of them does
+    uint64_t generation = 0;
+
+    for (uint32_t kind = 0; kind < CacheKindCount; kind++)
+    {
+        if (kinds & CACHE_KIND_MASK(kind))
+        {
+            generation += s_generations[kind].load(std::memory_order_acquire);
+        }
+    }
+
+    return generation;
+}
+
+void
+InvalidateCaches(
+        uint32_t kinds)
+{
+    for (uint32_t kind = 0; kind < CacheKindCount; kind++)
+    {
+        if (kinds & CACHE_KIND_MASK(kind))
+        {
+            s_generations[kind].fetch_add(1, std::memory_order_acq_rel);
+        }
+    }
+}
+
+void
+SyncCacheGenerations(
+        lldb::SBProcess process)
+{
+    uint32_t uniqueId = process.GetUniqueID();
+    uint32_t stopId = process.GetStopID();
+
+    std::lock_guard<std::mutex> lock(s_syncLock);
+
+    if (uniqueId != s_syncUniqueId || stopId != s_syncStopId)
+    {
+        s_syncUniqueId = uniqueId;
+        s_syncStopId = stopId;
+        InvalidateCaches(CacheKindAll);
+    }
+}
+
+void
+AddResumeHandler(
+        std::function<void()> handler)
+{
+    std::lock_guard<std::mutex> lock(s_handlersLock);
+    s_resumeHandlers.push_back(std::move(handler));
+}
+
+ExpressionEvaluationScope::ExpressionEvaluationScope()
+{
+    s_expressionDepth.fetch_add(1, std::memory_order_acq_rel);
+}
+
+ExpressionEvaluationScope::~ExpressionEvaluationScope()
+{
+    s_expressionDepth.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+bool
+StartInvalidationListener(
+        lldb::SBDebugger debugger)
+{
+    lldb::SBListener listener("loadmanaged.invalidation");
+
+    if (!listener.IsValid())
+    {
+        return false;
+    }
+
+    // Listening by class also covers the targets and processes created later
+    listener.StartListeningForEventClass(debugger, lldb::SBProcess::GetBroadcasterClassName(), lldb::SBProcess::eBroadcastBitStateChanged);
+    listener.StartListeningForEventClass(
+            debugger,
+            lldb::SBTarget::GetBroadcasterClassName(),
+            lldb::SBTarget::eBroadcastBitModulesLoaded | lldb::SBTarget::eBroadcastBitModulesUnloaded | lldb::SBTarget::eBroadcastBitSymbolsLoaded |
+            lldb::SBTarget::eBroadcastBitBreakpointChanged);
+
+    std::thread(ListenerThread, listener).detach();
+
+    return true;
+}
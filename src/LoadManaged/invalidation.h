@@ -0,0 +1,59 @@
+#ifndef __INVALIDATION_H__
+#define __INVALIDATION_H__
+
+#include <cstdint>
+#include <functional>
+#include "lldb/API/SBDebugger.h"
+#include "lldb/API/SBProcess.h"
+
+//
+// Central invalidation of the service caches. Every kind of cached data has a
+// generation counter, bumped when lldb reports something that makes it stale:
+// the process running or stopping, modules being loaded or unloaded, or
+// memory being written through the services. A cache remembers the
+// generation it was built at and compares a single integer on lookup.
+//
+enum CacheKind : uint32_t
+{
+    // Process structure (memory map, readers): changes whenever the process runs
+    CacheKindProcess,
+    CacheKindMemory,
+    CacheKindModules,
+    CacheKindSymbols,
+    CacheKindRegisters,
+    CacheKindUnwind,
+    // Breakpoint sites, which the live memory reader hides
+    CacheKindBreakpoints,
+    CacheKindCount
+};
+
+#define CACHE_KIND_MASK(kind) (1u << (kind))
+
+const uint32_t CacheKindAll = (1u << CacheKindCount) - 1;
+
+// Returns a value that changes whenever any of the kinds in the mask is invalidated
+uint64_t GetCacheGeneration(uint32_t kinds);
+
+// Bumps the generation of the kinds in the mask
+void InvalidateCaches(uint32_t kinds);
+
+// Invalidates everything if the process or its stop id changed since the last call.
+// Events are delivered asynchronously, so the caches call this before trusting their generation.
+void SyncCacheGenerations(lldb::SBProcess process);
+
+// Called on the listener thread when the user resumes a process. The short resumes lldb does on
+// its own (restarted stops, expression evaluation) don't run the handlers.
+void AddResumeHandler(std::function<void()> handler);
+
+// Marks the services evaluating an expression, which runs the target without leaving the stop
+class ExpressionEvaluationScope
+{
+public:
+    ExpressionEvaluationScope();
+    ~ExpressionEvaluationScope();
+};
+
+// Starts the thread listening to the process and target events of the debugger
+bool StartInvalidationListener(lldb::SBDebugger debugger);
+
+#endif // __INVALIDATION_H__
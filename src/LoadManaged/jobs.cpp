@@ -0,0 +1,231 @@
+#include "jobs.h"
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "interrupt.h"
+#include "sosplugin.h"
+#include "trace.h"
+
+JobManager g_jobs;
+
+static double
+ElapsedSeconds(const ManagedJob& job)
+{
+    auto end = job.Completed ? job.EndTime : std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - job.StartTime).count();
+}
+
+JobManager::JobManager() :
+        m_nextId(1)
+{
+}
+
+int
+JobManager::Start(
+        lldb::SBDebugger debugger,
+        const char* pluginName,
+        const char* commandName,
+        InvokeFunc* invokeFunc,
+        char** args,
+        lldb::SBCommandReturnObject& result)
+{
+    lldb::SBProcess process = debugger.GetSelectedTarget().GetProcess();
+
+    // Memory and threads would change under our feet if the target was running
+    if (!process.IsValid() || process.GetState() != lldb::eStateStopped)
+    {
+        result.Printf("Background commands can only run while the target is stopped\n");
+        result.SetStatus(lldb::eReturnStatusFailed);
+        return -1;
+    }
+
+    auto job = std::make_shared<ManagedJob>();
+    job->CommandLine = commandName;
+
+    // The argv of lldb doesn't outlive the command, the job gets its own copy
+    std::vector<std::string> arguments;
+
+    for (int i = 0; args != nullptr && args[i] != nullptr; i++)
+    {
+        arguments.push_back(args[i]);
+        job->CommandLine += " ";
+        job->CommandLine += args[i];
+    }
+
+    job->Interrupt = 0;
+    job->Completed = false;
+    job->StartTime = std::chrono::steady_clock::now();
+    job->Debugger = debugger;
+    job->Process = process;
+    job->Thread = process.GetSelectedThread();
+    job->StopId = process.GetStopID();
+    job->Result.SetImmediateOutputFile(stdout);
+    job->Result.SetImmediateErrorFile(stderr);
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        job->Id = m_nextId++;
+        m_jobs[job->Id] = job;
+    }
+
+    // The thread owns a reference to the job, so it can be detached and
+    // outlive its entry in the job list
+    std::thread(&JobManager::Run, this, job, pluginName, commandName, invokeFunc, std::move(arguments)).detach();
+
+    result.Printf("[%d] %s\n", job->Id, job->CommandLine.c_str());
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return job->Id;
+}
+
+void
+JobManager::Run(
+        std::shared_ptr<ManagedJob> job,
+        const char* pluginName,
+        const char* commandName,
+        InvokeFunc* invokeFunc,
+        std::vector<std::string> args)
+{
+    std::vector<CommandArgument> argv;
+
+    for (auto& arg : args)
+    {
+        argv.push_back({ arg.data(), arg.size() });
+    }
+
+    LLDBServices* services = new LLDBServices(job->Debugger, job->Result, &job->Process, &job->Thread);
+    services->SetInterruptFlag(&job->Interrupt);
+    services->BindToStop(job->StopId);
+
+    {
+        TraceSpan span("jobs", commandName);
+        invokeFunc(pluginName, commandName, services, argv.data(), (int)argv.size(), reinterpret_cast<const int*>(&job->Interrupt));
+    }
+
+    services->Release();
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        job->EndTime = std::chrono::steady_clock::now();
+        job->Completed = true;
+    }
+
+    fprintf(stdout, "[%d] %s %s (%.2fs)\n",
+            job->Id,
+            job->Interrupt ? "Cancelled" : "Done",
+            job->CommandLine.c_str(),
+            ElapsedSeconds(*job));
+    fflush(stdout);
+
+    m_jobCompleted.notify_all();
+}
+
+void
+JobManager::List(
+        lldb::SBCommandReturnObject& result)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (m_jobs.empty())
+    {
+        result.Printf("No managed jobs\n");
+        return;
+    }
+
+    for (auto it = m_jobs.begin(); it != m_jobs.end();)
+    {
+        const ManagedJob& job = *it->second;
+
+        const char* state = !job.Completed ? (job.Interrupt ? "Cancelling" : "Running")
+                                           : (job.Interrupt ? "Cancelled" : "Done");
+
+        result.Printf("[%d] %-10s %8.2fs  %s\n", job.Id, state, ElapsedSeconds(job), job.CommandLine.c_str());
+
+        if (job.Completed)
+        {
+            it = m_jobs.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+bool
+JobManager::Wait(
+        int id,
+        lldb::SBCommandReturnObject& result)
+{
+    std::vector<std::shared_ptr<ManagedJob>> jobs;
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        for (auto& entry : m_jobs)
+        {
+            if (id == -1 || entry.first == id)
+            {
+                jobs.push_back(entry.second);
+            }
+        }
+    }
+
+    if (id != -1 && jobs.empty())
+    {
+        result.Printf("No managed job with id %d\n", id);
+        result.SetStatus(lldb::eReturnStatusFailed);
+        return false;
+    }
+
+    InterruptScope interrupt;
+
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    for (auto& job : jobs)
+    {
+        while (!job->Completed)
+        {
+            if (g_interruptRequested.load(std::memory_order_relaxed) != 0)
+            {
+                result.Printf("Stopped waiting, the job is still running\n");
+                return false;
+            }
+
+            // The signal handler can't notify the condition variable, so wake up regularly to check for Ctrl-C
+            m_jobCompleted.wait_for(lock, std::chrono::milliseconds(100));
+        }
+
+        m_jobs.erase(job->Id);
+    }
+
+    return true;
+}
+
+bool
+JobManager::Cancel(
+        int id)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    auto it = m_jobs.find(id);
+
+    if (it == m_jobs.end() || it->second->Completed)
+    {
+        return false;
+    }
+
+    it->second->Interrupt = 1;
+    return true;
+}
+
+void
+JobManager::CancelAll()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    for (auto& entry : m_jobs)
+    {
+        entry.second->Interrupt = 1;
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef __JOBS_H__
+#define __JOBS_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "coreruncommon.h"
+#include "lldb/API/SBDebugger.h"
+#include "lldb/API/SBCommandReturnObject.h"
+#include "lldb/API/SBProcess.h"
+#include "lldb/API/SBThread.h"
+
+//
+// A managed command started with --async. It runs on its own thread with its
+// own LLDBServices instance, and its output is streamed to stdout as it is
+// produced since the original command has returned long before it completes.
+//
+struct ManagedJob
+{
+    int Id;
+    std::string CommandLine;
+
+    // Polled by the managed side and by LLDBServices::GetInterrupt
+    std::atomic<int> Interrupt;
+    std::atomic<bool> Completed;
+
+    std::chrono::steady_clock::time_point StartTime;
+    std::chrono::steady_clock::time_point EndTime;
+
+    lldb::SBDebugger Debugger;
+    lldb::SBProcess Process;
+    lldb::SBThread Thread;
+    // The services fail once the target has left this stop
+    uint32_t StopId;
+    lldb::SBCommandReturnObject Result;
+};
+
+class JobManager
+{
+private:
+    std::mutex m_lock;
+    std::condition_variable m_jobCompleted;
+    std::map<int, std::shared_ptr<ManagedJob>> m_jobs;
+    int m_nextId;
+
+    void Run(std::shared_ptr<ManagedJob> job, const char* pluginName, const char* commandName, InvokeFunc* invokeFunc, std::vector<std::string> args);
+
+public:
+    JobManager();
+
+    // Returns the id of the new job, or -1 if the target is not in a state where it can be inspected
+    // args is null-terminated, like the argv of the command
+    int Start(lldb::SBDebugger debugger, const char* pluginName, const char* commandName, InvokeFunc* invokeFunc, char** args, lldb::SBCommandReturnObject& result);
+
+    // Lists the jobs, and forgets about the ones that have completed since they have been reported
+    void List(lldb::SBCommandReturnObject& result);
+
+    // Waits for the given job (or all jobs if id is -1). Ctrl-C stops waiting but doesn't cancel the job.
+    bool Wait(int id, lldb::SBCommandReturnObject& result);
+
+    bool Cancel(int id);
+
+    void CancelAll();
+};
+
+extern JobManager g_jobs;
+
+#endif // __JOBS_H__
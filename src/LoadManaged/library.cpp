@@ -2,14 +2,31 @@
 
 #include <iostream>
 #include <cstdio>
+#include <map>
+#include <sstream>
+#include <set>
+#include <string>
+#include <vector>
 #include "coreruncommon.h"
+#include "corewriter.h"
+#include "exportmanifest.h"
 #include "services.h"
+#include "interrupt.h"
+#include "invalidation.h"
+#include "jobs.h"
+#include "memorysnapshot.h"
+#include "prefetcher.h"
+#include "runtimelocator.h"
+#include "servicestats.h"
+#include "trace.h"
 #include "lldb/API/SBDebugger.h"
 #include "lldb/API/SBCommandInterpreter.h"
 #include "lldb/API/SBCommandReturnObject.h"
 #include "lldb/API/SBTarget.h"
 #include <link.h>
 #include <libgen.h>
+#include <glob.h>
+#include <sys/stat.h>
 #include "ClrInterop.cpp"
 
 namespace lldb
@@ -18,7 +35,19 @@ namespace lldb
 }
 
 char* libraryPath;
-const char* clrPath = "/usr/share/dotnet/shared/Microsoft.NETCore.App/2.2.1/";
+
+// Set by SetClrPath, or located from the target when the CLR is started
+const char* clrPath = nullptr;
+static bool clrPathOverridden = false;
+static std::string locatedClrPath;
+static std::string locatedClrVersion;
+
+static ClrInterop clrInterop;
+
+bool LocateCoreClr(lldb::SBDebugger debugger);
+static bool ReloadManagedPlugin(lldb::SBDebugger debugger, std::string pluginName);
+static bool LoadManagedPlugins(lldb::SBDebugger debugger, const char* paths);
+static void ForgetDeferredCommands(const std::string& path);
 
 class SetClrPathCommand : public lldb::SBCommandPluginInterface
 {
@@ -31,6 +60,7 @@ public:
         }
 
         clrPath = strdup(command[0]);
+        clrPathOverridden = true;
 
         return true;
     }
@@ -38,84 +68,827 @@ public:
 
 class ManagedCommand : public lldb::SBCommandPluginInterface{
 private:
-    InvokeFunc* _invokeFunc;
     const char* _pluginName;
     const char* _commandName;
 
+    // Assembly to load on the first invocation, for the commands registered with LoadManaged --lazy
+    std::string _deferredPath;
+
 public:
 
-    ManagedCommand(const char* pluginName, const char* commandName, InvokeFunc* invokeFunc){
-        _invokeFunc = invokeFunc;
+    ManagedCommand(const char* pluginName, const char* commandName){
         _pluginName = pluginName;
         _commandName = commandName;
     }
 
+    const char* GetPluginName() const
+    {
+        return _pluginName;
+    }
+
+    const std::string& GetDeferredPath() const
+    {
+        return _deferredPath;
+    }
+
+    // lldb can't remove a command, so an unloaded plugin leaves its commands unbound until it is loaded again
+    void Bind(const char* pluginName)
+    {
+        _pluginName = pluginName;
+
+        if (pluginName != nullptr)
+        {
+            _deferredPath.clear();
+        }
+    }
+
+    void Defer(const std::string& path)
+    {
+        _deferredPath = path;
+    }
+
     virtual bool DoExecute(lldb::SBDebugger debugger, char **command, lldb::SBCommandReturnObject &result)
     {
-        LLDBServices* services = new LLDBServices(debugger, result);
+        if (_pluginName == nullptr && !_deferredPath.empty())
+        {
+            std::string path(_deferredPath);
 
-        _invokeFunc(_pluginName, _commandName, services, command == nullptr ? "" : command[0]);
+            LoadManagedPlugins(debugger, path.c_str());
+
+            // The other lazy commands of the assembly are either bound now, or not valid exports
+            ForgetDeferredCommands(path);
+
+            if (_pluginName == nullptr)
+            {
+                result.Printf("%s is not a valid command of %s\n", _commandName, path.c_str());
+                result.SetStatus(lldb::eReturnStatusFailed);
+                return false;
+            }
+        }
+
+        if (_pluginName != nullptr && clrInterop.IsPluginModified(_pluginName))
+        {
+            ReloadManagedPlugin(debugger, _pluginName);
+        }
+
+        if (_pluginName == nullptr)
+        {
+            result.Printf("The plugin of %s has been unloaded, use LoadManaged to load it again\n", _commandName);
+            result.SetStatus(lldb::eReturnStatusFailed);
+            return false;
+        }
+
+        if (command != nullptr && command[0] != nullptr && strcmp(command[0], "--async") == 0)
+        {
+            return g_jobs.Start(debugger, _pluginName, _commandName, clrInterop.Invoke, command + 1, result) != -1;
+        }
+
+        // Passed as-is to the managed side, which reads the UTF-8 bytes in place
+        std::vector<CommandArgument> argv;
+
+        for (int i = 0; command != nullptr && command[i] != nullptr; i++)
+        {
+            argv.push_back({ command[i], strlen(command[i]) });
+        }
+
+        LLDBServices* services = LLDBServices::Acquire(debugger, result);
+
+        {
+            InterruptScope interrupt;
+            TraceSpan span("commands", _commandName);
+
+            // std::atomic<int> is lock-free and laid out as a plain int, so the managed side can poll it directly
+            clrInterop.Invoke(_pluginName, _commandName, services, argv.data(), (int)argv.size(), reinterpret_cast<const int*>(&g_interruptRequested));
+        }
+
+        services->Release();
 
         return true;
     }
 };
 
-class LoadManagedCommand : public lldb::SBCommandPluginInterface
+// Commands registered by the managed plugins, by name, and the loaded plugins
+static std::map<std::string, ManagedCommand*> managedCommands;
+static std::set<std::string> loadedPlugins;
+
+// Returns the names of the commands
+static std::vector<std::string>
+RegisterManagedCommands(lldb::SBDebugger debugger, const char* pluginName)
 {
-private:
-    ClrInterop* _interop;
+    TraceSpan registerSpan("load", "RegisterCommands");
+
+    int exportCount = clrInterop.GetExportCount(pluginName);
+
+    std::vector<std::string> exportNames;
+
+    auto interpreter = debugger.GetCommandInterpreter();
+
+    for (int i = 0; i < exportCount; i++){
+        char* exportName = clrInterop.GetExportName(pluginName, i);
+
+        exportNames.push_back(exportName);
+
+        auto existing = managedCommands.find(exportName);
+
+        if (existing != managedCommands.end())
+        {
+            existing->second->Bind(pluginName);
+            free(exportName);
+            continue;
+        }
+
+        auto command = new ManagedCommand(pluginName, exportName);
+
+        interpreter.AddCommand(exportName, command, exportName);
+        managedCommands[exportName] = command;
+    }
+
+    loadedPlugins.insert(pluginName);
+
+    return exportNames;
+}
+
+// Registers the commands listed in the manifest of the assembly, without loading anything. Returns -1 if the assembly can't be read.
+static int
+DeferManagedCommands(lldb::SBDebugger debugger, const std::string& path)
+{
+    std::vector<std::string> exportNames;
+
+    if (!ReadExportManifest(path.c_str(), exportNames))
+    {
+        return -1;
+    }
+
+    auto interpreter = debugger.GetCommandInterpreter();
+
+    int count = 0;
+
+    for (auto& exportName : exportNames)
+    {
+        auto existing = managedCommands.find(exportName);
+
+        if (existing != managedCommands.end())
+        {
+            // Don't take over the command of a loaded plugin
+            if (existing->second->GetPluginName() == nullptr)
+            {
+                existing->second->Defer(path);
+                count++;
+            }
+
+            continue;
+        }
+
+        auto command = new ManagedCommand(nullptr, strdup(exportName.c_str()));
+        command->Defer(path);
+
+        interpreter.AddCommand(exportName.c_str(), command, exportName.c_str());
+        managedCommands[exportName] = command;
+        count++;
+    }
+
+    return count;
+}
+
+static void
+ForgetDeferredCommands(const std::string& path)
+{
+    for (auto& entry : managedCommands)
+    {
+        if (entry.second->GetDeferredPath() == path)
+        {
+            entry.second->Defer(std::string());
+        }
+    }
+}
+
+static void
+UnbindManagedCommands(const std::string& pluginName)
+{
+    for (auto& entry : managedCommands)
+    {
+        if (entry.second->GetPluginName() != nullptr && pluginName == entry.second->GetPluginName())
+        {
+            entry.second->Bind(nullptr);
+        }
+    }
+
+    loadedPlugins.erase(pluginName);
+}
+
+static bool
+ReloadManagedPlugin(lldb::SBDebugger debugger, std::string pluginName)
+{
+    TraceSpan span("load", "ReloadManaged");
+
+    // Commands of the previous version must not run while the new one is loaded
+    UnbindManagedCommands(pluginName);
+
+    char* newName = clrInterop.ReloadPlugin(pluginName.c_str());
+
+    if (newName == nullptr)
+    {
+        std::cout << "Failed to reload plugin " << pluginName << std::endl;
+        return false;
+    }
+
+    size_t exportCount = RegisterManagedCommands(debugger, newName).size();
+
+    std::cout << "Reloaded " << newName << ", " << exportCount << " functions" << std::endl;
+
+    return true;
+}
+
+static bool
+InitializeClr(lldb::SBDebugger debugger)
+{
+    if (clrInterop.Initialized)
+    {
+        return true;
+    }
+
+    // The target may have changed since the plugin was loaded
+    if (!clrPathOverridden && !LocateCoreClr(debugger))
+    {
+        std::cout << "Could not locate CoreCLR. Use SetClrPath to manually set the path to the CLR." << std::endl;
+        return false;
+    }
+
+    TraceSpan initializeSpan("load", "InitializeClr");
+
+    std::string managedAssembly;
+
+    managedAssembly += libraryPath;
+    managedAssembly += "/PluginInterop.dll";
+
+    // The runtime given with SetClrPath is started directly, hostfxr would pick its own
+    int status = clrInterop.Initialize(
+            "LoadManaged",
+            libraryPath,
+            clrPath,
+            clrPathOverridden ? nullptr : locatedClrVersion.c_str(),
+            managedAssembly.c_str());
+
+    if (status != 0)
+    {
+        std::cout << "Failed to initialize the CLR" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Loads the assemblies (separated by '\n') and registers their commands
+static bool
+LoadManagedPlugins(lldb::SBDebugger debugger, const char* paths)
+{
+    if (!InitializeClr(debugger))
+    {
+        return false;
+    }
+
+    // The plugins are parsed and loaded concurrently by the managed side
+    char* plugins;
+    {
+        TraceSpan loadSpan("load", "LoadPlugins");
+        plugins = clrInterop.LoadPlugins(paths);
+    }
+
+    if (plugins == nullptr || plugins[0] == '\0')
+    {
+        free(plugins);
+        std::cout << "No plugin loaded" << std::endl;
+        return false;
+    }
+
+    // lldb commands must be registered from this thread
+    char* context;
+
+    for (char* line = strtok_r(plugins, "\n", &context); line != nullptr; line = strtok_r(nullptr, "\n", &context))
+    {
+        // Each line is "name\tpath"
+        char* path = strchr(line, '\t');
+
+        if (path != nullptr)
+        {
+            *path++ = '\0';
+        }
+
+        // The commands keep a pointer to the name
+        char* pluginName = strdup(line);
+
+        // Loading a plugin again replaces the previous version
+        UnbindManagedCommands(pluginName);
 
+        auto exportNames = RegisterManagedCommands(debugger, pluginName);
+
+        // Lets the next session register the commands with --lazy without parsing the assembly
+        if (path != nullptr)
+        {
+            WriteExportManifest(path, exportNames);
+        }
+
+        std::cout << "Imported " << exportNames.size() << " functions from " << pluginName << std::endl;
+    }
+
+    free(plugins);
+
+    return true;
+}
+
+class ManagedJobsCommand : public lldb::SBCommandPluginInterface
+{
 public:
+    virtual bool DoExecute(lldb::SBDebugger debugger, char **command, lldb::SBCommandReturnObject &result)
+    {
+        g_jobs.List(result);
+        return true;
+    }
+};
 
-    LoadManagedCommand()
+class ManagedWaitCommand : public lldb::SBCommandPluginInterface
+{
+public:
+    virtual bool DoExecute(lldb::SBDebugger debugger, char **command, lldb::SBCommandReturnObject &result)
     {
-       _interop = new ClrInterop();
+        int id = -1;
+
+        if (command != nullptr && command[0] != nullptr)
+        {
+            id = atoi(command[0]);
+        }
+
+        return g_jobs.Wait(id, result);
     }
+};
 
+class LoadManagedStatsCommand : public lldb::SBCommandPluginInterface
+{
+public:
     virtual bool DoExecute(lldb::SBDebugger debugger, char **command, lldb::SBCommandReturnObject &result)
     {
-        auto path = command[0];
+        const char* action = command != nullptr ? command[0] : nullptr;
 
-        if (!_interop->Initialized)
+        if (action == nullptr || strcmp(action, "-v") == 0)
         {
-            std::string managedAssembly;
+            std::string output;
+            FormatServiceStats(output, action != nullptr);
+            result.Printf("%s", output.c_str());
+        }
+        else if (strcmp(action, "--json") == 0)
+        {
+            std::string output;
+            FormatServiceStatsJson(output);
+            result.Printf("%s", output.c_str());
+        }
+        else if (strcmp(action, "reset") == 0)
+        {
+            ResetServiceStats();
+        }
+        else if (strcmp(action, "on") == 0 || strcmp(action, "off") == 0)
+        {
+            g_serviceStatsEnabled.store(strcmp(action, "on") == 0, std::memory_order_relaxed);
+        }
+        else
+        {
+            result.Printf("Usage: LoadManagedStats [-v|--json|reset|on|off]\n");
+            result.SetStatus(lldb::eReturnStatusFailed);
+            return false;
+        }
+
+        return true;
+    }
+};
 
-            managedAssembly += libraryPath;
-            managedAssembly += "/PluginInterop.dll";
+class LoadManagedTraceCommand : public lldb::SBCommandPluginInterface
+{
+public:
+    virtual bool DoExecute(lldb::SBDebugger debugger, char **command, lldb::SBCommandReturnObject &result)
+    {
+        const char* action = command != nullptr ? command[0] : nullptr;
 
-            int status = _interop->Initialize(
-                    "LoadManaged",
-                    libraryPath,
-                    clrPath,
-                    managedAssembly.c_str());
+        if (action == nullptr)
+        {
+            uint64_t dropped;
+            size_t count = GetTraceSpanCount(&dropped);
 
-            if (status != 0)
+            result.Printf("Tracing is %s, %zu spans recorded (%llu overwritten)\n",
+                g_traceEnabled ? "on" : "off",
+                count,
+                (unsigned long long)dropped);
+        }
+        else if (strcmp(action, "on") == 0 || strcmp(action, "off") == 0)
+        {
+            g_traceEnabled.store(strcmp(action, "on") == 0, std::memory_order_relaxed);
+        }
+        else if (strcmp(action, "clear") == 0)
+        {
+            // Optional new capacity, in spans
+            ResetTrace(command[1] != nullptr ? strtoull(command[1], nullptr, 10) : 0);
+        }
+        else if (strcmp(action, "save") == 0 && command[1] != nullptr)
+        {
+            std::string error;
+
+            if (!WriteChromeTrace(command[1], error))
             {
-                std::cout << "Failed to initialize the CLR" << std::endl;
+                result.Printf("Failed to write %s: %s\n", command[1], error.c_str());
+                result.SetStatus(lldb::eReturnStatusFailed);
                 return false;
             }
+
+            result.Printf("Trace written to %s\n", command[1]);
+        }
+        else
+        {
+            result.Printf("Usage: LoadManagedTrace [on|off|clear [capacity]|save <file>]\n");
+            result.SetStatus(lldb::eReturnStatusFailed);
+            return false;
+        }
+
+        return true;
+    }
+};
+
+class LoadManagedFreezeCommand : public lldb::SBCommandPluginInterface
+{
+public:
+    virtual bool DoExecute(lldb::SBDebugger debugger, char **command, lldb::SBCommandReturnObject &result)
+    {
+        const char* action = command != nullptr ? command[0] : nullptr;
+        lldb::SBProcess process = debugger.GetSelectedTarget().GetProcess();
+
+        if (action == nullptr)
+        {
+            std::shared_ptr<MemorySnapshot> snapshot = process.IsValid() ? GetFrozenSnapshot(process) : nullptr;
+
+            if (snapshot == nullptr)
+            {
+                result.Printf("Freeze mode is off\n");
+                return true;
+            }
+
+            uint64_t readableBytes, storedBytes;
+            snapshot->GetSizes(&readableBytes, &storedBytes);
+
+            result.Printf("Freeze mode is on, %zu pages captured (%.1f MB, %.1f MB stored)\n",
+                snapshot->GetPageCount(),
+                readableBytes / (1024.0 * 1024.0),
+                storedBytes / (1024.0 * 1024.0));
+        }
+        else if (strcmp(action, "on") == 0 || strcmp(action, "off") == 0)
+        {
+            SetFreezeMode(strcmp(action, "on") == 0);
+        }
+        else if (strcmp(action, "clear") == 0)
+        {
+            ClearFrozenSnapshot();
+            InvalidateCaches(CACHE_KIND_MASK(CacheKindProcess));
+        }
+        else if (strcmp(action, "save") == 0 && command[1] != nullptr)
+        {
+            std::shared_ptr<MemorySnapshot> snapshot = process.IsValid() ? GetFrozenSnapshot(process) : nullptr;
+            std::string error;
+
+            if (snapshot == nullptr)
+            {
+                result.Printf("Freeze mode is off, there is no snapshot to save\n");
+                result.SetStatus(lldb::eReturnStatusFailed);
+                return false;
+            }
+
+            if (!snapshot->Save(command[1], error))
+            {
+                result.Printf("Failed to write %s: %s\n", command[1], error.c_str());
+                result.SetStatus(lldb::eReturnStatusFailed);
+                return false;
+            }
+
+            result.Printf("Snapshot of %zu pages written to %s\n", snapshot->GetPageCount(), command[1]);
+        }
+        else if (strcmp(action, "load") == 0 && command[1] != nullptr)
+        {
+            std::string error;
+
+            if (!process.IsValid())
+            {
+                result.Printf("No process to attach the snapshot to\n");
+                result.SetStatus(lldb::eReturnStatusFailed);
+                return false;
+            }
+
+            std::shared_ptr<MemorySnapshot> snapshot = MemorySnapshot::Load(command[1], error);
+
+            if (snapshot == nullptr)
+            {
+                result.Printf("Failed to load %s: %s\n", command[1], error.c_str());
+                result.SetStatus(lldb::eReturnStatusFailed);
+                return false;
+            }
+
+            // The pages missing from the snapshot are read from the process, so it must be the same stop
+            bool force = command[2] != nullptr && strcmp(command[2], "--force") == 0;
+
+            if (!force && (snapshot->GetProcessId() != process.GetProcessID() || snapshot->GetStopId() != process.GetStopID()))
+            {
+                result.Printf("The snapshot was taken from process %llu at stop %u, not the current stop of process %llu (%u). Use --force to load it anyway.\n",
+                    (unsigned long long)snapshot->GetProcessId(),
+                    snapshot->GetStopId(),
+                    (unsigned long long)process.GetProcessID(),
+                    process.GetStopID());
+                result.SetStatus(lldb::eReturnStatusFailed);
+                return false;
+            }
+
+            size_t pageCount = snapshot->GetPageCount();
+            SetFrozenSnapshot(process, std::move(snapshot));
+
+            result.Printf("Serving %zu pages from %s until the process resumes\n", pageCount, command[1]);
+        }
+        else
+        {
+            result.Printf("Usage: LoadManagedFreeze [on|off|clear|save <file>|load <file> [--force]]\n");
+            result.SetStatus(lldb::eReturnStatusFailed);
+            return false;
         }
 
-        char* pluginName = _interop->LoadPlugin(path);
+        return true;
+    }
+};
 
-        int exportCount = _interop->GetExportCount(pluginName);
+class LoadManagedCaptureCommand : public lldb::SBCommandPluginInterface
+{
+public:
+    virtual bool DoExecute(lldb::SBDebugger debugger, char **command, lldb::SBCommandReturnObject &result)
+    {
+        const char* action = command != nullptr ? command[0] : nullptr;
+        lldb::SBProcess process = debugger.GetSelectedTarget().GetProcess();
 
-        auto interpreter = debugger.GetCommandInterpreter();
+        if (action == nullptr)
+        {
+            std::shared_ptr<MemorySnapshot> capture = GetMemoryCapture();
 
-        for (int i = 0; i < exportCount; i++){
-            char* exportName = _interop->GetExportName(pluginName, i);
+            if (capture == nullptr)
+            {
+                result.Printf("Capture is off\n");
+                return true;
+            }
 
-            auto command = new ManagedCommand(pluginName, exportName, _interop->Invoke);
+            uint64_t readableBytes, storedBytes;
+            capture->GetSizes(&readableBytes, &storedBytes);
 
-            interpreter.AddCommand(exportName, command, exportName);
+            result.Printf("Capture is %s, %zu pages recorded (%.1f MB)\n",
+                process.IsValid() && GetActiveCapture(process) != nullptr ? "on" : "stopped",
+                capture->GetPageCount(),
+                readableBytes / (1024.0 * 1024.0));
         }
+        else if (strcmp(action, "on") == 0)
+        {
+            if (!process.IsValid())
+            {
+                result.Printf("No process to capture\n");
+                result.SetStatus(lldb::eReturnStatusFailed);
+                return false;
+            }
 
-        std::cout << "Imported " << exportCount << " functions" << std::endl;
+            StartMemoryCapture(process);
+            result.Printf("Recording the memory read by the next commands until the process resumes\n");
+        }
+        else if (strcmp(action, "off") == 0)
+        {
+            StopMemoryCapture();
+        }
+        else if (strcmp(action, "clear") == 0)
+        {
+            ClearMemoryCapture();
+        }
+        else if (strcmp(action, "save") == 0 && command[1] != nullptr)
+        {
+            std::shared_ptr<MemorySnapshot> capture = GetMemoryCapture();
+            std::string error;
+
+            if (capture == nullptr || !process.IsValid())
+            {
+                result.Printf("There is no capture to save\n");
+                result.SetStatus(lldb::eReturnStatusFailed);
+                return false;
+            }
+
+            if (!WriteCaptureCore(process, *capture, command[1], error))
+            {
+                result.Printf("Failed to write %s: %s\n", command[1], error.c_str());
+                result.SetStatus(lldb::eReturnStatusFailed);
+                return false;
+            }
+
+            uint64_t readableBytes, storedBytes;
+            capture->GetSizes(&readableBytes, &storedBytes);
+
+            result.Printf("Core of %zu pages (%.1f MB) written to %s\n",
+                capture->GetPageCount(),
+                readableBytes / (1024.0 * 1024.0),
+                command[1]);
+        }
+        else
+        {
+            result.Printf("Usage: LoadManagedCapture [on|off|clear|save <core>]\n");
+            result.SetStatus(lldb::eReturnStatusFailed);
+            return false;
+        }
 
         return true;
     }
 };
 
+class ManagedCancelCommand : public lldb::SBCommandPluginInterface
+{
+public:
+    virtual bool DoExecute(lldb::SBDebugger debugger, char **command, lldb::SBCommandReturnObject &result)
+    {
+        if (command == nullptr || command[0] == nullptr)
+        {
+            result.Printf("Usage: ManagedCancel <job id>\n");
+            result.SetStatus(lldb::eReturnStatusFailed);
+            return false;
+        }
+
+        int id = atoi(command[0]);
+
+        if (!g_jobs.Cancel(id))
+        {
+            result.Printf("No running managed job with id %d\n", id);
+            result.SetStatus(lldb::eReturnStatusFailed);
+            return false;
+        }
+
+        // Plugins have to poll the interrupt flag, so the job might take a moment to stop
+        result.Printf("Cancellation requested for job %d\n", id);
+        return true;
+    }
+};
+
+class LoadManagedCommand : public lldb::SBCommandPluginInterface
+{
+public:
+    virtual bool DoExecute(lldb::SBDebugger debugger, char **command, lldb::SBCommandReturnObject &result)
+    {
+        TraceSpan span("load", "LoadManaged");
+
+        bool lazy = command != nullptr && command[0] != nullptr && strcmp(command[0], "--lazy") == 0;
+
+        std::string paths;
+
+        if (!ExpandPluginPaths(lazy ? command + 1 : command, paths))
+        {
+            result.Printf("Usage: LoadManaged [--lazy] <path|directory|pattern>...\n");
+            result.SetStatus(lldb::eReturnStatusFailed);
+            return false;
+        }
+
+        if (lazy)
+        {
+            return DeferPlugins(debugger, paths);
+        }
+
+        return LoadManagedPlugins(debugger, paths.c_str());
+    }
+
+private:
+    static bool DeferPlugins(lldb::SBDebugger debugger, const std::string& paths)
+    {
+        std::istringstream lines(paths);
+        std::string path;
+        bool success = false;
+
+        while (std::getline(lines, path))
+        {
+            int count = DeferManagedCommands(debugger, path);
+
+            // Assemblies without commands are the dependencies found in the directories
+            if (count > 0)
+            {
+                std::cout << "Registered " << count << " functions from " << path << ", loaded on first use" << std::endl;
+                success = true;
+            }
+            else if (count == -1)
+            {
+                std::cout << "Could not read the exports of " << path << std::endl;
+            }
+        }
+
+        return success;
+    }
+
+    // Replaces the directories by the assemblies they contain and expands the patterns, and joins the paths with '\n'
+    static bool ExpandPluginPaths(char** command, std::string& paths)
+    {
+        if (command == nullptr || command[0] == nullptr)
+        {
+            return false;
+        }
+
+        for (int i = 0; command[i] != nullptr; i++)
+        {
+            glob_t matches;
+
+            struct stat st;
+            if (stat(command[i], &st) == 0 && S_ISDIR(st.st_mode))
+            {
+                std::string pattern(command[i]);
+                pattern += "/*.dll";
+
+                if (glob(pattern.c_str(), 0, nullptr, &matches) != 0)
+                {
+                    std::cout << "No assembly in " << command[i] << std::endl;
+                    continue;
+                }
+            }
+            else if (glob(command[i], GLOB_NOCHECK | GLOB_TILDE, nullptr, &matches) != 0)
+            {
+                continue;
+            }
+
+            for (size_t j = 0; j < matches.gl_pathc; j++)
+            {
+                paths += matches.gl_pathv[j];
+                paths += '\n';
+            }
+
+            globfree(&matches);
+        }
+
+        return !paths.empty();
+    }
+};
+
+class UnloadManagedCommand : public lldb::SBCommandPluginInterface
+{
+public:
+    virtual bool DoExecute(lldb::SBDebugger debugger, char **command, lldb::SBCommandReturnObject &result)
+    {
+        if (command == nullptr || command[0] == nullptr || !clrInterop.Initialized)
+        {
+            result.Printf("Usage: UnloadManaged <plugin name>\n");
+            result.SetStatus(lldb::eReturnStatusFailed);
+            return false;
+        }
+
+        std::string pluginName(command[0]);
+
+        UnbindManagedCommands(pluginName);
+
+        int status = clrInterop.UnloadPlugin(pluginName.c_str());
+
+        if (status == -1)
+        {
+            result.Printf("Plugin %s is not loaded\n", pluginName.c_str());
+            result.SetStatus(lldb::eReturnStatusFailed);
+            return false;
+        }
+
+        if (status == 1)
+        {
+            result.Printf("Plugin %s is still referenced (by a background command?), its memory will be reclaimed once it is released\n", pluginName.c_str());
+        }
+
+        return true;
+    }
+};
+
+class ReloadManagedCommand : public lldb::SBCommandPluginInterface
+{
+public:
+    virtual bool DoExecute(lldb::SBDebugger debugger, char **command, lldb::SBCommandReturnObject &result)
+    {
+        if (!clrInterop.Initialized)
+        {
+            result.Printf("No managed plugin loaded\n");
+            result.SetStatus(lldb::eReturnStatusFailed);
+            return false;
+        }
+
+        std::set<std::string> plugins;
+
+        if (command != nullptr && command[0] != nullptr)
+        {
+            plugins.insert(command[0]);
+        }
+        else
+        {
+            plugins = loadedPlugins;
+        }
+
+        bool success = true;
+
+        for (auto& pluginName : plugins)
+        {
+            success &= ReloadManagedPlugin(debugger, pluginName);
+        }
+
+        return success;
+    }
+};
+
 
 static int
 callback(struct dl_phdr_info *info, size_t size, void *data)
@@ -137,35 +910,24 @@ callback(struct dl_phdr_info *info, size_t size, void *data)
 
 bool LocateCoreClr(lldb::SBDebugger debugger)
 {
-    auto target = debugger.GetSelectedTarget();
+    RuntimeLocation location;
 
-    if (!target.IsValid())
+    // Without a target yet, the latest runtime installed is used
+    if (!LocateRuntime(debugger.GetSelectedTarget(), location))
     {
-        std::cout << "Invalid debug target" << std::endl;
         return false;
     }
 
-    int numModules = target.GetNumModules();
+    locatedClrPath = location.Directory;
+    locatedClrVersion = location.Version;
+    clrPath = locatedClrPath.c_str();
 
-    for (int i = 0; i < numModules; i++)
+    if (!location.TargetVersion.empty() && location.TargetVersion != location.Version)
     {
-        auto module = target.GetModuleAtIndex(i);
-
-        if (!module.IsValid())
-        {
-            continue;
-        }
-
-        auto fileName = module.GetFileSpec().GetFilename();
-
-        if (strcmp(fileName, "libcoreclr.so") == 0)
-        {
-            clrPath = strdup(module.GetFileSpec().GetDirectory());
-            return true;
-        }
+        std::cout << "The target runs CoreCLR " << location.TargetVersion << ", using " << location.Version << " instead" << std::endl;
     }
 
-    return false;
+    return true;
 }
 
 bool lldb::PluginInitialize(lldb::SBDebugger debugger)
@@ -174,7 +936,26 @@ bool lldb::PluginInitialize(lldb::SBDebugger debugger)
 
     auto interpreter = debugger.GetCommandInterpreter();
     interpreter.AddCommand("SetClrPath", new SetClrPathCommand(), "Set the path to the CLR");
-    interpreter.AddCommand("LoadManaged", new LoadManagedCommand(), "Load managed plugin");
+    interpreter.AddCommand("LoadManaged", new LoadManagedCommand(), "Load managed plugins, given as paths, directories or patterns. With --lazy, only register their commands and load them on first use");
+    interpreter.AddCommand("UnloadManaged", new UnloadManagedCommand(), "Unload a managed plugin. Its commands remain registered but fail until it is loaded again");
+    interpreter.AddCommand("ReloadManaged", new ReloadManagedCommand(), "Reload a managed plugin (or all of them) from disk. Plugins are also reloaded automatically when their files change");
+    interpreter.AddCommand("ManagedJobs", new ManagedJobsCommand(), "List the managed commands running in the background (started with --async)");
+    interpreter.AddCommand("ManagedWait", new ManagedWaitCommand(), "Wait for a background managed command to complete, or all of them if no id is given");
+    interpreter.AddCommand("ManagedCancel", new ManagedCancelCommand(), "Request the cancellation of a background managed command");
+    interpreter.AddCommand("LoadManagedTrace", new LoadManagedTraceCommand(), "Record a timeline of the managed commands and the services they call, and save it in the Chrome trace format");
+    interpreter.AddCommand("LoadManagedStats", new LoadManagedStatsCommand(), "Show the call counts and latencies of the services used by the managed commands (-v for histograms), or reset/enable/disable them");
+    interpreter.AddCommand("LoadManagedFreeze", new LoadManagedFreezeCommand(), "Keep the memory read from a stopped live process in a compressed snapshot reused by the next commands, and save or load it");
+    interpreter.AddCommand("LoadManagedCapture", new LoadManagedCaptureCommand(), "Record the memory read by the next commands, and save it as a minimal ELF core holding only those pages");
+
+    // The background commands would read the memory of a running process
+    AddResumeHandler([]() { g_jobs.CancelAll(); });
+    AddResumeHandler([]() { ReadPrefetcher::Shared().CancelAll(); });
+    AddResumeHandler([]() { ClearFrozenSnapshot(); });
+
+    if (!StartInvalidationListener(debugger))
+    {
+        std::cout << "Could not listen to the process events, the caches will only be refreshed on the next command" << std::endl;
+    }
 
     if (!LocateCoreClr(debugger))
     {
@@ -246,6 +246,78 @@ typedef struct _DEBUG_STACK_FRAME_EX
 struct ILLDBServices;
 typedef HRESULT (*PFN_EXCEPTION_CALLBACK)(ILLDBServices *services);
 
+typedef struct _DEBUG_MEMORY_RANGE
+{
+    ULONG64 Start;
+    ULONG64 Length;
+} DEBUG_MEMORY_RANGE, *PDEBUG_MEMORY_RANGE;
+
+#define DEBUG_MEMORY_REGION_READ    0x00000001
+#define DEBUG_MEMORY_REGION_WRITE   0x00000002
+#define DEBUG_MEMORY_REGION_EXECUTE 0x00000004
+
+typedef struct _DEBUG_MEMORY_REGION
+{
+    ULONG64 BaseAddress;
+    ULONG64 RegionSize;
+    ULONG Protection;
+    ULONG Reserved;
+} DEBUG_MEMORY_REGION, *PDEBUG_MEMORY_REGION;
+
+// Field of a layout registered with RegisterStructLayout, relative to the object address
+typedef struct _DEBUG_STRUCT_FIELD
+{
+    ULONG Offset;
+    ULONG Size;
+} DEBUG_STRUCT_FIELD, *PDEBUG_STRUCT_FIELD;
+
+// Why WalkChain stopped
+#define DEBUG_CHAIN_END_NULL        0x00000000
+#define DEBUG_CHAIN_END_LIMIT       0x00000001
+#define DEBUG_CHAIN_END_CYCLE       0x00000002
+#define DEBUG_CHAIN_END_UNREADABLE  0x00000003
+#define DEBUG_CHAIN_END_INTERRUPTED 0x00000004
+
+#define DEBUG_THREAD_STACKS_CONTEXTS  0x00000001
+#define DEBUG_THREAD_STACKS_SYMBOLS   0x00000002
+
+#define DEBUG_THREAD_STACKS_NO_SYMBOL 0xFFFFFFFF
+
+// Stacks of all the threads, stored as parallel arrays. The frames of thread i
+// are [FirstFrames[i], FirstFrames[i + 1]). Owned by the services until
+// ReleaseThreadStacks.
+typedef struct _DEBUG_THREAD_STACKS
+{
+    ULONG ThreadCount;
+    ULONG FrameCount;
+    const ULONG *ThreadIds;
+    const ULONG *FirstFrames;
+    const ULONG64 *InstructionOffsets;
+    const ULONG64 *StackOffsets;
+    const ULONG64 *FrameOffsets;
+
+    // Registers of the top frame of each thread (DEBUG_THREAD_STACKS_CONTEXTS), ContextSize bytes each
+    const BYTE *Contexts;
+    ULONG ContextSize;
+
+    // Index in Symbols of the function of each frame, or DEBUG_THREAD_STACKS_NO_SYMBOL (DEBUG_THREAD_STACKS_SYMBOLS)
+    const ULONG *SymbolIndices;
+    const ULONG64 *Displacements;
+
+    // "module!function", each name stored once
+    ULONG SymbolCount;
+    const PCSTR *Symbols;
+
+    PVOID Reserved;
+} DEBUG_THREAD_STACKS, *PDEBUG_THREAD_STACKS;
+
+// Filters the candidates of ScanMemory. Called concurrently from worker threads.
+typedef BOOL (*PFN_SCAN_PREDICATE)(PVOID context, ULONG64 address, const BYTE *data, ULONG size);
+
+// Receives the ScanMemory matches in batches, on the thread that called ScanMemory.
+// Returning anything but S_OK stops the scan.
+typedef HRESULT (*PFN_SCAN_RESULTS_CALLBACK)(PVOID context, const ULONG64 *addresses, ULONG count);
+
 //----------------------------------------------------------------------------
 // ILLDBServices
 //----------------------------------------------------------------------------
@@ -575,6 +647,111 @@ virtual HRESULT GetStackOffset(
 
 virtual HRESULT GetFrameOffset(
         PULONG64 offset) = 0;
+
+//------------------------------------------------
+// LoadManaged extensions
+//------------------------------------------------
+
+// Searches the given ranges for a (masked) byte pattern, or for the positions
+// accepted by the predicate if pattern is null, using all the cores.
+// Matches are aligned on alignment bytes and delivered in batches to the callback.
+// Returns S_FALSE if the callback stopped the scan, E_ABORT if it was interrupted.
+virtual HRESULT ScanMemory(
+        const DEBUG_MEMORY_RANGE *ranges,
+        ULONG rangeCount,
+        const BYTE *pattern,
+        const BYTE *mask,
+        ULONG patternSize,
+        ULONG alignment,
+        PFN_SCAN_PREDICATE predicate,
+        PVOID predicateContext,
+        PFN_SCAN_RESULTS_CALLBACK callback,
+        PVOID callbackContext) = 0;
+
+// Searches [offset, offset + length) for a (masked) pattern on the calling thread,
+// using the widest SIMD instructions supported by the CPU. Aligned pointer-sized
+// values without mask have a dedicated fast path (GC root hunting).
+// The matching addresses are stored in ascending order. Returns S_FALSE if the
+// buffer was filled before the end of the range: the search can be resumed
+// after the last match.
+virtual HRESULT SearchVirtual(
+        ULONG64 offset,
+        ULONG64 length,
+        const BYTE *pattern,
+        const BYTE *mask,
+        ULONG patternSize,
+        ULONG alignment,
+        PULONG64 matches,
+        ULONG matchesSize,
+        PULONG matchCount) = 0;
+
+// Returns the mapped regions of the target sorted by address, cached until
+// the next stop. regionCount receives the total number of regions: call with
+// a null buffer to size it. Returns S_FALSE if the buffer was too small.
+virtual HRESULT GetMemoryRegions(
+        PDEBUG_MEMORY_REGION regions,
+        ULONG regionsSize,
+        PULONG regionCount) = 0;
+
+// Returns the region containing offset. If offset is not mapped, returns
+// S_FALSE with the next region above it, or E_FAIL if there is none.
+virtual HRESULT QueryVirtual(
+        ULONG64 offset,
+        PDEBUG_MEMORY_REGION region) = 0;
+
+// Captures the frames of every thread in one pass, up to maxFrames per thread
+// (0 for all of them). The symbols are resolved serially on the calling
+// thread, each distinct instruction offset once, as lldb can't look them up in
+// parallel. The SB API lock is released every 64 offsets. The snapshot must be
+// freed with ReleaseThreadStacks. Returns E_ABORT if the command was interrupted.
+virtual HRESULT GetAllThreadStacks(
+        ULONG maxFrames,
+        ULONG flags,
+        PDEBUG_THREAD_STACKS *stacks) = 0;
+
+virtual HRESULT ReleaseThreadStacks(
+        PDEBUG_THREAD_STACKS stacks) = 0;
+
+// Registers the fields read by ReadStructs. Registering the same fields again
+// returns the same id. recordSize receives the sum of the field sizes: the
+// fields are packed in this order, without padding, in each output record.
+virtual HRESULT RegisterStructLayout(
+        const DEBUG_STRUCT_FIELD *fields,
+        ULONG fieldCount,
+        PULONG layoutId,
+        PULONG recordSize) = 0;
+
+// Reads the fields of the layout for each address into consecutive records,
+// with one read of the span covering the fields per object. The records of
+// the objects that couldn't be fully read are zeroed and their status (if
+// not null) set to 0. Returns S_FALSE if any object failed, E_ABORT if the
+// command was interrupted.
+virtual HRESULT ReadStructs(
+        ULONG layoutId,
+        const ULONG64 *addresses,
+        ULONG count,
+        PVOID buffer,
+        ULONG bufferSize,
+        PBYTE status) = 0;
+
+// Follows the pointer at nextOffset of each node from start, up to maxNodes
+// nodes, through the page cache. The address of each node is stored in nodes
+// and the pointer-sized words at payloadOffsets in payloads (payloadCount per
+// node). next receives the pointer that wasn't followed, to resume a chain
+// cut by the limit. Returns S_OK if the chain ended with a null pointer,
+// S_FALSE with the reason in endReason (limit, cycle or unreadable node), or
+// E_ABORT with DEBUG_CHAIN_END_INTERRUPTED and the nodes walked so far.
+virtual HRESULT WalkChain(
+        ULONG64 start,
+        ULONG nextOffset,
+        const ULONG *payloadOffsets,
+        ULONG payloadCount,
+        ULONG maxNodes,
+        PULONG64 nodes,
+        PULONG64 payloads,
+        PULONG nodeCount,
+        PULONG64 next,
+        PULONG endReason) = 0;
 };
 
 #ifdef __cplusplus
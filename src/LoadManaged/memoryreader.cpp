@@ -0,0 +1,504 @@
+#include "memoryreader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "lldb/API/SBBreakpoint.h"
+#include "lldb/API/SBBreakpointLocation.h"
+#include "lldb/API/SBFileSpec.h"
+#include "lldb/API/SBTarget.h"
+#include "invalidation.h"
+#include "memorysnapshot.h"
+#include "sosplugin.h"
+
+//----------------------------------------------------------------------------
+// CoreFile
+//----------------------------------------------------------------------------
+
+CoreFile::CoreFile() :
+        m_fd(-1),
+        m_base(nullptr),
+        m_size(0)
+{
+}
+
+CoreFile::~CoreFile()
+{
+    if (m_base != nullptr)
+    {
+        munmap((void*)m_base, m_size);
+    }
+
+    if (m_fd != -1)
+    {
+        close(m_fd);
+    }
+}
+
+std::shared_ptr<CoreFile>
+CoreFile::Open(
+        const char* path)
+{
+    std::shared_ptr<CoreFile> core(new CoreFile());
+
+    core->m_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (core->m_fd == -1)
+    {
+        return nullptr;
+    }
+
+    struct stat sb;
+    if (fstat(core->m_fd, &sb) == -1 || (size_t)sb.st_size < sizeof(Elf64_Ehdr))
+    {
+        return nullptr;
+    }
+
+    core->m_size = sb.st_size;
+
+    void* base = mmap(nullptr, core->m_size, PROT_READ, MAP_PRIVATE, core->m_fd, 0);
+    if (base == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    core->m_base = (const uint8_t*)base;
+
+    const Elf64_Ehdr* header = (const Elf64_Ehdr*)core->m_base;
+    uint64_t programHeaderCount = header->e_phnum;
+
+    // With more than 65534 segments, the count is in the first section header
+    if (programHeaderCount == PN_XNUM
+        && header->e_shoff != 0
+        && header->e_shoff + sizeof(Elf64_Shdr) <= core->m_size)
+    {
+        programHeaderCount = ((const Elf64_Shdr*)(core->m_base + header->e_shoff))->sh_info;
+    }
+
+    if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0
+        || header->e_ident[EI_CLASS] != ELFCLASS64
+        || header->e_type != ET_CORE
+        || header->e_phentsize != sizeof(Elf64_Phdr)
+        || header->e_phoff + programHeaderCount * sizeof(Elf64_Phdr) > core->m_size)
+    {
+        return nullptr;
+    }
+
+    const Elf64_Phdr* programHeaders = (const Elf64_Phdr*)(core->m_base + header->e_phoff);
+
+    for (uint64_t i = 0; i < programHeaderCount; i++)
+    {
+        const Elf64_Phdr& ph = programHeaders[i];
+
+        if (ph.p_type != PT_LOAD || ph.p_memsz == 0)
+        {
+            continue;
+        }
+
+        CoreSegment segment;
+        segment.VirtualAddress = ph.p_vaddr;
+        segment.MemorySize = ph.p_memsz;
+        segment.FileOffset = ph.p_offset;
+        segment.FileSize = std::min<uint64_t>(ph.p_filesz, ph.p_offset < core->m_size ? core->m_size - ph.p_offset : 0);
+        segment.Flags = ph.p_flags;
+
+        core->m_segments.push_back(segment);
+    }
+
+    std::sort(core->m_segments.begin(), core->m_segments.end(), [](const CoreSegment& left, const CoreSegment& right)
+    {
+        return left.VirtualAddress < right.VirtualAddress;
+    });
+
+    // The scanners read large chunks sequentially
+    madvise(base, core->m_size, MADV_SEQUENTIAL);
+
+    return core;
+}
+
+const CoreSegment*
+CoreFile::FindSegment(
+        uint64_t address) const
+{
+    auto it = std::upper_bound(m_segments.begin(), m_segments.end(), address, [](uint64_t value, const CoreSegment& segment)
+    {
+        return value < segment.VirtualAddress;
+    });
+
+    if (it == m_segments.begin())
+    {
+        return nullptr;
+    }
+
+    --it;
+
+    if (address - it->VirtualAddress >= it->MemorySize)
+    {
+        return nullptr;
+    }
+
+    return &*it;
+}
+
+const uint8_t*
+CoreFile::Translate(
+        uint64_t address,
+        size_t* available) const
+{
+    const CoreSegment* segment = FindSegment(address);
+
+    *available = 0;
+
+    // Pages that weren't dumped (filesz < memsz) aren't in the file, let lldb decide what to do with them
+    if (segment == nullptr || address - segment->VirtualAddress >= segment->FileSize)
+    {
+        return nullptr;
+    }
+
+    uint64_t offset = address - segment->VirtualAddress;
+
+    *available = segment->FileSize - offset;
+    return m_base + segment->FileOffset + offset;
+}
+
+//----------------------------------------------------------------------------
+// Readers
+//----------------------------------------------------------------------------
+
+// Goes through lldb, one caller at a time
+class SBProcessMemoryReader : public TargetMemoryReader
+{
+private:
+    lldb::SBProcess m_process;
+
+public:
+    SBProcessMemoryReader(lldb::SBProcess process) :
+            m_process(process)
+    {
+    }
+
+    virtual size_t Read(uint64_t address, void* buffer, size_t size)
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_sbApiLock);
+
+        lldb::SBError error;
+        return m_process.ReadMemory(address, buffer, size, error);
+    }
+
+    virtual const char* GetName() const
+    {
+        return "lldb";
+    }
+};
+
+class CoreMemoryReader : public TargetMemoryReader
+{
+private:
+    std::shared_ptr<CoreFile> m_core;
+    SBProcessMemoryReader m_fallback;
+
+public:
+    CoreMemoryReader(std::shared_ptr<CoreFile> core, lldb::SBProcess process) :
+            m_core(core),
+            m_fallback(process)
+    {
+    }
+
+    virtual size_t Read(uint64_t address, void* buffer, size_t size)
+    {
+        size_t read = 0;
+
+        while (read < size)
+        {
+            size_t available;
+            const uint8_t* source = m_core->Translate(address + read, &available);
+
+            if (source == nullptr)
+            {
+                // Not in the core (read-only module pages are usually left out), lldb will get it from the module files
+                size_t fallback = m_fallback.Read(address + read, (uint8_t*)buffer + read, size - read);
+                return read + fallback;
+            }
+
+            size_t count = std::min(available, size - read);
+            memcpy((uint8_t*)buffer + read, source, count);
+            read += count;
+        }
+
+        return read;
+    }
+
+    virtual std::shared_ptr<CoreFile> GetCoreFile() const
+    {
+        return m_core;
+    }
+
+    virtual const uint8_t* Map(uint64_t address, size_t size)
+    {
+        size_t available;
+        const uint8_t* source = m_core->Translate(address, &available);
+
+        return available >= size ? source : nullptr;
+    }
+
+    virtual const char* GetName() const
+    {
+        return "core mmap";
+    }
+};
+
+// Software breakpoints are trap instructions written in the process memory. SBProcess::ReadMemory
+// puts the original bytes back, process_vm_readv returns the memory as it is.
+#if defined(__x86_64__) || defined(__i386__)
+const size_t BreakpointOpcodeSize = 1;
+#else
+const size_t BreakpointOpcodeSize = 4;
+#endif
+
+struct BreakpointSite
+{
+    uint64_t Address;
+    uint8_t Original[BreakpointOpcodeSize];
+};
+
+class LiveProcessMemoryReader : public TargetMemoryReader
+{
+private:
+    pid_t m_pid;
+    lldb::SBProcess m_process;
+    SBProcessMemoryReader m_fallback;
+
+    std::mutex m_sitesLock;
+    std::shared_ptr<const std::vector<BreakpointSite>> m_sites;
+    uint64_t m_sitesGeneration;
+
+    // The readers are recreated at every stop, the sites only change when breakpoints are edited
+    std::shared_ptr<const std::vector<BreakpointSite>> GetBreakpointSites()
+    {
+        uint64_t generation = GetCacheGeneration(CACHE_KIND_MASK(CacheKindBreakpoints));
+
+        {
+            std::lock_guard<std::mutex> lock(m_sitesLock);
+
+            if (m_sites != nullptr && m_sitesGeneration == generation)
+            {
+                return m_sites;
+            }
+        }
+
+        std::lock_guard<std::recursive_mutex> sbLock(g_sbApiLock);
+        std::lock_guard<std::mutex> lock(m_sitesLock);
+
+        if (m_sites != nullptr && m_sitesGeneration == generation)
+        {
+            return m_sites;
+        }
+
+        // lldb's internal breakpoints (shared library notifications) aren't listed,
+        // they are in the dynamic loader code that the services don't read
+        auto sites = std::make_shared<std::vector<BreakpointSite>>();
+        lldb::SBTarget target = m_process.GetTarget();
+        uint32_t numBreakpoints = target.GetNumBreakpoints();
+
+        for (uint32_t i = 0; i < numBreakpoints; i++)
+        {
+            lldb::SBBreakpoint breakpoint = target.GetBreakpointAtIndex(i);
+            if (!breakpoint.IsValid() || !breakpoint.IsEnabled())
+            {
+                continue;
+            }
+
+            size_t numLocations = breakpoint.GetNumLocations();
+            for (size_t j = 0; j < numLocations; j++)
+            {
+                lldb::SBBreakpointLocation location = breakpoint.GetLocationAtIndex((uint32_t)j);
+                if (!location.IsValid() || !location.IsEnabled())
+                {
+                    continue;
+                }
+
+                BreakpointSite site;
+                site.Address = location.GetLoadAddress();
+
+                if (site.Address != LLDB_INVALID_ADDRESS &&
+                    m_fallback.Read(site.Address, site.Original, BreakpointOpcodeSize) == BreakpointOpcodeSize)
+                {
+                    sites->push_back(site);
+                }
+            }
+        }
+
+        std::sort(sites->begin(), sites->end(), [](const BreakpointSite& left, const BreakpointSite& right)
+        {
+            return left.Address < right.Address;
+        });
+
+        m_sites = sites;
+        m_sitesGeneration = generation;
+        return m_sites;
+    }
+
+    void RestoreBreakpointSites(uint64_t address, uint8_t* buffer, size_t size)
+    {
+        std::shared_ptr<const std::vector<BreakpointSite>> sites = GetBreakpointSites();
+
+        // A site starting a few bytes before the buffer can still overlap it
+        uint64_t first = address >= BreakpointOpcodeSize - 1 ? address - (BreakpointOpcodeSize - 1) : 0;
+
+        auto it = std::lower_bound(sites->begin(), sites->end(), first, [](const BreakpointSite& site, uint64_t value)
+        {
+            return site.Address < value;
+        });
+
+        for (; it != sites->end() && it->Address < address + size; ++it)
+        {
+            for (size_t i = 0; i < BreakpointOpcodeSize; i++)
+            {
+                uint64_t patched = it->Address + i;
+
+                if (patched >= address && patched < address + size)
+                {
+                    buffer[patched - address] = it->Original[i];
+                }
+            }
+        }
+    }
+
+public:
+    LiveProcessMemoryReader(pid_t pid, lldb::SBProcess process) :
+            m_pid(pid),
+            m_process(process),
+            m_fallback(process),
+            m_sitesGeneration(0)
+    {
+    }
+
+    virtual size_t Read(uint64_t address, void* buffer, size_t size)
+    {
+        struct iovec local;
+        local.iov_base = buffer;
+        local.iov_len = size;
+
+        struct iovec remote;
+        remote.iov_base = (void*)address;
+        remote.iov_len = size;
+
+        ssize_t read = process_vm_readv(m_pid, &local, 1, &remote, 1, 0);
+
+        if (read < 0)
+        {
+            // Some pages can't be read this way (guard pages, ...) while ptrace can still read them
+            return m_fallback.Read(address, buffer, size);
+        }
+
+        RestoreBreakpointSites(address, (uint8_t*)buffer, (size_t)read);
+
+        return (size_t)read;
+    }
+
+    virtual const char* GetName() const
+    {
+        return "process_vm_readv";
+    }
+
+    static bool IsSupported(pid_t pid, lldb::SBProcess process)
+    {
+        lldb::SBThread thread = process.GetSelectedThread();
+        if (!thread.IsValid())
+        {
+            return false;
+        }
+
+        // Check that we are allowed to read the process memory (local process, same user, ptrace scope)
+        uint64_t sp = thread.GetFrameAtIndex(0).GetSP();
+        uint8_t value;
+
+        struct iovec local = { &value, sizeof(value) };
+        struct iovec remote = { (void*)sp, sizeof(value) };
+
+        return process_vm_readv(pid, &local, 1, &remote, 1, 0) == sizeof(value);
+    }
+};
+
+static std::shared_ptr<TargetMemoryReader>
+CreateReader(
+        lldb::SBProcess process)
+{
+#ifdef HAVE_SBPROCESS_GETCOREFILE
+    lldb::SBFileSpec coreFile = process.GetCoreFile();
+
+    if (coreFile.IsValid())
+    {
+        char path[PATH_MAX];
+        coreFile.GetPath(path, sizeof(path));
+
+        std::shared_ptr<CoreFile> core = CoreFile::Open(path);
+
+        if (core != nullptr)
+        {
+            return std::make_shared<CoreMemoryReader>(core, process);
+        }
+    }
+#endif
+
+    const char* pluginName = process.GetPluginName();
+    bool isCore = pluginName != nullptr && strstr(pluginName, "core") != nullptr;
+
+    if (!isCore)
+    {
+        pid_t pid = (pid_t)process.GetProcessID();
+
+        if (pid > 0 && LiveProcessMemoryReader::IsSupported(pid, process))
+        {
+            return std::make_shared<LiveProcessMemoryReader>(pid, process);
+        }
+    }
+
+    return std::make_shared<SBProcessMemoryReader>(process);
+}
+
+std::shared_ptr<TargetMemoryReader>
+TargetMemoryReader::Get(
+        lldb::SBProcess process)
+{
+    static std::mutex lock;
+    static std::shared_ptr<TargetMemoryReader> reader;
+    static uint64_t readerGeneration;
+
+    std::lock_guard<std::recursive_mutex> sbLock(g_sbApiLock);
+    std::lock_guard<std::mutex> readerLock(lock);
+
+    SyncCacheGenerations(process);
+
+    uint64_t generation = GetCacheGeneration(CACHE_KIND_MASK(CacheKindProcess));
+
+    if (reader == nullptr || readerGeneration != generation)
+    {
+        reader = CreateReader(process);
+        readerGeneration = generation;
+
+        // Dumps are already local, freeze mode only caches live processes
+        std::shared_ptr<MemorySnapshot> snapshot = GetFrozenSnapshot(process);
+
+        if (snapshot != nullptr && reader->GetCoreFile() == nullptr)
+        {
+            reader = CreateSnapshotReader(reader, snapshot);
+        }
+
+        // The capture goes on top, so it also records the pages served by the frozen snapshot
+        std::shared_ptr<MemorySnapshot> capture = GetActiveCapture(process);
+
+        if (capture != nullptr)
+        {
+            reader = CreateSnapshotReader(reader, capture);
+        }
+    }
+
+    return reader;
+}
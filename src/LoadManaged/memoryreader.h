@@ -0,0 +1,84 @@
+#ifndef __MEMORYREADER_H__
+#define __MEMORYREADER_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "lldb/API/SBProcess.h"
+
+class CoreFile;
+
+//
+// Thread-safe access to the target memory for the services that fan out
+// across worker threads. Going through SBProcess::ReadMemory would serialize
+// every worker on the SB API lock, so when possible we read the memory
+// ourselves: straight from the mmapped core file for dumps, or with
+// process_vm_readv for live local processes. Anything we can't read directly
+// falls back to lldb. Like lldb, the readers return the original bytes at the
+// breakpoint sites rather than the trap instructions written there.
+//
+class TargetMemoryReader
+{
+public:
+    virtual ~TargetMemoryReader() {}
+
+    // Reads up to size bytes, stops at the first unreadable byte and returns the number of bytes read
+    virtual size_t Read(uint64_t address, void* buffer, size_t size) = 0;
+
+    // Returns a zero-copy view of the memory if the whole range is directly addressable (core mmap), nullptr otherwise
+    virtual const uint8_t* Map(uint64_t address, size_t size) { return nullptr; }
+
+    // Returns the core file backing the reader, nullptr for live processes
+    virtual std::shared_ptr<CoreFile> GetCoreFile() const { return nullptr; }
+
+    // Name of the backend, for diagnostics
+    virtual const char* GetName() const = 0;
+
+    // Returns a reader for the process, reusing the previous one while the process stays stopped
+    static std::shared_ptr<TargetMemoryReader> Get(lldb::SBProcess process);
+};
+
+//
+// PT_LOAD segments of an ELF core file
+//
+struct CoreSegment
+{
+    uint64_t VirtualAddress;
+    uint64_t MemorySize;
+    uint64_t FileOffset;
+    uint64_t FileSize;
+    uint32_t Flags;
+};
+
+class CoreFile
+{
+private:
+    int m_fd;
+    const uint8_t* m_base;
+    size_t m_size;
+    std::vector<CoreSegment> m_segments;
+
+    CoreFile();
+
+public:
+    ~CoreFile();
+
+    CoreFile(const CoreFile&) = delete;
+    CoreFile& operator=(const CoreFile&) = delete;
+
+    // Maps the file and parses its program headers. Returns nullptr if the file is not a 64-bit ELF core.
+    static std::shared_ptr<CoreFile> Open(const char* path);
+
+    // Segments sorted by virtual address
+    const std::vector<CoreSegment>& GetSegments() const { return m_segments; }
+
+    // Returns the segment containing the address, nullptr if it isn't in the core
+    const CoreSegment* FindSegment(uint64_t address) const;
+
+    // Returns a pointer to the dumped bytes at the address, and the number of contiguous bytes available from there
+    const uint8_t* Translate(uint64_t address, size_t* available) const;
+};
+
+#endif // __MEMORYREADER_H__
@@ -0,0 +1,329 @@
+#include "memoryscan.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include "threadpool.h"
+
+static const uint64_t PageSize = 4096;
+
+namespace
+{
+    // State shared between the workers and the thread that delivers the results
+    struct ScanState
+    {
+        TargetMemoryReader* Reader;
+        ScanPattern Pattern;
+        ScanPredicate Predicate;
+        void* PredicateContext;
+        const std::atomic<int>* Interrupt;
+
+        std::atomic<bool> Cancelled;
+
+        std::mutex Lock;
+        std::condition_variable ResultsAvailable;
+        std::deque<std::vector<uint64_t>> Batches;
+
+        bool ShouldStop() const
+        {
+            return Cancelled.load(std::memory_order_relaxed)
+                   || (Interrupt != nullptr && Interrupt->load(std::memory_order_relaxed) != 0);
+        }
+
+        void Publish(std::vector<uint64_t>& matches)
+        {
+            if (matches.empty())
+            {
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(Lock);
+                Batches.push_back(std::move(matches));
+            }
+
+            matches = std::vector<uint64_t>();
+            ResultsAvailable.notify_one();
+        }
+    };
+
+    void
+    ScanBlock(
+            ScanState& state,
+            const uint8_t* data,
+            size_t size,
+            size_t limit,
+            uint64_t address,
+            std::vector<uint64_t>& matches)
+    {
+        const ScanPattern& pattern = state.Pattern;
+
+        if (pattern.Bytes != nullptr)
+        {
+            size_t first = matches.size();
+
+            FindPatternMatches(data, size, limit, address, pattern, matches);
+
+            if (state.Predicate != nullptr)
+            {
+                auto end = std::remove_if(matches.begin() + first, matches.end(), [&](uint64_t match)
+                {
+                    return !state.Predicate(state.PredicateContext, match, data + (match - address), (uint32_t)pattern.Size);
+                });
+
+                matches.erase(end, matches.end());
+            }
+        }
+        else
+        {
+            size_t alignment = pattern.Alignment == 0 ? 1 : pattern.Alignment;
+            size_t last = size < pattern.Size ? 0 : std::min(limit, size - pattern.Size + 1);
+
+            for (size_t offset = (alignment - address % alignment) % alignment; offset < last; offset += alignment)
+            {
+                if (state.Predicate(state.PredicateContext, address + offset, data + offset, (uint32_t)pattern.Size))
+                {
+                    matches.push_back(address + offset);
+                }
+            }
+        }
+    }
+
+    //
+    // Calls onBlock(data, size, limit, address) for the readable parts of [start, start + length),
+    // with up to overlap bytes past the end so that patterns straddling the next chunk can be matched.
+    // Reads the whole chunk at once (or maps it, for cores) and only goes page by page around holes.
+    //
+    template <typename TStop, typename TBlock>
+    void
+    ReadChunk(
+            TargetMemoryReader& reader,
+            uint64_t start,
+            uint64_t length,
+            uint64_t rangeEnd,
+            uint64_t overlap,
+            TStop shouldStop,
+            TBlock onBlock)
+    {
+        uint64_t readEnd = std::min(rangeEnd, start + length + overlap);
+
+        const uint8_t* view = reader.Map(start, readEnd - start);
+
+        if (view != nullptr)
+        {
+            onBlock(view, (size_t)(readEnd - start), (size_t)length, start);
+            return;
+        }
+
+        static thread_local std::vector<uint8_t> buffer;
+        buffer.resize((size_t)(readEnd - start));
+
+        uint64_t position = start;
+
+        while (position < start + length && !shouldStop())
+        {
+            size_t requested = (size_t)(readEnd - position);
+            size_t read = reader.Read(position, buffer.data(), requested);
+
+            if (read > 0)
+            {
+                uint64_t limit = std::min<uint64_t>(read, start + length - position);
+                onBlock(buffer.data(), read, (size_t)limit, position);
+            }
+
+            if (read == requested)
+            {
+                break;
+            }
+
+            // Skip the unreadable page and carry on with the next one
+            position = (position + read + PageSize) & ~(PageSize - 1);
+        }
+    }
+
+    void
+    ScanChunk(
+            ScanState& state,
+            uint64_t start,
+            uint64_t length,
+            uint64_t rangeEnd)
+    {
+        if (state.ShouldStop())
+        {
+            return;
+        }
+
+        uint64_t overlap = state.Pattern.Size > 0 ? state.Pattern.Size - 1 : 0;
+        std::vector<uint64_t> matches;
+
+        ReadChunk(
+                *state.Reader,
+                start,
+                length,
+                rangeEnd,
+                overlap,
+                [&]() { return state.ShouldStop(); },
+                [&](const uint8_t* data, size_t size, size_t limit, uint64_t address)
+                {
+                    ScanBlock(state, data, size, limit, address, matches);
+
+                    if (matches.size() >= ScanBatchSize)
+                    {
+                        state.Publish(matches);
+                    }
+                });
+
+        state.Publish(matches);
+    }
+}
+
+ScanStatus
+SearchMemoryRange(
+        TargetMemoryReader& reader,
+        const ScanRange& range,
+        const ScanPattern& pattern,
+        const ScanResultsHandler& onResults,
+        const std::atomic<int>* interrupt)
+{
+    uint64_t end = range.Start + range.Length;
+    uint64_t overlap = pattern.Size - 1;
+    bool stopped = false;
+
+    std::vector<uint64_t> matches;
+
+    auto shouldStop = [&]()
+    {
+        return stopped || (interrupt != nullptr && interrupt->load(std::memory_order_relaxed) != 0);
+    };
+
+    for (uint64_t chunk = range.Start; chunk < end && !shouldStop(); chunk += ScanChunkSize)
+    {
+        ReadChunk(
+                reader,
+                chunk,
+                std::min<uint64_t>(ScanChunkSize, end - chunk),
+                end,
+                overlap,
+                shouldStop,
+                [&](const uint8_t* data, size_t size, size_t limit, uint64_t address)
+                {
+                    matches.clear();
+                    FindPatternMatches(data, size, limit, address, pattern, matches);
+
+                    if (!matches.empty() && !onResults(matches.data(), matches.size()))
+                    {
+                        stopped = true;
+                    }
+                });
+    }
+
+    if (stopped)
+    {
+        return ScanStatus::Stopped;
+    }
+
+    return shouldStop() ? ScanStatus::Interrupted : ScanStatus::Completed;
+}
+
+ScanStatus
+ScanMemoryRanges(
+        TargetMemoryReader& reader,
+        const ScanRange* ranges,
+        size_t rangeCount,
+        const ScanPattern& pattern,
+        ScanPredicate predicate,
+        void* predicateContext,
+        const ScanResultsHandler& onResults,
+        const std::atomic<int>* interrupt)
+{
+    auto state = std::make_shared<ScanState>();
+    state->Reader = &reader;
+    state->Pattern = pattern;
+    state->Predicate = predicate;
+    state->PredicateContext = predicateContext;
+    state->Interrupt = interrupt;
+    state->Cancelled = false;
+
+    std::vector<std::function<void()>> tasks;
+
+    for (size_t i = 0; i < rangeCount; i++)
+    {
+        uint64_t end = ranges[i].Start + ranges[i].Length;
+
+        for (uint64_t chunk = ranges[i].Start; chunk < end; chunk += ScanChunkSize)
+        {
+            uint64_t length = std::min<uint64_t>(ScanChunkSize, end - chunk);
+
+            tasks.push_back([state, chunk, length, end]()
+            {
+                ScanChunk(*state, chunk, length, end);
+            });
+        }
+    }
+
+    TaskGroup group;
+    ThreadPool::Shared().Submit(group, std::move(tasks));
+
+    ScanStatus status = ScanStatus::Completed;
+
+    while (true)
+    {
+        bool completed = group.IsCompleted();
+
+        std::deque<std::vector<uint64_t>> batches;
+
+        {
+            std::unique_lock<std::mutex> lock(state->Lock);
+
+            if (state->Batches.empty() && !completed)
+            {
+                state->ResultsAvailable.wait_for(lock, std::chrono::milliseconds(50));
+            }
+
+            batches.swap(state->Batches);
+        }
+
+        // The handler calls back into managed code, keep it on the caller's thread
+        for (auto& batch : batches)
+        {
+            if (status != ScanStatus::Completed)
+            {
+                break;
+            }
+
+            std::sort(batch.begin(), batch.end());
+
+            for (size_t offset = 0; offset < batch.size(); offset += ScanBatchSize)
+            {
+                if (!onResults(batch.data() + offset, std::min(ScanBatchSize, batch.size() - offset)))
+                {
+                    status = ScanStatus::Stopped;
+                    state->Cancelled = true;
+                    break;
+                }
+            }
+        }
+
+        if (status == ScanStatus::Completed && interrupt != nullptr && interrupt->load(std::memory_order_relaxed) != 0)
+        {
+            status = ScanStatus::Interrupted;
+            state->Cancelled = true;
+        }
+
+        if (completed && batches.empty())
+        {
+            break;
+        }
+
+        if (status != ScanStatus::Completed)
+        {
+            // Don't leave the workers writing to the state after we return
+            group.Wait();
+            break;
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,61 @@
+#ifndef __MEMORYSCAN_H__
+#define __MEMORYSCAN_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "memoryreader.h"
+#include "patternsearch.h"
+
+struct ScanRange
+{
+    uint64_t Start;
+    uint64_t Length;
+};
+
+// Filters candidates, called concurrently from the worker threads
+typedef bool (*ScanPredicate)(void* context, uint64_t address, const uint8_t* data, uint32_t size);
+
+// Receives the matches on the calling thread. Returning false stops the scan.
+typedef std::function<bool(const uint64_t* addresses, size_t count)> ScanResultsHandler;
+
+enum class ScanStatus
+{
+    Completed,
+    Stopped,
+    Interrupted
+};
+
+// Size of the reads issued by the workers, and unit of work stolen between them
+const size_t ScanChunkSize = 4 * 1024 * 1024;
+
+// Number of addresses handed to the results handler at once
+const size_t ScanBatchSize = 4096;
+
+//
+// Splits the ranges into chunks and searches them on the shared thread pool.
+// If there is no pattern, the predicate is called for every aligned position with pattern.Size bytes.
+//
+ScanStatus ScanMemoryRanges(
+        TargetMemoryReader& reader,
+        const ScanRange* ranges,
+        size_t rangeCount,
+        const ScanPattern& pattern,
+        ScanPredicate predicate,
+        void* predicateContext,
+        const ScanResultsHandler& onResults,
+        const std::atomic<int>* interrupt);
+
+//
+// Searches a single range on the calling thread, the matches are delivered in ascending order
+//
+ScanStatus SearchMemoryRange(
+        TargetMemoryReader& reader,
+        const ScanRange& range,
+        const ScanPattern& pattern,
+        const ScanResultsHandler& onResults,
+        const std::atomic<int>* interrupt);
+
+#endif // __MEMORYSCAN_H__
@@ -0,0 +1,557 @@
+#include "memorysnapshot.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include "invalidation.h"
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+const size_t MemorySnapshot::PageSize;
+
+static const char SnapshotMagic[8] = { 'L', 'M', 'F', 'R', 'E', 'E', 'Z', 'E' };
+static const uint32_t SnapshotVersion = 2;
+
+struct SnapshotHeader
+{
+    char Magic[8];
+    uint32_t Version;
+    // Stop of the process the pages were read at
+    uint32_t StopId;
+    uint64_t ProcessId;
+    uint64_t PageCount;
+};
+
+struct SnapshotPageHeader
+{
+    uint64_t Page;
+    uint32_t Valid;
+    uint32_t Encoding;
+    uint64_t StoredSize;
+};
+
+std::atomic<bool> g_freezeEnabled(false);
+std::atomic<bool> g_captureEnabled(false);
+
+namespace
+{
+    std::mutex s_frozenLock;
+    std::shared_ptr<MemorySnapshot> s_frozenSnapshot;
+
+    std::mutex s_captureLock;
+    std::shared_ptr<MemorySnapshot> s_captureSnapshot;
+
+    bool
+    IsZero(
+            const uint8_t* data,
+            size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            if (data[i] != 0)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+MemorySnapshot::MemorySnapshot(
+        uint64_t processId,
+        uint32_t uniqueId,
+        uint32_t stopId) :
+        m_storedBytes(0),
+        m_processId(processId),
+        m_uniqueId(uniqueId),
+        m_stopId(stopId)
+{
+}
+
+bool
+MemorySnapshot::LookupPage(
+        uint64_t page,
+        uint8_t* data,
+        size_t* valid) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    auto it = m_pages.find(page);
+    if (it == m_pages.end())
+    {
+        return false;
+    }
+
+    const StoredPage& stored = it->second;
+
+    switch (stored.Encoding)
+    {
+        case PageEncoding::Zero:
+            memset(data, 0, stored.Valid);
+            break;
+
+#ifdef HAVE_LZ4
+        case PageEncoding::Lz4:
+            if (LZ4_decompress_safe((const char*)stored.Data.data(), (char*)data, (int)stored.Data.size(), (int)PageSize) != (int)stored.Valid)
+            {
+                return false;
+            }
+            break;
+#endif
+
+        default:
+            memcpy(data, stored.Data.data(), stored.Valid);
+            break;
+    }
+
+    *valid = stored.Valid;
+    return true;
+}
+
+void
+MemorySnapshot::StorePage(
+        uint64_t page,
+        const uint8_t* data,
+        size_t valid)
+{
+    StoredPage stored;
+    stored.Valid = (uint32_t)valid;
+
+    if (IsZero(data, valid))
+    {
+        stored.Encoding = PageEncoding::Zero;
+    }
+    else
+    {
+        stored.Encoding = PageEncoding::Raw;
+
+#ifdef HAVE_LZ4
+        stored.Data.resize(LZ4_compressBound((int)valid));
+        int compressed = LZ4_compress_default((const char*)data, (char*)stored.Data.data(), (int)valid, (int)stored.Data.size());
+
+        if (compressed > 0 && (size_t)compressed < valid)
+        {
+            stored.Encoding = PageEncoding::Lz4;
+            stored.Data.resize(compressed);
+            stored.Data.shrink_to_fit();
+        }
+#endif
+
+        if (stored.Encoding == PageEncoding::Raw)
+        {
+            stored.Data.assign(data, data + valid);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    auto inserted = m_pages.emplace(page, std::move(stored));
+    if (inserted.second)
+    {
+        m_storedBytes += inserted.first->second.Data.size();
+    }
+}
+
+void
+MemorySnapshot::ErasePages(
+        uint64_t address,
+        size_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    for (uint64_t page = address / PageSize; page <= (address + size - 1) / PageSize; page++)
+    {
+        auto it = m_pages.find(page);
+        if (it != m_pages.end())
+        {
+            m_storedBytes -= it->second.Data.size();
+            m_pages.erase(it);
+        }
+    }
+}
+
+size_t
+MemorySnapshot::GetPageCount() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_pages.size();
+}
+
+void
+MemorySnapshot::ListPages(
+        std::vector<std::pair<uint64_t, size_t>>& pages) const
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        pages.reserve(pages.size() + m_pages.size());
+        for (auto& page : m_pages)
+        {
+            pages.emplace_back(page.first, page.second.Valid);
+        }
+    }
+
+    std::sort(pages.begin(), pages.end());
+}
+
+void
+MemorySnapshot::GetSizes(
+        uint64_t* readableBytes,
+        uint64_t* storedBytes) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    *readableBytes = 0;
+    for (auto& page : m_pages)
+    {
+        *readableBytes += page.second.Valid;
+    }
+
+    *storedBytes = m_storedBytes;
+}
+
+void
+MemorySnapshot::Bind(
+        uint64_t processId,
+        uint32_t uniqueId,
+        uint32_t stopId)
+{
+    m_processId = processId;
+    m_uniqueId = uniqueId;
+    m_stopId = stopId;
+}
+
+bool
+MemorySnapshot::Save(
+        const char* path,
+        std::string& error) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr)
+    {
+        error = strerror(errno);
+        return false;
+    }
+
+    SnapshotHeader header;
+    memcpy(header.Magic, SnapshotMagic, sizeof(header.Magic));
+    header.Version = SnapshotVersion;
+    header.StopId = m_stopId;
+    header.ProcessId = m_processId;
+    header.PageCount = m_pages.size();
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (auto it = m_pages.begin(); written && it != m_pages.end(); ++it)
+    {
+        SnapshotPageHeader pageHeader;
+        pageHeader.Page = it->first;
+        pageHeader.Valid = it->second.Valid;
+        pageHeader.Encoding = (uint32_t)it->second.Encoding;
+        pageHeader.StoredSize = it->second.Data.size();
+
+        written = fwrite(&pageHeader, sizeof(pageHeader), 1, file) == 1 &&
+            (it->second.Data.empty() || fwrite(it->second.Data.data(), it->second.Data.size(), 1, file) == 1);
+    }
+
+    if (fclose(file) != 0 || !written)
+    {
+        error = "write failed";
+        return false;
+    }
+
+    return true;
+}
+
+std::shared_ptr<MemorySnapshot>
+MemorySnapshot::Load(
+        const char* path,
+        std::string& error)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr)
+    {
+        error = strerror(errno);
+        return nullptr;
+    }
+
+    std::unique_ptr<FILE, int(*)(FILE*)> closer(file, fclose);
+
+    SnapshotHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.Magic, SnapshotMagic, sizeof(header.Magic)) != 0 ||
+        header.Version != SnapshotVersion)
+    {
+        error = "not a LoadManaged memory snapshot";
+        return nullptr;
+    }
+
+    std::shared_ptr<MemorySnapshot> snapshot = std::make_shared<MemorySnapshot>(header.ProcessId, 0, header.StopId);
+
+    for (uint64_t i = 0; i < header.PageCount; i++)
+    {
+        SnapshotPageHeader pageHeader;
+        if (fread(&pageHeader, sizeof(pageHeader), 1, file) != 1 ||
+            pageHeader.Valid > PageSize ||
+            pageHeader.StoredSize > PageSize ||
+            pageHeader.Encoding > (uint32_t)PageEncoding::Lz4)
+        {
+            error = "truncated or corrupted snapshot";
+            return nullptr;
+        }
+
+        // The pages are served by copying Valid bytes out of the stored data
+        if ((pageHeader.Encoding == (uint32_t)PageEncoding::Zero && pageHeader.StoredSize != 0) ||
+            (pageHeader.Encoding == (uint32_t)PageEncoding::Raw && pageHeader.StoredSize != pageHeader.Valid) ||
+            (pageHeader.Encoding == (uint32_t)PageEncoding::Lz4 && pageHeader.StoredSize == 0))
+        {
+            error = "corrupted snapshot";
+            return nullptr;
+        }
+
+#ifndef HAVE_LZ4
+        if (pageHeader.Encoding == (uint32_t)PageEncoding::Lz4)
+        {
+            error = "the snapshot is compressed with LZ4, which this build doesn't support";
+            return nullptr;
+        }
+#endif
+
+        StoredPage stored;
+        stored.Valid = pageHeader.Valid;
+        stored.Encoding = (PageEncoding)pageHeader.Encoding;
+        stored.Data.resize(pageHeader.StoredSize);
+
+        if (!stored.Data.empty() && fread(stored.Data.data(), stored.Data.size(), 1, file) != 1)
+        {
+            error = "truncated snapshot";
+            return nullptr;
+        }
+
+        snapshot->m_storedBytes += stored.Data.size();
+        snapshot->m_pages.emplace(pageHeader.Page, std::move(stored));
+    }
+
+    return snapshot;
+}
+
+void
+SetFreezeMode(
+        bool enabled)
+{
+    g_freezeEnabled.store(enabled, std::memory_order_relaxed);
+
+    // The readers are wrapped, or unwrapped, when they are created
+    InvalidateCaches(CACHE_KIND_MASK(CacheKindProcess));
+}
+
+std::shared_ptr<MemorySnapshot>
+GetFrozenSnapshot(
+        lldb::SBProcess process)
+{
+    if (!g_freezeEnabled.load(std::memory_order_relaxed))
+    {
+        return nullptr;
+    }
+
+    uint32_t uniqueId = process.GetUniqueID();
+    uint32_t stopId = process.GetStopID();
+
+    std::lock_guard<std::mutex> lock(s_frozenLock);
+
+    if (s_frozenSnapshot == nullptr || !s_frozenSnapshot->IsFor(uniqueId, stopId))
+    {
+        s_frozenSnapshot = std::make_shared<MemorySnapshot>(process.GetProcessID(), uniqueId, stopId);
+    }
+
+    return s_frozenSnapshot;
+}
+
+void
+SetFrozenSnapshot(
+        lldb::SBProcess process,
+        std::shared_ptr<MemorySnapshot> snapshot)
+{
+    snapshot->Bind(process.GetProcessID(), process.GetUniqueID(), process.GetStopID());
+
+    {
+        std::lock_guard<std::mutex> lock(s_frozenLock);
+        s_frozenSnapshot = std::move(snapshot);
+    }
+
+    SetFreezeMode(true);
+}
+
+void
+ClearFrozenSnapshot()
+{
+    std::lock_guard<std::mutex> lock(s_frozenLock);
+    s_frozenSnapshot = nullptr;
+}
+
+void
+StartMemoryCapture(
+        lldb::SBProcess process)
+{
+    {
+        std::lock_guard<std::mutex> lock(s_captureLock);
+        s_captureSnapshot = std::make_shared<MemorySnapshot>(process.GetProcessID(), process.GetUniqueID(), process.GetStopID());
+    }
+
+    g_captureEnabled.store(true, std::memory_order_relaxed);
+    InvalidateCaches(CACHE_KIND_MASK(CacheKindProcess));
+}
+
+void
+StopMemoryCapture()
+{
+    g_captureEnabled.store(false, std::memory_order_relaxed);
+    InvalidateCaches(CACHE_KIND_MASK(CacheKindProcess));
+}
+
+std::shared_ptr<MemorySnapshot>
+GetActiveCapture(
+        lldb::SBProcess process)
+{
+    if (!g_captureEnabled.load(std::memory_order_relaxed))
+    {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(s_captureLock);
+
+    // A core holds a single state of the memory, the pages of the next stops aren't mixed in
+    if (s_captureSnapshot == nullptr || !s_captureSnapshot->IsFor(process.GetUniqueID(), process.GetStopID()))
+    {
+        return nullptr;
+    }
+
+    return s_captureSnapshot;
+}
+
+std::shared_ptr<MemorySnapshot>
+GetMemoryCapture()
+{
+    std::lock_guard<std::mutex> lock(s_captureLock);
+    return s_captureSnapshot;
+}
+
+void
+ClearMemoryCapture()
+{
+    {
+        std::lock_guard<std::mutex> lock(s_captureLock);
+        s_captureSnapshot = nullptr;
+    }
+
+    StopMemoryCapture();
+}
+
+//----------------------------------------------------------------------------
+// Reader
+//----------------------------------------------------------------------------
+
+class SnapshotMemoryReader : public TargetMemoryReader
+{
+private:
+    std::shared_ptr<TargetMemoryReader> m_reader;
+    std::shared_ptr<MemorySnapshot> m_snapshot;
+
+    // Reads the pages [firstPage, endPage) from the process with a single read and stores them
+    void
+    FillPages(
+            uint64_t firstPage,
+            uint64_t endPage)
+    {
+        const size_t pageSize = MemorySnapshot::PageSize;
+
+        std::vector<uint8_t> data((endPage - firstPage) * pageSize);
+        size_t read = m_reader->Read(firstPage * pageSize, data.data(), data.size());
+
+        for (uint64_t page = firstPage; page < endPage; page++)
+        {
+            size_t offset = (page - firstPage) * pageSize;
+            size_t valid = std::min(pageSize, read - offset);
+
+            m_snapshot->StorePage(page, data.data() + offset, valid);
+
+            // The page holding the first unreadable byte is kept, the ones after it are unknown
+            if (valid != pageSize)
+            {
+                break;
+            }
+        }
+    }
+
+public:
+    SnapshotMemoryReader(std::shared_ptr<TargetMemoryReader> reader, std::shared_ptr<MemorySnapshot> snapshot) :
+            m_reader(std::move(reader)),
+            m_snapshot(std::move(snapshot))
+    {
+    }
+
+    virtual size_t Read(uint64_t address, void* buffer, size_t size)
+    {
+        const size_t pageSize = MemorySnapshot::PageSize;
+
+        uint8_t* output = (uint8_t*)buffer;
+        uint8_t page[MemorySnapshot::PageSize];
+        size_t read = 0;
+        bool filled = false;
+
+        while (read < size)
+        {
+            uint64_t current = address + read;
+            size_t offset = current % pageSize;
+            size_t chunk = std::min(size - read, pageSize - offset);
+            size_t valid;
+
+            if (!m_snapshot->LookupPage(current / pageSize, page, &valid))
+            {
+                // The missing pages of the request are read at once, and only once
+                if (filled)
+                {
+                    break;
+                }
+
+                FillPages(current / pageSize, (address + size + pageSize - 1) / pageSize);
+                filled = true;
+                continue;
+            }
+
+            size_t copied = valid > offset ? std::min(chunk, valid - offset) : 0;
+            memcpy(output + read, page + offset, copied);
+            read += copied;
+
+            if (copied != chunk)
+            {
+                break;
+            }
+        }
+
+        return read;
+    }
+
+    virtual const char* GetName() const
+    {
+        return "snapshot";
+    }
+};
+
+std::shared_ptr<TargetMemoryReader>
+CreateSnapshotReader(
+        std::shared_ptr<TargetMemoryReader> reader,
+        std::shared_ptr<MemorySnapshot> snapshot)
+{
+    return std::make_shared<SnapshotMemoryReader>(std::move(reader), std::move(snapshot));
+}
@@ -0,0 +1,118 @@
+#ifndef __MEMORYSNAPSHOT_H__
+#define __MEMORYSNAPSHOT_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "lldb/API/SBProcess.h"
+#include "memoryreader.h"
+
+//
+// Pages of a live process read while in freeze mode (LoadManagedFreeze on),
+// kept compressed (LZ4 when available, otherwise only the zero pages are
+// elided) so the next commands of the same stop don't read them again through
+// ptrace. The snapshot is dropped when the process resumes, and can be saved
+// to a file and loaded back. The same store records the pages read while
+// capturing (LoadManagedCapture on), to be written out as a core.
+//
+class MemorySnapshot
+{
+public:
+    static const size_t PageSize = 4096;
+
+private:
+    enum class PageEncoding : uint32_t
+    {
+        Raw,
+        Zero,
+        Lz4
+    };
+
+    struct StoredPage
+    {
+        // Number of readable bytes from the start of the page
+        uint32_t Valid;
+        PageEncoding Encoding;
+        std::vector<uint8_t> Data;
+    };
+
+    mutable std::mutex m_lock;
+    std::unordered_map<uint64_t, StoredPage> m_pages;
+    uint64_t m_storedBytes;
+    uint64_t m_processId;
+    uint32_t m_uniqueId;
+    uint32_t m_stopId;
+
+public:
+    MemorySnapshot(uint64_t processId, uint32_t uniqueId, uint32_t stopId);
+
+    // Returns false if the page isn't in the snapshot. data must hold PageSize bytes.
+    bool LookupPage(uint64_t page, uint8_t* data, size_t* valid) const;
+
+    void StorePage(uint64_t page, const uint8_t* data, size_t valid);
+
+    // Forgets the pages overlapping the range (written through the services)
+    void ErasePages(uint64_t address, size_t size);
+
+    size_t GetPageCount() const;
+
+    // Page numbers and their readable bytes, sorted by address
+    void ListPages(std::vector<std::pair<uint64_t, size_t>>& pages) const;
+
+    // Bytes of readable memory held, and their compressed size
+    void GetSizes(uint64_t* readableBytes, uint64_t* storedBytes) const;
+
+    uint64_t GetProcessId() const { return m_processId; }
+
+    uint32_t GetStopId() const { return m_stopId; }
+
+    bool IsFor(uint32_t uniqueId, uint32_t stopId) const { return m_uniqueId == uniqueId && m_stopId == stopId; }
+
+    // Serves the snapshot for the current stop of the process (after loading it)
+    void Bind(uint64_t processId, uint32_t uniqueId, uint32_t stopId);
+
+    bool Save(const char* path, std::string& error) const;
+
+    static std::shared_ptr<MemorySnapshot> Load(const char* path, std::string& error);
+};
+
+extern std::atomic<bool> g_freezeEnabled;
+
+// Turns freeze mode on or off. The memory readers are recreated on the next access.
+void SetFreezeMode(bool enabled);
+
+// Returns the snapshot of the current stop, created on first use. nullptr if freeze mode is off.
+std::shared_ptr<MemorySnapshot> GetFrozenSnapshot(lldb::SBProcess process);
+
+// Replaces the snapshot of the current stop (LoadManagedFreeze load), turning freeze mode on
+void SetFrozenSnapshot(lldb::SBProcess process, std::shared_ptr<MemorySnapshot> snapshot);
+
+// Drops the snapshot, called when the process resumes
+void ClearFrozenSnapshot();
+
+extern std::atomic<bool> g_captureEnabled;
+
+// Starts recording the pages read from the current stop of the process in a new snapshot
+void StartMemoryCapture(lldb::SBProcess process);
+
+// Stops recording, the pages captured so far are kept until the next capture or clear
+void StopMemoryCapture();
+
+// Returns the snapshot being recorded for the current stop, nullptr if capture is off or the process has run since
+std::shared_ptr<MemorySnapshot> GetActiveCapture(lldb::SBProcess process);
+
+// Returns the last capture, recording or not. nullptr if there is none.
+std::shared_ptr<MemorySnapshot> GetMemoryCapture();
+
+void ClearMemoryCapture();
+
+// Serves the reads from the snapshot, and stores the pages read from the reader in it
+std::shared_ptr<TargetMemoryReader> CreateSnapshotReader(std::shared_ptr<TargetMemoryReader> reader, std::shared_ptr<MemorySnapshot> snapshot);
+
+#endif // __MEMORYSNAPSHOT_H__
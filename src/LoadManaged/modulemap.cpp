@@ -0,0 +1,88 @@
+#include "modulemap.h"
+
+#include <mutex>
+#include "invalidation.h"
+#include "sosplugin.h"
+
+ModuleMap::ModuleMap(
+        lldb::SBTarget target)
+{
+    uint32_t numModules = target.GetNumModules();
+
+    m_modules.reserve(numModules);
+
+    for (uint32_t i = 0; i < numModules; i++)
+    {
+        lldb::SBModule module = target.GetModuleAtIndex(i);
+        if (!module.IsValid())
+        {
+            continue;
+        }
+
+        lldb::SBFileSpec fileSpec = module.GetFileSpec();
+        const char* fileName = fileSpec.GetFilename();
+        if (fileName == nullptr)
+        {
+            continue;
+        }
+
+        m_modules[fileName].push_back(ModuleEntry{ i, module });
+    }
+}
+
+const ModuleEntry*
+ModuleMap::FindByName(
+        const char* name,
+        uint32_t startIndex) const
+{
+    if (name == nullptr)
+    {
+        return nullptr;
+    }
+
+    auto it = m_modules.find(name);
+    if (it == m_modules.end())
+    {
+        return nullptr;
+    }
+
+    for (const ModuleEntry& entry : it->second)
+    {
+        if (entry.Index >= startIndex)
+        {
+            return &entry;
+        }
+    }
+
+    return nullptr;
+}
+
+std::shared_ptr<const ModuleMap>
+ModuleMap::Get(
+        lldb::SBTarget target)
+{
+    static std::mutex lock;
+    static std::shared_ptr<const ModuleMap> map;
+    static lldb::SBTarget mapTarget;
+    static uint64_t mapGeneration;
+
+    std::lock_guard<std::recursive_mutex> sbLock(g_sbApiLock);
+    std::lock_guard<std::mutex> mapLock(lock);
+
+    lldb::SBProcess process = target.GetProcess();
+    if (process.IsValid())
+    {
+        SyncCacheGenerations(process);
+    }
+
+    uint64_t generation = GetCacheGeneration(CACHE_KIND_MASK(CacheKindModules));
+
+    if (map == nullptr || mapGeneration != generation || !(mapTarget == target))
+    {
+        map = std::make_shared<ModuleMap>(target);
+        mapTarget = target;
+        mapGeneration = generation;
+    }
+
+    return map;
+}
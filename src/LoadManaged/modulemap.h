@@ -0,0 +1,39 @@
+#ifndef __MODULEMAP_H__
+#define __MODULEMAP_H__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "lldb/API/SBModule.h"
+#include "lldb/API/SBTarget.h"
+
+struct ModuleEntry
+{
+    uint32_t Index;
+    lldb::SBModule Module;
+};
+
+//
+// Modules of the target keyed by file name, built in one pass over the module
+// list and cached until modules are loaded or unloaded. Several modules can
+// share a name (same library from two directories), they are kept in index
+// order.
+//
+class ModuleMap
+{
+private:
+    std::unordered_map<std::string, std::vector<ModuleEntry>> m_modules;
+
+public:
+    explicit ModuleMap(lldb::SBTarget target);
+
+    // First module with this file name at or after startIndex, nullptr if there is none
+    const ModuleEntry* FindByName(const char* name, uint32_t startIndex = 0) const;
+
+    // Returns the modules of the target, reusing the previous map while the module list doesn't change
+    static std::shared_ptr<const ModuleMap> Get(lldb::SBTarget target);
+};
+
+#endif // __MODULEMAP_H__
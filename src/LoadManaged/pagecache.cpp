@@ -0,0 +1,175 @@
+#include "pagecache.h"
+
+#include <algorithm>
+#include <cstring>
+#include "invalidation.h"
+#include "sosplugin.h"
+
+const size_t PageCache::PageSize;
+
+// Total size of the cached pages
+const size_t PageCacheCapacity = 64 * 1024 * 1024;
+
+// Larger reads go straight to the reader instead of being split into pages
+const size_t PageCacheMaxRead = 4 * PageCache::PageSize;
+
+PageCache::PageCache(
+        std::shared_ptr<TargetMemoryReader> reader,
+        size_t capacity) :
+        m_reader(std::move(reader)),
+        m_pagesPerShard(std::max<size_t>(1, capacity / PageSize / ShardCount))
+{
+}
+
+size_t
+PageCache::ReadPage(
+        uint64_t page,
+        size_t offset,
+        uint8_t* buffer,
+        size_t size)
+{
+    Shard& shard = m_shards[page % ShardCount];
+
+    {
+        std::lock_guard<std::mutex> lock(shard.Lock);
+
+        auto it = shard.Pages.find(page);
+        if (it != shard.Pages.end())
+        {
+            size_t available = it->second->Valid > offset ? std::min(size, it->second->Valid - offset) : 0;
+            memcpy(buffer, it->second->Data + offset, available);
+            return available;
+        }
+    }
+
+    // Read outside of the lock, two threads missing the same page just read it twice
+    std::unique_ptr<Page> read(new Page());
+    read->Valid = m_reader->Read(page * PageSize, read->Data, PageSize);
+
+    size_t available = read->Valid > offset ? std::min(size, read->Valid - offset) : 0;
+    memcpy(buffer, read->Data + offset, available);
+
+    InsertPage(page, std::move(read));
+
+    return available;
+}
+
+void
+PageCache::InsertPage(
+        uint64_t page,
+        std::unique_ptr<Page> data)
+{
+    Shard& shard = m_shards[page % ShardCount];
+
+    std::lock_guard<std::mutex> lock(shard.Lock);
+
+    if (shard.Pages.emplace(page, std::move(data)).second)
+    {
+        shard.Order.push_back(page);
+
+        if (shard.Order.size() > m_pagesPerShard)
+        {
+            shard.Pages.erase(shard.Order.front());
+            shard.Order.pop_front();
+        }
+    }
+}
+
+size_t
+PageCache::Read(
+        uint64_t address,
+        void* buffer,
+        size_t size)
+{
+    const uint8_t* mapped = m_reader->Map(address, size);
+    if (mapped != nullptr)
+    {
+        memcpy(buffer, mapped, size);
+        return size;
+    }
+
+    if (size > PageCacheMaxRead)
+    {
+        return m_reader->Read(address, buffer, size);
+    }
+
+    uint8_t* output = (uint8_t*)buffer;
+    size_t read = 0;
+
+    while (read < size)
+    {
+        uint64_t current = address + read;
+        size_t offset = current % PageSize;
+        size_t chunk = std::min(size - read, PageSize - offset);
+
+        size_t copied = ReadPage(current / PageSize, offset, output + read, chunk);
+        read += copied;
+
+        if (copied != chunk)
+        {
+            break;
+        }
+    }
+
+    return read;
+}
+
+void
+PageCache::Prefetch(
+        uint64_t address,
+        size_t size)
+{
+    uint64_t firstPage = address / PageSize;
+    uint64_t endPage = (address + size + PageSize - 1) / PageSize;
+
+    // Nothing to gain from caching the pages of a mapped dump
+    if (m_reader->Map(firstPage * PageSize, (endPage - firstPage) * PageSize) != nullptr)
+    {
+        return;
+    }
+
+    std::vector<uint8_t> data((endPage - firstPage) * PageSize);
+    size_t read = m_reader->Read(firstPage * PageSize, data.data(), data.size());
+
+    for (uint64_t page = firstPage; page < endPage; page++)
+    {
+        size_t offset = (page - firstPage) * PageSize;
+
+        std::unique_ptr<Page> cached(new Page());
+        cached->Valid = std::min(PageSize, read - offset);
+        memcpy(cached->Data, data.data() + offset, cached->Valid);
+
+        InsertPage(page, std::move(cached));
+
+        // The page holding the first unreadable byte is kept, the ones after it are unknown
+        if (offset + PageSize > read)
+        {
+            break;
+        }
+    }
+}
+
+std::shared_ptr<PageCache>
+PageCache::Get(
+        lldb::SBProcess process)
+{
+    static std::mutex lock;
+    static std::shared_ptr<PageCache> cache;
+    static uint64_t cacheGeneration;
+
+    std::lock_guard<std::recursive_mutex> sbLock(g_sbApiLock);
+    std::lock_guard<std::mutex> cacheLock(lock);
+
+    SyncCacheGenerations(process);
+
+    // Pages read before the reader learnt about a new breakpoint may hold its opcode
+    uint64_t generation = GetCacheGeneration(CACHE_KIND_MASK(CacheKindProcess) | CACHE_KIND_MASK(CacheKindMemory) | CACHE_KIND_MASK(CacheKindBreakpoints));
+
+    if (cache == nullptr || cacheGeneration != generation)
+    {
+        cache = std::make_shared<PageCache>(TargetMemoryReader::Get(process), PageCacheCapacity);
+        cacheGeneration = generation;
+    }
+
+    return cache;
+}
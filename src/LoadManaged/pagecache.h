@@ -0,0 +1,78 @@
+#ifndef __PAGECACHE_H__
+#define __PAGECACHE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "lldb/API/SBProcess.h"
+#include "memoryreader.h"
+
+//
+// Page-granular cache in front of the memory reader, for the services that
+// issue many small reads (ReadVirtual, WalkChain). Dumps that can be mapped
+// are read in place and never go through the pages, and so do large reads. The cache is sharded by
+// page number so the worker threads don't contend on a single lock, and it
+// is dropped as soon as the process runs or its memory is written.
+//
+class PageCache
+{
+public:
+    static const size_t PageSize = 4096;
+
+private:
+    struct Page
+    {
+        uint8_t Data[PageSize];
+
+        // Number of readable bytes from the start of the page
+        size_t Valid;
+    };
+
+    struct Shard
+    {
+        std::mutex Lock;
+        std::unordered_map<uint64_t, std::unique_ptr<Page>> Pages;
+
+        // Insertion order, for the eviction
+        std::deque<uint64_t> Order;
+    };
+
+    static const size_t ShardCount = 16;
+
+    std::shared_ptr<TargetMemoryReader> m_reader;
+    Shard m_shards[ShardCount];
+    size_t m_pagesPerShard;
+
+    // Copies up to size bytes of a single page. Returns the number of bytes copied.
+    size_t ReadPage(uint64_t page, size_t offset, uint8_t* buffer, size_t size);
+
+    // Keeps the page already cached, if any
+    void InsertPage(uint64_t page, std::unique_ptr<Page> data);
+
+public:
+    PageCache(std::shared_ptr<TargetMemoryReader> reader, size_t capacity);
+
+    PageCache(const PageCache&) = delete;
+    PageCache& operator=(const PageCache&) = delete;
+
+    TargetMemoryReader& GetReader() const { return *m_reader; }
+
+    // Same contract as TargetMemoryReader::Read: stops at the first unreadable byte and returns the number of bytes read
+    size_t Read(uint64_t address, void* buffer, size_t size);
+
+    bool ReadPointer(uint64_t address, uint64_t& value)
+    {
+        return Read(address, &value, sizeof(value)) == sizeof(value);
+    }
+
+    // Reads the pages covering the range with a single read and caches them (read-ahead)
+    void Prefetch(uint64_t address, size_t size);
+
+    // Returns the cache of the process, reusing the previous one while the process stays stopped and its memory unchanged
+    static std::shared_ptr<PageCache> Get(lldb::SBProcess process);
+};
+
+#endif // __PAGECACHE_H__
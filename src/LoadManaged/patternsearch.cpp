@@ -0,0 +1,529 @@
+#include "patternsearch.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PATTERNSEARCH_X86
+#include <immintrin.h>
+#endif
+
+//----------------------------------------------------------------------------
+// Helpers
+//----------------------------------------------------------------------------
+
+static inline bool
+MatchesAt(
+        const uint8_t* candidate,
+        const ScanPattern& pattern)
+{
+    if (pattern.Mask == nullptr)
+    {
+        return memcmp(candidate, pattern.Bytes, pattern.Size) == 0;
+    }
+
+    for (size_t i = 0; i < pattern.Size; i++)
+    {
+        if (((candidate[i] ^ pattern.Bytes[i]) & pattern.Mask[i]) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static inline size_t
+FirstAlignedOffset(
+        uint64_t baseAddress,
+        size_t alignment)
+{
+    return (alignment - baseAddress % alignment) % alignment;
+}
+
+static bool
+IsValueSearch(
+        const ScanPattern& pattern)
+{
+    if ((pattern.Size != 8 && pattern.Size != 4) || pattern.Alignment != pattern.Size)
+    {
+        return false;
+    }
+
+    if (pattern.Mask != nullptr)
+    {
+        for (size_t i = 0; i < pattern.Size; i++)
+        {
+            if (pattern.Mask[i] != 0xff)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+//----------------------------------------------------------------------------
+// Scalar kernels
+//----------------------------------------------------------------------------
+
+template <typename T>
+static void
+FindValueScalar(
+        const uint8_t* data,
+        size_t offset,
+        size_t last,
+        T value,
+        uint64_t baseAddress,
+        std::vector<uint64_t>& matches)
+{
+    for (; offset < last; offset += sizeof(T))
+    {
+        T candidate;
+        memcpy(&candidate, data + offset, sizeof(T));
+
+        if (candidate == value)
+        {
+            matches.push_back(baseAddress + offset);
+        }
+    }
+}
+
+static void
+FindPatternScalar(
+        const uint8_t* data,
+        size_t offset,
+        size_t last,
+        uint64_t baseAddress,
+        const ScanPattern& pattern,
+        std::vector<uint64_t>& matches)
+{
+    size_t alignment = pattern.Alignment == 0 ? 1 : pattern.Alignment;
+
+    for (; offset < last; offset += alignment)
+    {
+        if (MatchesAt(data + offset, pattern))
+        {
+            matches.push_back(baseAddress + offset);
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+// SIMD kernels
+//----------------------------------------------------------------------------
+
+#ifdef PATTERNSEARCH_X86
+
+// Checks the candidate bits of a byte compare (bit i => anchor found at offset + i)
+static inline void
+VerifyCandidates(
+        uint32_t bits,
+        const uint8_t* data,
+        size_t offset,
+        size_t last,
+        uint64_t baseAddress,
+        const ScanPattern& pattern,
+        std::vector<uint64_t>& matches)
+{
+    size_t alignment = pattern.Alignment == 0 ? 1 : pattern.Alignment;
+
+    while (bits != 0)
+    {
+        size_t candidate = offset + __builtin_ctz(bits);
+        bits &= bits - 1;
+
+        if (candidate >= last)
+        {
+            break;
+        }
+
+        if ((baseAddress + candidate) % alignment == 0 && MatchesAt(data + candidate, pattern))
+        {
+            matches.push_back(baseAddress + candidate);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void
+FindValue64Avx2(
+        const uint8_t* data,
+        size_t offset,
+        size_t last,
+        uint64_t value,
+        uint64_t baseAddress,
+        std::vector<uint64_t>& matches)
+{
+    const __m256i needle = _mm256_set1_epi64x((long long)value);
+
+    // 128 bytes per iteration, most blocks don't contain any match
+    for (; offset + 128 <= last; offset += 128)
+    {
+        __m256i eq0 = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(data + offset)), needle);
+        __m256i eq1 = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(data + offset + 32)), needle);
+        __m256i eq2 = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(data + offset + 64)), needle);
+        __m256i eq3 = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(data + offset + 96)), needle);
+
+        __m256i any = _mm256_or_si256(_mm256_or_si256(eq0, eq1), _mm256_or_si256(eq2, eq3));
+
+        if (_mm256_testz_si256(any, any))
+        {
+            continue;
+        }
+
+        const __m256i eq[] = { eq0, eq1, eq2, eq3 };
+
+        for (int block = 0; block < 4; block++)
+        {
+            int bits = _mm256_movemask_pd(_mm256_castsi256_pd(eq[block]));
+
+            while (bits != 0)
+            {
+                matches.push_back(baseAddress + offset + block * 32 + __builtin_ctz(bits) * 8);
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    FindValueScalar<uint64_t>(data, offset, last, value, baseAddress, matches);
+}
+
+__attribute__((target("avx2")))
+static void
+FindValue32Avx2(
+        const uint8_t* data,
+        size_t offset,
+        size_t last,
+        uint32_t value,
+        uint64_t baseAddress,
+        std::vector<uint64_t>& matches)
+{
+    const __m256i needle = _mm256_set1_epi32((int)value);
+
+    for (; offset + 64 <= last; offset += 64)
+    {
+        __m256i eq0 = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + offset)), needle);
+        __m256i eq1 = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + offset + 32)), needle);
+
+        uint32_t bits = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(eq0))
+                        | ((uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(eq1)) << 8);
+
+        while (bits != 0)
+        {
+            matches.push_back(baseAddress + offset + __builtin_ctz(bits) * 4);
+            bits &= bits - 1;
+        }
+    }
+
+    FindValueScalar<uint32_t>(data, offset, last, value, baseAddress, matches);
+}
+
+__attribute__((target("avx2")))
+static void
+FindPatternAvx2(
+        const uint8_t* data,
+        size_t size,
+        size_t offset,
+        size_t last,
+        size_t anchor,
+        uint64_t baseAddress,
+        const ScanPattern& pattern,
+        std::vector<uint64_t>& matches)
+{
+    const __m256i needle = _mm256_set1_epi8((char)pattern.Bytes[anchor]);
+
+    // Stay within the buffer when loading the anchor bytes
+    for (; offset < last && offset + anchor + 32 <= size; offset += 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(data + offset + anchor));
+        uint32_t bits = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+
+        VerifyCandidates(bits, data, offset, last, baseAddress, pattern, matches);
+    }
+
+    size_t alignment = pattern.Alignment == 0 ? 1 : pattern.Alignment;
+    offset += FirstAlignedOffset(baseAddress + offset, alignment);
+
+    FindPatternScalar(data, offset, last, baseAddress, pattern, matches);
+}
+
+__attribute__((target("sse4.2")))
+static void
+FindValue64Sse42(
+        const uint8_t* data,
+        size_t offset,
+        size_t last,
+        uint64_t value,
+        uint64_t baseAddress,
+        std::vector<uint64_t>& matches)
+{
+    const __m128i needle = _mm_set1_epi64x((long long)value);
+
+    for (; offset + 64 <= last; offset += 64)
+    {
+        __m128i eq0 = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i*)(data + offset)), needle);
+        __m128i eq1 = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i*)(data + offset + 16)), needle);
+        __m128i eq2 = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i*)(data + offset + 32)), needle);
+        __m128i eq3 = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i*)(data + offset + 48)), needle);
+
+        uint32_t bits = (uint32_t)_mm_movemask_pd(_mm_castsi128_pd(eq0))
+                        | ((uint32_t)_mm_movemask_pd(_mm_castsi128_pd(eq1)) << 2)
+                        | ((uint32_t)_mm_movemask_pd(_mm_castsi128_pd(eq2)) << 4)
+                        | ((uint32_t)_mm_movemask_pd(_mm_castsi128_pd(eq3)) << 6);
+
+        while (bits != 0)
+        {
+            matches.push_back(baseAddress + offset + __builtin_ctz(bits) * 8);
+            bits &= bits - 1;
+        }
+    }
+
+    FindValueScalar<uint64_t>(data, offset, last, value, baseAddress, matches);
+}
+
+__attribute__((target("sse4.2")))
+static void
+FindValue32Sse42(
+        const uint8_t* data,
+        size_t offset,
+        size_t last,
+        uint32_t value,
+        uint64_t baseAddress,
+        std::vector<uint64_t>& matches)
+{
+    const __m128i needle = _mm_set1_epi32((int)value);
+
+    for (; offset + 32 <= last; offset += 32)
+    {
+        __m128i eq0 = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(data + offset)), needle);
+        __m128i eq1 = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(data + offset + 16)), needle);
+
+        uint32_t bits = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(eq0))
+                        | ((uint32_t)_mm_movemask_ps(_mm_castsi128_ps(eq1)) << 4);
+
+        while (bits != 0)
+        {
+            matches.push_back(baseAddress + offset + __builtin_ctz(bits) * 4);
+            bits &= bits - 1;
+        }
+    }
+
+    FindValueScalar<uint32_t>(data, offset, last, value, baseAddress, matches);
+}
+
+__attribute__((target("sse4.2")))
+static void
+FindPatternSse42(
+        const uint8_t* data,
+        size_t size,
+        size_t offset,
+        size_t last,
+        size_t anchor,
+        uint64_t baseAddress,
+        const ScanPattern& pattern,
+        std::vector<uint64_t>& matches)
+{
+    const __m128i needle = _mm_set1_epi8((char)pattern.Bytes[anchor]);
+
+    for (; offset < last && offset + anchor + 16 <= size; offset += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)(data + offset + anchor));
+        uint32_t bits = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+
+        VerifyCandidates(bits, data, offset, last, baseAddress, pattern, matches);
+    }
+
+    size_t alignment = pattern.Alignment == 0 ? 1 : pattern.Alignment;
+    offset += FirstAlignedOffset(baseAddress + offset, alignment);
+
+    FindPatternScalar(data, offset, last, baseAddress, pattern, matches);
+}
+
+#endif // PATTERNSEARCH_X86
+
+//----------------------------------------------------------------------------
+// Dispatch
+//----------------------------------------------------------------------------
+
+static SearchIsa
+DetectSearchIsa()
+{
+    SearchIsa best = SearchIsa::Scalar;
+
+#ifdef PATTERNSEARCH_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        best = SearchIsa::Avx2;
+    }
+    else if (__builtin_cpu_supports("sse4.2"))
+    {
+        best = SearchIsa::Sse42;
+    }
+#endif
+
+    const char* forced = getenv("LOADMANAGED_SIMD");
+
+    if (forced != nullptr)
+    {
+        // Never pick something the CPU doesn't support
+        if (strcmp(forced, "scalar") == 0)
+        {
+            best = SearchIsa::Scalar;
+        }
+        else if (strcmp(forced, "sse4.2") == 0 && best == SearchIsa::Avx2)
+        {
+            best = SearchIsa::Sse42;
+        }
+    }
+
+    return best;
+}
+
+SearchIsa
+GetSearchIsa()
+{
+    static const SearchIsa isa = DetectSearchIsa();
+    return isa;
+}
+
+const char*
+GetSearchIsaName(
+        SearchIsa isa)
+{
+    switch (isa)
+    {
+        case SearchIsa::Avx2:
+            return "avx2";
+        case SearchIsa::Sse42:
+            return "sse4.2";
+        default:
+            return "scalar";
+    }
+}
+
+void
+FindPatternMatches(
+        const uint8_t* data,
+        size_t size,
+        size_t limit,
+        uint64_t baseAddress,
+        const ScanPattern& pattern,
+        std::vector<uint64_t>& matches)
+{
+    FindPatternMatches(GetSearchIsa(), data, size, limit, baseAddress, pattern, matches);
+}
+
+void
+FindPatternMatches(
+        SearchIsa isa,
+        const uint8_t* data,
+        size_t size,
+        size_t limit,
+        uint64_t baseAddress,
+        const ScanPattern& pattern,
+        std::vector<uint64_t>& matches)
+{
+    if (pattern.Size == 0 || size < pattern.Size)
+    {
+        return;
+    }
+
+    size_t alignment = pattern.Alignment == 0 ? 1 : pattern.Alignment;
+    size_t last = std::min(limit, size - pattern.Size + 1);
+    size_t offset = FirstAlignedOffset(baseAddress, alignment);
+
+    if (offset >= last)
+    {
+        return;
+    }
+
+    if (IsValueSearch(pattern))
+    {
+        if (pattern.Size == 8)
+        {
+            uint64_t value;
+            memcpy(&value, pattern.Bytes, sizeof(value));
+
+#ifdef PATTERNSEARCH_X86
+            // The kernels compare whole elements, so last is rounded to the element following the last candidate
+            size_t end = offset + (last - offset + 7) / 8 * 8;
+
+            if (isa == SearchIsa::Avx2)
+            {
+                FindValue64Avx2(data, offset, end, value, baseAddress, matches);
+                return;
+            }
+
+            if (isa == SearchIsa::Sse42)
+            {
+                FindValue64Sse42(data, offset, end, value, baseAddress, matches);
+                return;
+            }
+#endif
+
+            FindValueScalar<uint64_t>(data, offset, last, value, baseAddress, matches);
+        }
+        else
+        {
+            uint32_t value;
+            memcpy(&value, pattern.Bytes, sizeof(value));
+
+#ifdef PATTERNSEARCH_X86
+            size_t end = offset + (last - offset + 3) / 4 * 4;
+
+            if (isa == SearchIsa::Avx2)
+            {
+                FindValue32Avx2(data, offset, end, value, baseAddress, matches);
+                return;
+            }
+
+            if (isa == SearchIsa::Sse42)
+            {
+                FindValue32Sse42(data, offset, end, value, baseAddress, matches);
+                return;
+            }
+#endif
+
+            FindValueScalar<uint32_t>(data, offset, last, value, baseAddress, matches);
+        }
+
+        return;
+    }
+
+#ifdef PATTERNSEARCH_X86
+    // Anchor the search on the first byte that has to match exactly
+    size_t anchor = pattern.Size;
+
+    for (size_t i = 0; i < pattern.Size; i++)
+    {
+        if (pattern.Mask == nullptr || pattern.Mask[i] == 0xff)
+        {
+            anchor = i;
+            break;
+        }
+    }
+
+    if (anchor != pattern.Size)
+    {
+        // The byte kernels test every position, the alignment is checked on the candidates
+        if (isa == SearchIsa::Avx2)
+        {
+            FindPatternAvx2(data, size, 0, last, anchor, baseAddress, pattern, matches);
+            return;
+        }
+
+        if (isa == SearchIsa::Sse42)
+        {
+            FindPatternSse42(data, size, 0, last, anchor, baseAddress, pattern, matches);
+            return;
+        }
+    }
+#endif
+
+    FindPatternScalar(data, offset, last, baseAddress, pattern, matches);
+}
@@ -0,0 +1,59 @@
+#ifndef __PATTERNSEARCH_H__
+#define __PATTERNSEARCH_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//
+// Masked byte pattern. A null mask means all the bits are significant.
+// Matches are only reported at addresses that are a multiple of Alignment.
+//
+struct ScanPattern
+{
+    const uint8_t* Bytes;
+    const uint8_t* Mask;
+    size_t Size;
+    size_t Alignment;
+};
+
+enum class SearchIsa
+{
+    Scalar,
+    Sse42,
+    Avx2
+};
+
+// Instruction set used by the search kernels, picked once from cpuid.
+// Can be forced with LOADMANAGED_SIMD=scalar|sse4.2|avx2 (to compare the kernels).
+SearchIsa GetSearchIsa();
+
+const char* GetSearchIsaName(SearchIsa isa);
+
+//
+// Appends to matches the address of every occurrence of the pattern in data (which is mapped at baseAddress).
+// Only occurrences starting before data + limit are reported, the bytes after that are only there so
+// that occurrences straddling two chunks are found.
+//
+// Aligned 4 or 8-byte values without mask (pointer search) use dedicated compare kernels,
+// other patterns look for the first fully-significant byte and verify the candidates.
+//
+void FindPatternMatches(
+        const uint8_t* data,
+        size_t size,
+        size_t limit,
+        uint64_t baseAddress,
+        const ScanPattern& pattern,
+        std::vector<uint64_t>& matches);
+
+// Same as FindPatternMatches, with an explicit instruction set
+void FindPatternMatches(
+        SearchIsa isa,
+        const uint8_t* data,
+        size_t size,
+        size_t limit,
+        uint64_t baseAddress,
+        const ScanPattern& pattern,
+        std::vector<uint64_t>& matches);
+
+#endif // __PATTERNSEARCH_H__
@@ -0,0 +1,126 @@
+#include "prefetcher.h"
+
+#include <algorithm>
+#include <thread>
+
+// Reads in a row before the stream is considered sequential
+const uint32_t SequentialReadThreshold = 4;
+
+// Largest gap between the end of a read and the start of the next one in a stream
+const uint64_t SequentialReadGap = PageCache::PageSize;
+
+// Size of each read-ahead, issued when the caller gets within half of it from the end of the previous one
+const size_t ReadAheadSize = 1024 * 1024;
+
+// Pending requests, beyond which new ones are dropped
+const size_t PrefetchQueueLimit = 16;
+
+ReadPrefetcher::ReadPrefetcher() :
+        m_started(false)
+{
+}
+
+void
+ReadPrefetcher::Run()
+{
+    while (true)
+    {
+        Request request;
+
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_wake.wait(lock, [this]() { return !m_queue.empty(); });
+
+            request = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        request.Cache->Prefetch(request.Address, request.Size);
+    }
+}
+
+void
+ReadPrefetcher::Submit(
+        std::shared_ptr<PageCache> cache,
+        uint64_t address,
+        size_t size)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        if (m_queue.size() >= PrefetchQueueLimit)
+        {
+            return;
+        }
+
+        m_queue.push_back(Request{ std::move(cache), address, size });
+
+        // Started on first use, it idles for the lifetime of lldb
+        if (!m_started)
+        {
+            m_started = true;
+            std::thread(&ReadPrefetcher::Run, this).detach();
+        }
+    }
+
+    m_wake.notify_one();
+}
+
+void
+ReadPrefetcher::CancelAll()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_queue.clear();
+}
+
+ReadPrefetcher&
+ReadPrefetcher::Shared()
+{
+    static ReadPrefetcher* prefetcher = new ReadPrefetcher();
+    return *prefetcher;
+}
+
+SequentialReadDetector::SequentialReadDetector() :
+        m_cache(nullptr),
+        m_nextAddress(0),
+        m_prefetchedEnd(0),
+        m_sequentialReads(0)
+{
+}
+
+void
+SequentialReadDetector::OnRead(
+        const std::shared_ptr<PageCache>& cache,
+        uint64_t address,
+        size_t size)
+{
+    // A new cache means the process ran, what was read ahead is gone
+    if (cache.get() != m_cache)
+    {
+        m_cache = cache.get();
+        m_prefetchedEnd = 0;
+        m_sequentialReads = 0;
+    }
+
+    if (address >= m_nextAddress && address - m_nextAddress <= SequentialReadGap)
+    {
+        m_sequentialReads++;
+    }
+    else
+    {
+        m_sequentialReads = 0;
+        m_prefetchedEnd = 0;
+    }
+
+    m_nextAddress = address + size;
+
+    if (m_sequentialReads < SequentialReadThreshold || m_nextAddress + ReadAheadSize / 2 < m_prefetchedEnd)
+    {
+        return;
+    }
+
+    uint64_t start = std::max(m_prefetchedEnd, m_nextAddress);
+
+    ReadPrefetcher::Shared().Submit(cache, start, ReadAheadSize);
+    m_prefetchedEnd = start + ReadAheadSize;
+}
@@ -0,0 +1,65 @@
+#ifndef __PREFETCHER_H__
+#define __PREFETCHER_H__
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include "pagecache.h"
+
+//
+// Reads ahead into the page cache on a helper thread, so the callers walking
+// the memory in ascending order (heap walks) find the next pages resident.
+// Read-ahead is a hint: requests are dropped when the queue is full, and the
+// queue is flushed when the process resumes.
+//
+class ReadPrefetcher
+{
+private:
+    struct Request
+    {
+        std::shared_ptr<PageCache> Cache;
+        uint64_t Address;
+        size_t Size;
+    };
+
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::deque<Request> m_queue;
+    bool m_started;
+
+    void Run();
+
+public:
+    ReadPrefetcher();
+
+    void Submit(std::shared_ptr<PageCache> cache, uint64_t address, size_t size);
+
+    // Drops the pending requests, the one being read completes
+    void CancelAll();
+
+    static ReadPrefetcher& Shared();
+};
+
+//
+// Recognizes the sequential reads of a caller: each read starting at most a
+// page after the end of the previous one. Once the stream is established, the
+// detector keeps the read-ahead ReadAheadSize bytes in front of it.
+//
+class SequentialReadDetector
+{
+private:
+    const PageCache* m_cache;
+    uint64_t m_nextAddress;
+    uint64_t m_prefetchedEnd;
+    uint32_t m_sequentialReads;
+
+public:
+    SequentialReadDetector();
+
+    void OnRead(const std::shared_ptr<PageCache>& cache, uint64_t address, size_t size);
+};
+
+#endif // __PREFETCHER_H__
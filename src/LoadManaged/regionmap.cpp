@@ -0,0 +1,180 @@
+#include "regionmap.h"
+
+#include <algorithm>
+#include <elf.h>
+#include <mutex>
+#include <utility>
+#include "lldb/API/SBMemoryRegionInfo.h"
+#include "lldb/API/SBMemoryRegionInfoList.h"
+#include "invalidation.h"
+#include "memoryreader.h"
+#include "sosplugin.h"
+
+MemoryRegionMap::MemoryRegionMap(
+        std::vector<MemoryRegion> regions)
+{
+    std::sort(regions.begin(), regions.end(),
+        [](const MemoryRegion& left, const MemoryRegion& right) { return left.Start < right.Start; });
+
+    // Lookups rely on the regions being disjoint
+    m_regions.reserve(regions.size());
+
+    for (MemoryRegion region : regions)
+    {
+        if (!m_regions.empty())
+        {
+            region.Start = std::max(region.Start, m_regions.back().End);
+        }
+
+        if (region.Start < region.End)
+        {
+            m_regions.push_back(region);
+        }
+    }
+}
+
+const MemoryRegion*
+MemoryRegionMap::FindRegion(
+        uint64_t address) const
+{
+    // First region ending after the address
+    auto it = std::upper_bound(m_regions.begin(), m_regions.end(), address,
+        [](uint64_t value, const MemoryRegion& region) { return value < region.End; });
+
+    return it != m_regions.end() ? &*it : nullptr;
+}
+
+bool
+MemoryRegionMap::ClipRange(
+        const ScanRange& range,
+        std::vector<ScanRange>& ranges) const
+{
+    if (m_regions.empty())
+    {
+        return false;
+    }
+
+    uint64_t end = range.Start + range.Length;
+    if (end < range.Start)
+    {
+        end = UINT64_MAX;
+    }
+
+    for (const MemoryRegion* region = FindRegion(range.Start);
+         region != nullptr && region != m_regions.data() + m_regions.size() && region->Start < end;
+         region++)
+    {
+        if ((region->Protection & MemoryProtectionRead) == 0)
+        {
+            continue;
+        }
+
+        uint64_t start = std::max(region->Start, range.Start);
+        uint64_t length = std::min(region->End, end) - start;
+
+        if (!ranges.empty() && ranges.back().Start + ranges.back().Length == start)
+        {
+            ranges.back().Length += length;
+        }
+        else
+        {
+            ranges.push_back(ScanRange{ start, length });
+        }
+    }
+
+    return true;
+}
+
+static void
+AddCoreRegions(
+        const CoreFile& core,
+        std::vector<MemoryRegion>& regions)
+{
+    for (const CoreSegment& segment : core.GetSegments())
+    {
+        if (segment.MemorySize == 0)
+        {
+            continue;
+        }
+
+        uint32_t protection = 0;
+        if (segment.Flags & PF_R) protection |= MemoryProtectionRead;
+        if (segment.Flags & PF_W) protection |= MemoryProtectionWrite;
+        if (segment.Flags & PF_X) protection |= MemoryProtectionExecute;
+
+        regions.push_back(MemoryRegion{ segment.VirtualAddress, segment.VirtualAddress + segment.MemorySize, protection });
+    }
+}
+
+static void
+AddProcessRegions(
+        lldb::SBProcess process,
+        std::vector<MemoryRegion>& regions)
+{
+    lldb::SBMemoryRegionInfoList list = process.GetMemoryRegions();
+    uint32_t count = list.GetSize();
+
+    regions.reserve(count);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        lldb::SBMemoryRegionInfo info;
+
+        // lldb also reports the holes between the mappings
+        if (!list.GetMemoryRegionAtIndex(i, info) || !info.IsMapped() || info.GetRegionEnd() <= info.GetRegionBase())
+        {
+            continue;
+        }
+
+        uint32_t protection = 0;
+        if (info.IsReadable()) protection |= MemoryProtectionRead;
+        if (info.IsWritable()) protection |= MemoryProtectionWrite;
+        if (info.IsExecutable()) protection |= MemoryProtectionExecute;
+
+        regions.push_back(MemoryRegion{ info.GetRegionBase(), info.GetRegionEnd(), protection });
+    }
+}
+
+static std::shared_ptr<const MemoryRegionMap>
+CreateRegionMap(
+        lldb::SBProcess process)
+{
+    std::vector<MemoryRegion> regions;
+
+    std::shared_ptr<CoreFile> core = TargetMemoryReader::Get(process)->GetCoreFile();
+
+    if (core != nullptr)
+    {
+        AddCoreRegions(*core, regions);
+    }
+    else
+    {
+        AddProcessRegions(process, regions);
+    }
+
+    return std::make_shared<MemoryRegionMap>(std::move(regions));
+}
+
+std::shared_ptr<const MemoryRegionMap>
+MemoryRegionMap::Get(
+        lldb::SBProcess process)
+{
+    static std::mutex lock;
+    static std::shared_ptr<const MemoryRegionMap> map;
+    static uint64_t mapGeneration;
+
+    std::lock_guard<std::recursive_mutex> sbLock(g_sbApiLock);
+    std::lock_guard<std::mutex> mapLock(lock);
+
+    SyncCacheGenerations(process);
+
+    uint64_t generation = GetCacheGeneration(CACHE_KIND_MASK(CacheKindProcess));
+
+    if (map == nullptr || mapGeneration != generation)
+    {
+        map = CreateRegionMap(process);
+        mapGeneration = generation;
+    }
+
+    return map;
+}
@@ -0,0 +1,52 @@
+#ifndef __REGIONMAP_H__
+#define __REGIONMAP_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "lldb/API/SBProcess.h"
+#include "memoryscan.h"
+
+enum MemoryProtection : uint32_t
+{
+    MemoryProtectionRead = 0x1,
+    MemoryProtectionWrite = 0x2,
+    MemoryProtectionExecute = 0x4,
+};
+
+struct MemoryRegion
+{
+    uint64_t Start;
+    uint64_t End;
+    uint32_t Protection;
+};
+
+//
+// Mapped regions of the target, sorted by address. Built from the core
+// PT_LOAD table for dumps (no round-trip through lldb), or from
+// SBProcess::GetMemoryRegions otherwise, and cached until the next stop.
+//
+class MemoryRegionMap
+{
+private:
+    std::vector<MemoryRegion> m_regions;
+
+public:
+    explicit MemoryRegionMap(std::vector<MemoryRegion> regions);
+
+    // Regions sorted by start address, without overlap. Empty if the region list isn't available.
+    const std::vector<MemoryRegion>& GetRegions() const { return m_regions; }
+
+    // Returns the region containing the address, or the first region above it. nullptr if there is none.
+    const MemoryRegion* FindRegion(uint64_t address) const;
+
+    // Appends the parts of the range backed by readable regions to ranges. Adjacent regions are coalesced.
+    // Returns false, without touching ranges, if the region list isn't available.
+    bool ClipRange(const ScanRange& range, std::vector<ScanRange>& ranges) const;
+
+    // Returns the regions of the process, reusing the previous map while the process stays stopped
+    static std::shared_ptr<const MemoryRegionMap> Get(lldb::SBProcess process);
+};
+
+#endif // __REGIONMAP_H__
@@ -0,0 +1,423 @@
+#include "runtimelocator.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <glob.h>
+#include <iterator>
+#include <mutex>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "modulemap.h"
+
+namespace
+{
+    const char* const CoreClrName = "libcoreclr.so";
+    const char* const CoreLibName = "System.Private.CoreLib.dll";
+    const char* const SharedRuntimePath = "/shared/Microsoft.NETCore.App/";
+    const char* const HostFxrPattern = "/host/fxr/*/libhostfxr.so";
+
+    // Embedded in the runtime binaries, followed by the file version (6.0.522.21309)
+    const char VersionMarker[] = "@(#)Version ";
+
+    struct RuntimeVersion
+    {
+        int Parts[3];
+        int PartCount;
+        bool Prerelease;
+    };
+
+    struct InstalledRuntime
+    {
+        std::string Directory;
+        std::string Version;
+        RuntimeVersion Parsed;
+    };
+
+    std::mutex s_lock;
+    bool s_probed;
+    std::vector<InstalledRuntime> s_installed;
+    std::unordered_map<std::string, RuntimeLocation> s_choices;
+
+    // 6.0.5, 7.0.0-preview.3.22175.4. Returns false if there isn't at least a major.minor.
+    bool
+    ParseVersion(
+            const std::string& text,
+            RuntimeVersion& version)
+    {
+        memset(&version, 0, sizeof(version));
+
+        const char* current = text.c_str();
+
+        while (version.PartCount < 3 && isdigit((unsigned char)*current))
+        {
+            char* end;
+            version.Parts[version.PartCount++] = (int)strtol(current, &end, 10);
+            current = end;
+
+            if (*current != '.')
+            {
+                break;
+            }
+
+            current++;
+        }
+
+        version.Prerelease = strchr(text.c_str(), '-') != nullptr;
+        return version.PartCount >= 2;
+    }
+
+    // Releases first, then the highest version
+    bool
+    IsPreferred(
+            const RuntimeVersion& left,
+            const RuntimeVersion& right)
+    {
+        if (left.Prerelease != right.Prerelease)
+        {
+            return !left.Prerelease;
+        }
+
+        return std::lexicographical_compare(right.Parts, right.Parts + 3, left.Parts, left.Parts + 3);
+    }
+
+    // 0 for the same version, 1 for the same major.minor, 2 for the same major, 3 otherwise
+    int
+    GetDistance(
+            const RuntimeVersion& candidate,
+            const RuntimeVersion& target)
+    {
+        int common = 0;
+
+        while (common < target.PartCount && candidate.Parts[common] == target.Parts[common])
+        {
+            common++;
+        }
+
+        return common == 3 ? 0 : common == 2 ? 1 : common == 1 ? 2 : 3;
+    }
+
+    std::string
+    GetFileName(
+            const std::string& path)
+    {
+        size_t end = path.find_last_not_of('/');
+        if (end == std::string::npos)
+        {
+            return std::string();
+        }
+
+        size_t start = path.find_last_of('/', end);
+        return path.substr(start == std::string::npos ? 0 : start + 1, end - (start == std::string::npos ? 0 : start + 1) + 1);
+    }
+
+    bool
+    FileExists(
+            const std::string& path)
+    {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+    }
+
+    // Only the major.minor of the file version match the runtime version
+    bool
+    ReadLibraryVersion(
+            const std::string& path,
+            RuntimeVersion& version)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::vector<char> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        auto marker = std::search(image.begin(), image.end(), VersionMarker, VersionMarker + sizeof(VersionMarker) - 1);
+        if (marker == image.end())
+        {
+            return false;
+        }
+
+        auto start = marker + sizeof(VersionMarker) - 1;
+        auto end = std::find_if(start, image.end(), [](char c) { return !isdigit((unsigned char)c) && c != '.'; });
+
+        if (!ParseVersion(std::string(start, end), version))
+        {
+            return false;
+        }
+
+        version.PartCount = 2;
+        return true;
+    }
+
+    void
+    AddRoot(
+            std::vector<std::string>& roots,
+            const std::string& root)
+    {
+        char resolved[PATH_MAX];
+
+        if (root.empty() || realpath(root.c_str(), resolved) == nullptr)
+        {
+            return;
+        }
+
+        if (std::find(roots.begin(), roots.end(), resolved) == roots.end())
+        {
+            roots.push_back(resolved);
+        }
+    }
+
+    // Where dotnet looks for its runtimes: DOTNET_ROOT, the installation of the dotnet on the PATH, then the usual locations
+    std::vector<std::string>
+    GetDotnetRoots()
+    {
+        std::vector<std::string> roots;
+
+        const char* dotnetRoot = getenv("DOTNET_ROOT");
+        if (dotnetRoot != nullptr)
+        {
+            AddRoot(roots, dotnetRoot);
+        }
+
+        const char* path = getenv("PATH");
+        std::string directories = path != nullptr ? path : "";
+        size_t start = 0;
+
+        while (start <= directories.size())
+        {
+            size_t end = directories.find(':', start);
+            if (end == std::string::npos)
+            {
+                end = directories.size();
+            }
+
+            std::string dotnet = directories.substr(start, end - start) + "/dotnet";
+            char resolved[PATH_MAX];
+
+            // Usually a symlink to <root>/dotnet
+            if (end != start && access(dotnet.c_str(), X_OK) == 0 && realpath(dotnet.c_str(), resolved) != nullptr)
+            {
+                std::string executable = resolved;
+                AddRoot(roots, executable.substr(0, executable.find_last_of('/')));
+            }
+
+            start = end + 1;
+        }
+
+        AddRoot(roots, "/usr/share/dotnet");
+        AddRoot(roots, "/usr/lib/dotnet");
+        AddRoot(roots, "/usr/lib64/dotnet");
+        AddRoot(roots, "/usr/local/share/dotnet");
+        AddRoot(roots, "/opt/dotnet");
+
+        const char* home = getenv("HOME");
+        if (home != nullptr)
+        {
+            AddRoot(roots, std::string(home) + "/.dotnet");
+        }
+
+        return roots;
+    }
+
+    std::vector<InstalledRuntime>
+    FindInstalledRuntimes()
+    {
+        std::vector<InstalledRuntime> runtimes;
+
+        for (auto& root : GetDotnetRoots())
+        {
+            std::string pattern = root + SharedRuntimePath + "*/" + CoreClrName;
+            glob_t matches;
+
+            if (glob(pattern.c_str(), 0, nullptr, &matches) == 0)
+            {
+                for (size_t i = 0; i < matches.gl_pathc; i++)
+                {
+                    std::string path = matches.gl_pathv[i];
+
+                    InstalledRuntime runtime;
+                    runtime.Directory = path.substr(0, path.size() - strlen(CoreClrName));
+                    runtime.Version = GetFileName(runtime.Directory);
+
+                    if (ParseVersion(runtime.Version, runtime.Parsed) && FileExists(runtime.Directory + CoreLibName))
+                    {
+                        runtimes.push_back(runtime);
+                    }
+                }
+            }
+
+            globfree(&matches);
+        }
+
+        return runtimes;
+    }
+
+    const InstalledRuntime*
+    SelectRuntime(
+            const std::vector<InstalledRuntime>& runtimes,
+            const RuntimeVersion* target)
+    {
+        const InstalledRuntime* best = nullptr;
+        int bestDistance = INT_MAX;
+
+        for (auto& runtime : runtimes)
+        {
+            int distance = target != nullptr ? GetDistance(runtime.Parsed, *target) : 3;
+
+            if (best == nullptr || distance < bestDistance || (distance == bestDistance && IsPreferred(runtime.Parsed, best->Parsed)))
+            {
+                best = &runtime;
+                bestDistance = distance;
+            }
+        }
+
+        return best;
+    }
+
+    bool
+    ResolveRuntime(
+            const std::string& targetDirectory,
+            RuntimeLocation& location)
+    {
+        RuntimeVersion targetVersion;
+        bool hasTargetVersion = false;
+
+        if (!targetDirectory.empty())
+        {
+            std::string targetLibrary = targetDirectory + CoreClrName;
+
+            // The directory is named after the runtime version, unless lldb found the binary elsewhere (symbol server cache)
+            location.TargetVersion = GetFileName(targetDirectory);
+            hasTargetVersion = ParseVersion(location.TargetVersion, targetVersion);
+
+            if (!hasTargetVersion && FileExists(targetLibrary))
+            {
+                hasTargetVersion = ReadLibraryVersion(targetLibrary, targetVersion);
+
+                if (hasTargetVersion)
+                {
+                    location.TargetVersion = std::to_string(targetVersion.Parts[0]) + "." + std::to_string(targetVersion.Parts[1]);
+                }
+            }
+
+            if (!hasTargetVersion)
+            {
+                location.TargetVersion.clear();
+            }
+
+            // A complete runtime, not only a copy of the binary
+            if (FileExists(targetLibrary) && FileExists(targetDirectory + CoreLibName))
+            {
+                location.Directory = targetDirectory;
+                location.Version = location.TargetVersion;
+                return true;
+            }
+        }
+
+        if (!s_probed)
+        {
+            s_installed = FindInstalledRuntimes();
+            s_probed = true;
+        }
+
+        const InstalledRuntime* runtime = SelectRuntime(s_installed, hasTargetVersion ? &targetVersion : nullptr);
+        if (runtime == nullptr)
+        {
+            return false;
+        }
+
+        location.Directory = runtime->Directory;
+        location.Version = runtime->Version;
+        return true;
+    }
+}
+
+bool
+LocateRuntime(
+        lldb::SBTarget target,
+        RuntimeLocation& location)
+{
+    std::string targetDirectory;
+    std::string key;
+
+    if (target.IsValid())
+    {
+        const ModuleEntry* coreclr = ModuleMap::Get(target)->FindByName(CoreClrName);
+
+        if (coreclr != nullptr)
+        {
+            lldb::SBModule module = coreclr->Module;
+            lldb::SBFileSpec fileSpec = module.GetFileSpec();
+            const char* directory = fileSpec.GetDirectory();
+            const char* uuid = module.GetUUIDString();
+
+            if (directory != nullptr)
+            {
+                targetDirectory = std::string(directory) + "/";
+            }
+
+            key = targetDirectory + "|" + (uuid != nullptr ? uuid : "");
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(s_lock);
+
+    auto it = s_choices.find(key);
+    if (it != s_choices.end())
+    {
+        location = it->second;
+        return true;
+    }
+
+    if (!ResolveRuntime(targetDirectory, location))
+    {
+        return false;
+    }
+
+    s_choices[key] = location;
+    return true;
+}
+
+bool
+LocateHostFxr(
+        const std::string& runtimeDirectory,
+        std::string& hostFxrPath,
+        std::string& dotnetRoot)
+{
+    size_t shared = runtimeDirectory.rfind(SharedRuntimePath);
+    if (shared == std::string::npos)
+    {
+        return false;
+    }
+
+    dotnetRoot = runtimeDirectory.substr(0, shared);
+
+    std::string pattern = dotnetRoot + HostFxrPattern;
+    RuntimeVersion bestVersion;
+    glob_t matches;
+
+    hostFxrPath.clear();
+
+    if (glob(pattern.c_str(), 0, nullptr, &matches) == 0)
+    {
+        for (size_t i = 0; i < matches.gl_pathc; i++)
+        {
+            std::string path = matches.gl_pathv[i];
+            RuntimeVersion version;
+
+            // <root>/host/fxr/<version>/libhostfxr.so
+            if (ParseVersion(GetFileName(path.substr(0, path.find_last_of('/'))), version) &&
+                (hostFxrPath.empty() || IsPreferred(version, bestVersion)))
+            {
+                hostFxrPath = path;
+                bestVersion = version;
+            }
+        }
+    }
+
+    globfree(&matches);
+
+    return !hostFxrPath.empty();
+}
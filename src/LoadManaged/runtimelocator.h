@@ -0,0 +1,34 @@
+#ifndef __RUNTIMELOCATOR_H__
+#define __RUNTIMELOCATOR_H__
+
+#include <string>
+#include "lldb/API/SBTarget.h"
+
+//
+// Picks the CoreCLR hosting the managed side. The runtime loaded by the
+// target is used directly when its directory exists on this machine (live
+// process, or dump opened where it was taken). Otherwise the runtimes
+// installed locally are probed, in the layout listed by dotnet
+// --list-runtimes (<root>/shared/Microsoft.NETCore.App/<version>), and the
+// closest to the version of the target's libcoreclr.so wins: same version,
+// then the latest patch of the same major.minor, then the latest of the same
+// major, then the latest overall. The choice is remembered per target
+// runtime, so the probing is done once.
+//
+struct RuntimeLocation
+{
+    // With a trailing '/'
+    std::string Directory;
+    std::string Version;
+    // Version of the runtime loaded by the target, empty if unknown
+    std::string TargetVersion;
+};
+
+// Returns false if no runtime was found. The target may be invalid, the latest runtime is picked then.
+bool LocateRuntime(lldb::SBTarget target, RuntimeLocation& location);
+
+// Finds the latest libhostfxr.so (<root>/host/fxr/<version>) of the installation the runtime directory belongs to.
+// Returns false for a runtime outside of a shared layout.
+bool LocateHostFxr(const std::string& runtimeDirectory, std::string& hostFxrPath, std::string& dotnetRoot);
+
+#endif // __RUNTIMELOCATOR_H__
@@ -2,15 +2,34 @@
 // The .NET Foundation licenses this file to you under the MIT license.
 // See the LICENSE file in the project root for more information.
 
+#include <algorithm>
 #include <cstdarg>
 #include <cstdlib>
 #include "sosplugin.h"
 #include <string.h>
 #include <string>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 //#include "services.h"
 #include "unknwn.h"
+#include "chainwalk.h"
+#include "interrupt.h"
+#include "invalidation.h"
+#include "memoryscan.h"
+#include "memorysnapshot.h"
+#include "modulemap.h"
+#include "pagecache.h"
+#include "prefetcher.h"
+#include "regionmap.h"
+#include "servicestats.h"
+#include "stacksnapshot.h"
+#include "structlayout.h"
+#include "threadmap.h"
+#include "threadpool.h"
 
 
 #define S_OK 0x0
@@ -18,29 +37,112 @@
 #define E_FAIL 0x80004005
 #define E_INVALIDARG 0x80070057
 #define E_NOTIMPL 0x80004001
+#define E_ABORT 0x80004004
 
 #define InterlockedIncrement __sync_add_and_fetch
 
 #define CONVERT_FROM_SIGN_EXTENDED(offset) ((ULONG_PTR)(offset))
 
+// Background jobs run managed commands on worker threads, so every service
+// call that goes through the SB APIs is serialized with this lock.
+// It is recursive because some services call each other.
+std::recursive_mutex g_sbApiLock;
+#define SB_API_LOCK() std::lock_guard<std::recursive_mutex> sbApiLock(g_sbApiLock)
+
+// Objects read by each task of a ReadStructs batch, smaller batches are read on the calling thread
+const ULONG StructsChunkSize = 1024;
+
 ULONG g_currentThreadIndex = -1;
 ULONG g_currentThreadSystemId = -1;
 char *g_coreclrDirectory;
 
+// Protects the pool and the binding of the pooled instances
+static std::mutex g_servicesPoolLock;
+static std::unordered_map<lldb::user_id_t, LLDBServices*> g_servicesPool;
+
 LLDBServices::LLDBServices(lldb::SBDebugger &debugger, lldb::SBCommandReturnObject &returnObject, lldb::SBProcess *process, lldb::SBThread *thread) :
         m_ref(1),
         m_debugger(debugger),
-        m_returnObject(returnObject),
-        m_currentProcess(process),
-        m_currentThread(thread)
+        m_returnObject(nullptr),
+        m_currentProcess(nullptr),
+        m_currentThread(nullptr),
+        m_interrupt(&g_interruptRequested),
+        m_stopBound(false),
+        m_stopId(0),
+        m_pooled(false)
 {
-    returnObject.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    Bind(returnObject, process, thread);
 }
 
 LLDBServices::~LLDBServices()
 {
 }
 
+LLDBServices*
+LLDBServices::Acquire(
+        lldb::SBDebugger &debugger,
+        lldb::SBCommandReturnObject &returnObject,
+        lldb::SBProcess *process,
+        lldb::SBThread *thread)
+{
+    std::lock_guard<std::mutex> lock(g_servicesPoolLock);
+
+    LLDBServices*& pooled = g_servicesPool[debugger.GetID()];
+
+    if (pooled == nullptr)
+    {
+        // The pool keeps its own reference
+        pooled = new LLDBServices(debugger, returnObject, process, thread);
+        pooled->m_pooled = true;
+        pooled->AddRef();
+        return pooled;
+    }
+
+    if (__atomic_load_n(&pooled->m_ref, __ATOMIC_SEQ_CST) != 1)
+    {
+        return new LLDBServices(debugger, returnObject, process, thread);
+    }
+
+    pooled->Bind(returnObject, process, thread);
+    pooled->AddRef();
+    return pooled;
+}
+
+void
+LLDBServices::Bind(
+        lldb::SBCommandReturnObject &returnObject,
+        lldb::SBProcess *process,
+        lldb::SBThread *thread)
+{
+    m_returnObject = &returnObject;
+    m_currentProcess = process;
+    m_currentThread = thread;
+    m_interrupt = &g_interruptRequested;
+    m_stopBound = false;
+
+    returnObject.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+}
+
+void
+LLDBServices::Unbind()
+{
+    // Plugins that hold on to the pointer after their command returned write to the console
+    static lldb::SBCommandReturnObject *console = nullptr;
+
+    if (console == nullptr)
+    {
+        console = new lldb::SBCommandReturnObject();
+        console->SetImmediateOutputFile(stdout);
+        console->SetImmediateErrorFile(stderr);
+    }
+
+    m_returnObject = console;
+    m_currentProcess = nullptr;
+    m_currentThread = nullptr;
+    m_interrupt = &g_interruptRequested;
+    m_stopBound = false;
+}
+
 //----------------------------------------------------------------------------
 // IUnknown
 //----------------------------------------------------------------------------
@@ -81,6 +183,19 @@ LLDBServices::AddRef()
 ULONG
 LLDBServices::Release()
 {
+    if (m_pooled)
+    {
+        // Only the pool is left: the command is done with the instance
+        std::lock_guard<std::mutex> lock(g_servicesPoolLock);
+
+        LONG ref = __atomic_sub_fetch(&m_ref, 1, __ATOMIC_SEQ_CST);
+        if (ref == 1)
+        {
+            Unbind();
+        }
+        return ref;
+    }
+
     LONG ref = __atomic_sub_fetch(&m_ref, 1, __ATOMIC_SEQ_CST);
 
     //LONG ref = InterlockedDecrement(&m_ref);
@@ -99,6 +214,7 @@ LLDBServices::Release()
 PCSTR
 LLDBServices::GetCoreClrDirectory()
 {
+    SERVICE_STATS();
     return g_coreclrDirectory;
 }
 
@@ -106,6 +222,9 @@ DWORD_PTR
 LLDBServices::GetExpression(
         PCSTR exp)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     if (exp == nullptr)
     {
         return 0;
@@ -146,6 +265,9 @@ LLDBServices::GetExpression(
 {
     DWORD_PTR result = 0;
 
+    // The expression may run the target, the background jobs and freeze mode must survive it
+    ExpressionEvaluationScope evaluation;
+
     lldb::SBValue value = frame.EvaluateExpression(exp, lldb::eNoDynamicValues);
     if (value.IsValid())
     {
@@ -166,8 +288,13 @@ LLDBServices::VirtualUnwind(
         ULONG32 contextSize,
         PBYTE context)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     lldb::SBProcess process;
     lldb::SBThread thread;
+    std::shared_ptr<const ThreadMap> threads;
+    const ThreadEntry* entry;
 
     if (context == NULL || contextSize < sizeof(DT_CONTEXT))
     {
@@ -180,11 +307,14 @@ LLDBServices::VirtualUnwind(
         return E_FAIL;
     }
 
-    thread = process.GetThreadByID(threadID);
-    if (!thread.IsValid())
+    // Unlike the other lookups by system id, the unwinding doesn't apply the fake thread
+    threads = ThreadMap::Get(process);
+    entry = threads->FindActualBySystemId(threadID);
+    if (entry == nullptr || !entry->Thread.IsValid())
     {
         return E_FAIL;
     }
+    thread = entry->Thread;
 
     DT_CONTEXT *dtcontext = (DT_CONTEXT*)context;
     lldb::SBFrame frameFound;
@@ -256,8 +386,10 @@ ExceptionBreakpointCallback(
 
     // Save the process and thread to be used by the current process/thread
     // helper functions.
-    LLDBServices* client = new LLDBServices(debugger, result, &process, &thread);
-    return ((PFN_EXCEPTION_CALLBACK)baton)(client) == S_OK;
+    LLDBServices* client = LLDBServices::Acquire(debugger, result, &process, &thread);
+    bool stop = ((PFN_EXCEPTION_CALLBACK)baton)(client) == S_OK;
+    client->Release();
+    return stop;
 }
 
 lldb::SBBreakpoint g_exceptionbp;
@@ -266,6 +398,9 @@ HRESULT
 LLDBServices::SetExceptionCallback(
         PFN_EXCEPTION_CALLBACK callback)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     if (!g_exceptionbp.IsValid())
     {
         lldb::SBTarget target = m_debugger.GetSelectedTarget();
@@ -290,6 +425,9 @@ LLDBServices::SetExceptionCallback(
 HRESULT
 LLDBServices::ClearExceptionCallback()
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     if (g_exceptionbp.IsValid())
     {
         lldb::SBTarget target = m_debugger.GetSelectedTarget();
@@ -313,7 +451,22 @@ LLDBServices::ClearExceptionCallback()
 HRESULT
 LLDBServices::GetInterrupt()
 {
-    return E_FAIL;
+    SERVICE_STATS();
+    if (m_interrupt->load(std::memory_order_relaxed) != 0)
+    {
+        return S_OK;
+    }
+
+#ifdef HAVE_SBDEBUGGER_INTERRUPTREQUESTED
+    // Front-ends that don't go through SIGINT (lldb-dap, IDEs) interrupt
+    // the debugger through the API instead
+    if (m_debugger.InterruptRequested())
+    {
+        return S_OK;
+    }
+#endif
+
+    return S_FALSE;
 }
 
 // Sends output through clients
@@ -327,6 +480,7 @@ LLDBServices::Output(
         PCSTR format,
         ...)
 {
+    SERVICE_STATS();
     va_list args;
     va_start (args, format);
     HRESULT result = OutputVaList(mask, format, args);
@@ -340,6 +494,7 @@ LLDBServices::OutputVaList(
         PCSTR format,
         va_list args)
 {
+    SERVICE_STATS();
     HRESULT result = S_OK;
     char str[1024];
 
@@ -387,6 +542,7 @@ LLDBServices::ControlledOutput(
         PCSTR format,
         ...)
 {
+    SERVICE_STATS();
     va_list args;
     va_start (args, format);
     HRESULT result = ControlledOutputVaList(outputControl, mask, format, args);
@@ -401,6 +557,7 @@ LLDBServices::ControlledOutputVaList(
         PCSTR format,
         va_list args)
 {
+    SERVICE_STATS();
     return OutputVaList(mask, format, args);
 }
 
@@ -411,6 +568,7 @@ LLDBServices::GetDebuggeeType(
         PULONG debugClass,
         PULONG qualifier)
 {
+    SERVICE_STATS();
     *debugClass = DEBUG_CLASS_USER_WINDOWS;
     *qualifier = 0;
     return S_OK;
@@ -423,6 +581,7 @@ HRESULT
 LLDBServices::GetPageSize(
         PULONG size)
 {
+    SERVICE_STATS();
     *size = 4096;
     return S_OK;
 }
@@ -431,6 +590,7 @@ HRESULT
 LLDBServices::GetExecutingProcessorType(
         PULONG type)
 {
+    SERVICE_STATS();
 
     //std::cout << "Inside GetExecutingProcessorType" << std::endl;
 #ifdef DBG_TARGET_AMD64
@@ -453,6 +613,9 @@ LLDBServices::Execute(
         PCSTR command,
         ULONG flags)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     lldb::SBCommandInterpreter interpreter = m_debugger.GetCommandInterpreter();
 
     lldb::SBCommandReturnObject result;
@@ -479,6 +642,9 @@ LLDBServices::GetLastEventInformation(
         ULONG descriptionSize,
         PULONG descriptionUsed)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     if (extraInformationSize < sizeof(DEBUG_LAST_EVENT_INFO_EXCEPTION) ||
         type == NULL || processId == NULL || threadId == NULL || extraInformationUsed == NULL)
     {
@@ -559,6 +725,9 @@ LLDBServices::Disassemble(
         PULONG disassemblySize,
         PULONG64 endOffset)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     lldb::SBInstruction instruction;
     lldb::SBInstructionList list;
     lldb::SBTarget target;
@@ -587,6 +756,12 @@ LLDBServices::Disassemble(
         hr = E_INVALIDARG;
         goto exit;
     }
+    // The instructions are read from the process memory
+    if (m_stopBound && !GetCurrentProcess().IsValid())
+    {
+        hr = E_FAIL;
+        goto exit;
+    }
     address = target.ResolveLoadAddress(offset);
     if (!address.IsValid())
     {
@@ -665,15 +840,16 @@ LLDBServices::OutputString(
         ULONG mask,
         PCSTR str)
 {
+    SERVICE_STATS();
     if (mask == DEBUG_OUTPUT_ERROR)
     {
-        m_returnObject.SetStatus(lldb::eReturnStatusFailed);
+        m_returnObject->SetStatus(lldb::eReturnStatusFailed);
     }
     // Can not use AppendMessage or AppendWarning because they add a newline. SetError
     // can not be used for DEBUG_OUTPUT_ERROR mask because it caches the error strings
     // seperately from the normal output so error/normal texts are not intermixed
     // correctly.
-    m_returnObject.Printf("%s", str);
+    m_returnObject->Printf("%s", str);
 }
 
 //----------------------------------------------------------------------------
@@ -691,6 +867,9 @@ LLDBServices::GetContextStackTrace(
         ULONG frameContextsEntrySize,
         PULONG framesFilled)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     DT_CONTEXT *currentContext = (DT_CONTEXT*)frameContexts;
     PDEBUG_STACK_FRAME currentFrame = frames;
     lldb::SBThread thread;
@@ -776,45 +955,58 @@ LLDBServices::ReadVirtual(
         ULONG bufferSize,
         PULONG bytesRead)
 {
-    /*
-    std::cout << "ReadVirtual" << std::endl;
-    std::cout << "Offset: " << std::hex << offset << std::endl;
-    std::cout << "bufferSize: " << bufferSize << std::endl;
-*/
+    SERVICE_STATS();
+
+    // Each caller thread has its own stream of reads
+    static thread_local SequentialReadDetector detector;
+
+    std::shared_ptr<PageCache> cache;
+    size_t read = 0;
+    HRESULT hr = S_OK;
+
     if (!buffer)
     {
         std::cout << "buffer is null" << std::endl;
     }
 
-
-    lldb::SBError error;
-    size_t read = 0;
-
     // lldb doesn't expect sign-extended address
     offset = CONVERT_FROM_SIGN_EXTENDED(offset);
 
-    lldb::SBProcess process = GetCurrentProcess();
-    if (!process.IsValid())
     {
-        goto exit;
+        SB_API_LOCK();
+
+        lldb::SBProcess process = GetCurrentProcess();
+        if (!process.IsValid())
+        {
+            hr = E_FAIL;
+            goto exit;
+        }
+
+        cache = PageCache::Get(process);
     }
 
-    read = process.ReadMemory(offset, buffer, bufferSize, error);
+    // The pages are read outside of the lock, so background jobs don't wait for each other
+    read = cache->Read(offset, buffer, bufferSize);
+    serviceCall.AddBytes(read);
 
-    exit:
-    if (bytesRead)
+    // While capturing, the pages read ahead would end up in the core without any command needing them
+    if (!g_captureEnabled.load(std::memory_order_relaxed))
     {
-        *bytesRead = read;
+        detector.OnRead(cache, offset, bufferSize);
     }
 
- //   std::cout << "Read: " << read << std::endl;
+    if (read == 0 && bufferSize != 0)
+    {
+        hr = E_FAIL;
+    }
 
-    /*if (!error.Success())
+    exit:
+    if (bytesRead)
     {
-        std::cout << "Error: " << error.GetCString() << std::endl;
-    }*/
+        *bytesRead = read;
+    }
 
-    return error.Success() || (read != 0) ? S_OK : E_FAIL;
+    return hr;
 }
 
 HRESULT
@@ -824,6 +1016,9 @@ LLDBServices::WriteVirtual(
         ULONG bufferSize,
         PULONG bytesWritten)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     lldb::SBError error;
     size_t written = 0;
 
@@ -837,6 +1032,24 @@ LLDBServices::WriteVirtual(
     }
 
     written = process.WriteMemory(offset, buffer, bufferSize, error);
+    serviceCall.AddBytes(written);
+
+    if (written != 0)
+    {
+        InvalidateCaches(CACHE_KIND_MASK(CacheKindMemory));
+
+        std::shared_ptr<MemorySnapshot> snapshot = GetFrozenSnapshot(process);
+        if (snapshot != nullptr)
+        {
+            snapshot->ErasePages(offset, written);
+        }
+
+        std::shared_ptr<MemorySnapshot> capture = GetActiveCapture(process);
+        if (capture != nullptr)
+        {
+            capture->ErasePages(offset, written);
+        }
+    }
 
     exit:
     if (bytesWritten)
@@ -854,6 +1067,7 @@ HRESULT
 LLDBServices::GetSymbolOptions(
         PULONG options)
 {
+    SERVICE_STATS();
     *options = SYMOPT_LOAD_LINES;
     return S_OK;
 }
@@ -866,6 +1080,9 @@ LLDBServices::GetNameByOffset(
         PULONG nameSize,
         PULONG64 displacement)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     ULONG64 disp = DEBUG_INVALID_OFFSET;
     HRESULT hr = S_OK;
 
@@ -946,6 +1163,9 @@ LLDBServices::GetNumberModules(
         PULONG loaded,
         PULONG unloaded)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     //std::cout << "Inside GetNumberModules" << std::endl;
 
     ULONG numModules = 0;
@@ -976,6 +1196,9 @@ HRESULT LLDBServices::GetModuleByIndex(
         ULONG index,
         PULONG64 base)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     ULONG64 moduleBase = UINT64_MAX;
 
     lldb::SBTarget target;
@@ -1010,13 +1233,15 @@ LLDBServices::GetModuleByModuleName(
         PULONG index,
         PULONG64 base)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     ULONG64 moduleBase = UINT64_MAX;
     ULONG moduleIndex = UINT32_MAX;
 
     lldb::SBTarget target;
     lldb::SBModule module;
-    lldb::SBFileSpec fileSpec;
-    fileSpec.SetFilename(name);
+    const ModuleEntry* entry;
 
     target = m_debugger.GetSelectedTarget();
     if (!target.IsValid())
@@ -1024,27 +1249,15 @@ LLDBServices::GetModuleByModuleName(
         goto exit;
     }
 
-    module = target.FindModule(fileSpec);
-    if (!module.IsValid())
+    entry = ModuleMap::Get(target)->FindByName(name, startIndex);
+    if (entry == nullptr)
     {
         goto exit;
     }
 
+    module = entry->Module;
     moduleBase = GetModuleBase(target, module);
-
-    if (index)
-    {
-        int numModules = target.GetNumModules();
-        for (int mi = startIndex; mi < numModules; mi++)
-        {
-            lldb::SBModule mod = target.GetModuleAtIndex(mi);
-            if (module == mod)
-            {
-                moduleIndex = mi;
-                break;
-            }
-        }
-    }
+    moduleIndex = entry->Index;
 
     exit:
     if (index)
@@ -1065,6 +1278,9 @@ LLDBServices::GetModuleByOffset(
         PULONG index,
         PULONG64 base)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     ULONG64 moduleBase = UINT64_MAX;
     ULONG moduleIndex = UINT32_MAX;
 
@@ -1134,6 +1350,9 @@ LLDBServices::GetModuleNames(
         ULONG loadedImageNameBufferSize,
         PULONG loadedImageNameSize)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     lldb::SBTarget target;
     lldb::SBFileSpec fileSpec;
     HRESULT hr = S_OK;
@@ -1220,6 +1439,7 @@ LLDBServices::GetModuleParameters(
         ULONG start,
         PDEBUG_MODULE_PARAMETERS params)
 {
+    SERVICE_STATS();
     //std::cout << "Inside GetModuleParameters" << std::endl;
 
     // TODO: Use the start parameter
@@ -1244,6 +1464,9 @@ LLDBServices::GetModuleNameString(
         ULONG   bufferSize,
         PULONG  nameSize)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     lldb::SBTarget target;
     lldb::SBFileSpec fileSpec;
 
@@ -1298,6 +1521,9 @@ LLDBServices::GetModuleNameString(
 
 HRESULT LLDBServices::IsPointer64Bit()
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     if (m_debugger.GetSelectedTarget().GetAddressByteSize() == 8)
     {
         //std::cout << "64bit" << std::endl;
@@ -1317,6 +1543,9 @@ LLDBServices::GetLineByOffset(
         PULONG fileSize,
         PULONG64 displacement)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     ULONG64 disp = DEBUG_INVALID_OFFSET;
     HRESULT hr = S_OK;
     ULONG line = 0;
@@ -1399,6 +1628,7 @@ LLDBServices::GetSourceFileLineOffsets(
         ULONG bufferLines,
         PULONG fileLines)
 {
+    SERVICE_STATS();
     if (fileLines != NULL)
     {
         *fileLines = (ULONG)-1;
@@ -1416,6 +1646,7 @@ LLDBServices::FindSourceFile(
         ULONG bufferSize,
         PULONG foundSize)
 {
+    SERVICE_STATS();
     return E_NOTIMPL;
 }
 
@@ -1424,6 +1655,8 @@ PCSTR
 LLDBServices::GetModuleDirectory(
         PCSTR name)
 {
+    SB_API_LOCK();
+
     lldb::SBTarget target = m_debugger.GetSelectedTarget();
     if (!target.IsValid())
     {
@@ -1442,6 +1675,21 @@ LLDBServices::GetModuleDirectory(
     return module.GetFileSpec().GetDirectory();
 }
 
+void
+LLDBServices::SetInterruptFlag(
+        const std::atomic<int> *interrupt)
+{
+    m_interrupt = interrupt;
+}
+
+void
+LLDBServices::BindToStop(
+        uint32_t stopId)
+{
+    m_stopBound = true;
+    m_stopId = stopId;
+}
+
 ULONG64
 LLDBServices::GetModuleBase(
         /* const */ lldb::SBTarget& target,
@@ -1473,6 +1721,9 @@ HRESULT
 LLDBServices::GetCurrentProcessId(
         PULONG id)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     if (id == NULL)
     {
         return E_INVALIDARG;
@@ -1493,6 +1744,9 @@ HRESULT
 LLDBServices::GetCurrentThreadId(
         PULONG id)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     if (id == NULL)
     {
         return E_INVALIDARG;
@@ -1521,6 +1775,9 @@ HRESULT
 LLDBServices::SetCurrentThreadId(
         ULONG id)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     lldb::SBProcess process = GetCurrentProcess();
     if (!process.IsValid())
     {
@@ -1539,6 +1796,9 @@ HRESULT
 LLDBServices::GetCurrentThreadSystemId(
         PULONG sysId)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     if (sysId == NULL)
     {
         return E_INVALIDARG;
@@ -1568,11 +1828,15 @@ LLDBServices::GetThreadIdBySystemId(
         ULONG sysId,
         PULONG threadId)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     HRESULT hr = E_FAIL;
     ULONG id = 0;
 
     lldb::SBProcess process;
-    lldb::SBThread thread;
+    std::shared_ptr<const ThreadMap> threads;
+    const ThreadEntry* entry;
 
     if (threadId == NULL)
     {
@@ -1585,22 +1849,15 @@ LLDBServices::GetThreadIdBySystemId(
         goto exit;
     }
 
-    // If we have a "fake" thread OS (system) id and a fake thread index,
-    // we need to return fake thread index.
-    if (g_currentThreadSystemId == sysId && g_currentThreadIndex != -1)
+    // The map returns the fake thread index for a "fake" thread OS (system) id
+    threads = ThreadMap::Get(process);
+    entry = threads->FindBySystemId(sysId);
+    if (entry == nullptr)
     {
-        id = g_currentThreadIndex;
+        goto exit;
     }
-    else
-    {
-        thread = process.GetThreadByID(sysId);
-        if (!thread.IsValid())
-        {
-            goto exit;
-        }
 
-        id = thread.GetIndexID();
-    }
+    id = entry->IndexId;
     hr = S_OK;
 
     exit:
@@ -1615,8 +1872,13 @@ LLDBServices::GetThreadContextById(
         /* in */ ULONG32 contextSize,
         /* out */ PBYTE context)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     lldb::SBProcess process;
     lldb::SBThread thread;
+    std::shared_ptr<const ThreadMap> threads;
+    const ThreadEntry* entry;
     lldb::SBFrame frame;
     DT_CONTEXT *dtcontext;
     HRESULT hr = E_FAIL;
@@ -1633,21 +1895,14 @@ LLDBServices::GetThreadContextById(
         goto exit;
     }
 
-    // If we have a "fake" thread OS (system) id and a fake thread index,
-    // use the fake thread index to get the context.
-    if (g_currentThreadSystemId == threadID && g_currentThreadIndex != -1)
-    {
-        thread = process.GetThreadByIndexID(g_currentThreadIndex);
-    }
-    else
-    {
-        thread = process.GetThreadByID(threadID);
-    }
-
-    if (!thread.IsValid())
+    // The map returns the thread of the fake thread index for a "fake" thread OS (system) id
+    threads = ThreadMap::Get(process);
+    entry = threads->FindBySystemId(threadID);
+    if (entry == nullptr || !entry->Thread.IsValid())
     {
         goto exit;
     }
+    thread = entry->Thread;
 
     frame = thread.GetFrameAtIndex(0);
     if (!frame.IsValid())
@@ -1762,6 +2017,9 @@ LLDBServices::GetValueByName(
         PCSTR name,
         PDWORD_PTR debugValue)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     lldb::SBFrame frame = GetCurrentFrame();
     if (!frame.IsValid())
     {
@@ -1784,6 +2042,9 @@ HRESULT
 LLDBServices::GetInstructionOffset(
         PULONG64 offset)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     lldb::SBFrame frame = GetCurrentFrame();
     if (!frame.IsValid())
     {
@@ -1799,6 +2060,9 @@ HRESULT
 LLDBServices::GetStackOffset(
         PULONG64 offset)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     lldb::SBFrame frame = GetCurrentFrame();
     if (!frame.IsValid())
     {
@@ -1814,6 +2078,9 @@ HRESULT
 LLDBServices::GetFrameOffset(
         PULONG64 offset)
 {
+    SERVICE_STATS();
+    SB_API_LOCK();
+
     lldb::SBFrame frame = GetCurrentFrame();
     if (!frame.IsValid())
     {
@@ -1825,6 +2092,655 @@ LLDBServices::GetFrameOffset(
     return S_OK;
 }
 
+//----------------------------------------------------------------------------
+// LoadManaged extensions
+//----------------------------------------------------------------------------
+
+struct ScanPredicateAdapter
+{
+    PFN_SCAN_PREDICATE Predicate;
+    PVOID Context;
+
+    static bool Invoke(void* context, uint64_t address, const uint8_t* data, uint32_t size)
+    {
+        ScanPredicateAdapter* adapter = (ScanPredicateAdapter*)context;
+        return adapter->Predicate(adapter->Context, address, data, size) != FALSE;
+    }
+};
+
+HRESULT
+LLDBServices::ScanMemory(
+        const DEBUG_MEMORY_RANGE *ranges,
+        ULONG rangeCount,
+        const BYTE *pattern,
+        const BYTE *mask,
+        ULONG patternSize,
+        ULONG alignment,
+        PFN_SCAN_PREDICATE predicate,
+        PVOID predicateContext,
+        PFN_SCAN_RESULTS_CALLBACK callback,
+        PVOID callbackContext)
+{
+    SERVICE_STATS();
+    if (ranges == NULL || callback == NULL || patternSize == 0 || (pattern == NULL && predicate == NULL))
+    {
+        return E_INVALIDARG;
+    }
+
+    std::shared_ptr<TargetMemoryReader> reader;
+    std::shared_ptr<const MemoryRegionMap> regions;
+
+    {
+        SB_API_LOCK();
+
+        lldb::SBProcess process = GetCurrentProcess();
+        if (!process.IsValid())
+        {
+            return E_FAIL;
+        }
+
+        reader = TargetMemoryReader::Get(process);
+        regions = MemoryRegionMap::Get(process);
+    }
+
+    // Skip the holes up front instead of probing them page by page
+    std::vector<ScanRange> scanRanges;
+    for (ULONG i = 0; i < rangeCount; i++)
+    {
+        // lldb doesn't expect sign-extended address
+        ScanRange range = { CONVERT_FROM_SIGN_EXTENDED(ranges[i].Start), ranges[i].Length };
+
+        if (!regions->ClipRange(range, scanRanges))
+        {
+            scanRanges.push_back(range);
+        }
+    }
+
+    for (const ScanRange& range : scanRanges)
+    {
+        serviceCall.AddBytes(range.Length);
+    }
+
+    ScanPredicateAdapter predicateAdapter = { predicate, predicateContext };
+
+    ScanPattern scanPattern;
+    scanPattern.Bytes = pattern;
+    scanPattern.Mask = mask;
+    scanPattern.Size = patternSize;
+    scanPattern.Alignment = alignment;
+
+    // The workers don't take the SB API lock unless they have to fall back to lldb,
+    // so it must not be held while we wait for them
+    ScanStatus status = ScanMemoryRanges(
+            *reader,
+            scanRanges.data(),
+            scanRanges.size(),
+            scanPattern,
+            predicate != NULL ? ScanPredicateAdapter::Invoke : nullptr,
+            &predicateAdapter,
+            [callback, callbackContext](const uint64_t* addresses, size_t count)
+            {
+                return callback(callbackContext, (const ULONG64*)addresses, (ULONG)count) == S_OK;
+            },
+            m_interrupt);
+
+    switch (status)
+    {
+        case ScanStatus::Stopped:
+            return S_FALSE;
+        case ScanStatus::Interrupted:
+            return E_ABORT;
+        default:
+            return S_OK;
+    }
+}
+
+HRESULT
+LLDBServices::SearchVirtual(
+        ULONG64 offset,
+        ULONG64 length,
+        const BYTE *pattern,
+        const BYTE *mask,
+        ULONG patternSize,
+        ULONG alignment,
+        PULONG64 matches,
+        ULONG matchesSize,
+        PULONG matchCount)
+{
+    SERVICE_STATS();
+    ULONG found = 0;
+    HRESULT hr = S_OK;
+    std::shared_ptr<TargetMemoryReader> reader;
+    std::shared_ptr<const MemoryRegionMap> regions;
+    std::vector<ScanRange> ranges;
+    ScanRange range;
+    ScanPattern scanPattern;
+    ScanStatus status = ScanStatus::Completed;
+
+    if (pattern == NULL || patternSize == 0 || matches == NULL || matchesSize == 0)
+    {
+        hr = E_INVALIDARG;
+        goto exit;
+    }
+
+    {
+        SB_API_LOCK();
+
+        lldb::SBProcess process = GetCurrentProcess();
+        if (!process.IsValid())
+        {
+            hr = E_FAIL;
+            goto exit;
+        }
+
+        reader = TargetMemoryReader::Get(process);
+        regions = MemoryRegionMap::Get(process);
+    }
+
+    // lldb doesn't expect sign-extended address
+    range.Start = CONVERT_FROM_SIGN_EXTENDED(offset);
+    range.Length = length;
+
+    if (!regions->ClipRange(range, ranges))
+    {
+        ranges.push_back(range);
+    }
+
+    for (const ScanRange& searched : ranges)
+    {
+        serviceCall.AddBytes(searched.Length);
+    }
+
+    scanPattern.Bytes = pattern;
+    scanPattern.Mask = mask;
+    scanPattern.Size = patternSize;
+    scanPattern.Alignment = alignment;
+
+    for (size_t i = 0; i < ranges.size() && status == ScanStatus::Completed; i++)
+    {
+        status = SearchMemoryRange(
+                *reader,
+                ranges[i],
+                scanPattern,
+                [&](const uint64_t* addresses, size_t count)
+                {
+                    size_t copied = std::min<size_t>(count, matchesSize - found);
+                    memcpy(matches + found, addresses, copied * sizeof(ULONG64));
+                    found += copied;
+
+                    // Stop as soon as the buffer is full, the caller resumes after the last match
+                    return copied == count && found < matchesSize;
+                },
+                m_interrupt);
+    }
+
+    if (status == ScanStatus::Interrupted)
+    {
+        hr = E_ABORT;
+    }
+    else if (status == ScanStatus::Stopped)
+    {
+        hr = S_FALSE;
+    }
+
+    exit:
+    if (matchCount)
+    {
+        *matchCount = found;
+    }
+    return hr;
+}
+
+static void
+ToDebugMemoryRegion(
+        const MemoryRegion& source,
+        PDEBUG_MEMORY_REGION region)
+{
+    region->BaseAddress = source.Start;
+    region->RegionSize = source.End - source.Start;
+    region->Protection = 0;
+    region->Reserved = 0;
+
+    if (source.Protection & MemoryProtectionRead)
+    {
+        region->Protection |= DEBUG_MEMORY_REGION_READ;
+    }
+    if (source.Protection & MemoryProtectionWrite)
+    {
+        region->Protection |= DEBUG_MEMORY_REGION_WRITE;
+    }
+    if (source.Protection & MemoryProtectionExecute)
+    {
+        region->Protection |= DEBUG_MEMORY_REGION_EXECUTE;
+    }
+}
+
+HRESULT
+LLDBServices::GetMemoryRegions(
+        PDEBUG_MEMORY_REGION regions,
+        ULONG regionsSize,
+        PULONG regionCount)
+{
+    SERVICE_STATS();
+    std::shared_ptr<const MemoryRegionMap> map;
+
+    {
+        SB_API_LOCK();
+
+        lldb::SBProcess process = GetCurrentProcess();
+        if (!process.IsValid())
+        {
+            return E_FAIL;
+        }
+
+        map = MemoryRegionMap::Get(process);
+    }
+
+    const std::vector<MemoryRegion>& source = map->GetRegions();
+
+    if (source.empty())
+    {
+        // The process plugin can't list the regions
+        return E_NOTIMPL;
+    }
+
+    if (regionCount)
+    {
+        *regionCount = (ULONG)source.size();
+    }
+
+    if (regions == NULL)
+    {
+        return S_OK;
+    }
+
+    size_t count = std::min<size_t>(regionsSize, source.size());
+    for (size_t i = 0; i < count; i++)
+    {
+        ToDebugMemoryRegion(source[i], &regions[i]);
+    }
+
+    return count == source.size() ? S_OK : S_FALSE;
+}
+
+HRESULT
+LLDBServices::QueryVirtual(
+        ULONG64 offset,
+        PDEBUG_MEMORY_REGION region)
+{
+    SERVICE_STATS();
+    if (region == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    std::shared_ptr<const MemoryRegionMap> map;
+
+    {
+        SB_API_LOCK();
+
+        lldb::SBProcess process = GetCurrentProcess();
+        if (!process.IsValid())
+        {
+            return E_FAIL;
+        }
+
+        map = MemoryRegionMap::Get(process);
+    }
+
+    if (map->GetRegions().empty())
+    {
+        return E_NOTIMPL;
+    }
+
+    // lldb doesn't expect sign-extended address
+    offset = CONVERT_FROM_SIGN_EXTENDED(offset);
+
+    const MemoryRegion* found = map->FindRegion(offset);
+    if (found == nullptr)
+    {
+        return E_FAIL;
+    }
+
+    ToDebugMemoryRegion(*found, region);
+
+    return found->Start <= offset ? S_OK : S_FALSE;
+}
+
+HRESULT
+LLDBServices::GetAllThreadStacks(
+        ULONG maxFrames,
+        ULONG flags,
+        PDEBUG_THREAD_STACKS *stacks)
+{
+    SERVICE_STATS();
+    if (stacks == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    *stacks = NULL;
+
+    std::unique_ptr<ThreadStackSnapshot> snapshot(new ThreadStackSnapshot());
+    lldb::SBTarget target;
+
+    {
+        SB_API_LOCK();
+
+        lldb::SBProcess process = GetCurrentProcess();
+        if (!process.IsValid())
+        {
+            return E_FAIL;
+        }
+
+        uint32_t numThreads = process.GetNumThreads();
+        for (uint32_t i = 0; i < numThreads; i++)
+        {
+            if (m_interrupt->load(std::memory_order_relaxed) != 0)
+            {
+                return E_ABORT;
+            }
+
+            lldb::SBThread thread = process.GetThreadAtIndex(i);
+            if (!thread.IsValid())
+            {
+                continue;
+            }
+
+            snapshot->AddThread(thread.GetThreadID());
+
+            uint32_t numFrames = thread.GetNumFrames();
+            if (maxFrames != 0 && numFrames > maxFrames)
+            {
+                numFrames = maxFrames;
+            }
+
+            for (uint32_t j = 0; j < numFrames; j++)
+            {
+                lldb::SBFrame frame = thread.GetFrameAtIndex(j);
+                if (!frame.IsValid())
+                {
+                    break;
+                }
+
+                snapshot->AddFrame(frame.GetPC(), frame.GetSP(), frame.GetFP());
+            }
+
+            if (flags & DEBUG_THREAD_STACKS_CONTEXTS)
+            {
+                // Threads without frames get an empty context, so the contexts stay indexed by thread
+                DT_CONTEXT context;
+                memset(&context, 0, sizeof(context));
+                context.ContextFlags = DT_CONTEXT_FULL;
+
+                lldb::SBFrame frame = thread.GetFrameAtIndex(0);
+                if (frame.IsValid())
+                {
+                    GetContextFromFrame(frame, &context);
+                }
+
+                snapshot->AddContext(&context, sizeof(context));
+            }
+        }
+
+        target = process.GetTarget();
+    }
+
+    // The stacks are captured, the symbols are resolved in chunks so other jobs can take the lock in between
+    if ((flags & DEBUG_THREAD_STACKS_SYMBOLS) && !snapshot->Symbolize(target, m_interrupt))
+    {
+        return E_ABORT;
+    }
+
+    *stacks = snapshot.release()->GetView();
+    return S_OK;
+}
+
+HRESULT
+LLDBServices::ReleaseThreadStacks(
+        PDEBUG_THREAD_STACKS stacks)
+{
+    SERVICE_STATS();
+    if (stacks == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    delete ThreadStackSnapshot::FromView(stacks);
+    return S_OK;
+}
+
+HRESULT
+LLDBServices::RegisterStructLayout(
+        const DEBUG_STRUCT_FIELD *fields,
+        ULONG fieldCount,
+        PULONG layoutId,
+        PULONG recordSize)
+{
+    SERVICE_STATS();
+    if (fields == NULL || fieldCount == 0 || layoutId == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    std::vector<StructField> layoutFields(fieldCount);
+    for (ULONG i = 0; i < fieldCount; i++)
+    {
+        layoutFields[i] = StructField{ fields[i].Offset, fields[i].Size };
+    }
+
+    ULONG id = StructLayout::Register(layoutFields);
+    if (id == 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    *layoutId = id;
+
+    if (recordSize != NULL)
+    {
+        *recordSize = StructLayout::Get(id)->GetRecordSize();
+    }
+
+    return S_OK;
+}
+
+HRESULT
+LLDBServices::ReadStructs(
+        ULONG layoutId,
+        const ULONG64 *addresses,
+        ULONG count,
+        PVOID buffer,
+        ULONG bufferSize,
+        PBYTE status)
+{
+    SERVICE_STATS();
+    std::shared_ptr<const StructLayout> layout = StructLayout::Get(layoutId);
+    std::shared_ptr<TargetMemoryReader> reader;
+
+    if (layout == nullptr || (count != 0 && (addresses == NULL || buffer == NULL)))
+    {
+        return E_INVALIDARG;
+    }
+
+    if ((uint64_t)count * layout->GetRecordSize() > bufferSize)
+    {
+        return E_INVALIDARG;
+    }
+
+    {
+        SB_API_LOCK();
+
+        lldb::SBProcess process = GetCurrentProcess();
+        if (!process.IsValid())
+        {
+            return E_FAIL;
+        }
+
+        reader = TargetMemoryReader::Get(process);
+    }
+
+    std::atomic<ULONG> failed(0);
+    std::atomic<bool> interrupted(false);
+
+    auto readChunk = [&](size_t start, size_t end)
+    {
+        uint8_t* record = (uint8_t*)buffer + start * layout->GetRecordSize();
+        ULONG chunkFailed = 0;
+        size_t i = start;
+
+        try
+        {
+            std::vector<uint8_t> scratch(layout->GetScratchSize());
+
+            for (; i < end; i++, record += layout->GetRecordSize())
+            {
+                // lldb doesn't expect sign-extended address
+                bool read = layout->Read(*reader, CONVERT_FROM_SIGN_EXTENDED(addresses[i]), record, scratch.data());
+
+                if (status != NULL)
+                {
+                    status[i] = read ? 1 : 0;
+                }
+
+                if (!read)
+                {
+                    chunkFailed++;
+                }
+            }
+        }
+        catch (const std::exception&)
+        {
+            // The chunks run on pool workers, the rest of the chunk is reported as unreadable instead
+            for (; i < end; i++, record += layout->GetRecordSize())
+            {
+                memset(record, 0, layout->GetRecordSize());
+
+                if (status != NULL)
+                {
+                    status[i] = 0;
+                }
+
+                chunkFailed++;
+            }
+        }
+
+        failed += chunkFailed;
+    };
+
+    if (count <= StructsChunkSize)
+    {
+        readChunk(0, count);
+    }
+    else
+    {
+        std::vector<std::function<void()>> tasks;
+
+        for (size_t start = 0; start < count; start += StructsChunkSize)
+        {
+            size_t end = std::min<size_t>(start + StructsChunkSize, count);
+
+            tasks.push_back([&, start, end]()
+            {
+                if (m_interrupt->load(std::memory_order_relaxed) != 0)
+                {
+                    interrupted = true;
+                    return;
+                }
+
+                readChunk(start, end);
+            });
+        }
+
+        TaskGroup group;
+        ThreadPool::Shared().Submit(group, std::move(tasks));
+        group.Wait();
+    }
+
+    if (interrupted)
+    {
+        return E_ABORT;
+    }
+
+    serviceCall.AddBytes((uint64_t)(count - failed) * (layout->GetScratchSize() != 0 ? layout->GetSpanSize() : layout->GetRecordSize()));
+
+    return failed == 0 ? S_OK : S_FALSE;
+}
+
+HRESULT
+LLDBServices::WalkChain(
+        ULONG64 start,
+        ULONG nextOffset,
+        const ULONG *payloadOffsets,
+        ULONG payloadCount,
+        ULONG maxNodes,
+        PULONG64 nodes,
+        PULONG64 payloads,
+        PULONG nodeCount,
+        PULONG64 next,
+        PULONG endReason)
+{
+    SERVICE_STATS();
+    std::shared_ptr<PageCache> cache;
+    ChainLayout layout;
+    size_t count;
+    uint64_t notFollowed;
+    ChainEnd end;
+
+    if ((maxNodes != 0 && nodes == NULL) ||
+        (payloadCount != 0 && (payloadOffsets == NULL || (maxNodes != 0 && payloads == NULL))) ||
+        nodeCount == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    {
+        SB_API_LOCK();
+
+        lldb::SBProcess process = GetCurrentProcess();
+        if (!process.IsValid())
+        {
+            return E_FAIL;
+        }
+
+        cache = PageCache::Get(process);
+    }
+
+    layout.NextOffset = nextOffset;
+    layout.PayloadOffsets = payloadOffsets;
+    layout.PayloadCount = payloadCount;
+
+    // lldb doesn't expect sign-extended address
+    end = ::WalkChain(*cache, CONVERT_FROM_SIGN_EXTENDED(start), layout, maxNodes, nodes, payloads, &count, &notFollowed, m_interrupt);
+
+    *nodeCount = (ULONG)count;
+    serviceCall.AddBytes((uint64_t)count * (payloadCount + 1) * sizeof(ULONG64));
+
+    if (next != NULL)
+    {
+        *next = notFollowed;
+    }
+
+    if (endReason != NULL)
+    {
+        switch (end)
+        {
+            case ChainEnd::Limit: *endReason = DEBUG_CHAIN_END_LIMIT; break;
+            case ChainEnd::Cycle: *endReason = DEBUG_CHAIN_END_CYCLE; break;
+            case ChainEnd::Unreadable: *endReason = DEBUG_CHAIN_END_UNREADABLE; break;
+            case ChainEnd::Interrupted: *endReason = DEBUG_CHAIN_END_INTERRUPTED; break;
+            default: *endReason = DEBUG_CHAIN_END_NULL; break;
+        }
+    }
+
+    switch (end)
+    {
+        case ChainEnd::Null: return S_OK;
+        case ChainEnd::Interrupted: return E_ABORT;
+        default: return S_FALSE;
+    }
+}
+
 //----------------------------------------------------------------------------
 // Helper functions
 //----------------------------------------------------------------------------
@@ -1847,6 +2763,14 @@ LLDBServices::GetCurrentProcess()
         process = *m_currentProcess;
     }
 
+    // lldb resumes the target from its command thread without taking the SB API lock, so a
+    // background job checks the state under the lock on every call and fails once it has moved on
+    if (m_stopBound && process.IsValid() &&
+        (process.GetState() != lldb::eStateStopped || process.GetStopID() != m_stopId))
+    {
+        process = lldb::SBProcess();
+    }
+
     return process;
 }
 
@@ -1863,7 +2787,7 @@ LLDBServices::GetCurrentThread()
             thread = process.GetSelectedThread();
         }
     }
-    else
+    else if (!m_stopBound || GetCurrentProcess().IsValid())
     {
         thread = *m_currentThread;
     }
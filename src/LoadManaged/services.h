@@ -2,6 +2,10 @@
 // The .NET Foundation licenses this file to you under the MIT license.
 // See the LICENSE file in the project root for more information.
 
+#ifndef __SERVICES_H__
+#define __SERVICES_H__
+
+#include <atomic>
 #include <cstdarg>
 #include "mstypes.h"
 #include "lldb/API/SBDebugger.h"
@@ -149,12 +153,24 @@ class LLDBServices : public ILLDBServices
 {
 private:
     LONG m_ref;
-    lldb::SBDebugger &m_debugger;
-    lldb::SBCommandReturnObject &m_returnObject;
+    lldb::SBDebugger m_debugger;
+    lldb::SBCommandReturnObject *m_returnObject;
 
     lldb::SBProcess *m_currentProcess;
     lldb::SBThread *m_currentThread;
 
+    const std::atomic<int> *m_interrupt;
+
+    // Set for background jobs, which must not see the target once it has been resumed
+    bool m_stopBound;
+    uint32_t m_stopId;
+
+    // Owned by the per-debugger pool, see Acquire
+    bool m_pooled;
+
+    void Bind(lldb::SBCommandReturnObject &returnObject, lldb::SBProcess *process, lldb::SBThread *thread);
+    void Unbind();
+
     void OutputString(ULONG mask, PCSTR str);
     ULONG64 GetModuleBase(lldb::SBTarget& target, lldb::SBModule& module);
     DWORD_PTR GetExpression(lldb::SBFrame& frame, lldb::SBError& error, PCSTR exp);
@@ -167,7 +183,12 @@ private:
 
 public:
     LLDBServices(lldb::SBDebugger &debugger, lldb::SBCommandReturnObject &returnObject, lldb::SBProcess *process = nullptr, lldb::SBThread *thread = nullptr);
-    ~LLDBServices();
+    virtual ~LLDBServices();
+
+    // Returns the services of the debugger bound to the command's return object (and process/thread if given),
+    // with a reference the caller must Release once the command is done. The instance is reused by the next
+    // commands, so it keeps its caches; a new one is created if it is still in use (background job, nested command).
+    static LLDBServices* Acquire(lldb::SBDebugger &debugger, lldb::SBCommandReturnObject &returnObject, lldb::SBProcess *process = nullptr, lldb::SBThread *thread = nullptr);
 
     //----------------------------------------------------------------------------
     // IUnknown
@@ -424,10 +445,90 @@ public:
     virtual HRESULT GetFrameOffset(
         PULONG64 offset);
 
+    //----------------------------------------------------------------------------
+    // LoadManaged extensions
+    //----------------------------------------------------------------------------
+
+    virtual HRESULT ScanMemory(
+        const DEBUG_MEMORY_RANGE *ranges,
+        ULONG rangeCount,
+        const BYTE *pattern,
+        const BYTE *mask,
+        ULONG patternSize,
+        ULONG alignment,
+        PFN_SCAN_PREDICATE predicate,
+        PVOID predicateContext,
+        PFN_SCAN_RESULTS_CALLBACK callback,
+        PVOID callbackContext);
+
+    virtual HRESULT SearchVirtual(
+        ULONG64 offset,
+        ULONG64 length,
+        const BYTE *pattern,
+        const BYTE *mask,
+        ULONG patternSize,
+        ULONG alignment,
+        PULONG64 matches,
+        ULONG matchesSize,
+        PULONG matchCount);
+
+    virtual HRESULT GetMemoryRegions(
+        PDEBUG_MEMORY_REGION regions,
+        ULONG regionsSize,
+        PULONG regionCount);
+
+    virtual HRESULT QueryVirtual(
+        ULONG64 offset,
+        PDEBUG_MEMORY_REGION region);
+
+    virtual HRESULT GetAllThreadStacks(
+        ULONG maxFrames,
+        ULONG flags,
+        PDEBUG_THREAD_STACKS *stacks);
+
+    virtual HRESULT ReleaseThreadStacks(
+        PDEBUG_THREAD_STACKS stacks);
+
+    virtual HRESULT RegisterStructLayout(
+        const DEBUG_STRUCT_FIELD *fields,
+        ULONG fieldCount,
+        PULONG layoutId,
+        PULONG recordSize);
+
+    virtual HRESULT ReadStructs(
+        ULONG layoutId,
+        const ULONG64 *addresses,
+        ULONG count,
+        PVOID buffer,
+        ULONG bufferSize,
+        PBYTE status);
+
+    virtual HRESULT WalkChain(
+        ULONG64 start,
+        ULONG nextOffset,
+        const ULONG *payloadOffsets,
+        ULONG payloadCount,
+        ULONG maxNodes,
+        PULONG64 nodes,
+        PULONG64 payloads,
+        PULONG nodeCount,
+        PULONG64 next,
+        PULONG endReason);
+
     //----------------------------------------------------------------------------
     // LLDBServices (internal)
     //----------------------------------------------------------------------------
 
     virtual PCSTR GetModuleDirectory(
         PCSTR name);
-};
\ No newline at end of file
+
+    // Background jobs are cancelled through their own flag instead of Ctrl-C
+    void SetInterruptFlag(
+        const std::atomic<int> *interrupt);
+
+    // The process is only returned while it is still stopped at the given stop
+    void BindToStop(
+        uint32_t stopId);
+};
+
+#endif // __SERVICES_H__
@@ -0,0 +1,341 @@
+#include "servicestats.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+static bool
+StatsEnabledByDefault()
+{
+    const char* value = getenv("LOADMANAGED_STATS");
+    return value != nullptr && strcmp(value, "0") != 0;
+}
+
+std::atomic<bool> g_serviceStatsEnabled(StatsEnabledByDefault());
+
+thread_local int t_serviceCallDepth = 0;
+
+namespace
+{
+    struct MethodCounters
+    {
+        std::atomic<uint64_t> Calls;
+        std::atomic<uint64_t> Bytes;
+        std::atomic<uint64_t> Nanoseconds;
+        std::atomic<uint64_t> Histogram[ServiceStatsBuckets];
+    };
+
+    // Only written by the owning thread, read concurrently by the dump
+    struct ThreadCounters
+    {
+        MethodCounters Methods[ServiceStatsMaxMethods];
+        bool InUse;
+    };
+
+    struct MethodTotals
+    {
+        uint64_t Calls;
+        uint64_t Bytes;
+        uint64_t Nanoseconds;
+        uint64_t Histogram[ServiceStatsBuckets];
+    };
+
+    // Protects the registration of the methods and threads, and the reset baseline
+    std::mutex s_lock;
+    const char* s_methodNames[ServiceStatsMaxMethods];
+    std::atomic<int> s_methodCount(0);
+
+    // Blocks of the exited threads are reused instead of freed, so the totals keep their calls
+    std::vector<ThreadCounters*> s_threads;
+
+    // Totals at the last reset. Resetting the per-thread counters would race with their owner.
+    MethodTotals s_baseline[ServiceStatsMaxMethods];
+
+    struct ThreadCountersHolder
+    {
+        ThreadCounters* Counters = nullptr;
+
+        ~ThreadCountersHolder()
+        {
+            if (Counters != nullptr)
+            {
+                std::lock_guard<std::mutex> lock(s_lock);
+                Counters->InUse = false;
+            }
+        }
+    };
+
+    thread_local ThreadCountersHolder t_counters;
+
+    ThreadCounters*
+    GetThreadCounters()
+    {
+        if (t_counters.Counters != nullptr)
+        {
+            return t_counters.Counters;
+        }
+
+        std::lock_guard<std::mutex> lock(s_lock);
+
+        for (ThreadCounters* counters : s_threads)
+        {
+            if (!counters->InUse)
+            {
+                counters->InUse = true;
+                return t_counters.Counters = counters;
+            }
+        }
+
+        ThreadCounters* counters = new ThreadCounters();
+        counters->InUse = true;
+        s_threads.push_back(counters);
+
+        return t_counters.Counters = counters;
+    }
+
+    inline void
+    Increment(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        // Single writer: no need for a locked read-modify-write
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    inline int
+    GetBucket(uint64_t nanoseconds)
+    {
+        if (nanoseconds == 0)
+        {
+            return 0;
+        }
+
+        return std::min(63 - __builtin_clzll(nanoseconds), ServiceStatsBuckets - 1);
+    }
+
+    // Must be called with s_lock held
+    void
+    ComputeTotals(MethodTotals* totals, int methodCount)
+    {
+        memset(totals, 0, sizeof(MethodTotals) * methodCount);
+
+        for (ThreadCounters* counters : s_threads)
+        {
+            for (int i = 0; i < methodCount; i++)
+            {
+                const MethodCounters& method = counters->Methods[i];
+
+                totals[i].Calls += method.Calls.load(std::memory_order_relaxed);
+                totals[i].Bytes += method.Bytes.load(std::memory_order_relaxed);
+                totals[i].Nanoseconds += method.Nanoseconds.load(std::memory_order_relaxed);
+
+                for (int b = 0; b < ServiceStatsBuckets; b++)
+                {
+                    totals[i].Histogram[b] += method.Histogram[b].load(std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    // Calls since the last reset, and the indices of the methods that were called sorted by total time.
+    // Must be called with s_lock held.
+    void
+    GetRecordedTotals(std::vector<MethodTotals>& totals, std::vector<int>& order)
+    {
+        int methodCount = s_methodCount.load(std::memory_order_relaxed);
+
+        totals.resize(methodCount);
+        ComputeTotals(totals.data(), methodCount);
+
+        for (int i = 0; i < methodCount; i++)
+        {
+            MethodTotals& method = totals[i];
+
+            method.Calls -= s_baseline[i].Calls;
+            method.Bytes -= s_baseline[i].Bytes;
+            method.Nanoseconds -= s_baseline[i].Nanoseconds;
+
+            for (int b = 0; b < ServiceStatsBuckets; b++)
+            {
+                method.Histogram[b] -= s_baseline[i].Histogram[b];
+            }
+
+            if (method.Calls != 0)
+            {
+                order.push_back(i);
+            }
+        }
+
+        std::sort(order.begin(), order.end(), [&](int left, int right) { return totals[left].Nanoseconds > totals[right].Nanoseconds; });
+    }
+
+    // Upper bound of the bucket containing the given percentile, in nanoseconds
+    uint64_t
+    GetPercentile(const MethodTotals& totals, double percentile)
+    {
+        uint64_t threshold = (uint64_t)(totals.Calls * percentile);
+        uint64_t count = 0;
+
+        for (int b = 0; b < ServiceStatsBuckets; b++)
+        {
+            count += totals.Histogram[b];
+
+            if (count > threshold)
+            {
+                return 2ULL << b;
+            }
+        }
+
+        return 2ULL << (ServiceStatsBuckets - 1);
+    }
+
+    void
+    AppendFormat(std::string& output, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+    void
+    AppendFormat(std::string& output, const char* format, ...)
+    {
+        char buffer[256];
+
+        va_list args;
+        va_start(args, format);
+        vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+
+        output.append(buffer);
+    }
+}
+
+int
+RegisterServiceMethod(
+        const char* name)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+
+    int count = s_methodCount.load(std::memory_order_relaxed);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(s_methodNames[i], name) == 0)
+        {
+            return i;
+        }
+    }
+
+    if (count == ServiceStatsMaxMethods)
+    {
+        // Shared overflow slot, keeps the totals right
+        return ServiceStatsMaxMethods - 1;
+    }
+
+    s_methodNames[count] = count == ServiceStatsMaxMethods - 1 ? "(other)" : name;
+    s_methodCount.store(count + 1, std::memory_order_release);
+
+    return count;
+}
+
+void
+RecordServiceCall(
+        int method,
+        uint64_t nanoseconds,
+        uint64_t bytes)
+{
+    MethodCounters& counters = GetThreadCounters()->Methods[method];
+
+    Increment(counters.Calls, 1);
+    Increment(counters.Bytes, bytes);
+    Increment(counters.Nanoseconds, nanoseconds);
+    Increment(counters.Histogram[GetBucket(nanoseconds)], 1);
+}
+
+void
+FormatServiceStats(
+        std::string& output,
+        bool histograms)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+
+    std::vector<MethodTotals> totals;
+    std::vector<int> order;
+    GetRecordedTotals(totals, order);
+
+    if (!g_serviceStatsEnabled.load(std::memory_order_relaxed))
+    {
+        output.append("Service statistics are disabled, use 'LoadManagedStats on' to enable them\n");
+    }
+
+    if (order.empty())
+    {
+        output.append("No service call recorded\n");
+        return;
+    }
+
+    AppendFormat(output, "%-28s %10s %14s %12s %10s %10s %10s\n", "Method", "Calls", "Bytes", "Total (ms)", "Avg (us)", "p50 (us)", "p99 (us)");
+
+    for (int i : order)
+    {
+        const MethodTotals& method = totals[i];
+
+        AppendFormat(output, "%-28s %10llu %14llu %12.3f %10.2f %10.2f %10.2f\n",
+            s_methodNames[i],
+            (unsigned long long)method.Calls,
+            (unsigned long long)method.Bytes,
+            method.Nanoseconds / 1e6,
+            method.Nanoseconds / 1e3 / method.Calls,
+            GetPercentile(method, 0.5) / 1e3,
+            GetPercentile(method, 0.99) / 1e3);
+
+        if (!histograms)
+        {
+            continue;
+        }
+
+        for (int b = 0; b < ServiceStatsBuckets; b++)
+        {
+            if (method.Histogram[b] != 0)
+            {
+                AppendFormat(output, "    < %12.3f us %10llu\n", (2ULL << b) / 1e3, (unsigned long long)method.Histogram[b]);
+            }
+        }
+    }
+}
+
+void
+FormatServiceStatsJson(
+        std::string& output)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+
+    std::vector<MethodTotals> totals;
+    std::vector<int> order;
+    GetRecordedTotals(totals, order);
+
+    AppendFormat(output, "{\"enabled\":%s,\"methods\":{", g_serviceStatsEnabled.load(std::memory_order_relaxed) ? "true" : "false");
+
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const MethodTotals& method = totals[order[i]];
+
+        // Method names are C++ identifiers, no escaping needed
+        AppendFormat(output, "%s\"%s\":{\"calls\":%llu,\"bytes\":%llu,\"total_ns\":%llu,\"p50_ns\":%llu,\"p99_ns\":%llu}",
+            i == 0 ? "" : ",",
+            s_methodNames[order[i]],
+            (unsigned long long)method.Calls,
+            (unsigned long long)method.Bytes,
+            (unsigned long long)method.Nanoseconds,
+            (unsigned long long)GetPercentile(method, 0.5),
+            (unsigned long long)GetPercentile(method, 0.99));
+    }
+
+    output.append("}}\n");
+}
+
+void
+ResetServiceStats()
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+
+    ComputeTotals(s_baseline, s_methodCount.load(std::memory_order_relaxed));
+}
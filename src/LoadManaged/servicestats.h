@@ -0,0 +1,95 @@
+#ifndef __SERVICESTATS_H__
+#define __SERVICESTATS_H__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "trace.h"
+
+//
+// Call counters and latency histograms of the ILLDBServices methods, to find
+// out which service calls dominate a slow plugin command. Every thread updates
+// its own counters without locking; they are only summed when dumped.
+// Disabled by default (LoadManagedStats on, or LOADMANAGED_STATS=1): a
+// disabled call costs a couple of relaxed loads and a branch.
+// The same scope records the call in the trace timeline when tracing is on.
+// Only the method the plugin called is recorded: the services calling each
+// other (Output -> OutputVaList -> OutputString) don't count the inner calls.
+//
+extern std::atomic<bool> g_serviceStatsEnabled;
+
+// Number of instrumented methods running on the thread
+extern thread_local int t_serviceCallDepth;
+
+const int ServiceStatsMaxMethods = 96;
+
+// Bucket i counts the calls that took [2^i, 2^(i+1)) nanoseconds, the last one everything above
+const int ServiceStatsBuckets = 36;
+
+// Returns the id of the method, registering it on first use
+int RegisterServiceMethod(const char* name);
+
+void RecordServiceCall(int method, uint64_t nanoseconds, uint64_t bytes);
+
+class ServiceCallScope
+{
+private:
+    int m_method;
+    const char* m_name;
+    bool m_stats;
+    bool m_trace;
+    uint64_t m_start;
+    uint64_t m_bytes;
+
+public:
+    ServiceCallScope(int method, const char* name) :
+            m_method(method),
+            m_name(name),
+            m_stats(t_serviceCallDepth == 0 && g_serviceStatsEnabled.load(std::memory_order_relaxed)),
+            m_trace(t_serviceCallDepth == 0 && g_traceEnabled.load(std::memory_order_relaxed)),
+            m_start(m_stats || m_trace ? TraceTimestamp() : 0),
+            m_bytes(0)
+    {
+        t_serviceCallDepth++;
+    }
+
+    ~ServiceCallScope()
+    {
+        t_serviceCallDepth--;
+
+        if (m_start != 0)
+        {
+            uint64_t end = TraceTimestamp();
+
+            if (m_stats)
+            {
+                RecordServiceCall(m_method, end - m_start, m_bytes);
+            }
+
+            if (m_trace)
+            {
+                AddTraceSpan("services", m_name, m_start, end);
+            }
+        }
+    }
+
+    ServiceCallScope(const ServiceCallScope&) = delete;
+    ServiceCallScope& operator=(const ServiceCallScope&) = delete;
+
+    void AddBytes(uint64_t bytes) { m_bytes += bytes; }
+};
+
+// Appends a table of the calls recorded since the last reset, sorted by total time
+void FormatServiceStats(std::string& output, bool histograms);
+
+// Same as a single-line JSON object, for the benchmark harnesses
+void FormatServiceStatsJson(std::string& output);
+
+void ResetServiceStats();
+
+// Instruments the enclosing ILLDBServices method. Use serviceCall.AddBytes to report the bytes transferred.
+#define SERVICE_STATS() \
+    static const int serviceStatsMethod = RegisterServiceMethod(__func__); \
+    ServiceCallScope serviceCall(serviceStatsMethod, __func__)
+
+#endif // __SERVICESTATS_H__
@@ -2,6 +2,10 @@
 // The .NET Foundation licenses this file to you under the MIT license.
 // See the LICENSE file in the project root for more information.
 
+#ifndef __SOSPLUGIN_H__
+#define __SOSPLUGIN_H__
+
+#include <mutex>
 #include <lldb/API/LLDB.h>
 #include "mstypes.h"
 #define DEFINE_EXCEPTION_RECORD
@@ -14,6 +18,7 @@ typedef HRESULT (*CommandFunc)(ILLDBServices* services, const char *args);
 extern char *g_coreclrDirectory;
 extern ULONG g_currentThreadIndex;
 extern ULONG g_currentThreadSystemId;
+extern std::recursive_mutex g_sbApiLock;
 
 bool
 sosCommandInitialize(lldb::SBDebugger debugger);
@@ -22,4 +27,6 @@ bool
 setsostidCommandInitialize(lldb::SBDebugger debugger);
 
 bool
-setclrpathCommandInitialize(lldb::SBDebugger debugger);
\ No newline at end of file
+setclrpathCommandInitialize(lldb::SBDebugger debugger);
+
+#endif // __SOSPLUGIN_H__
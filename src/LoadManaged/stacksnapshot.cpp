@@ -0,0 +1,204 @@
+#include "stacksnapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+// Instruction offsets resolved each time the SB API lock is taken
+const size_t SymbolizeChunkSize = 64;
+
+namespace
+{
+    struct ResolvedSymbol
+    {
+        std::string Name;
+        uint64_t Displacement;
+    };
+
+    // Same format as GetNameByOffset: module!function
+    void
+    ResolveSymbol(
+            lldb::SBTarget& target,
+            uint64_t offset,
+            ResolvedSymbol& result)
+    {
+        result.Displacement = DEBUG_INVALID_OFFSET;
+
+        lldb::SBAddress address = target.ResolveLoadAddress(offset);
+        if (!address.IsValid())
+        {
+            return;
+        }
+
+        lldb::SBModule module = address.GetModule();
+        if (!module.IsValid())
+        {
+            return;
+        }
+
+        lldb::SBFileSpec file = module.GetFileSpec();
+        if (file.IsValid() && file.GetFilename() != nullptr)
+        {
+            result.Name.append(file.GetFilename());
+        }
+
+        lldb::SBSymbol symbol = address.GetSymbol();
+        if (symbol.IsValid())
+        {
+            result.Displacement = address.GetOffset() - symbol.GetStartAddress().GetOffset();
+
+            const char* name = symbol.GetName();
+            if (name != nullptr)
+            {
+                if (!result.Name.empty())
+                {
+                    result.Name.append("!");
+                }
+                result.Name.append(name);
+            }
+        }
+    }
+}
+
+ThreadStackSnapshot::ThreadStackSnapshot() :
+        m_contextSize(0)
+{
+    memset(&m_view, 0, sizeof(m_view));
+}
+
+void
+ThreadStackSnapshot::AddThread(
+        uint32_t threadId)
+{
+    m_threadIds.push_back(threadId);
+    m_firstFrames.push_back((ULONG)m_instructionOffsets.size());
+}
+
+void
+ThreadStackSnapshot::AddFrame(
+        uint64_t instructionOffset,
+        uint64_t stackOffset,
+        uint64_t frameOffset)
+{
+    m_instructionOffsets.push_back(instructionOffset);
+    m_stackOffsets.push_back(stackOffset);
+    m_frameOffsets.push_back(frameOffset);
+}
+
+void
+ThreadStackSnapshot::AddContext(
+        const void* context,
+        size_t size)
+{
+    const BYTE* bytes = (const BYTE*)context;
+
+    m_contextSize = (ULONG)size;
+    m_contexts.insert(m_contexts.end(), bytes, bytes + size);
+}
+
+bool
+ThreadStackSnapshot::Symbolize(
+        lldb::SBTarget target,
+        const std::atomic<int>* interrupt)
+{
+    // Thousands of threads are usually parked in a handful of functions
+    std::vector<uint64_t> offsets(m_instructionOffsets.begin(), m_instructionOffsets.end());
+    std::sort(offsets.begin(), offsets.end());
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+
+    std::vector<ResolvedSymbol> resolved(offsets.size());
+
+    // The lookups go through the SB API, so they can't run in parallel. The lock is
+    // released between the chunks, so the background jobs can make progress meanwhile.
+    for (size_t start = 0; start < offsets.size(); start += SymbolizeChunkSize)
+    {
+        size_t end = std::min(start + SymbolizeChunkSize, offsets.size());
+
+        std::lock_guard<std::recursive_mutex> lock(g_sbApiLock);
+
+        for (size_t i = start; i < end; i++)
+        {
+            if (interrupt->load(std::memory_order_relaxed) != 0)
+            {
+                return false;
+            }
+
+            ResolveSymbol(target, offsets[i], resolved[i]);
+        }
+    }
+
+    // Each name is stored once, frames refer to it by index
+    std::unordered_map<std::string, ULONG> nameIndices;
+    std::vector<ULONG> offsetSymbols(offsets.size(), DEBUG_THREAD_STACKS_NO_SYMBOL);
+
+    for (size_t i = 0; i < offsets.size(); i++)
+    {
+        if (resolved[i].Name.empty())
+        {
+            continue;
+        }
+
+        auto inserted = nameIndices.emplace(resolved[i].Name, (ULONG)m_symbolNames.size());
+        if (inserted.second)
+        {
+            m_symbolNames.push_back(resolved[i].Name);
+        }
+
+        offsetSymbols[i] = inserted.first->second;
+    }
+
+    m_symbolIndices.resize(m_instructionOffsets.size());
+    m_displacements.resize(m_instructionOffsets.size());
+
+    for (size_t i = 0; i < m_instructionOffsets.size(); i++)
+    {
+        size_t index = std::lower_bound(offsets.begin(), offsets.end(), m_instructionOffsets[i]) - offsets.begin();
+
+        m_symbolIndices[i] = offsetSymbols[index];
+        m_displacements[i] = resolved[index].Displacement;
+    }
+
+    return true;
+}
+
+PDEBUG_THREAD_STACKS
+ThreadStackSnapshot::GetView()
+{
+    // The frames of the last thread end with the array
+    if (m_firstFrames.size() == m_threadIds.size())
+    {
+        m_firstFrames.push_back((ULONG)m_instructionOffsets.size());
+    }
+
+    // The strings don't move once the snapshot is complete
+    m_symbols.clear();
+    for (const std::string& name : m_symbolNames)
+    {
+        m_symbols.push_back(name.c_str());
+    }
+
+    m_view.ThreadCount = (ULONG)m_threadIds.size();
+    m_view.FrameCount = (ULONG)m_instructionOffsets.size();
+    m_view.ThreadIds = m_threadIds.data();
+    m_view.FirstFrames = m_firstFrames.data();
+    m_view.InstructionOffsets = m_instructionOffsets.data();
+    m_view.StackOffsets = m_stackOffsets.data();
+    m_view.FrameOffsets = m_frameOffsets.data();
+    m_view.Contexts = m_contexts.empty() ? nullptr : m_contexts.data();
+    m_view.ContextSize = m_contextSize;
+    m_view.SymbolIndices = m_symbolIndices.empty() ? nullptr : m_symbolIndices.data();
+    m_view.Displacements = m_displacements.empty() ? nullptr : m_displacements.data();
+    m_view.SymbolCount = (ULONG)m_symbols.size();
+    m_view.Symbols = m_symbols.empty() ? nullptr : m_symbols.data();
+    m_view.Reserved = this;
+
+    return &m_view;
+}
+
+ThreadStackSnapshot*
+ThreadStackSnapshot::FromView(
+        PDEBUG_THREAD_STACKS view)
+{
+    return (ThreadStackSnapshot*)view->Reserved;
+}
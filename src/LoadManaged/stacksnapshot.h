@@ -0,0 +1,59 @@
+#ifndef __STACKSNAPSHOT_H__
+#define __STACKSNAPSHOT_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "sosplugin.h"
+
+//
+// Stacks of all the threads captured by GetAllThreadStacks. The frames are
+// stored as parallel arrays rather than one struct per frame, so the managed
+// side reads each column in place, and the snapshot owns the storage behind
+// the DEBUG_THREAD_STACKS view it hands out.
+//
+class ThreadStackSnapshot
+{
+private:
+    DEBUG_THREAD_STACKS m_view;
+
+    std::vector<ULONG> m_threadIds;
+    std::vector<ULONG> m_firstFrames;
+    std::vector<ULONG64> m_instructionOffsets;
+    std::vector<ULONG64> m_stackOffsets;
+    std::vector<ULONG64> m_frameOffsets;
+    std::vector<BYTE> m_contexts;
+    ULONG m_contextSize;
+
+    std::vector<ULONG> m_symbolIndices;
+    std::vector<ULONG64> m_displacements;
+    std::vector<std::string> m_symbolNames;
+    std::vector<PCSTR> m_symbols;
+
+public:
+    ThreadStackSnapshot();
+
+    ThreadStackSnapshot(const ThreadStackSnapshot&) = delete;
+    ThreadStackSnapshot& operator=(const ThreadStackSnapshot&) = delete;
+
+    void AddThread(uint32_t threadId);
+
+    // Appends a frame to the last thread
+    void AddFrame(uint64_t instructionOffset, uint64_t stackOffset, uint64_t frameOffset);
+
+    // Registers of the top frame of the last thread. Every thread must have one, or none.
+    void AddContext(const void* context, size_t size);
+
+    // Resolves the symbols of the distinct instruction offsets, taking the SB API
+    // lock for each chunk of lookups. Returns false if it was interrupted.
+    bool Symbolize(lldb::SBTarget target, const std::atomic<int>* interrupt);
+
+    // Fills the view with the arrays. The snapshot must not be modified afterwards.
+    PDEBUG_THREAD_STACKS GetView();
+
+    static ThreadStackSnapshot* FromView(PDEBUG_THREAD_STACKS view);
+};
+
+#endif // __STACKSNAPSHOT_H__
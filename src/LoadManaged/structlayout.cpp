@@ -0,0 +1,161 @@
+#include "structlayout.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+// Larger spans are read field by field, so the scratch buffers stay small
+const uint32_t MaxSpanSize = 4 * 4096;
+
+namespace
+{
+    std::mutex s_layoutsLock;
+
+    // Indexed by id - 1. Layouts are never removed, plugins keep their ids across reloads.
+    std::vector<std::shared_ptr<const StructLayout>> s_layouts;
+
+    bool
+    SameFields(
+            const std::vector<StructField>& left,
+            const std::vector<StructField>& right)
+    {
+        return left.size() == right.size() &&
+            std::equal(left.begin(), left.end(), right.begin(),
+                [](const StructField& l, const StructField& r) { return l.Offset == r.Offset && l.Size == r.Size; });
+    }
+}
+
+StructLayout::StructLayout(
+        std::vector<StructField> fields) :
+        m_fields(std::move(fields)),
+        m_spanStart(UINT32_MAX),
+        m_spanSize(0),
+        m_recordSize(0),
+        m_readsSpan(false)
+{
+    uint32_t spanEnd = 0;
+
+    for (const StructField& field : m_fields)
+    {
+        m_spanStart = std::min(m_spanStart, field.Offset);
+        spanEnd = std::max(spanEnd, field.Offset + field.Size);
+        m_recordSize += field.Size;
+    }
+
+    m_spanSize = spanEnd - m_spanStart;
+    m_readsSpan = m_spanSize <= MaxSpanSize;
+}
+
+bool
+StructLayout::ReadFields(
+        TargetMemoryReader& reader,
+        uint64_t address,
+        uint8_t* record) const
+{
+    uint8_t* current = record;
+
+    for (const StructField& field : m_fields)
+    {
+        if (reader.Read(address + field.Offset, current, field.Size) != field.Size)
+        {
+            memset(record, 0, m_recordSize);
+            return false;
+        }
+
+        current += field.Size;
+    }
+
+    return true;
+}
+
+bool
+StructLayout::Read(
+        TargetMemoryReader& reader,
+        uint64_t address,
+        uint8_t* record,
+        uint8_t* scratch) const
+{
+    if (!m_readsSpan)
+    {
+        return ReadFields(reader, address, record);
+    }
+
+    uint64_t start = address + m_spanStart;
+
+    // Dumps are read in place, without copying the span
+    const uint8_t* span = reader.Map(start, m_spanSize);
+
+    if (span == nullptr)
+    {
+        if (reader.Read(start, scratch, m_spanSize) != m_spanSize)
+        {
+            // The hole may be between the fields
+            if (m_fields.size() > 1)
+            {
+                return ReadFields(reader, address, record);
+            }
+
+            memset(record, 0, m_recordSize);
+            return false;
+        }
+
+        span = scratch;
+    }
+
+    for (const StructField& field : m_fields)
+    {
+        memcpy(record, span + (field.Offset - m_spanStart), field.Size);
+        record += field.Size;
+    }
+
+    return true;
+}
+
+uint32_t
+StructLayout::Register(
+        const std::vector<StructField>& fields)
+{
+    if (fields.empty())
+    {
+        return 0;
+    }
+
+    uint64_t recordSize = 0;
+
+    for (const StructField& field : fields)
+    {
+        recordSize += field.Size;
+
+        if (field.Size == 0 || (uint64_t)field.Offset + field.Size > UINT32_MAX || recordSize > UINT32_MAX)
+        {
+            return 0;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(s_layoutsLock);
+
+    for (size_t i = 0; i < s_layouts.size(); i++)
+    {
+        if (SameFields(s_layouts[i]->GetFields(), fields))
+        {
+            return (uint32_t)i + 1;
+        }
+    }
+
+    s_layouts.push_back(std::make_shared<StructLayout>(fields));
+    return (uint32_t)s_layouts.size();
+}
+
+std::shared_ptr<const StructLayout>
+StructLayout::Get(
+        uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(s_layoutsLock);
+
+    if (id == 0 || id > s_layouts.size())
+    {
+        return nullptr;
+    }
+
+    return s_layouts[id - 1];
+}
@@ -0,0 +1,60 @@
+#ifndef __STRUCTLAYOUT_H__
+#define __STRUCTLAYOUT_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "memoryreader.h"
+
+struct StructField
+{
+    uint32_t Offset;
+    uint32_t Size;
+};
+
+//
+// Fields of a target structure read by ReadStructs. The layouts are
+// registered once per plugin and identified by a small integer, so a batch
+// only carries the addresses. Each object is read with a single read of the
+// span covering all its fields, then the fields are packed into the record.
+// Layouts spanning more than a few pages, and objects with an unreadable byte
+// between their fields, are read field by field instead.
+//
+class StructLayout
+{
+private:
+    std::vector<StructField> m_fields;
+    uint32_t m_spanStart;
+    uint32_t m_spanSize;
+    uint32_t m_recordSize;
+    bool m_readsSpan;
+
+    bool ReadFields(TargetMemoryReader& reader, uint64_t address, uint8_t* record) const;
+
+public:
+    explicit StructLayout(std::vector<StructField> fields);
+
+    const std::vector<StructField>& GetFields() const { return m_fields; }
+
+    // Sum of the field sizes
+    uint32_t GetRecordSize() const { return m_recordSize; }
+
+    // From the lowest field offset to the end of the highest field
+    uint32_t GetSpanSize() const { return m_spanSize; }
+
+    // Size of the scratch buffer given to Read, 0 if the fields are read one by one
+    uint32_t GetScratchSize() const { return m_readsSpan ? m_spanSize : 0; }
+
+    // Packs the fields of the object at address into record. scratch must hold GetScratchSize() bytes.
+    // Returns false, with a zeroed record, if any field is unreadable.
+    bool Read(TargetMemoryReader& reader, uint64_t address, uint8_t* record, uint8_t* scratch) const;
+
+    // Returns the id of the layout, 0 if the fields are invalid (empty, or overflowing 32 bits)
+    static uint32_t Register(const std::vector<StructField>& fields);
+
+    // nullptr if the id wasn't registered
+    static std::shared_ptr<const StructLayout> Get(uint32_t id);
+};
+
+#endif // __STRUCTLAYOUT_H__
@@ -0,0 +1,86 @@
+#include "threadmap.h"
+
+#include <mutex>
+#include "invalidation.h"
+#include "sosplugin.h"
+
+ThreadMap::ThreadMap(
+        lldb::SBProcess process) :
+        m_hasFakeThread(false),
+        m_fakeSystemId(0)
+{
+    uint32_t numThreads = process.GetNumThreads();
+
+    m_threads.reserve(numThreads);
+
+    for (uint32_t i = 0; i < numThreads; i++)
+    {
+        lldb::SBThread thread = process.GetThreadAtIndex(i);
+        if (!thread.IsValid())
+        {
+            continue;
+        }
+
+        m_threads[thread.GetThreadID()] = ThreadEntry{ thread.GetIndexID(), thread };
+    }
+
+    // The fake system id maps to the fake index, even if lldb doesn't know that thread
+    if (g_currentThreadSystemId != (ULONG)-1 && g_currentThreadIndex != (ULONG)-1)
+    {
+        m_hasFakeThread = true;
+        m_fakeSystemId = g_currentThreadSystemId;
+        m_fakeThread = ThreadEntry{ g_currentThreadIndex, process.GetThreadByIndexID(g_currentThreadIndex) };
+    }
+}
+
+const ThreadEntry*
+ThreadMap::FindBySystemId(
+        uint64_t systemId) const
+{
+    if (m_hasFakeThread && systemId == m_fakeSystemId)
+    {
+        return &m_fakeThread;
+    }
+
+    return FindActualBySystemId(systemId);
+}
+
+const ThreadEntry*
+ThreadMap::FindActualBySystemId(
+        uint64_t systemId) const
+{
+    auto it = m_threads.find(systemId);
+    return it != m_threads.end() ? &it->second : nullptr;
+}
+
+std::shared_ptr<const ThreadMap>
+ThreadMap::Get(
+        lldb::SBProcess process)
+{
+    static std::mutex lock;
+    static std::shared_ptr<const ThreadMap> map;
+    static uint64_t mapGeneration;
+    static ULONG mapThreadIndex;
+    static ULONG mapThreadSystemId;
+
+    std::lock_guard<std::recursive_mutex> sbLock(g_sbApiLock);
+    std::lock_guard<std::mutex> mapLock(lock);
+
+    SyncCacheGenerations(process);
+
+    uint64_t generation = GetCacheGeneration(CACHE_KIND_MASK(CacheKindProcess));
+
+    // The fake thread can be changed without the process running
+    if (map == nullptr ||
+        mapGeneration != generation ||
+        mapThreadIndex != g_currentThreadIndex ||
+        mapThreadSystemId != g_currentThreadSystemId)
+    {
+        map = std::make_shared<ThreadMap>(process);
+        mapGeneration = generation;
+        mapThreadIndex = g_currentThreadIndex;
+        mapThreadSystemId = g_currentThreadSystemId;
+    }
+
+    return map;
+}
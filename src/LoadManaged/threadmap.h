@@ -0,0 +1,44 @@
+#ifndef __THREADMAP_H__
+#define __THREADMAP_H__
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include "lldb/API/SBProcess.h"
+#include "lldb/API/SBThread.h"
+
+struct ThreadEntry
+{
+    uint32_t IndexId;
+    lldb::SBThread Thread;
+};
+
+//
+// Threads of the target keyed by OS (system) id, built in one pass over the
+// thread list and cached until the next stop. The "fake" current thread set
+// through g_currentThreadSystemId/g_currentThreadIndex is kept aside, so the
+// services don't need to special case it on every lookup.
+//
+class ThreadMap
+{
+private:
+    std::unordered_map<uint64_t, ThreadEntry> m_threads;
+
+    bool m_hasFakeThread;
+    uint64_t m_fakeSystemId;
+    ThreadEntry m_fakeThread;
+
+public:
+    explicit ThreadMap(lldb::SBProcess process);
+
+    // nullptr if the process has no thread with this id. The fake system id maps to the fake thread index.
+    const ThreadEntry* FindBySystemId(uint64_t systemId) const;
+
+    // Same, ignoring the fake thread
+    const ThreadEntry* FindActualBySystemId(uint64_t systemId) const;
+
+    // Returns the threads of the process, reusing the previous map while the process stays stopped
+    static std::shared_ptr<const ThreadMap> Get(lldb::SBProcess process);
+};
+
+#endif // __THREADMAP_H__
@@ -0,0 +1,226 @@
+#include "threadpool.h"
+
+// Pool and queue of the current thread, if it is a worker
+static thread_local ThreadPool* t_workerPool;
+static thread_local size_t t_workerIndex;
+
+//----------------------------------------------------------------------------
+// TaskGroup
+//----------------------------------------------------------------------------
+
+TaskGroup::TaskGroup() :
+        m_pending(0)
+{
+}
+
+void
+TaskGroup::OnTaskCompleted()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (--m_pending == 0)
+    {
+        m_completed.notify_all();
+    }
+}
+
+bool
+TaskGroup::IsCompleted()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_pending == 0;
+}
+
+void
+TaskGroup::Wait()
+{
+    // A task waiting on a nested group (a scan predicate reading structs, ...) would hold its
+    // worker, so the worker helps instead. Once the queues are empty, the remaining tasks of
+    // the group are running on other workers, which help with their own nested groups the same way.
+    while (t_workerPool != nullptr && !IsCompleted())
+    {
+        if (!t_workerPool->RunPendingTask(t_workerIndex))
+        {
+            break;
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_completed.wait(lock, [this]() { return m_pending == 0; });
+}
+
+bool
+TaskGroup::WaitFor(
+        std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    return m_completed.wait_for(lock, timeout, [this]() { return m_pending == 0; });
+}
+
+//----------------------------------------------------------------------------
+// ThreadPool
+//----------------------------------------------------------------------------
+
+ThreadPool::ThreadPool(
+        size_t workerCount) :
+        m_queued(0),
+        m_nextQueue(0),
+        m_stopping(false)
+{
+    if (workerCount == 0)
+    {
+        workerCount = 1;
+    }
+
+    for (size_t i = 0; i < workerCount; i++)
+    {
+        m_queues.emplace_back(new WorkerQueue());
+    }
+
+    for (size_t i = 0; i < workerCount; i++)
+    {
+        m_threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_wakeLock);
+        m_stopping = true;
+    }
+
+    m_wake.notify_all();
+
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+ThreadPool&
+ThreadPool::Shared()
+{
+    static ThreadPool pool(std::thread::hardware_concurrency());
+    return pool;
+}
+
+void
+ThreadPool::Submit(
+        TaskGroup& group,
+        std::vector<std::function<void()>> tasks)
+{
+    if (tasks.empty())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(group.m_lock);
+        group.m_pending += tasks.size();
+    }
+
+    // Deal the tasks round-robin, the stealing takes care of the imbalance
+    for (auto& task : tasks)
+    {
+        size_t index = m_nextQueue++ % m_queues.size();
+        TaskGroup* owner = &group;
+
+        std::function<void()> wrapper = [task, owner]()
+        {
+            // An exception escaping a worker would terminate lldb, the tasks report their own failures
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+            }
+
+            owner->OnTaskCompleted();
+        };
+
+        std::lock_guard<std::mutex> lock(m_queues[index]->Lock);
+        m_queues[index]->Tasks.push_back(std::move(wrapper));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_wakeLock);
+        m_queued += (long)tasks.size();
+    }
+
+    m_wake.notify_all();
+}
+
+bool
+ThreadPool::TryDequeue(
+        size_t index,
+        std::function<void()>& task)
+{
+    {
+        WorkerQueue& own = *m_queues[index];
+        std::lock_guard<std::mutex> lock(own.Lock);
+
+        if (!own.Tasks.empty())
+        {
+            task = std::move(own.Tasks.back());
+            own.Tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < m_queues.size(); i++)
+    {
+        WorkerQueue& victim = *m_queues[(index + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(victim.Lock);
+
+        if (!victim.Tasks.empty())
+        {
+            task = std::move(victim.Tasks.front());
+            victim.Tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool
+ThreadPool::RunPendingTask(
+        size_t index)
+{
+    std::function<void()> task;
+
+    if (!TryDequeue(index, task))
+    {
+        return false;
+    }
+
+    m_queued--;
+    task();
+    return true;
+}
+
+void
+ThreadPool::WorkerLoop(
+        size_t index)
+{
+    t_workerPool = this;
+    t_workerIndex = index;
+
+    while (true)
+    {
+        if (RunPendingTask(index))
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_wakeLock);
+        m_wake.wait(lock, [this]() { return m_stopping || m_queued > 0; });
+
+        if (m_stopping)
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//
+// Tracks a batch of tasks submitted to the thread pool
+//
+class TaskGroup
+{
+    friend class ThreadPool;
+
+private:
+    std::mutex m_lock;
+    std::condition_variable m_completed;
+    size_t m_pending;
+
+    void OnTaskCompleted();
+
+public:
+    TaskGroup();
+
+    bool IsCompleted();
+
+    // Called from a pool worker, runs the queued tasks while waiting so nested groups can't starve the pool
+    void Wait();
+
+    // Returns true if all the tasks have completed
+    bool WaitFor(std::chrono::milliseconds timeout);
+};
+
+//
+// Fixed-size work-stealing pool used by the services that split their work
+// (memory scans, stack collection, ...). Each worker pops from the back of
+// its own queue and steals from the front of the others when it runs dry,
+// so uneven chunks (holes in the address space, huge stacks) balance out.
+//
+class ThreadPool
+{
+    friend class TaskGroup;
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex Lock;
+        std::deque<std::function<void()>> Tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_wakeLock;
+    std::condition_variable m_wake;
+    std::atomic<long> m_queued;
+    std::atomic<size_t> m_nextQueue;
+    bool m_stopping;
+
+    bool TryDequeue(size_t index, std::function<void()>& task);
+    void WorkerLoop(size_t index);
+
+    // Runs one queued task on the current worker, returns false if there was none
+    bool RunPendingTask(size_t index);
+
+public:
+    explicit ThreadPool(size_t workerCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Pool shared by all the services, sized after the number of cores
+    static ThreadPool& Shared();
+
+    size_t GetWorkerCount() const { return m_threads.size(); }
+
+    void Submit(TaskGroup& group, std::vector<std::function<void()>> tasks);
+};
+
+#endif // __THREADPOOL_H__
@@ -0,0 +1,271 @@
+#include "trace.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static bool
+TraceEnabledByDefault()
+{
+    const char* value = getenv("LOADMANAGED_TRACE");
+    return value != nullptr && strcmp(value, "0") != 0;
+}
+
+std::atomic<bool> g_traceEnabled(TraceEnabledByDefault());
+
+namespace
+{
+    struct TraceEvent
+    {
+        // Index + 1 of the span stored in the slot, 0 while it is being written
+        std::atomic<uint64_t> Sequence;
+        const char* Category;
+        const char* Name;
+        uint64_t Start;
+        uint64_t End;
+        uint32_t ThreadId;
+    };
+
+    struct TraceBuffer
+    {
+        TraceEvent* Events;
+        size_t Capacity;
+        std::atomic<uint64_t> Next;
+
+        explicit TraceBuffer(size_t capacity) :
+                Events(new TraceEvent[capacity]()),
+                Capacity(capacity),
+                Next(0)
+        {
+        }
+    };
+
+    // Replaced buffers are leaked on purpose: a writer may still hold a pointer to them
+    std::atomic<TraceBuffer*> s_buffer(nullptr);
+    std::mutex s_lock;
+
+    thread_local uint32_t t_threadId = 0;
+
+    TraceBuffer*
+    GetBuffer()
+    {
+        TraceBuffer* buffer = s_buffer.load(std::memory_order_acquire);
+
+        if (buffer == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(s_lock);
+
+            buffer = s_buffer.load(std::memory_order_relaxed);
+            if (buffer == nullptr)
+            {
+                buffer = new TraceBuffer(TraceDefaultCapacity);
+                s_buffer.store(buffer, std::memory_order_release);
+            }
+        }
+
+        return buffer;
+    }
+
+    uint32_t
+    GetThreadId()
+    {
+        if (t_threadId == 0)
+        {
+            t_threadId = (uint32_t)syscall(SYS_gettid);
+        }
+
+        return t_threadId;
+    }
+
+    void
+    AppendJsonString(std::string& output, const char* value)
+    {
+        output.push_back('"');
+
+        for (const char* c = value; *c != '\0'; c++)
+        {
+            switch (*c)
+            {
+                case '"':
+                    output.append("\\\"");
+                    break;
+                case '\\':
+                    output.append("\\\\");
+                    break;
+                default:
+                    if ((unsigned char)*c < 0x20)
+                    {
+                        char escaped[8];
+                        snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+                        output.append(escaped);
+                    }
+                    else
+                    {
+                        output.push_back(*c);
+                    }
+                    break;
+            }
+        }
+
+        output.push_back('"');
+    }
+}
+
+void
+AddTraceSpan(
+        const char* category,
+        const char* name,
+        uint64_t start,
+        uint64_t end)
+{
+    TraceBuffer* buffer = GetBuffer();
+
+    uint64_t index = buffer->Next.fetch_add(1, std::memory_order_relaxed);
+    TraceEvent& event = buffer->Events[index % buffer->Capacity];
+
+    // Writers only collide on a slot if one of them wrapped around the whole buffer meanwhile;
+    // the reader then sees a mismatched sequence and skips it
+    event.Sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    event.Category = category;
+    event.Name = name;
+    event.Start = start;
+    event.End = end;
+    event.ThreadId = GetThreadId();
+
+    event.Sequence.store(index + 1, std::memory_order_release);
+}
+
+const char*
+InternTraceName(
+        const char* name)
+{
+    static std::set<std::string> names;
+
+    std::lock_guard<std::mutex> lock(s_lock);
+
+    return names.insert(name).first->c_str();
+}
+
+void
+ResetTrace(
+        size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+
+    s_buffer.store(new TraceBuffer(capacity != 0 ? capacity : TraceDefaultCapacity), std::memory_order_release);
+}
+
+size_t
+GetTraceSpanCount(
+        uint64_t* dropped)
+{
+    TraceBuffer* buffer = GetBuffer();
+    uint64_t next = buffer->Next.load(std::memory_order_relaxed);
+
+    if (dropped)
+    {
+        *dropped = next > buffer->Capacity ? next - buffer->Capacity : 0;
+    }
+
+    return next < buffer->Capacity ? next : buffer->Capacity;
+}
+
+bool
+WriteChromeTrace(
+        const char* path,
+        std::string& error)
+{
+    TraceBuffer* buffer = GetBuffer();
+
+    uint64_t next = buffer->Next.load(std::memory_order_acquire);
+    uint64_t first = next > buffer->Capacity ? next - buffer->Capacity : 0;
+
+    FILE* file = fopen(path, "w");
+    if (file == nullptr)
+    {
+        error = strerror(errno);
+        return false;
+    }
+
+    int pid = getpid();
+    bool firstEvent = true;
+    std::string line;
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+
+    for (uint64_t index = first; index < next; index++)
+    {
+        const TraceEvent& event = buffer->Events[index % buffer->Capacity];
+
+        if (event.Sequence.load(std::memory_order_acquire) != index + 1)
+        {
+            // Still being written, or already overwritten
+            continue;
+        }
+
+        const char* category = event.Category;
+        const char* name = event.Name;
+        uint64_t start = event.Start;
+        uint64_t end = event.End;
+        uint32_t threadId = event.ThreadId;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (event.Sequence.load(std::memory_order_relaxed) != index + 1)
+        {
+            continue;
+        }
+
+        char numbers[128];
+        snprintf(numbers, sizeof(numbers), ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+            start / 1e3, (end - start) / 1e3, pid, threadId);
+
+        line.assign(firstEvent ? "{\"name\":" : ",\n{\"name\":");
+        AppendJsonString(line, name);
+        line.append(",\"cat\":");
+        AppendJsonString(line, category);
+        line.append(numbers);
+
+        fputs(line.c_str(), file);
+        firstEvent = false;
+    }
+
+    fputs("\n]}\n", file);
+
+    if (fclose(file) != 0)
+    {
+        error = strerror(errno);
+        return false;
+    }
+
+    return true;
+}
+
+//----------------------------------------------------------------------------
+// Exports for PluginInterop (DllImport("loadmanaged"))
+//----------------------------------------------------------------------------
+
+// Returns the start timestamp of a span, 0 if tracing is disabled
+extern "C" uint64_t
+LoadManagedTraceBegin()
+{
+    return g_traceEnabled.load(std::memory_order_relaxed) ? TraceTimestamp() : 0;
+}
+
+extern "C" void
+LoadManagedTraceEnd(
+        const char* category,
+        const char* name,
+        uint64_t start)
+{
+    if (start != 0)
+    {
+        AddTraceSpan(InternTraceName(category), InternTraceName(name), start, TraceTimestamp());
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//
+// Timeline of the managed commands, exported in the Chrome trace format
+// (chrome://tracing, ui.perfetto.dev). Spans are written to a fixed-size
+// lock-free ring buffer, overwriting the oldest ones when it is full, so
+// tracing can stay on during a multi-minute analysis.
+// Disabled by default (LoadManagedTrace on, or LOADMANAGED_TRACE=1).
+//
+extern std::atomic<bool> g_traceEnabled;
+
+const size_t TraceDefaultCapacity = 1 << 20;
+
+// Nanoseconds on the steady clock, also used by the service statistics
+inline uint64_t
+TraceTimestamp()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The name and category must outlive the trace: use string literals or InternTraceName
+void AddTraceSpan(const char* category, const char* name, uint64_t start, uint64_t end);
+
+// Returns a copy of the name that lives until the process exits
+const char* InternTraceName(const char* name);
+
+// Discards the recorded spans and resizes the ring buffer. Spans recorded concurrently may be lost.
+void ResetTrace(size_t capacity);
+
+// Returns the number of spans currently held by the ring buffer, and how many were overwritten
+size_t GetTraceSpanCount(uint64_t* dropped);
+
+// Writes the recorded spans as a Chrome trace JSON file
+bool WriteChromeTrace(const char* path, std::string& error);
+
+class TraceSpan
+{
+private:
+    const char* m_category;
+    const char* m_name;
+    uint64_t m_start;
+
+public:
+    TraceSpan(const char* category, const char* name) :
+            m_category(category),
+            m_name(name),
+            m_start(g_traceEnabled.load(std::memory_order_relaxed) ? TraceTimestamp() : 0)
+    {
+    }
+
+    ~TraceSpan()
+    {
+        if (m_start != 0)
+        {
+            AddTraceSpan(m_category, m_name, m_start, TraceTimestamp());
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+#endif // __TRACE_H__
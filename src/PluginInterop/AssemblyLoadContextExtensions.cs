@@ -0,0 +1,23 @@
+﻿using System.IO;
+using System.Reflection;
+using System.Runtime.Loader;
+
+namespace PluginInterop
+{
+    internal static class AssemblyLoadContextExtensions
+    {
+        /// <summary>
+        /// Loads the assembly from a copy in memory: a mapped file would be overwritten under our feet by the next build.
+        /// </summary>
+        public static Assembly LoadFromFile(this AssemblyLoadContext context, string path)
+        {
+            var pdbPath = Path.ChangeExtension(path, ".pdb");
+
+            using (var assembly = new MemoryStream(File.ReadAllBytes(path)))
+            using (var symbols = File.Exists(pdbPath) ? new MemoryStream(File.ReadAllBytes(pdbPath)) : null)
+            {
+                return context.LoadFromStream(assembly, symbols);
+            }
+        }
+    }
+}
@@ -0,0 +1,23 @@
+﻿namespace PluginInterop
+{
+    /// <summary>
+    /// Why <see cref="LLDBServices.WalkChain"/> stopped.
+    /// </summary>
+    public enum ChainEnd
+    {
+        /// <summary>The next pointer of the last node is null.</summary>
+        Null = 0,
+
+        /// <summary>The node buffer is full, the chain may continue at the next pointer.</summary>
+        Limit = 1,
+
+        /// <summary>The next pointer points back to a node already walked.</summary>
+        Cycle = 2,
+
+        /// <summary>The node at the next pointer can't be read.</summary>
+        Unreadable = 3,
+
+        /// <summary>The user interrupted the command. <see cref="LLDBServices.WalkChain"/> throws an <see cref="System.OperationCanceledException"/> instead.</summary>
+        Interrupted = 4
+    }
+}
@@ -0,0 +1,72 @@
+﻿using System;
+using System.Runtime.InteropServices;
+using System.Text;
+
+namespace PluginInterop
+{
+    [StructLayout(LayoutKind.Sequential)]
+    internal unsafe struct CommandArgument
+    {
+        public byte* Data;
+        public ulong Length;
+    }
+
+    /// <summary>
+    /// Arguments of the command, as split by lldb. The UTF-8 bytes are read in place from the native argv, so they are only valid
+    /// until the command returns: copy them (for instance with <see cref="GetString"/>) to keep them longer.
+    /// Exports declared as <c>(IntPtr services, CommandArguments arguments)</c> receive them directly, the others can use
+    /// <see cref="CommandContext.Arguments"/>.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public readonly unsafe struct CommandArguments
+    {
+        private readonly CommandArgument* _arguments;
+        private readonly int _count;
+
+        internal CommandArguments(IntPtr arguments, int count)
+        {
+            _arguments = (CommandArgument*)arguments;
+            _count = count;
+        }
+
+        public int Count => _count;
+
+        public ReadOnlySpan<byte> this[int index]
+        {
+            get
+            {
+                if ((uint)index >= (uint)_count)
+                {
+                    throw new ArgumentOutOfRangeException(nameof(index));
+                }
+
+                return new ReadOnlySpan<byte>(_arguments[index].Data, (int)_arguments[index].Length);
+            }
+        }
+
+        public string GetString(int index)
+        {
+            return Encoding.UTF8.GetString(this[index]);
+        }
+
+        /// <summary>
+        /// The arguments joined with spaces. Exports declared with a string only receive the first argument.
+        /// </summary>
+        public override string ToString()
+        {
+            var result = new StringBuilder();
+
+            for (int i = 0; i < _count; i++)
+            {
+                if (i > 0)
+                {
+                    result.Append(' ');
+                }
+
+                result.Append(GetString(i));
+            }
+
+            return result.ToString();
+        }
+    }
+}
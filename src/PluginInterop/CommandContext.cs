@@ -0,0 +1,116 @@
+﻿using System;
+using System.Threading;
+
+namespace PluginInterop
+{
+    /// <summary>
+    /// State of the managed command currently being executed.
+    /// Plugins running long loops should poll <see cref="IsInterruptRequested"/> (cheap, reads the native flag)
+    /// or pass <see cref="CancellationToken"/> to APIs that accept one.
+    /// </summary>
+    public sealed unsafe class CommandContext : IDisposable
+    {
+        private const int PollingInterval = 50;
+
+        private static readonly AsyncLocal<CommandContext> CurrentContext = new AsyncLocal<CommandContext>();
+
+        private readonly int* _interruptFlag;
+        private readonly CancellationTokenSource _cancellationTokenSource = new CancellationTokenSource();
+        private Timer _pollingTimer;
+
+        internal CommandContext(IntPtr interruptFlag, CommandArguments arguments)
+        {
+            _interruptFlag = (int*)interruptFlag;
+            Arguments = arguments;
+        }
+
+        public static CommandContext Current => CurrentContext.Value;
+
+        /// <summary>
+        /// Arguments of the command, valid until it returns.
+        /// </summary>
+        public CommandArguments Arguments { get; }
+
+        public bool IsInterruptRequested
+        {
+            get
+            {
+                if (_interruptFlag != null && Volatile.Read(ref *_interruptFlag) != 0)
+                {
+                    return true;
+                }
+
+                return _cancellationTokenSource.IsCancellationRequested;
+            }
+        }
+
+        public CancellationToken CancellationToken
+        {
+            get
+            {
+                // The native flag is set from a signal handler, so nobody can cancel the token for us.
+                // Only start polling once a plugin actually asks for the token.
+                if (_pollingTimer == null && _interruptFlag != null)
+                {
+                    var timer = new Timer(_ => Poll(), null, Timeout.Infinite, Timeout.Infinite);
+
+                    if (Interlocked.CompareExchange(ref _pollingTimer, timer, null) == null)
+                    {
+                        timer.Change(PollingInterval, PollingInterval);
+                    }
+                    else
+                    {
+                        timer.Dispose();
+                    }
+                }
+
+                return _cancellationTokenSource.Token;
+            }
+        }
+
+        public void ThrowIfInterruptRequested()
+        {
+            if (IsInterruptRequested)
+            {
+                throw new OperationCanceledException("The command was interrupted", _cancellationTokenSource.Token);
+            }
+        }
+
+        internal static CommandContext Enter(IntPtr interruptFlag, CommandArguments arguments)
+        {
+            var context = new CommandContext(interruptFlag, arguments);
+
+            CurrentContext.Value = context;
+
+            return context;
+        }
+
+        public void Dispose()
+        {
+            if (CurrentContext.Value == this)
+            {
+                CurrentContext.Value = null;
+            }
+
+            _pollingTimer?.Dispose();
+            _cancellationTokenSource.Dispose();
+        }
+
+        private void Poll()
+        {
+            if (Volatile.Read(ref *_interruptFlag) != 0)
+            {
+                _pollingTimer?.Change(Timeout.Infinite, Timeout.Infinite);
+
+                try
+                {
+                    _cancellationTokenSource.Cancel();
+                }
+                catch (ObjectDisposedException)
+                {
+                    // The command completed while we were polling
+                }
+            }
+        }
+    }
+}
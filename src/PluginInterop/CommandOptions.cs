@@ -0,0 +1,236 @@
+﻿using System;
+using System.Buffers.Text;
+using System.Text;
+
+namespace PluginInterop
+{
+    /// <summary>
+    /// Typed access to the options of a command, on top of <see cref="CommandArguments"/>, without copying the arguments.
+    /// Options are written --name or -n (single-letter names), and their value is either the next argument or follows an '='.
+    /// The options taking a value must be declared, so that their value isn't mistaken for a positional argument.
+    /// Everything after "--" is positional.
+    /// <code>
+    /// var options = new CommandOptions(arguments, "count");
+    /// options.TryGetInt32("count", out var count);
+    /// var verbose = options.HasFlag("verbose") || options.HasFlag("v");
+    /// var address = options.GetPositionalUInt64(0);
+    /// </code>
+    /// </summary>
+    public readonly struct CommandOptions
+    {
+        private readonly CommandArguments _arguments;
+        private readonly string[] _optionsWithValue;
+
+        public CommandOptions(CommandArguments arguments, params string[] optionsWithValue)
+        {
+            _arguments = arguments;
+            _optionsWithValue = optionsWithValue ?? Array.Empty<string>();
+        }
+
+        public bool HasFlag(string name)
+        {
+            return TryFind(name, out _, out _);
+        }
+
+        public bool TryGetValue(string name, out ReadOnlySpan<byte> value)
+        {
+            return TryFind(name, out _, out value) && !value.IsEmpty;
+        }
+
+        public string GetString(string name, string defaultValue = null)
+        {
+            return TryGetValue(name, out var value) ? Encoding.UTF8.GetString(value) : defaultValue;
+        }
+
+        public bool TryGetInt32(string name, out int value)
+        {
+            value = 0;
+            return TryGetValue(name, out var text) && Utf8Parser.TryParse(text, out value, out var consumed) && consumed == text.Length;
+        }
+
+        /// <summary>
+        /// Accepts decimal or 0x-prefixed hexadecimal values, the usual format for addresses.
+        /// </summary>
+        public bool TryGetUInt64(string name, out ulong value)
+        {
+            value = 0;
+            return TryGetValue(name, out var text) && TryParseUInt64(text, out value);
+        }
+
+        public int PositionalCount
+        {
+            get
+            {
+                int count = 0;
+
+                for (int i = NextPositional(0); i < _arguments.Count; i = NextPositional(i + 1))
+                {
+                    count++;
+                }
+
+                return count;
+            }
+        }
+
+        public ReadOnlySpan<byte> GetPositional(int index)
+        {
+            for (int i = NextPositional(0); i < _arguments.Count; i = NextPositional(i + 1))
+            {
+                if (index-- == 0)
+                {
+                    return _arguments[i];
+                }
+            }
+
+            throw new ArgumentOutOfRangeException(nameof(index));
+        }
+
+        public string GetPositionalString(int index)
+        {
+            return Encoding.UTF8.GetString(GetPositional(index));
+        }
+
+        public bool TryGetPositionalUInt64(int index, out ulong value)
+        {
+            value = 0;
+            return index < PositionalCount && TryParseUInt64(GetPositional(index), out value);
+        }
+
+        public static bool TryParseUInt64(ReadOnlySpan<byte> text, out ulong value)
+        {
+            int consumed;
+
+            if (text.Length > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+            {
+                text = text.Slice(2);
+                return Utf8Parser.TryParse(text, out value, out consumed, 'X') && consumed == text.Length;
+            }
+
+            return Utf8Parser.TryParse(text, out value, out consumed) && consumed == text.Length;
+        }
+
+        // Returns the index of the first positional argument at or after start
+        private int NextPositional(int start)
+        {
+            bool afterSeparator = false;
+
+            for (int i = 0; i < _arguments.Count; i++)
+            {
+                var argument = _arguments[i];
+
+                if (!afterSeparator && IsOption(argument))
+                {
+                    if (argument.Length == 2 && argument[1] == '-')
+                    {
+                        afterSeparator = true;
+                    }
+                    else if (argument.IndexOf((byte)'=') < 0 && TakesValue(argument))
+                    {
+                        // Skip the value
+                        i++;
+                    }
+
+                    continue;
+                }
+
+                if (i >= start)
+                {
+                    return i;
+                }
+            }
+
+            return _arguments.Count;
+        }
+
+        private bool TryFind(string name, out int index, out ReadOnlySpan<byte> value)
+        {
+            for (int i = 0; i < _arguments.Count; i++)
+            {
+                var argument = _arguments[i];
+
+                if (!IsOption(argument))
+                {
+                    continue;
+                }
+
+                if (argument.Length == 2 && argument[1] == '-')
+                {
+                    break;
+                }
+
+                var optionName = GetOptionName(argument);
+                var separator = optionName.IndexOf((byte)'=');
+
+                if (separator >= 0)
+                {
+                    value = optionName.Slice(separator + 1);
+                    optionName = optionName.Slice(0, separator);
+                }
+                else
+                {
+                    value = TakesValue(argument) && i + 1 < _arguments.Count ? _arguments[i + 1] : default;
+                }
+
+                if (Matches(optionName, name))
+                {
+                    index = i;
+                    return true;
+                }
+
+                if (separator < 0 && TakesValue(argument))
+                {
+                    i++;
+                }
+            }
+
+            index = -1;
+            value = default;
+            return false;
+        }
+
+        private bool TakesValue(ReadOnlySpan<byte> argument)
+        {
+            var optionName = GetOptionName(argument);
+
+            foreach (var name in _optionsWithValue)
+            {
+                if (Matches(optionName, name))
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        // Negative numbers are values, not options
+        private static bool IsOption(ReadOnlySpan<byte> argument)
+        {
+            return argument.Length >= 2 && argument[0] == '-' && (argument[1] < '0' || argument[1] > '9');
+        }
+
+        private static ReadOnlySpan<byte> GetOptionName(ReadOnlySpan<byte> argument)
+        {
+            return argument[1] == '-' ? argument.Slice(2) : argument.Slice(1);
+        }
+
+        // The names are ASCII, so they are compared byte by byte without transcoding
+        private static bool Matches(ReadOnlySpan<byte> optionName, string name)
+        {
+            if (optionName.Length != name.Length)
+            {
+                return false;
+            }
+
+            for (int i = 0; i < name.Length; i++)
+            {
+                if (optionName[i] != name[i])
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+    }
+}
@@ -0,0 +1,73 @@
+﻿using System;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
+using System.IO;
+using System.Reflection;
+using System.Runtime.Loader;
+
+namespace PluginInterop
+{
+    /// <summary>
+    /// Maps the dependencies of a plugin to their path, from its .deps.json when there is one.
+    /// Names that can't be resolved are remembered, so the framework assemblies go straight to the default context.
+    /// </summary>
+    internal class DependencyResolver
+    {
+        private readonly string _basePath;
+        private readonly AssemblyDependencyResolver _resolver;
+        private readonly ConcurrentDictionary<string, string> _paths = new ConcurrentDictionary<string, string>(StringComparer.OrdinalIgnoreCase);
+        private Dictionary<string, string> _directoryIndex;
+
+        public DependencyResolver(string path)
+        {
+            _basePath = Path.GetDirectoryName(path);
+
+            try
+            {
+                _resolver = new AssemblyDependencyResolver(path);
+            }
+            catch (InvalidOperationException)
+            {
+                // hostpolicy couldn't be loaded from the CLR directory, index the plugin directory instead
+                _resolver = null;
+            }
+        }
+
+        /// <summary>
+        /// Returns the path of the dependency, null if it isn't part of the plugin.
+        /// </summary>
+        public string ResolveAssemblyToPath(AssemblyName assemblyName)
+        {
+            // A null value is the negative cache entry
+            return _paths.GetOrAdd(assemblyName.Name, _ => Resolve(assemblyName));
+        }
+
+        public string ResolveUnmanagedDllToPath(string unmanagedDllName)
+        {
+            return _resolver?.ResolveUnmanagedDllToPath(unmanagedDllName);
+        }
+
+        private string Resolve(AssemblyName assemblyName)
+        {
+            if (_resolver != null)
+            {
+                return _resolver.ResolveAssemblyToPath(assemblyName);
+            }
+
+            lock (_paths)
+            {
+                if (_directoryIndex == null)
+                {
+                    _directoryIndex = new Dictionary<string, string>(StringComparer.OrdinalIgnoreCase);
+
+                    foreach (var file in Directory.EnumerateFiles(_basePath, "*.dll"))
+                    {
+                        _directoryIndex[Path.GetFileNameWithoutExtension(file)] = file;
+                    }
+                }
+
+                return _directoryIndex.TryGetValue(assemblyName.Name, out var path) ? path : null;
+            }
+        }
+    }
+}
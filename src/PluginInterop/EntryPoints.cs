@@ -0,0 +1,28 @@
+﻿using System;
+
+namespace PluginInterop
+{
+    /// <summary>
+    /// Signatures of the <see cref="PluginLoader"/> methods called by the native host. coreclr_create_delegate infers
+    /// them, but load_assembly_and_get_function_pointer (hostfxr) needs a delegate type, looked up as the method name
+    /// followed by "Delegate".
+    /// </summary>
+    public static class EntryPoints
+    {
+        public delegate string LoadPluginDelegate(string path);
+
+        public delegate string LoadPluginsDelegate(string paths);
+
+        public delegate int UnloadPluginDelegate(string pluginName);
+
+        public delegate string ReloadPluginDelegate(string pluginName);
+
+        public delegate int IsPluginModifiedDelegate(string pluginName);
+
+        public delegate int GetExportCountDelegate(string pluginName);
+
+        public delegate string GetExportNameDelegate(string pluginName, int index);
+
+        public delegate void InvokeDelegate(string pluginName, string exportName, IntPtr debugClient, IntPtr argv, int argc, IntPtr interruptFlag);
+    }
+}
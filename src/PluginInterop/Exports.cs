@@ -177,7 +177,8 @@ namespace PluginInterop
         {
             return method.Parameters.Count == 2
                    && method.Parameters[0].ParameterType.FullName == "System.IntPtr"
-                   && method.Parameters[1].ParameterType.FullName == "System.String";
+                   && (method.Parameters[1].ParameterType.FullName == "System.String"
+                       || method.Parameters[1].ParameterType.FullName == typeof(CommandArguments).FullName);
         }
     }
 }
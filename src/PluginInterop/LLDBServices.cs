@@ -0,0 +1,555 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Runtime.InteropServices;
+
+namespace PluginInterop
+{
+    public delegate bool ScanResultsHandler(ReadOnlySpan<ulong> addresses);
+
+    // Called concurrently from the native worker threads
+    public delegate bool ScanPredicate(ulong address, ReadOnlySpan<byte> data);
+
+    /// <summary>
+    /// Gives access to the LoadManaged extensions of the ILLDBServices pointer received by the commands.
+    /// The methods are called through the native vtable, so the slots must match the declaration order in lldbservices.h.
+    /// </summary>
+    public unsafe class LLDBServices
+    {
+        public const int S_OK = 0;
+        public const int S_FALSE = 1;
+        public const int E_NOTIMPL = unchecked((int)0x80004001);
+        public const int E_ABORT = unchecked((int)0x80004004);
+        public const int E_FAIL = unchecked((int)0x80004005);
+
+        // IUnknown (3 slots) and the dbgeng-style methods come first
+        private const int ScanMemorySlot = 42;
+        private const int SearchVirtualSlot = 43;
+        private const int GetMemoryRegionsSlot = 44;
+        private const int QueryVirtualSlot = 45;
+        private const int GetAllThreadStacksSlot = 46;
+        private const int ReleaseThreadStacksSlot = 47;
+        private const int RegisterStructLayoutSlot = 48;
+        private const int ReadStructsSlot = 49;
+        private const int WalkChainSlot = 50;
+
+        private readonly IntPtr* _vtable;
+
+        private ScanMemoryDelegate _scanMemory;
+        private SearchVirtualDelegate _searchVirtual;
+        private GetMemoryRegionsDelegate _getMemoryRegions;
+        private QueryVirtualDelegate _queryVirtual;
+        private GetAllThreadStacksDelegate _getAllThreadStacks;
+        private ReleaseThreadStacksDelegate _releaseThreadStacks;
+        private RegisterStructLayoutDelegate _registerStructLayout;
+        private ReadStructsDelegate _readStructs;
+        private WalkChainDelegate _walkChain;
+
+        public LLDBServices(IntPtr services)
+        {
+            if (services == IntPtr.Zero)
+            {
+                throw new ArgumentNullException(nameof(services));
+            }
+
+            Pointer = services;
+            _vtable = *(IntPtr**)services;
+        }
+
+        public IntPtr Pointer { get; }
+
+        /// <summary>
+        /// Searches the ranges for the (masked) pattern on all the cores. The matches are sorted within a batch,
+        /// but batches are delivered in no particular order. Return false from the handler to stop the scan (the method then returns S_FALSE).
+        /// Throws an OperationCanceledException if the user interrupts the command.
+        /// </summary>
+        public int ScanMemory(IReadOnlyList<MemoryRange> ranges, ReadOnlySpan<byte> pattern, ReadOnlySpan<byte> mask, int alignment, ScanResultsHandler onResults, ScanPredicate predicate = null)
+        {
+            if (pattern.IsEmpty)
+            {
+                throw new ArgumentException("The pattern cannot be empty", nameof(pattern));
+            }
+
+            if (!mask.IsEmpty && mask.Length != pattern.Length)
+            {
+                throw new ArgumentException("The mask must have the same length as the pattern", nameof(mask));
+            }
+
+            fixed (byte* patternPtr = pattern)
+            fixed (byte* maskPtr = mask)
+            {
+                return ScanMemory(ranges, patternPtr, mask.IsEmpty ? null : maskPtr, pattern.Length, alignment, onResults, predicate);
+            }
+        }
+
+        /// <summary>
+        /// Calls the predicate for every aligned position of the ranges, with elementSize bytes of data.
+        /// </summary>
+        public int ScanMemory(IReadOnlyList<MemoryRange> ranges, int elementSize, int alignment, ScanPredicate predicate, ScanResultsHandler onResults)
+        {
+            if (predicate == null)
+            {
+                throw new ArgumentNullException(nameof(predicate));
+            }
+
+            return ScanMemory(ranges, null, null, elementSize, alignment, onResults, predicate);
+        }
+
+        public List<ulong> ScanMemory(IReadOnlyList<MemoryRange> ranges, ReadOnlySpan<byte> pattern, int alignment)
+        {
+            var result = new List<ulong>();
+
+            ScanMemory(ranges, pattern, default, alignment, addresses =>
+            {
+                foreach (var address in addresses)
+                {
+                    result.Add(address);
+                }
+
+                return true;
+            });
+
+            return result;
+        }
+
+        private int ScanMemory(IReadOnlyList<MemoryRange> ranges, byte* pattern, byte* mask, int size, int alignment, ScanResultsHandler onResults, ScanPredicate predicate)
+        {
+            if (onResults == null)
+            {
+                throw new ArgumentNullException(nameof(onResults));
+            }
+
+            var scanMemory = GetMethod(ref _scanMemory, ScanMemorySlot);
+
+            var nativeRanges = new MemoryRange[ranges.Count];
+
+            for (int i = 0; i < nativeRanges.Length; i++)
+            {
+                nativeRanges[i] = ranges[i];
+            }
+
+            Exception callbackException = null;
+
+            ScanResultsCallback resultsCallback = (context, addresses, count) =>
+            {
+                try
+                {
+                    return onResults(new ReadOnlySpan<ulong>(addresses, (int)count)) ? S_OK : S_FALSE;
+                }
+                catch (Exception ex)
+                {
+                    callbackException = ex;
+                    return S_FALSE;
+                }
+            };
+
+            // An exception escaping to a native worker thread would take lldb down
+            ScanPredicateCallback predicateCallback = predicate == null ? null : new ScanPredicateCallback((context, address, data, dataSize) =>
+            {
+                try
+                {
+                    return predicate(address, new ReadOnlySpan<byte>(data, (int)dataSize)) ? 1 : 0;
+                }
+                catch (Exception ex)
+                {
+                    callbackException = ex;
+                    return 0;
+                }
+            });
+
+            int hr;
+
+            fixed (MemoryRange* rangesPtr = nativeRanges)
+            {
+                hr = scanMemory(
+                    Pointer,
+                    rangesPtr,
+                    (uint)nativeRanges.Length,
+                    pattern,
+                    mask,
+                    (uint)size,
+                    (uint)alignment,
+                    predicateCallback == null ? IntPtr.Zero : Marshal.GetFunctionPointerForDelegate(predicateCallback),
+                    IntPtr.Zero,
+                    Marshal.GetFunctionPointerForDelegate(resultsCallback),
+                    IntPtr.Zero);
+            }
+
+            GC.KeepAlive(resultsCallback);
+            GC.KeepAlive(predicateCallback);
+
+            if (callbackException != null)
+            {
+                throw new AggregateException("An exception occured in a ScanMemory callback", callbackException);
+            }
+
+            if (hr == E_ABORT)
+            {
+                throw new OperationCanceledException("The scan was interrupted");
+            }
+
+            return hr;
+        }
+
+        /// <summary>
+        /// Searches [start, start + length) for the (masked) pattern on the calling thread. The matches are stored in ascending order.
+        /// Returns S_FALSE if the buffer was filled before the end of the range: call again from the last match + 1 to resume.
+        /// </summary>
+        public int SearchVirtual(ulong start, ulong length, ReadOnlySpan<byte> pattern, ReadOnlySpan<byte> mask, int alignment, Span<ulong> matches, out int found)
+        {
+            if (pattern.IsEmpty)
+            {
+                throw new ArgumentException("The pattern cannot be empty", nameof(pattern));
+            }
+
+            if (!mask.IsEmpty && mask.Length != pattern.Length)
+            {
+                throw new ArgumentException("The mask must have the same length as the pattern", nameof(mask));
+            }
+
+            if (matches.IsEmpty)
+            {
+                throw new ArgumentException("The matches buffer cannot be empty", nameof(matches));
+            }
+
+            var searchVirtual = GetMethod(ref _searchVirtual, SearchVirtualSlot);
+
+            int hr;
+            uint count;
+
+            fixed (byte* patternPtr = pattern)
+            fixed (byte* maskPtr = mask)
+            fixed (ulong* matchesPtr = matches)
+            {
+                hr = searchVirtual(Pointer, start, length, patternPtr, mask.IsEmpty ? null : maskPtr, (uint)pattern.Length, (uint)alignment, matchesPtr, (uint)matches.Length, &count);
+            }
+
+            found = (int)count;
+
+            if (hr == E_ABORT)
+            {
+                throw new OperationCanceledException("The search was interrupted");
+            }
+
+            return hr;
+        }
+
+        /// <summary>
+        /// Returns the addresses of all the pointer-aligned occurrences of value in [start, start + length).
+        /// </summary>
+        public List<ulong> SearchVirtual(ulong start, ulong length, ulong value)
+        {
+            var result = new List<ulong>();
+            var pattern = new ReadOnlySpan<byte>(&value, sizeof(ulong));
+            var matches = new ulong[1024];
+            var end = start + length;
+
+            while (true)
+            {
+                var hr = SearchVirtual(start, end - start, pattern, default, sizeof(ulong), matches, out var found);
+
+                for (int i = 0; i < found; i++)
+                {
+                    result.Add(matches[i]);
+                }
+
+                if (hr != S_FALSE || found == 0)
+                {
+                    break;
+                }
+
+                start = matches[found - 1] + 1;
+            }
+
+            return result;
+        }
+
+        /// <summary>
+        /// Returns the mapped regions of the target, sorted by address. The list is cached natively until the next stop.
+        /// Throws a NotSupportedException if the process plugin can't list the regions.
+        /// </summary>
+        public MemoryRegion[] GetMemoryRegions()
+        {
+            var getMemoryRegions = GetMethod(ref _getMemoryRegions, GetMemoryRegionsSlot);
+
+            while (true)
+            {
+                uint count;
+                var hr = getMemoryRegions(Pointer, null, 0, &count);
+
+                ThrowOnRegionError(hr);
+
+                var regions = new MemoryRegion[count];
+
+                fixed (MemoryRegion* regionsPtr = regions)
+                {
+                    hr = getMemoryRegions(Pointer, regionsPtr, (uint)regions.Length, &count);
+                }
+
+                ThrowOnRegionError(hr);
+
+                // The process may have stopped again in between
+                if (hr == S_OK && count == regions.Length)
+                {
+                    return regions;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Returns the region containing the address. If the address isn't mapped, returns false with the next region above it, if any.
+        /// </summary>
+        public bool QueryVirtual(ulong address, out MemoryRegion region)
+        {
+            var queryVirtual = GetMethod(ref _queryVirtual, QueryVirtualSlot);
+
+            MemoryRegion result;
+            var hr = queryVirtual(Pointer, address, &result);
+
+            ThrowOnRegionError(hr);
+
+            region = hr == E_FAIL ? default : result;
+            return hr == S_OK;
+        }
+
+        /// <summary>
+        /// Captures the frames of all the threads in one call, up to maxFrames per thread (0 for all of them).
+        /// The symbols are resolved natively one after the other on the calling thread, each distinct instruction offset once,
+        /// and the lldb lock is released between chunks of offsets. Dispose the result to free the native snapshot.
+        /// Throws an OperationCanceledException if the user interrupts the command.
+        /// </summary>
+        public ThreadStacks GetAllThreadStacks(int maxFrames = 0, ThreadStacksFlags flags = ThreadStacksFlags.Symbols)
+        {
+            if (maxFrames < 0)
+            {
+                throw new ArgumentOutOfRangeException(nameof(maxFrames));
+            }
+
+            var getAllThreadStacks = GetMethod(ref _getAllThreadStacks, GetAllThreadStacksSlot);
+
+            IntPtr stacks;
+            var hr = getAllThreadStacks(Pointer, (uint)maxFrames, flags, &stacks);
+
+            if (hr == E_ABORT)
+            {
+                throw new OperationCanceledException("The stack walk was interrupted");
+            }
+
+            if (hr < 0)
+            {
+                Marshal.ThrowExceptionForHR(hr);
+            }
+
+            return new ThreadStacks(this, stacks);
+        }
+
+        internal void ReleaseThreadStacks(IntPtr stacks)
+        {
+            var releaseThreadStacks = GetMethod(ref _releaseThreadStacks, ReleaseThreadStacksSlot);
+            releaseThreadStacks(Pointer, stacks);
+        }
+
+        /// <summary>
+        /// Registers the fields read by ReadStructs. Registering the same fields again returns the same native layout.
+        /// </summary>
+        public FieldLayout RegisterStructLayout(params StructField[] fields)
+        {
+            if (fields == null || fields.Length == 0)
+            {
+                throw new ArgumentException("The layout must have at least one field", nameof(fields));
+            }
+
+            var registerStructLayout = GetMethod(ref _registerStructLayout, RegisterStructLayoutSlot);
+
+            uint id, recordSize;
+            int hr;
+
+            fixed (StructField* fieldsPtr = fields)
+            {
+                hr = registerStructLayout(Pointer, fieldsPtr, (uint)fields.Length, &id, &recordSize);
+            }
+
+            if (hr < 0)
+            {
+                Marshal.ThrowExceptionForHR(hr);
+            }
+
+            return new FieldLayout(id, (int)recordSize, (StructField[])fields.Clone());
+        }
+
+        /// <summary>
+        /// Reads the fields of the layout for each address into consecutive records, with one memory read per object
+        /// and a single native call for the whole batch. The records of the objects that couldn't be read are zeroed,
+        /// and their status (if provided) set to false. Returns true if all the objects were read.
+        /// Throws an OperationCanceledException if the user interrupts the command.
+        /// </summary>
+        public bool ReadStructs(FieldLayout layout, ReadOnlySpan<ulong> addresses, Span<byte> records, Span<bool> status = default)
+        {
+            if (layout == null)
+            {
+                throw new ArgumentNullException(nameof(layout));
+            }
+
+            if (records.Length < (long)addresses.Length * layout.RecordSize)
+            {
+                throw new ArgumentException("The buffer is too small for the records", nameof(records));
+            }
+
+            if (!status.IsEmpty && status.Length < addresses.Length)
+            {
+                throw new ArgumentException("The status buffer is too small", nameof(status));
+            }
+
+            var readStructs = GetMethod(ref _readStructs, ReadStructsSlot);
+
+            int hr;
+
+            fixed (ulong* addressesPtr = addresses)
+            fixed (byte* recordsPtr = records)
+            fixed (bool* statusPtr = status)
+            {
+                hr = readStructs(Pointer, layout.Id, addressesPtr, (uint)addresses.Length, recordsPtr, (uint)records.Length, status.IsEmpty ? null : (byte*)statusPtr);
+            }
+
+            if (hr == E_ABORT)
+            {
+                throw new OperationCanceledException("The read was interrupted");
+            }
+
+            if (hr < 0)
+            {
+                Marshal.ThrowExceptionForHR(hr);
+            }
+
+            return hr == S_OK;
+        }
+
+        /// <summary>
+        /// Reads the records into a struct mirroring the packed fields of the layout.
+        /// </summary>
+        public bool ReadStructs<T>(FieldLayout layout, ReadOnlySpan<ulong> addresses, Span<T> records, Span<bool> status = default) where T : unmanaged
+        {
+            if (layout == null)
+            {
+                throw new ArgumentNullException(nameof(layout));
+            }
+
+            if (sizeof(T) != layout.RecordSize)
+            {
+                throw new ArgumentException($"The size of {typeof(T).Name} doesn't match the records of the layout ({layout.RecordSize} bytes)", nameof(records));
+            }
+
+            return ReadStructs(layout, addresses, MemoryMarshal.AsBytes(records), status);
+        }
+
+        /// <summary>
+        /// Follows the pointer at nextOffset of each node from start, natively, until a null pointer, a cycle,
+        /// an unreadable node, or the end of the nodes buffer. The pointer-sized words at payloadOffsets
+        /// are stored in payloads for each node (payloadOffsets.Length words per node).
+        /// next receives the pointer that wasn't followed, to resume a chain cut by the limit.
+        /// Throws an OperationCanceledException if the user interrupts the command.
+        /// </summary>
+        public ChainEnd WalkChain(ulong start, uint nextOffset, ReadOnlySpan<uint> payloadOffsets, Span<ulong> nodes, Span<ulong> payloads, out int nodeCount, out ulong next)
+        {
+            if (payloads.Length < (long)nodes.Length * payloadOffsets.Length)
+            {
+                throw new ArgumentException("The payloads buffer is too small for the nodes", nameof(payloads));
+            }
+
+            var walkChain = GetMethod(ref _walkChain, WalkChainSlot);
+
+            int hr;
+            uint count, endReason;
+            ulong notFollowed;
+
+            fixed (uint* payloadOffsetsPtr = payloadOffsets)
+            fixed (ulong* nodesPtr = nodes)
+            fixed (ulong* payloadsPtr = payloads)
+            {
+                hr = walkChain(Pointer, start, nextOffset, payloadOffsetsPtr, (uint)payloadOffsets.Length, (uint)nodes.Length, nodesPtr, payloadsPtr, &count, &notFollowed, &endReason);
+            }
+
+            if (hr == E_ABORT)
+            {
+                throw new OperationCanceledException("The walk was interrupted");
+            }
+
+            if (hr < 0)
+            {
+                Marshal.ThrowExceptionForHR(hr);
+            }
+
+            nodeCount = (int)count;
+            next = notFollowed;
+            return (ChainEnd)endReason;
+        }
+
+        /// <summary>
+        /// Returns the addresses of the nodes of the chain, up to maxNodes.
+        /// </summary>
+        public ulong[] WalkChain(ulong start, uint nextOffset, int maxNodes, out ChainEnd end)
+        {
+            if (maxNodes < 0)
+            {
+                throw new ArgumentOutOfRangeException(nameof(maxNodes));
+            }
+
+            var nodes = new ulong[maxNodes];
+
+            end = WalkChain(start, nextOffset, default, nodes, default, out var count, out _);
+
+            Array.Resize(ref nodes, count);
+            return nodes;
+        }
+
+        private static void ThrowOnRegionError(int hr)
+        {
+            if (hr == E_NOTIMPL)
+            {
+                throw new NotSupportedException("The memory regions are not available for this process");
+            }
+
+            if (hr < 0 && hr != E_FAIL)
+            {
+                Marshal.ThrowExceptionForHR(hr);
+            }
+        }
+
+        private T GetMethod<T>(ref T cache, int slot) where T : Delegate
+        {
+            return cache ?? (cache = Marshal.GetDelegateForFunctionPointer<T>(_vtable[slot]));
+        }
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        private delegate int ScanMemoryDelegate(IntPtr self, MemoryRange* ranges, uint rangeCount, byte* pattern, byte* mask, uint patternSize, uint alignment, IntPtr predicate, IntPtr predicateContext, IntPtr callback, IntPtr callbackContext);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        private delegate int SearchVirtualDelegate(IntPtr self, ulong offset, ulong length, byte* pattern, byte* mask, uint patternSize, uint alignment, ulong* matches, uint matchesSize, uint* matchCount);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        private delegate int GetMemoryRegionsDelegate(IntPtr self, MemoryRegion* regions, uint regionsSize, uint* regionCount);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        private delegate int QueryVirtualDelegate(IntPtr self, ulong offset, MemoryRegion* region);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        private delegate int GetAllThreadStacksDelegate(IntPtr self, uint maxFrames, ThreadStacksFlags flags, IntPtr* stacks);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        private delegate int ReleaseThreadStacksDelegate(IntPtr self, IntPtr stacks);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        private delegate int RegisterStructLayoutDelegate(IntPtr self, StructField* fields, uint fieldCount, uint* layoutId, uint* recordSize);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        private delegate int ReadStructsDelegate(IntPtr self, uint layoutId, ulong* addresses, uint count, byte* buffer, uint bufferSize, byte* status);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        private delegate int WalkChainDelegate(IntPtr self, ulong start, uint nextOffset, uint* payloadOffsets, uint payloadCount, uint maxNodes, ulong* nodes, ulong* payloads, uint* nodeCount, ulong* next, uint* endReason);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        private delegate int ScanResultsCallback(IntPtr context, ulong* addresses, uint count);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        private delegate int ScanPredicateCallback(IntPtr context, ulong address, byte* data, uint size);
+    }
+}
@@ -0,0 +1,19 @@
+﻿using System.Runtime.InteropServices;
+
+namespace PluginInterop
+{
+    [StructLayout(LayoutKind.Sequential)]
+    public struct MemoryRange
+    {
+        public ulong Start;
+        public ulong Length;
+
+        public MemoryRange(ulong start, ulong length)
+        {
+            Start = start;
+            Length = length;
+        }
+
+        public ulong End => Start + Length;
+    }
+}
@@ -0,0 +1,31 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+namespace PluginInterop
+{
+    [Flags]
+    public enum MemoryProtection : uint
+    {
+        None = 0,
+        Read = 0x1,
+        Write = 0x2,
+        Execute = 0x4
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct MemoryRegion
+    {
+        public ulong BaseAddress;
+        public ulong RegionSize;
+        public MemoryProtection Protection;
+        private uint _reserved;
+
+        public ulong End => BaseAddress + RegionSize;
+
+        public bool Contains(ulong address) => address >= BaseAddress && address - BaseAddress < RegionSize;
+
+        public MemoryRange ToRange() => new MemoryRange(BaseAddress, RegionSize);
+
+        public override string ToString() => $"{BaseAddress:x16}-{End:x16} {Protection}";
+    }
+}
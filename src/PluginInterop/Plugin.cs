@@ -1,4 +1,6 @@
-﻿using System.Collections.Generic;
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
 using System.Reflection;
 
 namespace PluginInterop
@@ -6,6 +8,17 @@ namespace PluginInterop
     public class Plugin
     {
         public IDictionary<string, Export> Exports { get; set; }
+
+        // Resolved when the plugin is loaded, so the calls don't go through reflection
+        public IDictionary<string, CommandHandler> Commands { get; set; }
         public Assembly Assembly { get; set; }
+        public string Path { get; set; }
+        public PluginLoadContext LoadContext { get; set; }
+        public FileSystemWatcher Watcher { get; set; }
+
+        // Ticks of the last change to the plugin or its private dependencies, 0 if nothing changed since the plugin was loaded
+        public long LastModified;
     }
-}
\ No newline at end of file
+
+    public delegate void CommandHandler(IntPtr debugClient, CommandArguments arguments);
+}
@@ -1,31 +1,73 @@
 ﻿using System;
+using System.Collections.Concurrent;
 using System.IO;
 using System.Reflection;
 using System.Runtime.Loader;
 
 namespace PluginInterop
 {
+    /// <summary>
+    /// Collectible context holding a plugin and its private dependencies, so the plugin can be unloaded and rebuilt
+    /// without restarting lldb. Framework assemblies come from the default context, and the shared dependencies
+    /// from a <see cref="SharedLoadContext"/>.
+    /// </summary>
     public class PluginLoadContext : AssemblyLoadContext
     {
-        private readonly string _basePath;
+        private static readonly string InteropAssemblyName = typeof(PluginLoadContext).Assembly.GetName().Name;
+
+        private readonly DependencyResolver _resolver;
+
+        // Files of the plugin and of the private dependencies loaded so far, a change to them requires a reload
+        private readonly ConcurrentDictionary<string, bool> _loadedPaths = new ConcurrentDictionary<string, bool>(StringComparer.Ordinal);
 
         public PluginLoadContext(string path)
+            : base(Path.GetFileNameWithoutExtension(path), isCollectible: true)
+        {
+            _resolver = new DependencyResolver(path);
+            _loadedPaths.TryAdd(Path.GetFullPath(path), true);
+        }
+
+        /// <summary>
+        /// Returns true if the file is the plugin or one of the private dependencies this context loaded.
+        /// </summary>
+        public bool HasLoaded(string path)
         {
-            _basePath = Path.GetDirectoryName(path);
+            return _loadedPaths.ContainsKey(Path.GetFullPath(path));
         }
 
         protected override Assembly Load(AssemblyName assemblyName)
         {
-            try
+            // The plugins are usually deployed with a copy of PluginInterop, but they must use the types of the host.
+            // It isn't in the default context when hosted through hostfxr, which loads it in a context of its own.
+            if (string.Equals(assemblyName.Name, InteropAssemblyName, StringComparison.OrdinalIgnoreCase))
             {
-                var assembly = LoadFromAssemblyPath(Path.Combine(_basePath, assemblyName.Name + ".dll"));
+                return typeof(PluginLoadContext).Assembly;
+            }
 
-                return assembly ?? LoadFromAssemblyName(assemblyName);
+            var path = _resolver.ResolveAssemblyToPath(assemblyName);
+
+            if (path == null)
+            {
+                // Let the default context bind it
+                return null;
             }
-            catch (Exception)
+
+            // A shared dependency is kept by the session, reloading the plugin wouldn't pick up a new build of it
+            if (SharedLoadContext.IsShared(assemblyName.Name))
             {
-                return AssemblyLoadContext.Default.LoadFromAssemblyName(assemblyName);
+                return SharedLoadContext.Load(path);
             }
+
+            _loadedPaths.TryAdd(Path.GetFullPath(path), true);
+
+            return this.LoadFromFile(path);
+        }
+
+        protected override IntPtr LoadUnmanagedDll(string unmanagedDllName)
+        {
+            var path = _resolver.ResolveUnmanagedDllToPath(unmanagedDllName);
+
+            return path == null ? IntPtr.Zero : LoadUnmanagedDllFromPath(path);
         }
     }
-}
\ No newline at end of file
+}
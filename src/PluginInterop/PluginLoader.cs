@@ -1,71 +1,341 @@
 ﻿using System;
 using System.Collections.Generic;
+using System.IO;
 using System.Linq;
+using System.Reflection;
+using System.Runtime.CompilerServices;
+using System.Runtime.ExceptionServices;
 using System.Runtime.InteropServices;
+using System.Threading;
+using System.Threading.Tasks;
 
 namespace PluginInterop
 {
     public class PluginLoader
     {
+        // Time without changes to the plugin directory before the new build is picked up, to avoid loading a half-written file
+        private static readonly TimeSpan ReloadDelay = TimeSpan.FromSeconds(1);
+
+        // Commands started with --async call Invoke from other threads, so every access takes the lock
         private static readonly Dictionary<string, Plugin> Plugins = new Dictionary<string, Plugin>();
 
         public static string LoadPlugin(string path)
         {
-            var loadContext = new PluginLoadContext(path);
+            return Load(path, null);
+        }
+
+        /// <summary>
+        /// Loads the plugins at the given paths (separated by '\n') concurrently, and returns a 'name\tpath' line for each loaded plugin.
+        /// Assemblies without any exported command (the dependencies found when scanning a directory) are skipped.
+        /// </summary>
+        public static string LoadPlugins(string paths)
+        {
+            var candidates = paths.Split('\n', StringSplitOptions.RemoveEmptyEntries)
+                .Select(Path.GetFullPath)
+                .Distinct()
+                .ToArray();
+
+            var names = new string[candidates.Length];
+
+            Parallel.For(0, candidates.Length, i =>
+            {
+                Export[] exports;
+
+                using (Trace.Begin("Exports.Get", "load"))
+                {
+                    try
+                    {
+                        exports = Exports.Get(candidates[i]);
+                    }
+                    catch (Exception)
+                    {
+                        // Not a managed assembly, or not an assembly at all
+                        exports = Array.Empty<Export>();
+                    }
+                }
+
+                if (exports.Length == 0)
+                {
+                    if (candidates.Length == 1)
+                    {
+                        Console.WriteLine("{0} doesn't export any command", candidates[0]);
+                    }
+
+                    return;
+                }
+
+                var name = Load(candidates[i], exports);
+
+                if (name != null)
+                {
+                    names[i] = name + "\t" + candidates[i];
+                }
+            });
+
+            return string.Join("\n", names.Where(n => n != null));
+        }
+
+        // Reads the exports if they are null
+        private static string Load(string path, Export[] exports)
+        {
+            try
+            {
+                path = Path.GetFullPath(path);
+
+                if (exports == null)
+                {
+                    using (Trace.Begin("Exports.Get", "load"))
+                    {
+                        exports = Exports.Get(path);
+                    }
+                }
+
+                var loadContext = new PluginLoadContext(path);
+
+                Assembly assembly;
+
+                using (Trace.Begin("LoadFromFile", "load"))
+                {
+                    assembly = loadContext.LoadFromFile(path);
+                }
+
+                var plugin = new Plugin();
 
-            var assembly = loadContext.LoadFromAssemblyPath(path);
+                plugin.Exports = exports.ToDictionary(e => e.ExportName, e => e);
+                plugin.Commands = exports.ToDictionary(e => e.ExportName, e => CreateHandler(assembly, e));
+                plugin.Assembly = assembly;
+                plugin.Path = path;
+                plugin.LoadContext = loadContext;
+                plugin.Watcher = Watch(plugin);
 
-            var plugin = new Plugin();
+                var name = assembly.GetName().Name;
 
-            plugin.Exports = Exports.Get(path).ToDictionary(e => e.ExportName, e => e);
-            plugin.Assembly = assembly;
+                // Loading the same plugin again replaces the previous version
+                UnloadPlugin(name);
 
-            var name = assembly.GetName().Name;
+                lock (Plugins)
+                {
+                    Plugins.Add(name, plugin);
+                }
+
+                return name;
+            }
+            catch (Exception ex)
+            {
+                Console.WriteLine("Failed to load plugin {0}: {1}", path, ex);
+                return null;
+            }
+        }
+
+        /// <summary>
+        /// Unloads the plugin and waits for its load context to be collected.
+        /// Returns 0 if it was collected, 1 if something still holds a reference to it (a background command, a static event handler...),
+        /// and -1 if the plugin isn't loaded.
+        /// </summary>
+        public static int UnloadPlugin(string pluginName)
+        {
+            var loadContext = Unload(pluginName);
+
+            if (loadContext == null)
+            {
+                return -1;
+            }
+
+            for (int i = 0; i < 10 && loadContext.IsAlive; i++)
+            {
+                GC.Collect();
+                GC.WaitForPendingFinalizers();
+            }
+
+            return loadContext.IsAlive ? 1 : 0;
+        }
+
+        /// <summary>
+        /// Unloads the plugin and loads it again from the same path. Returns the name of the new plugin, null on failure.
+        /// </summary>
+        public static string ReloadPlugin(string pluginName)
+        {
+            string path;
+
+            lock (Plugins)
+            {
+                if (!Plugins.TryGetValue(pluginName, out var plugin))
+                {
+                    return null;
+                }
+
+                path = plugin.Path;
+            }
 
-            Plugins.Add(name, plugin);
+            UnloadPlugin(pluginName);
 
-            return name;
+            return LoadPlugin(path);
+        }
+
+        /// <summary>
+        /// Returns 1 if the plugin directory changed since the plugin was loaded, and has been stable since.
+        /// </summary>
+        public static int IsPluginModified(string pluginName)
+        {
+            Plugin plugin;
+
+            lock (Plugins)
+            {
+                if (!Plugins.TryGetValue(pluginName, out plugin))
+                {
+                    return 0;
+                }
+            }
+
+            var lastModified = Interlocked.Read(ref plugin.LastModified);
+
+            return lastModified != 0 && DateTime.UtcNow.Ticks - lastModified >= ReloadDelay.Ticks ? 1 : 0;
         }
 
         public static int GetExportCount(string pluginName)
         {
-            return Plugins[pluginName].Exports.Count;
+            lock (Plugins)
+            {
+                return Plugins[pluginName].Exports.Count;
+            }
         }
 
         public static string GetExportName(string pluginName, int index)
         {
-            return Plugins[pluginName].Exports.Values.ElementAt(index).ExportName;
+            lock (Plugins)
+            {
+                return Plugins[pluginName].Exports.Values.ElementAt(index).ExportName;
+            }
         }
 
-        public static void Invoke(string pluginName, string exportName, IntPtr debugClient, [MarshalAs(UnmanagedType.LPStr)] string args)
+        public static void Invoke(string pluginName, string exportName, IntPtr debugClient, IntPtr argv, int argc, IntPtr interruptFlag)
         {
-            var plugin = Plugins[pluginName];
-            var export = Plugins[pluginName].Exports[exportName];
+            Plugin plugin;
+
+            lock (Plugins)
+            {
+                if (!Plugins.TryGetValue(pluginName, out plugin))
+                {
+                    Console.WriteLine("Plugin {0} is not loaded", pluginName);
+                    return;
+                }
+            }
 
-            var type = plugin.Assembly.GetType(export.Type);
+            var handler = plugin.Commands[exportName];
+            var arguments = new CommandArguments(argv, argc);
+
+            using (CommandContext.Enter(interruptFlag, arguments))
+            {
+                try
+                {
+                    using (Trace.Begin(exportName))
+                    {
+                        handler(debugClient, arguments);
+                    }
+                }
+                catch (OperationCanceledException)
+                {
+                    Console.WriteLine("Command {0} was interrupted", exportName);
+                }
+                catch (Exception ex)
+                {
+                    Console.WriteLine("An error occured while executing command {0}: {1}", exportName, ex);
+                }
+            }
+        }
+
+        private static CommandHandler CreateHandler(Assembly assembly, Export export)
+        {
+            var type = assembly.GetType(export.Type);
 
             if (type == null)
             {
-                Console.WriteLine("Could not locate type {0} in assembly {1}", export.Type, plugin.Assembly);
-                return;
+                return (debugClient, arguments) => Console.WriteLine("Could not locate type {0} in assembly {1}", export.Type, assembly);
             }
 
             var method = type.GetMethod(export.MethodName);
 
             if (method == null)
             {
-                Console.WriteLine("Could not locate method {0} in assembly {1}", method, plugin.Assembly);
-                return;
+                return (debugClient, arguments) => Console.WriteLine("Could not locate method {0} in assembly {1}", export.MethodName, assembly);
             }
 
+            var parameters = method.GetParameters();
+            var isLegacy = parameters[1].ParameterType != typeof(CommandArguments);
+
             try
             {
-                method.Invoke(null, new object[] { debugClient, args });
+                if (!isLegacy)
+                {
+                    return (CommandHandler)method.CreateDelegate(typeof(CommandHandler));
+                }
+
+                var legacy = (Action<IntPtr, string>)method.CreateDelegate(typeof(Action<IntPtr, string>));
+
+                // The legacy signature only ever received the first argument
+                return (debugClient, arguments) => legacy(debugClient, arguments.Count > 0 ? arguments.GetString(0) : null);
             }
-            catch (Exception ex)
+            catch (ArgumentException)
+            {
+                // Not bindable to a delegate (the method returns a value), the return value is ignored
+            }
+
+            return (debugClient, arguments) =>
+            {
+                object args = isLegacy ? (arguments.Count > 0 ? arguments.GetString(0) : null) : (object)arguments;
+
+                try
+                {
+                    method.Invoke(null, new object[] { debugClient, args });
+                }
+                catch (TargetInvocationException ex)
+                {
+                    ExceptionDispatchInfo.Capture(ex.InnerException).Throw();
+                }
+            };
+        }
+
+        private static FileSystemWatcher Watch(Plugin plugin)
+        {
+            // The directory may hold other plugins (LoadManaged <dir>), only the assemblies this one loaded count
+            var watcher = new FileSystemWatcher(Path.GetDirectoryName(plugin.Path), "*.dll");
+
+            FileSystemEventHandler onChanged = (sender, e) =>
             {
-                Console.WriteLine("An error occured while executing command {0}: {1}", exportName, ex);
+                if (plugin.LoadContext.HasLoaded(e.FullPath))
+                {
+                    Interlocked.Exchange(ref plugin.LastModified, DateTime.UtcNow.Ticks);
+                }
+            };
+
+            watcher.Changed += onChanged;
+            watcher.Created += onChanged;
+            watcher.Renamed += (sender, e) => onChanged(sender, e);
+            watcher.EnableRaisingEvents = true;
+
+            return watcher;
+        }
+
+        // Kept out of UnloadPlugin so that no local keeps the context alive while waiting for the collection
+        [MethodImpl(MethodImplOptions.NoInlining)]
+        private static WeakReference Unload(string pluginName)
+        {
+            Plugin plugin;
+
+            lock (Plugins)
+            {
+                if (!Plugins.TryGetValue(pluginName, out plugin))
+                {
+                    return null;
+                }
+
+                Plugins.Remove(pluginName);
             }
+
+            plugin.Watcher.Dispose();
+            plugin.LoadContext.Unload();
+
+            return new WeakReference(plugin.LoadContext);
         }
     }
 }
@@ -0,0 +1,72 @@
+﻿using System;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Reflection;
+using System.Runtime.Loader;
+
+namespace PluginInterop
+{
+    /// <summary>
+    /// Non-collectible context holding a dependency shared by all the plugins, so that heavy libraries such as ClrMD
+    /// are loaded (and warmed up) once per session instead of once per plugin and per reload.
+    /// There is one context per assembly version, so plugins built against different versions still get their own.
+    /// The shared assemblies are Microsoft.Diagnostics.Runtime by default, or the list in LOADMANAGED_SHARED_ASSEMBLIES (separated by ';').
+    /// </summary>
+    internal class SharedLoadContext : AssemblyLoadContext
+    {
+        private static readonly HashSet<string> SharedNames = GetSharedNames();
+
+        private static readonly ConcurrentDictionary<string, Lazy<Assembly>> SharedAssemblies = new ConcurrentDictionary<string, Lazy<Assembly>>(StringComparer.OrdinalIgnoreCase);
+
+        private readonly DependencyResolver _resolver;
+
+        private SharedLoadContext(string path)
+            : base("Shared:" + Path.GetFileNameWithoutExtension(path))
+        {
+            _resolver = new DependencyResolver(path);
+        }
+
+        public static bool IsShared(string assemblyName)
+        {
+            return SharedNames.Contains(assemblyName);
+        }
+
+        /// <summary>
+        /// Returns the shared instance of the assembly at the given path, loading it on first use.
+        /// </summary>
+        public static Assembly Load(string path)
+        {
+            var name = AssemblyName.GetAssemblyName(path);
+
+            return SharedAssemblies.GetOrAdd(name.Name + "/" + name.Version, _ => new Lazy<Assembly>(() => new SharedLoadContext(path).LoadFromFile(path))).Value;
+        }
+
+        protected override Assembly Load(AssemblyName assemblyName)
+        {
+            var path = _resolver.ResolveAssemblyToPath(assemblyName);
+
+            if (path == null)
+            {
+                return null;
+            }
+
+            return IsShared(assemblyName.Name) ? Load(path) : this.LoadFromFile(path);
+        }
+
+        protected override IntPtr LoadUnmanagedDll(string unmanagedDllName)
+        {
+            var path = _resolver.ResolveUnmanagedDllToPath(unmanagedDllName);
+
+            return path == null ? IntPtr.Zero : LoadUnmanagedDllFromPath(path);
+        }
+
+        private static HashSet<string> GetSharedNames()
+        {
+            var names = Environment.GetEnvironmentVariable("LOADMANAGED_SHARED_ASSEMBLIES") ?? "Microsoft.Diagnostics.Runtime";
+
+            return new HashSet<string>(names.Split(';').Select(n => n.Trim()).Where(n => n.Length > 0), StringComparer.OrdinalIgnoreCase);
+        }
+    }
+}
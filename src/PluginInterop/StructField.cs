@@ -0,0 +1,58 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+namespace PluginInterop
+{
+    /// <summary>
+    /// Field of a target structure, relative to the object address.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct StructField
+    {
+        public uint Offset;
+        public uint Size;
+
+        public StructField(uint offset, uint size)
+        {
+            Offset = offset;
+            Size = size;
+        }
+    }
+
+    /// <summary>
+    /// Layout registered with <see cref="LLDBServices.RegisterStructLayout"/>. ReadStructs packs the fields,
+    /// in registration order and without padding, into records of RecordSize bytes.
+    /// </summary>
+    public sealed class FieldLayout
+    {
+        private readonly int[] _recordOffsets;
+
+        internal FieldLayout(uint id, int recordSize, StructField[] fields)
+        {
+            Id = id;
+            RecordSize = recordSize;
+            Fields = fields;
+
+            _recordOffsets = new int[fields.Length];
+
+            int offset = 0;
+
+            for (int i = 0; i < fields.Length; i++)
+            {
+                _recordOffsets[i] = offset;
+                offset += (int)fields[i].Size;
+            }
+        }
+
+        public uint Id { get; }
+
+        public int RecordSize { get; }
+
+        public StructField[] Fields { get; }
+
+        /// <summary>
+        /// Returns the offset of the field in the records.
+        /// </summary>
+        public int GetRecordOffset(int field) => _recordOffsets[field];
+    }
+}
@@ -0,0 +1,145 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+namespace PluginInterop
+{
+    [Flags]
+    public enum ThreadStacksFlags : uint
+    {
+        None = 0,
+        Contexts = 0x1,
+        Symbols = 0x2
+    }
+
+    /// <summary>
+    /// Stacks of all the threads, captured natively in a single call. The frames are stored as parallel arrays
+    /// read in place from the native snapshot, which is freed when the object is disposed.
+    /// </summary>
+    public unsafe sealed class ThreadStacks : IDisposable
+    {
+        private const uint NoSymbol = 0xFFFFFFFF;
+
+        private readonly LLDBServices _services;
+        private Native* _stacks;
+
+        internal ThreadStacks(LLDBServices services, IntPtr stacks)
+        {
+            _services = services;
+            _stacks = (Native*)stacks;
+        }
+
+        ~ThreadStacks()
+        {
+            Dispose();
+        }
+
+        public int ThreadCount => (int)Stacks->ThreadCount;
+
+        public int FrameCount => (int)Stacks->FrameCount;
+
+        public ReadOnlySpan<uint> ThreadIds => new ReadOnlySpan<uint>(Stacks->ThreadIds, ThreadCount);
+
+        /// <summary>
+        /// Indexed by frame, the frames of a thread are contiguous (see <see cref="GetFrameRange"/>).
+        /// </summary>
+        public ReadOnlySpan<ulong> InstructionOffsets => new ReadOnlySpan<ulong>(Stacks->InstructionOffsets, FrameCount);
+
+        public ReadOnlySpan<ulong> StackOffsets => new ReadOnlySpan<ulong>(Stacks->StackOffsets, FrameCount);
+
+        public ReadOnlySpan<ulong> FrameOffsets => new ReadOnlySpan<ulong>(Stacks->FrameOffsets, FrameCount);
+
+        public bool HasContexts => Stacks->Contexts != null;
+
+        public bool HasSymbols => Stacks->SymbolIndices != null;
+
+        /// <summary>
+        /// Returns the index of the first frame of the thread and the number of frames.
+        /// </summary>
+        public (int Start, int Count) GetFrameRange(int thread)
+        {
+            CheckThread(thread);
+
+            var start = Stacks->FirstFrames[thread];
+            return ((int)start, (int)(Stacks->FirstFrames[thread + 1] - start));
+        }
+
+        /// <summary>
+        /// Returns the registers of the top frame of the thread, in the native CONTEXT layout.
+        /// </summary>
+        public ReadOnlySpan<byte> GetContext(int thread)
+        {
+            CheckThread(thread);
+
+            if (!HasContexts)
+            {
+                throw new InvalidOperationException("The contexts were not captured");
+            }
+
+            var size = (int)Stacks->ContextSize;
+            return new ReadOnlySpan<byte>(Stacks->Contexts + (long)thread * size, size);
+        }
+
+        /// <summary>
+        /// Returns the name of the function of the frame ("module!function"), or null if it couldn't be resolved.
+        /// </summary>
+        public string GetSymbol(int frame, out ulong displacement)
+        {
+            if ((uint)frame >= Stacks->FrameCount)
+            {
+                throw new ArgumentOutOfRangeException(nameof(frame));
+            }
+
+            if (!HasSymbols)
+            {
+                throw new InvalidOperationException("The symbols were not resolved");
+            }
+
+            var index = Stacks->SymbolIndices[frame];
+            displacement = Stacks->Displacements[frame];
+
+            return index == NoSymbol ? null : Marshal.PtrToStringUTF8(Stacks->Symbols[index]);
+        }
+
+        public void Dispose()
+        {
+            var stacks = _stacks;
+            _stacks = null;
+
+            if (stacks != null)
+            {
+                _services.ReleaseThreadStacks((IntPtr)stacks);
+                GC.SuppressFinalize(this);
+            }
+        }
+
+        private Native* Stacks => _stacks != null ? _stacks : throw new ObjectDisposedException(nameof(ThreadStacks));
+
+        private void CheckThread(int thread)
+        {
+            if ((uint)thread >= Stacks->ThreadCount)
+            {
+                throw new ArgumentOutOfRangeException(nameof(thread));
+            }
+        }
+
+        // DEBUG_THREAD_STACKS
+        [StructLayout(LayoutKind.Sequential)]
+        private struct Native
+        {
+            public uint ThreadCount;
+            public uint FrameCount;
+            public uint* ThreadIds;
+            public uint* FirstFrames;
+            public ulong* InstructionOffsets;
+            public ulong* StackOffsets;
+            public ulong* FrameOffsets;
+            public byte* Contexts;
+            public uint ContextSize;
+            public uint* SymbolIndices;
+            public ulong* Displacements;
+            public uint SymbolCount;
+            public IntPtr* Symbols;
+            public IntPtr Reserved;
+        }
+    }
+}
@@ -0,0 +1,63 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+namespace PluginInterop
+{
+    /// <summary>
+    /// Records spans in the native timeline (LoadManagedTrace). Plugins can use it to annotate their own phases:
+    /// <code>using (Trace.Begin("ParseHeap")) { ... }</code>
+    /// </summary>
+    public static class Trace
+    {
+        private static bool _unavailable;
+
+        public static Span Begin(string name, string category = "managed")
+        {
+            if (_unavailable)
+            {
+                return default;
+            }
+
+            try
+            {
+                var start = LoadManagedTraceBegin();
+                return start == 0 ? default : new Span(category, name, start);
+            }
+            catch (DllNotFoundException)
+            {
+                // Hosted by something else than the lldb plugin
+                _unavailable = true;
+                return default;
+            }
+        }
+
+        public struct Span : IDisposable
+        {
+            private readonly string _category;
+            private readonly string _name;
+            private readonly ulong _start;
+
+            internal Span(string category, string name, ulong start)
+            {
+                _category = category;
+                _name = name;
+                _start = start;
+            }
+
+            public void Dispose()
+            {
+                if (_start != 0)
+                {
+                    LoadManagedTraceEnd(_category, _name, _start);
+                }
+            }
+        }
+
+        // The library is already loaded by lldb, dlopen resolves it by soname
+        [DllImport("loadmanaged")]
+        private static extern ulong LoadManagedTraceBegin();
+
+        [DllImport("loadmanaged")]
+        private static extern void LoadManagedTraceEnd([MarshalAs(UnmanagedType.LPStr)] string category, [MarshalAs(UnmanagedType.LPStr)] string name, ulong start);
+    }
+}